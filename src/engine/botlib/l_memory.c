@@ -330,6 +330,13 @@ void DumpMemory(void)
 
 #else
 
+// the size is kept in front of the id so FreeMemory can keep the counters
+typedef struct memoryheader_s
+{
+	unsigned long int size;
+	unsigned long int id;
+} memoryheader_t;
+
 //===========================================================================
 //
 // Parameter:			-
@@ -342,14 +349,15 @@ void *GetMemoryDebug(unsigned long size, char *label, char *file, int line)
 void *GetMemory(unsigned long size)
 #endif //MEMDEBUG
 {
-	void *ptr;
-	unsigned long int *memid;
+	memoryheader_t *hdr;
 
-	ptr = botimport.GetMemory(size + sizeof(unsigned long int));
-	if (!ptr) return NULL;
-	memid = (unsigned long int *) ptr;
-	*memid = MEM_ID;
-	return (unsigned long int *) ((char *) ptr + sizeof(unsigned long int));
+	hdr = (memoryheader_t *) botimport.GetMemory(size + sizeof(memoryheader_t));
+	if (!hdr) return NULL;
+	hdr->size = size;
+	hdr->id = MEM_ID;
+	allocatedmemory += size;
+	numblocks++;
+	return hdr + 1;
 } //end of the function GetMemory
 //===========================================================================
 //
@@ -384,14 +392,13 @@ void *GetHunkMemoryDebug(unsigned long size, char *label, char *file, int line)
 void *GetHunkMemory(unsigned long size)
 #endif //MEMDEBUG
 {
-	void *ptr;
-	unsigned long int *memid;
+	memoryheader_t *hdr;
 
-	ptr = botimport.HunkAlloc(size + sizeof(unsigned long int));
-	if (!ptr) return NULL;
-	memid = (unsigned long int *) ptr;
-	*memid = HUNK_ID;
-	return (unsigned long int *) ((char *) ptr + sizeof(unsigned long int));
+	hdr = (memoryheader_t *) botimport.HunkAlloc(size + sizeof(memoryheader_t));
+	if (!hdr) return NULL;
+	hdr->size = size;
+	hdr->id = HUNK_ID;
+	return hdr + 1;
 } //end of the function GetHunkMemory
 //===========================================================================
 //
@@ -422,13 +429,15 @@ void *GetClearedHunkMemory(unsigned long size)
 //===========================================================================
 void FreeMemory(void *ptr)
 {
-	unsigned long int *memid;
+	memoryheader_t *hdr;
 
-	memid = (unsigned long int *) ((char *) ptr - sizeof(unsigned long int));
+	hdr = (memoryheader_t *) ptr - 1;
 
-	if (*memid == MEM_ID)
+	if (hdr->id == MEM_ID)
 	{
-		botimport.FreeMemory(memid);
+		allocatedmemory -= hdr->size;
+		numblocks--;
+		botimport.FreeMemory(hdr);
 	} //end if
 } //end of the function FreeMemory
 //===========================================================================
@@ -449,6 +458,8 @@ int AvailableMemory(void)
 //===========================================================================
 void PrintUsedMemorySize(void)
 {
+	botimport.Print(PRT_MESSAGE, "total allocated memory: %d KB\n", allocatedmemory >> 10);
+	botimport.Print(PRT_MESSAGE, "total memory blocks: %d\n", numblocks);
 } //end of the function PrintUsedMemorySize
 //===========================================================================
 //
@@ -461,3 +472,14 @@ void PrintMemoryLabels(void)
 } //end of the function PrintMemoryLabels
 
 #endif
+//===========================================================================
+//
+// Parameter:			-
+// Returns:				-
+// Changes Globals:		-
+//===========================================================================
+void MemoryStats(int *allocated, int *blocks)
+{
+	*allocated = allocatedmemory;
+	*blocks = numblocks;
+} //end of the function MemoryStats
@@ -70,6 +70,8 @@ int AvailableMemory(void);
 void PrintUsedMemorySize(void);
 //print all memory blocks with label
 void PrintMemoryLabels(void);
+//returns the bytes and number of blocks currently allocated
+void MemoryStats(int *allocated, int *blocks);
 //returns the size of the memory block in bytes
 int MemoryByteSize(void *ptr);
 //free all allocated memory
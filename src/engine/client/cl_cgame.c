@@ -392,7 +392,7 @@ void CL_ShutdownCGame( void ) {
 	if ( !cgvm ) {
 		return;
 	}
-	VM_Call( cgvm, CG_SHUTDOWN );
+	VM_Call0( cgvm, CG_SHUTDOWN );
 	VM_Free( cgvm );
 	cgvm = NULL;
 }
@@ -405,6 +405,42 @@ static int	FloatAsInt( float f ) {
 	return temp;
 }
 
+#define	VMA(x) VM_ArgPtr(args[x])
+#define	VMF(x) (*(float*)&args[x])
+
+/*
+====================
+CL_CgamePointContents etc
+
+The system calls made many times a frame, CL_SetCgameSystemCalls
+gives them their own handlers so they skip the switch below
+====================
+*/
+static intptr_t CL_CgamePointContents( intptr_t *args ) {
+	return CM_PointContents((const vec_t*) VMA(1), args[2]);
+}
+
+static intptr_t CL_CgameBoxTrace( intptr_t *args ) {
+	CM_BoxTrace((trace_t*)VMA(1), (const vec_t*)VMA(2), (const vec_t*) VMA(3), (vec_t*) VMA(4), (vec_t*) VMA(5), args[6], args[7], /*int capsule*/ qfalse);
+	return 0;
+}
+
+static intptr_t CL_CgameCapsuleTrace( intptr_t *args ) {
+	CM_BoxTrace((trace_t*)VMA(1), (const vec_t*)VMA(2), (const vec_t*) VMA(3), (vec_t*) VMA(4), (vec_t*) VMA(5), args[6], args[7], /*int capsule*/ qtrue);
+	return 0;
+}
+
+static intptr_t CL_CgameGetSnapshot( intptr_t *args ) {
+	return CL_GetSnapshot( args[1], (snapshot_t*) VMA(2) );
+}
+
+static void CL_SetCgameSystemCalls( void ) {
+	VM_SetSystemCall( cgvm, CG_CM_POINTCONTENTS, CL_CgamePointContents );
+	VM_SetSystemCall( cgvm, CG_CM_BOXTRACE, CL_CgameBoxTrace );
+	VM_SetSystemCall( cgvm, CG_CM_CAPSULETRACE, CL_CgameCapsuleTrace );
+	VM_SetSystemCall( cgvm, CG_GETSNAPSHOT, CL_CgameGetSnapshot );
+}
+
 /*
 ====================
 CL_CgameSystemCalls
@@ -412,9 +448,6 @@ CL_CgameSystemCalls
 The cgame module is making a system call
 ====================
 */
-#define	VMA(x) VM_ArgPtr(args[x])
-#define	VMF(x) (*(float*)&args[x])
-
 intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 	switch( args[0] ) {
 	case CG_PRINT:
@@ -490,15 +523,13 @@ intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 	case CG_CM_TEMPCAPSULEMODEL:
 		return CM_TempBoxModel((const vec_t*)VMA(1), (const vec_t*) VMA(2), /*int capsule*/ qtrue);
 	case CG_CM_POINTCONTENTS:
-		return CM_PointContents((const vec_t*) VMA(1), args[2]);
+		return CL_CgamePointContents( args );
 	case CG_CM_TRANSFORMEDPOINTCONTENTS:
 		return CM_TransformedPointContents((const vec_t*)VMA(1), args[2], (const vec_t*)VMA(3), (const vec_t*) VMA(4));
 	case CG_CM_BOXTRACE:
-		CM_BoxTrace((trace_t*)VMA(1), (const vec_t*)VMA(2), (const vec_t*) VMA(3), (vec_t*) VMA(4), (vec_t*) VMA(5), args[6], args[7], /*int capsule*/ qfalse);
-		return 0;
+		return CL_CgameBoxTrace( args );
 	case CG_CM_CAPSULETRACE:
-		CM_BoxTrace((trace_t*)VMA(1), (const vec_t*)VMA(2), (const vec_t*) VMA(3), (vec_t*) VMA(4), (vec_t*) VMA(5), args[6], args[7], /*int capsule*/ qtrue);
-		return 0;
+		return CL_CgameCapsuleTrace( args );
 	case CG_CM_TRANSFORMEDBOXTRACE:
 		CM_TransformedBoxTrace((trace_t*)VMA(1), (const vec_t*)VMA(2), (const vec_t*)VMA(3), (vec_t*)VMA(4), (vec_t*)VMA(5), args[6], args[7], (const vec_t*)VMA(8), (const vec_t*) VMA(9), /*int capsule*/ qfalse);
 		return 0;
@@ -593,7 +624,7 @@ intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 		CL_GetCurrentSnapshotNumber( (int*) VMA(1), (int*) VMA(2) );
 		return 0;
 	case CG_GETSNAPSHOT:
-		return CL_GetSnapshot( args[1], (snapshot_t*) VMA(2) );
+		return CL_CgameGetSnapshot( args );
 	case CG_GETSERVERCOMMAND:
 		return CL_GetServerCommand( args[1] );
 	case CG_GETCURRENTCMDNUMBER:
@@ -742,12 +773,13 @@ void CL_InitCGame( void ) {
 	if ( !cgvm ) {
 		Com_Error( ERR_DROP, "VM_Create on cgame failed" );
 	}
+	CL_SetCgameSystemCalls();
 	cls.state = CA_LOADING;
 
 	// init for this gamestate
 	// use the lastExecutedServerCommand instead of the serverCommandSequence
 	// otherwise server commands sent just before a gamestate are dropped
-	VM_Call( cgvm, CG_INIT, clc.serverMessageSequence, clc.lastExecutedServerCommand, clc.clientNum );
+	VM_Call3( cgvm, CG_INIT, clc.serverMessageSequence, clc.lastExecutedServerCommand, clc.clientNum );
 
 	// we will send a usercmd this frame, which
 	// will cause the server to send us the first snapshot
@@ -783,7 +815,7 @@ qboolean CL_GameCommand( void ) {
 		return qfalse;
 	}
 
-	return (qboolean) VM_Call( cgvm, CG_CONSOLE_COMMAND );
+	return (qboolean) VM_Call0( cgvm, CG_CONSOLE_COMMAND );
 }
 
 
@@ -794,7 +826,7 @@ CL_CGameRendering
 =====================
 */
 void CL_CGameRendering( stereoFrame_t stereo ) {
-	VM_Call( cgvm, CG_DRAW_ACTIVE_FRAME, cl.serverTime, stereo, clc.demoplaying );
+	VM_Call3( cgvm, CG_DRAW_ACTIVE_FRAME, cl.serverTime, stereo, clc.demoplaying );
 	VM_Debug( 0 );
 }
 
@@ -745,7 +745,7 @@ void CL_Disconnect( qboolean showMainMenu ) {
 	}
 
 	if ( uivm && showMainMenu ) {
-		VM_Call( uivm, UI_SET_ACTIVE_MENU, UIMENU_NONE );
+		VM_Call1( uivm, UI_SET_ACTIVE_MENU, UIMENU_NONE );
 	}
 
 	SCR_StopCinematic ();
@@ -2003,12 +2003,12 @@ void CL_Frame ( int msec ) {
 	if ( cls.cddialog ) {
 		// bring up the cd error dialog if needed
 		cls.cddialog = qfalse;
-		VM_Call( uivm, UI_SET_ACTIVE_MENU, UIMENU_NEED_CD );
+		VM_Call1( uivm, UI_SET_ACTIVE_MENU, UIMENU_NEED_CD );
 	} else	if ( cls.state == CA_DISCONNECTED && !( cls.keyCatchers & KEYCATCH_UI )
 		&& !com_sv_running->integer ) {
 		// if disconnected, bring up the menu
 		S_StopAllSounds();
-		VM_Call( uivm, UI_SET_ACTIVE_MENU, UIMENU_MAIN );
+		VM_Call1( uivm, UI_SET_ACTIVE_MENU, UIMENU_MAIN );
 	}
 
 	// if recording an avi, lock to a fixed fps
@@ -2108,6 +2108,29 @@ void CL_ShutdownRef( void ) {
 	Com_Memset( &re, 0, sizeof( re ) );
 }
 
+/*
+============
+CL_RendererMemoryStats
+
+Returns qfalse if the renderer isn't running
+============
+*/
+qboolean CL_RendererMemoryStats( int *images, int *imageTexels, int *usedImageTexels, int *models, int *modelBytes ) {
+	refMemoryStats_t	stats;
+
+	if ( !cls.rendererStarted || !re.GetMemoryStats ) {
+		return qfalse;
+	}
+
+	re.GetMemoryStats( &stats );
+	*images = stats.numImages;
+	*imageTexels = stats.imageTexels;
+	*usedImageTexels = stats.usedImageTexels;
+	*models = stats.numModels;
+	*modelBytes = stats.modelBytes;
+	return qtrue;
+}
+
 /*
 ============
 CL_InitRenderer
@@ -2206,6 +2229,7 @@ void CL_InitRef( void ) {
 	ri.Hunk_FreeTempMemory = Hunk_FreeTempMemory;
 	ri.CM_DrawDebugSurface = CM_DrawDebugSurface;
 	ri.FS_ReadFile = FS_ReadFile;
+	ri.FS_ReadFileView = FS_ReadFileView;
 	ri.FS_FreeFile = FS_FreeFile;
 	ri.FS_WriteFile = FS_WriteFile;
 	ri.FS_FreeFileList = FS_FreeFileList;
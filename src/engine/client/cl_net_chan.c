@@ -141,13 +141,15 @@ CL_Netchan_Transmit
 ================
 */
 void CL_Netchan_Transmit( netchan_t *chan, msg_t* msg ) {
+	if ( msg->warning ) {
+		Com_Printf( "%s", msg->warning );
+	}
 	MSG_WriteByte( msg, clc_EOF );
 
 	CL_Netchan_Encode( msg );
 	Netchan_Transmit( chan, msg->cursize, msg->data );
 }
 
-extern 	int oldsize;
 int newsize = 0;
 
 /*
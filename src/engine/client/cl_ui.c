@@ -1130,7 +1130,7 @@ void CL_ShutdownUI( void ) {
 	if ( !uivm ) {
 		return;
 	}
-	VM_Call( uivm, UI_SHUTDOWN );
+	VM_Call0( uivm, UI_SHUTDOWN );
 	VM_Free( uivm );
 	uivm = NULL;
 }
@@ -1160,11 +1160,11 @@ void CL_InitUI( void ) {
 	}
 
 	// sanity check
-	v = VM_Call( uivm, UI_GETAPIVERSION );
+	v = VM_Call0( uivm, UI_GETAPIVERSION );
 	if (v == UI_OLD_API_VERSION) {
 //		Com_Printf(S_COLOR_YELLOW "WARNING: loading old Quake III Arena User Interface version %d\n", v );
 		// init for this gamestate
-		VM_Call( uivm, UI_INIT, (cls.state >= CA_AUTHORIZING && cls.state < CA_ACTIVE));
+		VM_Call1( uivm, UI_INIT, (cls.state >= CA_AUTHORIZING && cls.state < CA_ACTIVE));
 	}
 	else if (v != UI_API_VERSION) {
 		Com_Error( ERR_DROP, "User Interface is version %d, expected %d", v, UI_API_VERSION );
@@ -1172,13 +1172,13 @@ void CL_InitUI( void ) {
 	}
 	else {
 		// init for this gamestate
-		VM_Call( uivm, UI_INIT, (cls.state >= CA_AUTHORIZING && cls.state < CA_ACTIVE) );
+		VM_Call1( uivm, UI_INIT, (cls.state >= CA_AUTHORIZING && cls.state < CA_ACTIVE) );
 	}
 }
 
 qboolean UI_usesUniqueCDKey() {
 	if (uivm) {
-		return (qboolean) (VM_Call( uivm, UI_HASUNIQUECDKEY) == qtrue);
+		return (qboolean) (VM_Call0( uivm, UI_HASUNIQUECDKEY) == qtrue);
 	} else {
 		return qfalse;
 	}
@@ -1196,5 +1196,5 @@ qboolean UI_GameCommand( void ) {
 		return qfalse;
 	}
 
-	return (qboolean) VM_Call( uivm, UI_CONSOLE_COMMAND, cls.realtime );
+	return (qboolean) VM_Call1( uivm, UI_CONSOLE_COMMAND, cls.realtime );
 }
@@ -339,7 +339,7 @@ qboolean S_LoadSound( sfx_t *sfx )
 	}
 
 	// load it in
-	size = FS_ReadFile( sfx->soundName, (void **)&data );
+	size = FS_ReadFileView( sfx->soundName, (const void **)&data );
 	if ( !data ) {
 		return qfalse;
 	}
@@ -48,6 +48,7 @@ void	Sys_DestroyConsole( void );
 char	*Sys_ConsoleInput (void);
 
 qboolean	Sys_GetPacket ( netadr_t *net_from, msg_t *net_message );
+extern int	recvfromCount;
 
 // Input subsystem
 
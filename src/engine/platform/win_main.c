@@ -94,6 +94,40 @@ qboolean Sys_LowPhysicalMemory() {
 	return (stat.dwTotalPhys <= MEM_THRESHOLD) ? qtrue : qfalse;
 }
 
+/*
+==================
+Sys_ReserveMemory
+
+Reserves address space without backing it with memory.  Returns NULL
+if the range can't be reserved.
+==================
+*/
+void *Sys_ReserveMemory( int size ) {
+	return VirtualAlloc( NULL, size, MEM_RESERVE, PAGE_NOACCESS );
+}
+
+/*
+==================
+Sys_CommitMemory
+
+Backs part of a reserved range with zero filled memory
+==================
+*/
+qboolean Sys_CommitMemory( void *ptr, int size ) {
+	return (qboolean)( VirtualAlloc( ptr, size, MEM_COMMIT, PAGE_READWRITE ) != NULL );
+}
+
+/*
+==================
+Sys_DecommitMemory
+
+Gives the memory back to the system, the range stays reserved
+==================
+*/
+void Sys_DecommitMemory( void *ptr, int size ) {
+	VirtualFree( ptr, size, MEM_DECOMMIT );
+}
+
 /*
 ==================
 Sys_BeginProfiling
@@ -174,6 +208,219 @@ void Sys_Mkdir( const char *path ) {
 	_mkdir (path);
 }
 
+/*
+==============
+Sys_StatFile
+
+Size and modification time of a file, qfalse if it doesn't exist
+==============
+*/
+qboolean Sys_StatFile( const char *ospath, int *size, int *mtime ) {
+	struct _stat buf;
+
+	if ( _stat( ospath, &buf ) != 0 ) {
+		return qfalse;
+	}
+	*size = (int)buf.st_size;
+	*mtime = (int)buf.st_mtime;
+	return qtrue;
+}
+
+/*
+==============
+Sys_MapFile
+
+Maps a whole file read only, NULL if it can't be mapped
+==============
+*/
+const void *Sys_MapFile( const char *ospath, int *length ) {
+	HANDLE	file, mapping;
+	DWORD	size, sizeHigh;
+	void	*base;
+
+	file = CreateFile( ospath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( file == INVALID_HANDLE_VALUE ) {
+		return NULL;
+	}
+	size = GetFileSize( file, &sizeHigh );
+	if ( size == INVALID_FILE_SIZE || sizeHigh || !size || size > 0x7fffffff ) {
+		CloseHandle( file );
+		return NULL;
+	}
+	mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( file );
+	if ( !mapping ) {
+		return NULL;
+	}
+	// the view keeps the mapping alive
+	base = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping );
+	if ( !base ) {
+		return NULL;
+	}
+	*length = (int)size;
+	return base;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( const void *base, int length ) {
+	UnmapViewOfFile( base );
+}
+
+/*
+==============
+Sys_ReplaceFile
+
+Renames from to to in one step, replacing to if it exists.  Fails rather
+than rewriting to in place, which it can't while to is mapped.
+==============
+*/
+qboolean Sys_ReplaceFile( const char *from, const char *to ) {
+	return MoveFileEx( from, to, MOVEFILE_REPLACE_EXISTING ) ? qtrue : qfalse;
+}
+
+/*
+==============
+Sys_ProcessId
+==============
+*/
+int Sys_ProcessId( void ) {
+	return (int)GetCurrentProcessId();
+}
+
+/*
+========================================================================
+
+THREADS
+
+Worker threads for background jobs.  The threads run until the process
+exits, the synchronization objects are never destroyed either.
+
+========================================================================
+*/
+
+#define	MAX_SYS_THREADS		16
+
+typedef struct {
+	void	(*function)( void *data );
+	void	*data;
+} sysThread_t;
+
+static sysThread_t	sys_threads[MAX_SYS_THREADS];
+static int			sys_numThreads;
+
+/*
+==============
+Sys_ThreadStart
+==============
+*/
+static DWORD WINAPI Sys_ThreadStart( LPVOID parm ) {
+	sysThread_t	*thread = (sysThread_t *)parm;
+
+	thread->function( thread->data );
+	return 0;
+}
+
+/*
+==============
+Sys_CreateThread
+==============
+*/
+qboolean Sys_CreateThread( void (*function)( void *data ), void *data ) {
+	sysThread_t	*thread;
+	HANDLE		handle;
+	DWORD		id;
+
+	if ( sys_numThreads == MAX_SYS_THREADS ) {
+		return qfalse;
+	}
+	thread = &sys_threads[sys_numThreads];
+	thread->function = function;
+	thread->data = data;
+
+	handle = CreateThread( NULL, 0, Sys_ThreadStart, thread, 0, &id );
+	if ( !handle ) {
+		return qfalse;
+	}
+	CloseHandle( handle );
+	sys_numThreads++;
+	return qtrue;
+}
+
+/*
+==============
+Sys_ProcessorCount
+==============
+*/
+unsigned int Sys_ProcessorCount( void ) {
+	SYSTEM_INFO	info;
+
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+/*
+==============
+Sys_CreateMutex
+==============
+*/
+void *Sys_CreateMutex( void ) {
+	CRITICAL_SECTION	*crit;
+
+	crit = (CRITICAL_SECTION *) Z_Malloc( sizeof( *crit ) );
+	InitializeCriticalSection( crit );
+	return crit;
+}
+
+/*
+==============
+Sys_LockMutex
+==============
+*/
+void Sys_LockMutex( void *mutex ) {
+	EnterCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+/*
+==============
+Sys_UnlockMutex
+==============
+*/
+void Sys_UnlockMutex( void *mutex ) {
+	LeaveCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+/*
+==============
+Sys_CreateSemaphore
+==============
+*/
+void *Sys_CreateSemaphore( void ) {
+	return CreateSemaphore( NULL, 0, 0x7fffffff, NULL );
+}
+
+/*
+==============
+Sys_SignalSemaphore
+==============
+*/
+void Sys_SignalSemaphore( void *semaphore ) {
+	ReleaseSemaphore( (HANDLE)semaphore, 1, NULL );
+}
+
+/*
+==============
+Sys_WaitSemaphore
+==============
+*/
+void Sys_WaitSemaphore( void *semaphore ) {
+	WaitForSingleObject( (HANDLE)semaphore, INFINITE );
+}
+
 /*
 ==============
 Sys_Cwd
@@ -512,6 +759,20 @@ void Sys_UnloadDll( void *dllHandle ) {
 	}
 }
 
+/*
+=================
+Sys_DllSymbol
+
+Returns NULL if the dll doesn't export the symbol
+=================
+*/
+void *Sys_DllSymbol( void *dllHandle, const char *symbol ) {
+	if ( !dllHandle ) {
+		return NULL;
+	}
+	return (void *)GetProcAddress( (HMODULE) dllHandle, symbol );
+}
+
 /*
 =================
 Sys_LoadDll
@@ -892,6 +1153,8 @@ EVENT LOOP
 
 #define	MAX_QUED_EVENTS		256
 #define	MASK_QUED_EVENTS	( MAX_QUED_EVENTS - 1 )
+#define	MAX_QUED_PACKETS	64		// read from the sockets per Sys_GetEvent
+#define	NET_BENCH_ROUND		32		// datagrams net_bench sends before draining
 
 sysEvent_t	eventQue[MAX_QUED_EVENTS];
 int			eventHead, eventTail;
@@ -933,6 +1196,124 @@ void Sys_QueEvent( int time, sysEventType_t type, int value, int value2, int ptr
 	ev->evPtr = ptr;
 }
 
+/*
+================
+Sys_QueuePackets
+
+Queues everything waiting on the sockets, up to max packets, so a busy
+server doesn't pump the message loop and the console once per packet.
+Returns the number queued.
+================
+*/
+static int Sys_QueuePackets( int max ) {
+	msg_t		netmsg;
+	netadr_t	adr;
+	netadr_t	*buf;
+	int			len, count;
+
+	for ( count = 0 ; count < max && eventHead - eventTail < MAX_QUED_EVENTS ; count++ ) {
+		MSG_Init( &netmsg, sys_packetReceived, sizeof( sys_packetReceived ) );
+		if ( !Sys_GetPacket ( &adr, &netmsg ) ) {
+			break;
+		}
+
+		// copy out to a seperate buffer for qeueing
+		// the readcount stepahead is for SOCKS support
+		len = sizeof( netadr_t ) + netmsg.cursize - netmsg.readcount;
+		buf = (netadr_t*) Z_Malloc( len );
+		*buf = adr;
+		memcpy( buf+1, &netmsg.data[netmsg.readcount], netmsg.cursize - netmsg.readcount );
+		Sys_QueEvent( 0, SE_PACKET, 0, 0, len, buf );
+	}
+	return count;
+}
+
+/*
+================
+Sys_NetBench_f
+
+net_bench [packets] [size]
+
+Sends datagrams to the server socket over 127.0.0.1 and times draining
+them into the event queue, MAX_QUED_PACKETS per Sys_QueuePackets call
+against one per call with a message pump check in between, the way
+Sys_GetEvent read them before the drain.  The datagrams go out in rounds
+that fit the socket buffer and are dropped after they are queued, along
+with anything else that arrives meanwhile.
+================
+*/
+static void Sys_NetBench_f( void ) {
+	static byte	data[MAX_PACKETLEN];
+	MSG			msg;
+	netadr_t	adr;
+	int			packets, size, pass, max;
+	int			sent, round, received, count, calls, recvfroms;
+	int			i, start, usec, timeout;
+
+	packets = 10000;
+	if ( Cmd_Argc() > 1 ) {
+		packets = atoi( Cmd_Argv( 1 ) );
+		if ( packets < 1 ) {
+			packets = 1;
+		}
+	}
+	size = 1000;
+	if ( Cmd_Argc() > 2 ) {
+		size = atoi( Cmd_Argv( 2 ) );
+		if ( size < 1 ) {
+			size = 1;
+		} else if ( size > MAX_PACKETLEN ) {
+			size = MAX_PACKETLEN;
+		}
+	}
+
+	// everything queued from here on is the benchmark's to drop
+	if ( eventHead != eventTail ) {
+		Com_Printf( "net_bench: events are waiting, try again\n" );
+		return;
+	}
+	if ( !NET_StringToAdr( va( "127.0.0.1:%i", Cvar_VariableIntegerValue( "net_port" ) ), &adr ) ) {
+		Com_Printf( "net_bench: bad net_port\n" );
+		return;
+	}
+
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		max = pass ? 1 : MAX_QUED_PACKETS;
+		received = calls = usec = 0;
+		recvfroms = recvfromCount;
+
+		for ( sent = 0 ; sent < packets ; sent += round ) {
+			round = packets - sent < NET_BENCH_ROUND ? packets - sent : NET_BENCH_ROUND;
+			for ( i = 0 ; i < round ; i++ ) {
+				Sys_SendPacket( size, data, adr );
+			}
+
+			start = Sys_Microseconds();
+			timeout = Sys_Milliseconds() + 100;
+			for ( count = 0 ; count < round && Sys_Milliseconds() < timeout ; ) {
+				if ( pass ) {
+					PeekMessage( &msg, NULL, 0, 0, PM_NOREMOVE );
+				}
+				count += Sys_QueuePackets( max );
+				calls++;
+
+				while ( eventHead > eventTail ) {
+					if ( eventQue[ eventTail & MASK_QUED_EVENTS ].evPtr ) {
+						Z_Free( eventQue[ eventTail & MASK_QUED_EVENTS ].evPtr );
+					}
+					eventTail++;
+				}
+			}
+			usec += Sys_Microseconds() - start;
+			received += count;
+		}
+
+		Com_Printf( "%s %6i of %i received, %8i usec, %6.2f usec per packet, %i calls, %i recvfrom\n",
+			pass ? "single:" : "drain: ", received, packets, usec,
+			received ? (float)usec / received : 0.0f, calls, recvfromCount - recvfroms );
+	}
+}
+
 /*
 ================
 Sys_GetEvent
@@ -943,8 +1324,6 @@ sysEvent_t Sys_GetEvent( void ) {
     MSG			msg;
 	sysEvent_t	ev;
 	char		*s;
-	msg_t		netmsg;
-	netadr_t	adr;
 
 	// return if we have data
 	if ( eventHead > eventTail ) {
@@ -978,19 +1357,7 @@ sysEvent_t Sys_GetEvent( void ) {
 	}
 
 	// check for network packets
-	MSG_Init( &netmsg, sys_packetReceived, sizeof( sys_packetReceived ) );
-	if ( Sys_GetPacket ( &adr, &netmsg ) ) {
-		netadr_t		*buf;
-		int				len;
-
-		// copy out to a seperate buffer for qeueing
-		// the readcount stepahead is for SOCKS support
-		len = sizeof( netadr_t ) + netmsg.cursize - netmsg.readcount;
-		buf = (netadr_t*) Z_Malloc( len );
-		*buf = adr;
-		memcpy( buf+1, &netmsg.data[netmsg.readcount], netmsg.cursize - netmsg.readcount );
-		Sys_QueEvent( 0, SE_PACKET, 0, 0, len, buf );
-	}
+	Sys_QueuePackets( MAX_QUED_PACKETS );
 
 	// return if we have data
 	if ( eventHead > eventTail ) {
@@ -1053,6 +1420,7 @@ void Sys_Init( void ) {
 
 	Cmd_AddCommand ("in_restart", Sys_In_Restart_f);
 	Cmd_AddCommand ("net_restart", Sys_Net_Restart_f);
+	Cmd_AddCommand ("net_bench", Sys_NetBench_f);
 
 	g_wv.osversion.dwOSVersionInfoSize = sizeof( g_wv.osversion );
 
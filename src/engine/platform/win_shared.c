@@ -53,6 +53,33 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+
+For timing things that take much less than a millisecond.  Only
+differences between two calls are meaningful, the value wraps
+after about half an hour.
+================
+*/
+int Sys_Microseconds( void )
+{
+	static LARGE_INTEGER	frequency, base;
+	LARGE_INTEGER	now;
+	LONGLONG		ticks;
+
+	if ( !frequency.QuadPart ) {
+		QueryPerformanceFrequency( &frequency );
+		QueryPerformanceCounter( &base );
+	}
+	QueryPerformanceCounter( &now );
+
+	// split so the multiply can't overflow however long we run
+	ticks = now.QuadPart - base.QuadPart;
+	return (int)( ( ticks / frequency.QuadPart ) * 1000000
+		+ ( ticks % frequency.QuadPart ) * 1000000 / frequency.QuadPart );
+}
+
 /*
 ================
 Sys_SnapVector
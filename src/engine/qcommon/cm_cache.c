@@ -0,0 +1,811 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// cm_cache.c -- collision map cache
+
+#include "cm_local.h"
+#include "cm_patch.h"
+
+/*
+===============================================================================
+
+COLLISION MAP CACHE
+
+Generating the patch collision and the brush trees takes most of the time
+of CM_LoadMap.  After a map is loaded its collision data is written to
+cmcache/<map>-<checksum>.cmc in the home path, and the next load of the
+same bsp maps that file read only instead of building it all again.  The
+big arrays are used straight from the mapping, so servers on one host that
+run the same map share a single copy of them.  Structures that hold
+pointers are stored with indexes and rebuilt on the hunk, as are the areas
+that change while the map runs.
+
+The file uses the byte order and structure sizes of the build that wrote
+it, a build that lays the structures out differently rewrites it.  A bsp
+with another checksum gets a file of its own, so the file a running server
+has mapped is only replaced when it is damaged or from another build, and
+then by renaming a complete file over it.  Bump CM_CACHE_VERSION when the
+patch collision or brush tree code changes what it builds.
+
+	header, then the sections in cmCacheSection_t order, each one starting
+	on a CM_CACHE_ALIGN boundary
+
+===============================================================================
+*/
+
+#define	CM_CACHE_IDENT		(('C'<<24)+('M'<<16)+('C'<<8)+'Q')
+#define	CM_CACHE_VERSION	1
+#define	CM_CACHE_DIR		"cmcache"
+#define	CM_CACHE_ALIGN		64		// the SSE brush planes need 16
+
+typedef enum {
+	CC_PLANES,			// cplane_t, mapped
+	CC_NODES,			// cmCacheNode_t
+	CC_LEAFS,			// cLeaf_t
+	CC_LEAFBRUSHES,		// int, mapped, followed by those of the submodels
+	CC_LEAFSURFACES,	// int, mapped, followed by those of the submodels
+	CC_BRUSHSIDES,		// cmCacheBrushSide_t
+	CC_BRUSHES,			// cmCacheBrush_t
+	CC_BRUSHPLANES,		// cbrushPlanes_t, mapped, in brush order
+	CC_SUBMODELS,		// cmodel_t
+	CC_BRUSHNODES,		// cbrushNode_t, mapped
+	CC_TREEBRUSHES,		// int, mapped
+	CC_VISIBILITY,		// byte, mapped
+	CC_PATCHES,			// cmCachePatch_t
+	CC_PATCHPLANES,		// patchPlane_t, mapped
+	CC_FACETS,			// facet_t, mapped
+
+	CC_NUM_SECTIONS
+} cmCacheSection_t;
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			layout;			// CM_CacheLayout of the build that wrote it
+	int			checksum;		// of the bsp, as CM_LoadMap returns it
+	int			length;			// of the whole file
+	int			numSurfaces;
+	int			numClusters;
+	int			clusterBytes;
+	int			vised;
+	int			numAreas;
+	lump_t		sections[CC_NUM_SECTIONS];
+} cmCacheHeader_t;
+
+typedef struct {
+	int			planeNum;
+	int			children[2];
+} cmCacheNode_t;
+
+typedef struct {
+	int			planeNum;
+	int			surfaceFlags;
+	int			shaderNum;
+} cmCacheBrushSide_t;
+
+typedef struct {
+	int			shaderNum;
+	int			contents;
+	vec3_t		bounds[2];
+	int			firstSide;
+	int			numSides;
+} cmCacheBrush_t;
+
+typedef struct {
+	int			surfaceNum;
+	int			surfaceFlags;
+	int			contents;
+	vec3_t		bounds[2];
+	int			firstPlane;
+	int			numPlanes;
+	int			firstFacet;
+	int			numFacets;
+} cmCachePatch_t;
+
+static const int	cm_sectionSizes[CC_NUM_SECTIONS] = {
+	sizeof( cplane_t ),
+	sizeof( cmCacheNode_t ),
+	sizeof( cLeaf_t ),
+	sizeof( int ),
+	sizeof( int ),
+	sizeof( cmCacheBrushSide_t ),
+	sizeof( cmCacheBrush_t ),
+#if idsse
+	sizeof( cbrushPlanes_t ),
+#else
+	1,		// always empty
+#endif
+	sizeof( cmodel_t ),
+	sizeof( cbrushNode_t ),
+	sizeof( int ),
+	1,
+	sizeof( cmCachePatch_t ),
+	sizeof( patchPlane_t ),
+	sizeof( facet_t )
+};
+
+// the mapping the current map uses
+static const byte	*cm_cacheView;
+static int			cm_cacheLength;
+
+/*
+=================
+CM_CacheLayout
+=================
+*/
+static int CM_CacheLayout( void ) {
+	return (int)Com_BlockChecksum( cm_sectionSizes, sizeof( cm_sectionSizes ) );
+}
+
+/*
+=================
+CM_CachePath
+=================
+*/
+static void CM_CachePath( const char *name, int checksum, char *path, int size ) {
+	char	stripped[MAX_QPATH];
+
+	COM_StripExtension( name, stripped );
+	Com_sprintf( path, size, "%s/%s-%08x.cmc", CM_CACHE_DIR, stripped, (unsigned)checksum );
+}
+
+/*
+=================
+CM_CacheSection
+=================
+*/
+static const void *CM_CacheSection( const cmCacheHeader_t *header, int section, int *count ) {
+	*count = header->sections[section].filelen / cm_sectionSizes[section];
+	return (const byte *)header + header->sections[section].fileofs;
+}
+
+/*
+=================
+CM_CheckCacheLeaf
+
+The brush and surface ranges of a leaf or submodel
+=================
+*/
+static qboolean CM_CheckCacheLeaf( const cLeaf_t *leaf, int numLeafBrushes, int numLeafSurfaces ) {
+	if ( leaf->firstLeafBrush < 0 || leaf->numLeafBrushes < 0
+		|| leaf->numLeafBrushes > numLeafBrushes - leaf->firstLeafBrush ) {
+		return qfalse;
+	}
+	if ( leaf->firstLeafSurface < 0 || leaf->numLeafSurfaces < 0
+		|| leaf->numLeafSurfaces > numLeafSurfaces - leaf->firstLeafSurface ) {
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+=================
+CM_CheckCacheTree
+
+Walks the brush tree of a leaf the way CM_MarkTreeBrushes does.  Children
+come after their parent, so the walk ends, and visited counts the nodes
+of all the trees, which don't share any.
+=================
+*/
+static qboolean CM_CheckCacheTree( const cLeaf_t *leaf, const cbrushNode_t *nodes, int numNodes,
+								   const int *treeBrushes, int numTreeBrushes, int *visited ) {
+	const cbrushNode_t	*node;
+	int					stack[32];
+	int					depth, n, i;
+
+	if ( leaf->numLeafBrushes > MAX_TREE_BRUSHES ) {
+		return qfalse;
+	}
+
+	stack[0] = leaf->brushTree;
+	depth = 1;
+	while ( depth ) {
+		n = stack[--depth];
+		if ( n <= 0 || n >= numNodes || ++*visited >= numNodes ) {
+			return qfalse;
+		}
+		node = &nodes[n];
+
+		if ( node->children ) {
+			if ( node->children <= n || node->children >= numNodes - 1 || depth + 2 > (int)ARRAY_LEN( stack ) ) {
+				return qfalse;
+			}
+			stack[depth++] = node->children;
+			stack[depth++] = node->children + 1;
+			continue;
+		}
+
+		if ( node->firstBrush < 0 || node->numBrushes < 0 || node->numBrushes > numTreeBrushes - node->firstBrush ) {
+			return qfalse;
+		}
+		for ( i = 0 ; i < node->numBrushes ; i++ ) {
+			if ( (unsigned)treeBrushes[node->firstBrush + i] >= (unsigned)leaf->numLeafBrushes ) {
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+CM_CheckCacheFacets
+
+The facets of a patch index its own planes, and the signbits of the
+planes index the trace offsets.
+=================
+*/
+static qboolean CM_CheckCacheFacets( const facet_t *facets, int numFacets, const patchPlane_t *planes, int numPlanes ) {
+	const facet_t	*facet;
+	int				i, j;
+
+	for ( i = 0 ; i < numPlanes ; i++ ) {
+		if ( (unsigned)planes[i].signbits > 7 ) {
+			return qfalse;
+		}
+	}
+
+	for ( i = 0, facet = facets ; i < numFacets ; i++, facet++ ) {
+		if ( (unsigned)facet->surfacePlane >= (unsigned)numPlanes
+			|| facet->numBorders < 0 || facet->numBorders > (int)ARRAY_LEN( facet->borderPlanes ) ) {
+			return qfalse;
+		}
+		for ( j = 0 ; j < facet->numBorders ; j++ ) {
+			if ( (unsigned)facet->borderPlanes[j] >= (unsigned)numPlanes ) {
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+CM_CheckCache
+
+Like the bsp, the plane normals and the bounds are trusted.  Every index in
+the file is range checked, once per load, so a damaged file can't make
+the loader, the traces or the pvs read outside of it.
+=================
+*/
+static qboolean CM_CheckCache( const byte *base, int length, int checksum ) {
+	const cmCacheHeader_t		*header;
+	const lump_t				*l;
+	const cmCacheNode_t			*node;
+	const cLeaf_t				*leaf;
+	const cmodel_t				*model;
+	const cmCacheBrushSide_t	*side;
+	const cmCacheBrush_t		*brush;
+	const cmCachePatch_t		*patch;
+	const cplane_t				*planes;
+	const patchPlane_t			*patchPlanes;
+	const facet_t				*facets;
+	const cbrushNode_t			*brushNodes;
+	const int					*leafBrushes, *leafSurfaces, *treeBrushes;
+	int							i, j, count, visited;
+	int							numPlanes, numNodes, numLeafs, numBrushes, numBrushSides, numBrushPlanes;
+	int							numLeafBrushes, numLeafSurfaces, numBrushNodes, numTreeBrushes;
+	int							numVisibility, numPatchPlanes, numFacets;
+
+	header = (const cmCacheHeader_t *)base;
+	if ( length < (int)sizeof( *header ) || header->ident != CM_CACHE_IDENT
+		|| header->version != CM_CACHE_VERSION || header->layout != CM_CacheLayout()
+		|| header->checksum != checksum || header->length != length ) {
+		return qfalse;
+	}
+
+	for ( i = 0, l = header->sections ; i < CC_NUM_SECTIONS ; i++, l++ ) {
+		if ( l->fileofs < (int)sizeof( *header ) || l->fileofs > length || ( l->fileofs & ( CM_CACHE_ALIGN - 1 ) )
+			|| l->filelen < 0 || l->filelen > length - l->fileofs || l->filelen % cm_sectionSizes[i] ) {
+			return qfalse;
+		}
+	}
+
+	planes = (const cplane_t *) CM_CacheSection( header, CC_PLANES, &numPlanes );
+	CM_CacheSection( header, CC_NODES, &numNodes );
+	CM_CacheSection( header, CC_LEAFS, &numLeafs );
+	CM_CacheSection( header, CC_BRUSHES, &numBrushes );
+	CM_CacheSection( header, CC_BRUSHSIDES, &numBrushSides );
+	CM_CacheSection( header, CC_BRUSHPLANES, &numBrushPlanes );
+	CM_CacheSection( header, CC_VISIBILITY, &numVisibility );
+	patchPlanes = (const patchPlane_t *) CM_CacheSection( header, CC_PATCHPLANES, &numPatchPlanes );
+	facets = (const facet_t *) CM_CacheSection( header, CC_FACETS, &numFacets );
+	leafBrushes = (const int *) CM_CacheSection( header, CC_LEAFBRUSHES, &numLeafBrushes );
+	leafSurfaces = (const int *) CM_CacheSection( header, CC_LEAFSURFACES, &numLeafSurfaces );
+	brushNodes = (const cbrushNode_t *) CM_CacheSection( header, CC_BRUSHNODES, &numBrushNodes );
+	treeBrushes = (const int *) CM_CacheSection( header, CC_TREEBRUSHES, &numTreeBrushes );
+
+	if ( !numPlanes || !numNodes || !numLeafs || header->numSurfaces < 0 || header->numAreas < 0 ) {
+		return qfalse;
+	}
+	for ( i = 0 ; i < numPlanes ; i++ ) {
+		if ( planes[i].type > 3 || planes[i].signbits > 7 ) {
+			return qfalse;
+		}
+	}
+	CM_CacheSection( header, CC_SUBMODELS, &count );
+	if ( !count || count > MAX_SUBMODELS ) {
+		return qfalse;
+	}
+
+	// a pvs row has a bit for every cluster
+	if ( header->numClusters < 0 || header->clusterBytes < ( header->numClusters + 7 ) >> 3 ) {
+		return qfalse;
+	}
+	if ( header->vised ) {
+		if ( header->numClusters && numVisibility / header->clusterBytes < header->numClusters ) {
+			return qfalse;
+		}
+	} else if ( numVisibility < header->clusterBytes ) {
+		return qfalse;
+	}
+
+	node = (const cmCacheNode_t *) CM_CacheSection( header, CC_NODES, &count );
+	for ( i = 0 ; i < count ; i++, node++ ) {
+		if ( (unsigned)node->planeNum >= (unsigned)numPlanes ) {
+			return qfalse;
+		}
+		// children after their parent, so the tree has no loops
+		for ( j = 0 ; j < 2 ; j++ ) {
+			if ( node->children[j] >= 0 ) {
+				if ( node->children[j] <= i || node->children[j] >= numNodes ) {
+					return qfalse;
+				}
+			} else if ( -1 - node->children[j] >= numLeafs ) {
+				return qfalse;
+			}
+		}
+	}
+
+	for ( i = 0 ; i < numLeafBrushes ; i++ ) {
+		if ( (unsigned)leafBrushes[i] >= (unsigned)numBrushes ) {
+			return qfalse;
+		}
+	}
+	for ( i = 0 ; i < numLeafSurfaces ; i++ ) {
+		if ( (unsigned)leafSurfaces[i] >= (unsigned)header->numSurfaces ) {
+			return qfalse;
+		}
+	}
+
+	// trees are only used when there are nodes, CM_LoadCache clears brushTree otherwise
+	visited = 0;
+	leaf = (const cLeaf_t *) CM_CacheSection( header, CC_LEAFS, &count );
+	for ( i = 0 ; i < count ; i++, leaf++ ) {
+		if ( leaf->cluster < -1 || leaf->cluster >= header->numClusters
+			|| leaf->area < -1 || leaf->area >= header->numAreas
+			|| !CM_CheckCacheLeaf( leaf, numLeafBrushes, numLeafSurfaces ) ) {
+			return qfalse;
+		}
+		if ( leaf->brushTree && numBrushNodes
+			&& !CM_CheckCacheTree( leaf, brushNodes, numBrushNodes, treeBrushes, numTreeBrushes, &visited ) ) {
+			return qfalse;
+		}
+	}
+
+	// submodels have no trees
+	model = (const cmodel_t *) CM_CacheSection( header, CC_SUBMODELS, &count );
+	for ( i = 0 ; i < count ; i++, model++ ) {
+		if ( !CM_CheckCacheLeaf( &model->leaf, numLeafBrushes, numLeafSurfaces ) || model->leaf.brushTree ) {
+			return qfalse;
+		}
+	}
+
+	side = (const cmCacheBrushSide_t *) CM_CacheSection( header, CC_BRUSHSIDES, &count );
+	for ( i = 0 ; i < count ; i++, side++ ) {
+		if ( (unsigned)side->planeNum >= (unsigned)numPlanes
+			|| (unsigned)side->shaderNum >= (unsigned)cm.numShaders ) {
+			return qfalse;
+		}
+	}
+
+	brush = (const cmCacheBrush_t *) CM_CacheSection( header, CC_BRUSHES, &count );
+	for ( i = 0 ; i < count ; i++, brush++ ) {
+		if ( brush->firstSide < 0 || brush->numSides < 0 || brush->numSides > numBrushSides - brush->firstSide ) {
+			return qfalse;
+		}
+#if idsse
+		numBrushPlanes -= ( brush->numSides + 3 ) >> 2;
+#endif
+	}
+	if ( numBrushPlanes ) {
+		return qfalse;
+	}
+
+	patch = (const cmCachePatch_t *) CM_CacheSection( header, CC_PATCHES, &count );
+	for ( i = 0 ; i < count ; i++, patch++ ) {
+		if ( (unsigned)patch->surfaceNum >= (unsigned)header->numSurfaces
+			|| patch->firstPlane < 0 || patch->numPlanes < 0 || patch->numPlanes > numPatchPlanes - patch->firstPlane
+			|| patch->firstFacet < 0 || patch->numFacets < 0 || patch->numFacets > numFacets - patch->firstFacet
+			|| !CM_CheckCacheFacets( facets + patch->firstFacet, patch->numFacets, patchPlanes + patch->firstPlane, patch->numPlanes ) ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+CM_LoadCache
+
+Sets up everything CMod_Load* would from the cache of the map, qfalse if
+there is no current cache.  The shaders are already loaded.
+=================
+*/
+qboolean CM_LoadCache( const char *name, int checksum ) {
+	const cmCacheHeader_t		*header;
+	const cmCacheNode_t			*inNode;
+	const cmCacheBrushSide_t	*inSide;
+	const cmCacheBrush_t		*inBrush;
+	const cmCachePatch_t		*inPatch;
+	const cLeaf_t				*inLeaf;
+	const cmodel_t				*inModel;
+	const patchPlane_t			*patchPlanes;
+	const facet_t				*facets;
+	const byte					*base;
+	cNode_t						*node;
+	cbrushside_t				*side;
+	cbrush_t					*brush;
+	cPatch_t					*patch;
+	patchCollide_t				*pc;
+#if idsse
+	cbrushPlanes_t				*brushPlanes;
+#endif
+	char						path[MAX_QPATH];
+	int							i, j, count, length;
+
+	if ( !cm_cache->integer ) {
+		return qfalse;
+	}
+
+	CM_CachePath( name, checksum, path, sizeof( path ) );
+	base = (const byte *) FS_MapFile( path, &length );
+	if ( !base ) {
+		return qfalse;
+	}
+	if ( !CM_CheckCache( base, length, checksum ) ) {
+		Com_DPrintf( "%s is out of date\n", path );
+		Sys_UnmapFile( base, length );
+		return qfalse;
+	}
+	header = (const cmCacheHeader_t *)base;
+
+	// the arrays that don't change are used from the mapping
+	cm.planes = (cplane_t *) CM_CacheSection( header, CC_PLANES, &cm.numPlanes );
+	cm.leafbrushes = (int *) CM_CacheSection( header, CC_LEAFBRUSHES, &cm.numLeafBrushes );
+	cm.leafsurfaces = (int *) CM_CacheSection( header, CC_LEAFSURFACES, &cm.numLeafSurfaces );
+	cm.visibility = (byte *) CM_CacheSection( header, CC_VISIBILITY, &count );
+	cm.numClusters = header->numClusters;
+	cm.clusterBytes = header->clusterBytes;
+	cm.vised = header->vised ? qtrue : qfalse;
+
+	// the brush trees can be turned off after the cache was written,
+	// when they were off then CM_LoadMap builds them
+	if ( cm_brushTrees->integer ) {
+		cm.brushNodes = (cbrushNode_t *) CM_CacheSection( header, CC_BRUSHNODES, &cm.numBrushNodes );
+		cm.treeBrushes = (int *) CM_CacheSection( header, CC_TREEBRUSHES, &count );
+		if ( !cm.numBrushNodes ) {
+			cm.brushNodes = NULL;
+			cm.treeBrushes = NULL;
+		}
+	}
+
+	// the rest holds pointers or is written to, so it goes on the hunk
+	inLeaf = (const cLeaf_t *) CM_CacheSection( header, CC_LEAFS, &cm.numLeafs );
+	cm.leafs = (cLeaf_t *) Hunk_Alloc( ( BOX_LEAFS + cm.numLeafs ) * sizeof( *cm.leafs ), h_high );
+	Com_Memcpy( cm.leafs, inLeaf, cm.numLeafs * sizeof( *cm.leafs ) );
+	if ( !cm.brushNodes ) {
+		for ( i = 0 ; i < cm.numLeafs ; i++ ) {
+			cm.leafs[i].brushTree = 0;
+		}
+	}
+
+	cm.numAreas = header->numAreas;
+	cm.areas = (cArea_t *) Hunk_Alloc( cm.numAreas * sizeof( *cm.areas ), h_high );
+	cm.areaPortals = (int *) Hunk_Alloc( cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ), h_high );
+
+	inSide = (const cmCacheBrushSide_t *) CM_CacheSection( header, CC_BRUSHSIDES, &cm.numBrushSides );
+	cm.brushsides = (cbrushside_t *) Hunk_Alloc( cm.numBrushSides * sizeof( *cm.brushsides ), h_high );
+	for ( i = 0, side = cm.brushsides ; i < cm.numBrushSides ; i++, side++, inSide++ ) {
+		side->plane = &cm.planes[inSide->planeNum];
+		side->surfaceFlags = inSide->surfaceFlags;
+		side->shaderNum = inSide->shaderNum;
+	}
+
+	inBrush = (const cmCacheBrush_t *) CM_CacheSection( header, CC_BRUSHES, &cm.numBrushes );
+	cm.brushes = (cbrush_t *) Hunk_Alloc( cm.numBrushes * sizeof( *cm.brushes ), h_high );
+#if idsse
+	brushPlanes = (cbrushPlanes_t *) CM_CacheSection( header, CC_BRUSHPLANES, &count );
+#endif
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++, inBrush++ ) {
+		brush->shaderNum = inBrush->shaderNum;
+		brush->contents = inBrush->contents;
+		VectorCopy( inBrush->bounds[0], brush->bounds[0] );
+		VectorCopy( inBrush->bounds[1], brush->bounds[1] );
+		brush->numsides = inBrush->numSides;
+		brush->sides = cm.brushsides + inBrush->firstSide;
+#if idsse
+		brush->planes = brushPlanes;
+		brushPlanes += ( brush->numsides + 3 ) >> 2;
+#endif
+	}
+
+	inModel = (const cmodel_t *) CM_CacheSection( header, CC_SUBMODELS, &cm.numSubModels );
+	cm.cmodels = (cmodel_t *) Hunk_Alloc( cm.numSubModels * sizeof( *cm.cmodels ), h_high );
+	Com_Memcpy( cm.cmodels, inModel, cm.numSubModels * sizeof( *cm.cmodels ) );
+
+	inNode = (const cmCacheNode_t *) CM_CacheSection( header, CC_NODES, &cm.numNodes );
+	cm.nodes = (cNode_t *) Hunk_Alloc( cm.numNodes * sizeof( *cm.nodes ), h_high );
+	for ( i = 0, node = cm.nodes ; i < cm.numNodes ; i++, node++, inNode++ ) {
+		node->plane = &cm.planes[inNode->planeNum];
+		node->children[0] = inNode->children[0];
+		node->children[1] = inNode->children[1];
+	}
+
+	cm.numSurfaces = header->numSurfaces;
+	cm.surfaces = (cPatch_t **) Hunk_Alloc( cm.numSurfaces * sizeof( cm.surfaces[0] ), h_high );
+	patchPlanes = (const patchPlane_t *) CM_CacheSection( header, CC_PATCHPLANES, &count );
+	facets = (const facet_t *) CM_CacheSection( header, CC_FACETS, &count );
+	inPatch = (const cmCachePatch_t *) CM_CacheSection( header, CC_PATCHES, &count );
+	for ( i = 0 ; i < count ; i++, inPatch++ ) {
+		cm.surfaces[inPatch->surfaceNum] = patch = (cPatch_t *) Hunk_Alloc( sizeof( *patch ), h_high );
+		patch->surfaceFlags = inPatch->surfaceFlags;
+		patch->contents = inPatch->contents;
+
+		patch->pc = pc = (patchCollide_t *) Hunk_Alloc( sizeof( *pc ), h_high );
+		for ( j = 0 ; j < 3 ; j++ ) {
+			pc->bounds[0][j] = inPatch->bounds[0][j];
+			pc->bounds[1][j] = inPatch->bounds[1][j];
+		}
+		pc->numPlanes = inPatch->numPlanes;
+		pc->planes = (patchPlane_t *) patchPlanes + inPatch->firstPlane;
+		pc->numFacets = inPatch->numFacets;
+		pc->facets = (facet_t *) facets + inPatch->firstFacet;
+	}
+
+	cm_cacheView = base;
+	cm_cacheLength = length;
+
+	Com_DPrintf( "CM_LoadMap: collision from %s\n", path );
+	return qtrue;
+}
+
+/*
+=================
+CM_WriteCache
+
+Writes the cache of the map that was just loaded from the bsp.  It is
+written under another name first, so other servers never map half of it.
+=================
+*/
+void CM_WriteCache( const char *name, int checksum ) {
+	cmCacheHeader_t		*header;
+	cmCacheNode_t		*outNode;
+	cmCacheBrushSide_t	*outSide;
+	cmCacheBrush_t		*outBrush;
+	cmCachePatch_t		*outPatch;
+	cmodel_t			*outModel;
+	patchPlane_t		*outPatchPlanes;
+	facet_t				*outFacets;
+	int					*outLeafBrushes, *outLeafSurfaces;
+	cbrush_t			*brush;
+	cmodel_t			*model;
+	patchCollide_t		*pc;
+	byte				*data;
+	int					counts[CC_NUM_SECTIONS];
+	int					i, j, length;
+	int					numLeafBrushes, numLeafSurfaces;
+	int					numPatchPlanes, numFacets;
+	char				path[MAX_QPATH], temp[MAX_QPATH];
+#if idsse
+	cbrushPlanes_t		*outBrushPlanes;
+#endif
+
+	if ( !cm_cache->integer ) {
+		return;
+	}
+
+	Com_Memset( counts, 0, sizeof( counts ) );
+	counts[CC_PLANES] = cm.numPlanes;
+	counts[CC_NODES] = cm.numNodes;
+	counts[CC_LEAFS] = cm.numLeafs;
+	counts[CC_LEAFBRUSHES] = cm.numLeafBrushes;
+	counts[CC_LEAFSURFACES] = cm.numLeafSurfaces;
+	for ( i = 1 ; i < cm.numSubModels ; i++ ) {
+		counts[CC_LEAFBRUSHES] += cm.cmodels[i].leaf.numLeafBrushes;
+		counts[CC_LEAFSURFACES] += cm.cmodels[i].leaf.numLeafSurfaces;
+	}
+	counts[CC_BRUSHSIDES] = cm.numBrushSides;
+	counts[CC_BRUSHES] = cm.numBrushes;
+#if idsse
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++ ) {
+		counts[CC_BRUSHPLANES] += ( brush->numsides + 3 ) >> 2;
+	}
+#endif
+	counts[CC_SUBMODELS] = cm.numSubModels;
+	if ( cm.brushNodes ) {
+		counts[CC_BRUSHNODES] = cm.numBrushNodes;
+		for ( i = 0 ; i < cm.numLeafs ; i++ ) {
+			if ( cm.leafs[i].brushTree ) {
+				counts[CC_TREEBRUSHES] += cm.leafs[i].numLeafBrushes;
+			}
+		}
+	}
+	counts[CC_VISIBILITY] = cm.vised ? cm.numClusters * cm.clusterBytes : cm.clusterBytes;
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( cm.surfaces[i] ) {
+			counts[CC_PATCHES]++;
+			counts[CC_PATCHPLANES] += cm.surfaces[i]->pc->numPlanes;
+			counts[CC_FACETS] += cm.surfaces[i]->pc->numFacets;
+		}
+	}
+
+	// lay out the sections
+	length = ( sizeof( *header ) + CM_CACHE_ALIGN - 1 ) & ~( CM_CACHE_ALIGN - 1 );
+	for ( i = 0 ; i < CC_NUM_SECTIONS ; i++ ) {
+		length += ( counts[i] * cm_sectionSizes[i] + CM_CACHE_ALIGN - 1 ) & ~( CM_CACHE_ALIGN - 1 );
+	}
+
+	data = (byte *) Hunk_AllocateTempMemory( length );
+	Com_Memset( data, 0, length );
+
+	header = (cmCacheHeader_t *)data;
+	header->ident = CM_CACHE_IDENT;
+	header->version = CM_CACHE_VERSION;
+	header->layout = CM_CacheLayout();
+	header->checksum = checksum;
+	header->length = length;
+	header->numSurfaces = cm.numSurfaces;
+	header->numClusters = cm.numClusters;
+	header->clusterBytes = cm.clusterBytes;
+	header->vised = cm.vised;
+	header->numAreas = cm.numAreas;
+
+	length = ( sizeof( *header ) + CM_CACHE_ALIGN - 1 ) & ~( CM_CACHE_ALIGN - 1 );
+	for ( i = 0 ; i < CC_NUM_SECTIONS ; i++ ) {
+		header->sections[i].fileofs = length;
+		header->sections[i].filelen = counts[i] * cm_sectionSizes[i];
+		length += ( header->sections[i].filelen + CM_CACHE_ALIGN - 1 ) & ~( CM_CACHE_ALIGN - 1 );
+	}
+
+	Com_Memcpy( data + header->sections[CC_PLANES].fileofs, cm.planes, header->sections[CC_PLANES].filelen );
+	Com_Memcpy( data + header->sections[CC_LEAFS].fileofs, cm.leafs, header->sections[CC_LEAFS].filelen );
+	Com_Memcpy( data + header->sections[CC_VISIBILITY].fileofs, cm.visibility, header->sections[CC_VISIBILITY].filelen );
+	if ( cm.brushNodes ) {
+		Com_Memcpy( data + header->sections[CC_BRUSHNODES].fileofs, cm.brushNodes, header->sections[CC_BRUSHNODES].filelen );
+		Com_Memcpy( data + header->sections[CC_TREEBRUSHES].fileofs, cm.treeBrushes, header->sections[CC_TREEBRUSHES].filelen );
+	}
+
+	outNode = (cmCacheNode_t *)( data + header->sections[CC_NODES].fileofs );
+	for ( i = 0 ; i < cm.numNodes ; i++, outNode++ ) {
+		outNode->planeNum = cm.nodes[i].plane - cm.planes;
+		outNode->children[0] = cm.nodes[i].children[0];
+		outNode->children[1] = cm.nodes[i].children[1];
+	}
+
+	outSide = (cmCacheBrushSide_t *)( data + header->sections[CC_BRUSHSIDES].fileofs );
+	for ( i = 0 ; i < cm.numBrushSides ; i++, outSide++ ) {
+		outSide->planeNum = cm.brushsides[i].plane - cm.planes;
+		outSide->surfaceFlags = cm.brushsides[i].surfaceFlags;
+		outSide->shaderNum = cm.brushsides[i].shaderNum;
+	}
+
+	outBrush = (cmCacheBrush_t *)( data + header->sections[CC_BRUSHES].fileofs );
+#if idsse
+	outBrushPlanes = (cbrushPlanes_t *)( data + header->sections[CC_BRUSHPLANES].fileofs );
+#endif
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++, outBrush++ ) {
+		outBrush->shaderNum = brush->shaderNum;
+		outBrush->contents = brush->contents;
+		VectorCopy( brush->bounds[0], outBrush->bounds[0] );
+		VectorCopy( brush->bounds[1], outBrush->bounds[1] );
+		outBrush->firstSide = brush->sides - cm.brushsides;
+		outBrush->numSides = brush->numsides;
+#if idsse
+		Com_Memcpy( outBrushPlanes, brush->planes, ( ( brush->numsides + 3 ) >> 2 ) * sizeof( *outBrushPlanes ) );
+		outBrushPlanes += ( brush->numsides + 3 ) >> 2;
+#endif
+	}
+
+	// the submodel brush and surface lists were allocated after the map's,
+	// they go right behind them in the cache
+	outLeafBrushes = (int *)( data + header->sections[CC_LEAFBRUSHES].fileofs );
+	outLeafSurfaces = (int *)( data + header->sections[CC_LEAFSURFACES].fileofs );
+	Com_Memcpy( outLeafBrushes, cm.leafbrushes, cm.numLeafBrushes * sizeof( *outLeafBrushes ) );
+	Com_Memcpy( outLeafSurfaces, cm.leafsurfaces, cm.numLeafSurfaces * sizeof( *outLeafSurfaces ) );
+	numLeafBrushes = cm.numLeafBrushes;
+	numLeafSurfaces = cm.numLeafSurfaces;
+
+	outModel = (cmodel_t *)( data + header->sections[CC_SUBMODELS].fileofs );
+	Com_Memcpy( outModel, cm.cmodels, header->sections[CC_SUBMODELS].filelen );
+	for ( i = 1, model = cm.cmodels + 1, outModel++ ; i < cm.numSubModels ; i++, model++, outModel++ ) {
+		Com_Memcpy( outLeafBrushes + numLeafBrushes, cm.leafbrushes + model->leaf.firstLeafBrush,
+			model->leaf.numLeafBrushes * sizeof( *outLeafBrushes ) );
+		outModel->leaf.firstLeafBrush = numLeafBrushes;
+		numLeafBrushes += model->leaf.numLeafBrushes;
+
+		Com_Memcpy( outLeafSurfaces + numLeafSurfaces, cm.leafsurfaces + model->leaf.firstLeafSurface,
+			model->leaf.numLeafSurfaces * sizeof( *outLeafSurfaces ) );
+		outModel->leaf.firstLeafSurface = numLeafSurfaces;
+		numLeafSurfaces += model->leaf.numLeafSurfaces;
+	}
+
+	outPatch = (cmCachePatch_t *)( data + header->sections[CC_PATCHES].fileofs );
+	outPatchPlanes = (patchPlane_t *)( data + header->sections[CC_PATCHPLANES].fileofs );
+	outFacets = (facet_t *)( data + header->sections[CC_FACETS].fileofs );
+	numPatchPlanes = 0;
+	numFacets = 0;
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		pc = cm.surfaces[i]->pc;
+		outPatch->surfaceNum = i;
+		outPatch->surfaceFlags = cm.surfaces[i]->surfaceFlags;
+		outPatch->contents = cm.surfaces[i]->contents;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			outPatch->bounds[0][j] = pc->bounds[0][j];
+			outPatch->bounds[1][j] = pc->bounds[1][j];
+		}
+		outPatch->firstPlane = numPatchPlanes;
+		outPatch->numPlanes = pc->numPlanes;
+		outPatch->firstFacet = numFacets;
+		outPatch->numFacets = pc->numFacets;
+		Com_Memcpy( outPatchPlanes + numPatchPlanes, pc->planes, pc->numPlanes * sizeof( *outPatchPlanes ) );
+		Com_Memcpy( outFacets + numFacets, pc->facets, pc->numFacets * sizeof( *outFacets ) );
+		numPatchPlanes += pc->numPlanes;
+		numFacets += pc->numFacets;
+		outPatch++;
+	}
+
+	// every process writes its own temp file, and the rename never
+	// leaves a partial file under the real name
+	CM_CachePath( name, checksum, path, sizeof( path ) );
+	Com_sprintf( temp, sizeof( temp ), "%s.%i.tmp", path, Sys_ProcessId() );
+	FS_WriteFile( temp, data, length );
+
+	Hunk_FreeTempMemory( data );
+
+	if ( !FS_ReplaceFile( temp, path ) ) {
+		Com_DPrintf( "Couldn't replace %s\n", path );
+		return;
+	}
+	Com_DPrintf( "Wrote %s, %i bytes\n", path, length );
+}
+
+/*
+=================
+CM_FreeCache
+
+Unmaps the cache of the last map, cm can't point into it any more
+=================
+*/
+void CM_FreeCache( void ) {
+	if ( !cm_cacheView ) {
+		return;
+	}
+	Sys_UnmapFile( cm_cacheView, cm_cacheLength );
+	cm_cacheView = NULL;
+	cm_cacheLength = 0;
+}
@@ -41,19 +41,12 @@ void SetPlaneSignbits (cplane_t *out) {
 }
 #endif //BSPC
 
-// to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
-#define	BOX_LEAFS		2
-#define	BOX_PLANES		12
-
 #define	LL(x) x=LittleLong(x)
 
 
 clipMap_t	cm;
-int			c_pointcontents;
-int			c_traces, c_brush_traces, c_patch_traces;
+QTHREAD int	c_pointcontents;
+QTHREAD int	c_traces, c_brush_traces, c_patch_traces;
 
 
 byte		*cmod_base;
@@ -62,15 +55,20 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_brushTrees;
+cvar_t		*cm_cache;
+static cvar_t	*cm_prefetch;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+// to allow boxes to be treated as brush models, every thread that clips
+// against entity bounds gets its own box hull
+QTHREAD cmodel_t		box_model;
+QTHREAD cbrush_t		box_brush;
+static QTHREAD cbrushside_t	box_sides[6];
+static QTHREAD cplane_t		box_planes[12];
 
 
 
-void	CM_InitBoxHull (void);
 void	CM_FloodAreaConnections (void);
 
 
@@ -224,6 +222,44 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+#if idsse
+/*
+=================
+CMod_LoadBrushPlanes
+
+Copies the sides of every brush into groups of four for the SSE code,
+unused lanes are left zeroed
+=================
+*/
+void CMod_LoadBrushPlanes( void ) {
+	cbrush_t		*b;
+	cbrushPlanes_t	*out;
+	cplane_t		*plane;
+	int				i, j, count;
+
+	count = 0;
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		count += ( b->numsides + 3 ) >> 2;
+	}
+
+	// the hunk only aligns to pointers, and HUNK_DEBUG puts a header
+	// in front, so round up inside a slightly bigger block
+	out = (cbrushPlanes_t *)( ( (intptr_t)Hunk_Alloc( count * sizeof( *out ) + 15, h_high ) + 15 ) & ~(intptr_t)15 );
+
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		b->planes = out;
+		for ( j = 0 ; j < b->numsides ; j++ ) {
+			plane = b->sides[j].plane;
+			out[j>>2].normal[0][j&3] = plane->normal[0];
+			out[j>>2].normal[1][j&3] = plane->normal[1];
+			out[j>>2].normal[2][j&3] = plane->normal[2];
+			out[j>>2].dist[j&3] = plane->dist;
+		}
+		out += ( b->numsides + 3 ) >> 2;
+	}
+}
+#endif
+
 /*
 =================
 CMod_LoadBrushes
@@ -241,7 +277,7 @@ void CMod_LoadBrushes( lump_t *l ) {
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushes = (cbrush_t*) Hunk_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ), h_high );
+	cm.brushes = (cbrush_t*) Hunk_Alloc( count * sizeof( *cm.brushes ), h_high );
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -259,6 +295,9 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+#if idsse
+	CMod_LoadBrushPlanes();
+#endif
 }
 
 /*
@@ -324,7 +363,7 @@ void CMod_LoadPlanes (lump_t *l)
 
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no planes");
-	cm.planes = (cplane_t*) Hunk_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ), h_high );
+	cm.planes = (cplane_t*) Hunk_Alloc( count * sizeof( *cm.planes ), h_high );
 	cm.numPlanes = count;
 
 	out = cm.planes;	
@@ -362,7 +401,7 @@ void CMod_LoadLeafBrushes (lump_t *l)
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof(*in);
 
-	cm.leafbrushes = (int*) Hunk_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
+	cm.leafbrushes = (int*) Hunk_Alloc( count * sizeof( *cm.leafbrushes ), h_high );
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -418,7 +457,7 @@ void CMod_LoadBrushSides (lump_t *l)
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushsides = (cbrushside_t*) Hunk_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ), h_high );
+	cm.brushsides = (cbrushside_t*) Hunk_Alloc( count * sizeof( *cm.brushsides ), h_high );
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;	
@@ -446,6 +485,55 @@ void CMod_LoadEntityString( lump_t *l ) {
 	Com_Memcpy (cm.entityString, cmod_base + l->fileofs, l->filelen);
 }
 
+#ifndef BSPC
+/*
+=================
+CMod_PrefetchAssets
+
+Starts reading the textures, models and sounds the map refers to, so
+they are cached by the time the renderer, sound and cgame ask for them.
+Shaders from scripts can use other images, the guess is the image with
+the shader's name.
+=================
+*/
+void CMod_PrefetchAssets( void ) {
+	int		i;
+	char	*p, *token;
+	char	key[MAX_TOKEN_CHARS];
+
+	for ( i = 0 ; i < cm.numShaders ; i++ ) {
+		if ( !FS_Prefetch( va( "%s.tga", cm.shaders[i].shader ) ) ) {
+			FS_Prefetch( va( "%s.jpg", cm.shaders[i].shader ) );
+		}
+	}
+
+	p = cm.entityString;
+	while ( 1 ) {
+		token = COM_Parse( &p );
+		if ( !token[0] ) {
+			break;
+		}
+		if ( token[0] == '{' || token[0] == '}' ) {
+			continue;
+		}
+		Q_strncpyz( key, token, sizeof( key ) );
+
+		token = COM_Parse( &p );
+		if ( !token[0] ) {
+			break;
+		}
+		// inline models are "*number"
+		if ( token[0] == '*' ) {
+			continue;
+		}
+		if ( !Q_stricmp( key, "model" ) || !Q_stricmp( key, "model2" )
+			|| !Q_stricmp( key, "noise" ) || !Q_stricmp( key, "music" ) ) {
+			FS_Prefetch( token );
+		}
+	}
+}
+#endif
+
 /*
 =================
 CMod_LoadVisibility
@@ -559,6 +647,166 @@ unsigned CM_Checksum(dheader_t *header) {
 	return LittleLong(Com_BlockChecksum(checksums, 11 * 4));
 }
 
+/*
+===============================================================================
+
+BRUSH TREES
+
+Leafs with a lot of detail brushes get a bounding volume hierarchy over
+their brushes, so traces can skip most of them without looking at each
+one.  The tree only decides which brushes are skipped, the rest are still
+tested in leaf brush list order, so the results don't change.
+
+===============================================================================
+*/
+
+static const cLeaf_t	*cm_sortLeaf;
+static int				cm_sortAxis;
+
+/*
+=================
+CM_BrushTreeNodes
+
+Number of nodes a tree over count brushes is going to need
+=================
+*/
+static int CM_BrushTreeNodes( int count ) {
+	if ( count <= TREE_LEAF_BRUSHES ) {
+		return 1;
+	}
+	return 1 + CM_BrushTreeNodes( count >> 1 ) + CM_BrushTreeNodes( count - ( count >> 1 ) );
+}
+
+/*
+=================
+CM_CompareTreeBrushes
+
+Sorts leaf brush list positions by brush center along cm_sortAxis
+=================
+*/
+static int CM_CompareTreeBrushes( const void *a, const void *b ) {
+	const cbrush_t	*ba, *bb;
+	float			ca, cb;
+
+	ba = &cm.brushes[ cm.leafbrushes[ cm_sortLeaf->firstLeafBrush + *(const int *)a ] ];
+	bb = &cm.brushes[ cm.leafbrushes[ cm_sortLeaf->firstLeafBrush + *(const int *)b ] ];
+	ca = ba->bounds[0][cm_sortAxis] + ba->bounds[1][cm_sortAxis];
+	cb = bb->bounds[0][cm_sortAxis] + bb->bounds[1][cm_sortAxis];
+
+	if ( ca != cb ) {
+		return ca < cb ? -1 : 1;
+	}
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+=================
+CM_BuildBrushTree_r
+
+Fills in node for the positions in cm.treeBrushes from first on, and
+returns the next free node
+=================
+*/
+static int CM_BuildBrushTree_r( const cLeaf_t *leaf, int nodeNum, int first, int count, int freeNode ) {
+	cbrushNode_t	*node;
+	cbrush_t		*b;
+	vec3_t			centerMins, centerMaxs, center;
+	int				i, j;
+	int				half;
+
+	node = &cm.brushNodes[nodeNum];
+	ClearBounds( node->bounds[0], node->bounds[1] );
+	ClearBounds( centerMins, centerMaxs );
+	node->contents = 0;
+
+	for ( i = first ; i < first + count ; i++ ) {
+		b = &cm.brushes[ cm.leafbrushes[ leaf->firstLeafBrush + cm.treeBrushes[i] ] ];
+		AddPointToBounds( b->bounds[0], node->bounds[0], node->bounds[1] );
+		AddPointToBounds( b->bounds[1], node->bounds[0], node->bounds[1] );
+		node->contents |= b->contents;
+
+		for ( j = 0 ; j < 3 ; j++ ) {
+			center[j] = ( b->bounds[0][j] + b->bounds[1][j] ) * 0.5f;
+		}
+		AddPointToBounds( center, centerMins, centerMaxs );
+	}
+
+	if ( count <= TREE_LEAF_BRUSHES ) {
+		node->children = 0;
+		node->firstBrush = first;
+		node->numBrushes = count;
+		return freeNode;
+	}
+
+	// split at the median along the axis the centers spread out the most
+	cm_sortAxis = 0;
+	for ( j = 1 ; j < 3 ; j++ ) {
+		if ( centerMaxs[j] - centerMins[j] > centerMaxs[cm_sortAxis] - centerMins[cm_sortAxis] ) {
+			cm_sortAxis = j;
+		}
+	}
+	cm_sortLeaf = leaf;
+	qsort( cm.treeBrushes + first, count, sizeof( *cm.treeBrushes ), CM_CompareTreeBrushes );
+
+	half = count >> 1;
+	node->children = freeNode;
+	node->firstBrush = 0;
+	node->numBrushes = 0;
+	freeNode += 2;
+
+	freeNode = CM_BuildBrushTree_r( leaf, node->children, first, half, freeNode );
+	freeNode = CM_BuildBrushTree_r( leaf, node->children + 1, first + half, count - half, freeNode );
+
+	return freeNode;
+}
+
+/*
+=================
+CM_BuildBrushTrees
+=================
+*/
+void CM_BuildBrushTrees( void ) {
+	cLeaf_t		*leaf;
+	int			i, j;
+	int			numNodes, numBrushes;
+	int			nextNode, nextBrush;
+
+	numNodes = 1;
+	numBrushes = 0;
+	for ( i = 0, leaf = cm.leafs ; i < cm.numLeafs ; i++, leaf++ ) {
+		if ( leaf->numLeafBrushes < MIN_TREE_BRUSHES || leaf->numLeafBrushes > MAX_TREE_BRUSHES ) {
+			continue;
+		}
+		numNodes += CM_BrushTreeNodes( leaf->numLeafBrushes );
+		numBrushes += leaf->numLeafBrushes;
+	}
+	if ( !numBrushes ) {
+		return;
+	}
+
+	cm.brushNodes = (cbrushNode_t *) Hunk_Alloc( numNodes * sizeof( *cm.brushNodes ), h_high );
+	cm.treeBrushes = (int *) Hunk_Alloc( numBrushes * sizeof( *cm.treeBrushes ), h_high );
+	cm.numBrushNodes = numNodes;
+
+	nextNode = 1;
+	nextBrush = 0;
+	for ( i = 0, leaf = cm.leafs ; i < cm.numLeafs ; i++, leaf++ ) {
+		if ( leaf->numLeafBrushes < MIN_TREE_BRUSHES || leaf->numLeafBrushes > MAX_TREE_BRUSHES ) {
+			continue;
+		}
+		for ( j = 0 ; j < leaf->numLeafBrushes ; j++ ) {
+			cm.treeBrushes[nextBrush + j] = j;
+		}
+		leaf->brushTree = nextNode;
+		nextNode = CM_BuildBrushTree_r( leaf, nextNode, nextBrush, leaf->numLeafBrushes, nextNode + 1 );
+		nextBrush += leaf->numLeafBrushes;
+	}
+
+	if ( nextNode != numNodes ) {
+		Com_Error( ERR_DROP, "CM_BuildBrushTrees: used %i of %i nodes", nextNode, numNodes );
+	}
+}
+
 /*
 ==================
 CM_LoadMap
@@ -571,6 +819,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	int				i;
 	dheader_t		header;
 	int				length;
+	qboolean		cached;
 	static unsigned	last_checksum;
 
 	if ( !name || !name[0] ) {
@@ -581,15 +830,27 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_prefetch = Cvar_Get ("cm_prefetch", "1", CVAR_ARCHIVE );
+	cm_brushTrees = Cvar_Get ("cm_brushTrees", "1", CVAR_ARCHIVE );
+	cm_cache = Cvar_Get ("cm_cache", "1", CVAR_ARCHIVE );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
 	if ( !strcmp( cm.name, name ) && clientload ) {
 		*checksum = last_checksum;
+#ifndef BSPC
+		// the server loaded it, the client still wants the assets
+		if ( cm_prefetch->integer && !com_dedicated->integer ) {
+			CMod_PrefetchAssets();
+		}
+#endif
 		return;
 	}
 
 	// free old stuff
+#ifndef BSPC
+	CM_FreeCache();
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
 
@@ -632,25 +893,47 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	// load into heap
 	CMod_LoadShaders( &header.lumps[LUMP_SHADERS] );
-	CMod_LoadLeafs (&header.lumps[LUMP_LEAFS]);
-	CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES]);
-	CMod_LoadLeafSurfaces (&header.lumps[LUMP_LEAFSURFACES]);
-	CMod_LoadPlanes (&header.lumps[LUMP_PLANES]);
-	CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES]);
-	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
-	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
-	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
-	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+#ifndef BSPC
+	// only the client uses the assets
+	if ( clientload && cm_prefetch->integer && !com_dedicated->integer ) {
+		CMod_PrefetchAssets();
+	}
+
+	// the rest comes from the collision cache if it is current
+	cached = CM_LoadCache( name, last_checksum );
+#else
+	cached = qfalse;
+#endif
+	if ( !cached ) {
+		CMod_LoadLeafs (&header.lumps[LUMP_LEAFS]);
+		CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES]);
+		CMod_LoadLeafSurfaces (&header.lumps[LUMP_LEAFSURFACES]);
+		CMod_LoadPlanes (&header.lumps[LUMP_PLANES]);
+		CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES]);
+		CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
+		CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
+		CMod_LoadNodes (&header.lumps[LUMP_NODES]);
+		CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
+		CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	}
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf);
 
-	CM_InitBoxHull ();
-
 	CM_FloodAreaConnections ();
 
+#ifndef BSPC
+	// a cache written with the trees off has none
+	if ( cm_brushTrees->integer && !cm.brushNodes ) {
+		CM_BuildBrushTrees();
+	}
+
+	if ( !cached ) {
+		CM_WriteCache( name, last_checksum );
+	}
+#endif
+
 	// allow this to be cached if it is loaded by the server
 	if ( !clientload ) {
 		Q_strncpyz( cm.name, name, sizeof( cm.name ) );
@@ -663,6 +946,9 @@ CM_ClearMap
 ==================
 */
 void CM_ClearMap( void ) {
+#ifndef BSPC
+	CM_FreeCache();
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
 }
@@ -739,34 +1025,31 @@ CM_InitBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
+The hull does not reference the map, so it is only built once per thread.
+CM_TestInLeaf and friends recognize box_model.leaf and use box_brush
+directly instead of looking it up through cm.leafbrushes.
 ===================
 */
-void CM_InitBoxHull (void)
+static void CM_InitBoxHull (void)
 {
 	int			i;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
 
-	box_planes = &cm.planes[cm.numPlanes];
-
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
+	box_brush.numsides = 6;
+	box_brush.sides = box_sides;
+	box_brush.contents = CONTENTS_BODY;
 
 	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
 
 	for (i=0 ; i<6 ; i++)
 	{
 		side = i&1;
 
 		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane = 	cm.planes + (cm.numPlanes+i*2+side);
+		s = &box_sides[i];
+		s->plane = &box_planes[i*2+side];
 		s->surfaceFlags = 0;
 
 		// planes
@@ -797,6 +1080,10 @@ Capsules are handled differently though.
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
 
+	if ( !box_brush.sides ) {
+		CM_InitBoxHull();
+	}
+
 	VectorCopy( mins, box_model.mins );
 	VectorCopy( maxs, box_model.maxs );
 
@@ -817,8 +1104,8 @@ clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	VectorCopy( mins, box_brush.bounds[0] );
+	VectorCopy( maxs, box_brush.bounds[1] );
 
 	return BOX_MODEL_HANDLE;
 }
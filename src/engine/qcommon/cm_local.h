@@ -28,6 +28,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	BOX_MODEL_HANDLE		255
 #define CAPSULE_MODEL_HANDLE	254
 
+// extra leafs allocated along with those needed by the map
+#define	BOX_LEAFS				2
+
 
 typedef struct {
 	cplane_t	*plane;
@@ -43,6 +46,8 @@ typedef struct {
 
 	int			firstLeafSurface;
 	int			numLeafSurfaces;
+
+	int			brushTree;			// root in cm.brushNodes, 0 if the brushes are tested one by one
 } cLeaf_t;
 
 typedef struct cmodel_s {
@@ -56,18 +61,42 @@ typedef struct {
 	int			shaderNum;
 } cbrushside_t;
 
+#if idsse
+// four brush sides in structure of arrays form, so the SSE code can
+// clip against all of them at once.  CMod_LoadBrushPlanes and the
+// collision cache place them on 16 byte boundaries for _mm_load_ps.
+typedef struct cbrushPlanes_s {
+	float		normal[3][4];
+	float		dist[4];
+} cbrushPlanes_t;
+#endif
+
 typedef struct {
 	int			shaderNum;		// the shader that determined the contents
 	int			contents;
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+#if idsse
+	cbrushPlanes_t	*planes;	// ( numsides + 3 ) / 4 groups, NULL for the box brush
+#endif
 } cbrush_t;
 
 
+// a node of the bounding volume hierarchy over the brushes of a big leaf
+typedef struct {
+	vec3_t		bounds[2];		// of every brush below
+	int			contents;		// ored contents of every brush below
+	int			children;		// first of two consecutive children, 0 for a leaf node
+	int			firstBrush;		// in cm.treeBrushes, leaf nodes only
+	int			numBrushes;
+} cbrushNode_t;
+
+#define	MIN_TREE_BRUSHES	16		// smaller leafs keep the linear loop
+#define	MAX_TREE_BRUSHES	8192	// bigger leafs too, for the size of the marks
+#define	TREE_LEAF_BRUSHES	4
+
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -109,6 +138,10 @@ typedef struct {
 	int			numBrushes;
 	cbrush_t	*brushes;
 
+	int			numBrushNodes;
+	cbrushNode_t	*brushNodes;	// node 0 is unused
+	int			*treeBrushes;		// positions in the leaf brush list, grouped by tree leaf node
+
 	int			numClusters;
 	int			clusterBytes;
 	byte		*visibility;
@@ -125,7 +158,6 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
 } clipMap_t;
 
 
@@ -134,14 +166,38 @@ typedef struct {
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
 extern	clipMap_t	cm;
-extern	int			c_pointcontents;
-extern	int			c_traces, c_brush_traces, c_patch_traces;
+extern	QTHREAD int	c_pointcontents;	// counted per thread, com_showtrace
+extern	QTHREAD int	c_traces, c_brush_traces, c_patch_traces;	// shows the main thread
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_brushTrees;
+extern	cvar_t		*cm_cache;
+
+// the temporary box model is kept per thread, so that traces against
+// entity bounds can run concurrently
+extern	QTHREAD cmodel_t	box_model;
+extern	QTHREAD cbrush_t	box_brush;
 
 // cm_test.c
 
+// brushes and patches that touch several leafs are only tested once per
+// query. The set is kept with the query instead of stamping the map data,
+// so collision can be queried from more than one thread at a time.
+// Once the set fills up new entries are not remembered and may be tested
+// again, which does not change the result of a trace.
+#define	MAX_VISITED			256		// must be a power of two
+#define	MAX_VISITED_COUNT	( MAX_VISITED * 3 / 4 )
+
+typedef struct {
+	int			count;
+	unsigned int	used[MAX_VISITED / 32];
+	int			keys[MAX_VISITED];
+} visitedSet_t;
+
+#define	VISITED_BRUSH( num )	( (num) << 1 )
+#define	VISITED_PATCH( num )	( ( (num) << 1 ) | 1 )
+
 // Used for oriented capsule collision detection
 typedef struct
 {
@@ -164,6 +220,7 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	visitedSet_t	visited;	// brushes and patches already tested
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -174,6 +231,7 @@ typedef struct leafList_s {
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
+	visitedSet_t	visited;	// only used by CM_StoreBrushes
 } leafList_t;
 
 
@@ -184,8 +242,42 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum );
 
 void CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
+static ID_INLINE void CM_ClearVisited( visitedSet_t *visited ) {
+	visited->count = 0;
+	Com_Memset( visited->used, 0, sizeof( visited->used ) );
+}
+
+// returns qtrue if key was already in the set, otherwise adds it
+static ID_INLINE qboolean CM_CheckVisited( visitedSet_t *visited, int key ) {
+	unsigned int	slot;
+
+	slot = ( ( (unsigned int)key * 2654435761U ) >> 16 ) & ( MAX_VISITED - 1 );
+	while ( visited->used[slot >> 5] & ( 1U << ( slot & 31 ) ) ) {
+		if ( visited->keys[slot] == key ) {
+			return qtrue;
+		}
+		slot = ( slot + 1 ) & ( MAX_VISITED - 1 );
+	}
+	if ( visited->count < MAX_VISITED_COUNT ) {
+		visited->used[slot >> 5] |= 1U << ( slot & 31 );
+		visited->keys[slot] = key;
+		visited->count++;
+	}
+	return qfalse;
+}
+
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
 
+// cm_cache.c
+
+qboolean CM_LoadCache( const char *name, int checksum );
+void CM_WriteCache( const char *name, int checksum );
+void CM_FreeCache( void );
+
+// cm_trace.c
+
+void CM_RunParallel( void (*function)( void *data, int index ), void *data, int count, int threads );
+
 // cm_patch.c
 
 struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
@@ -45,6 +45,17 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, int capsule );
+// same results as CM_BoxTrace against the world for each query
+void		CM_BoxTraceBatch( trace_t *results, const traceQuery_t *queries, int count, int threads );
+
+// checks traces done on several threads against a serial run
+void		CM_TraceStress_f( void );
+#if idsse
+// times the SSE brush side tests against the scalar ones
+void		CM_BrushBench_f( void );
+#endif
+// brush tree coverage and brushes tested per trace
+void		CM_BrushTreeStats_f( void );
 
 byte		*CM_ClusterPVS (int cluster);
 
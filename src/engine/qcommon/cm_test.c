@@ -101,10 +101,20 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( CM_CheckVisited( &ll->visited, VISITED_BRUSH( brushnum ) ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		if ( ll->visited.count == MAX_VISITED_COUNT ) {
+			// the set is full, so look through the brushes already stored
+			for ( i = 0 ; i < ll->count ; i++ ) {
+				if ( ((cbrush_t **)ll->list)[i] == b ) {
+					break;
+				}
+			}
+			if ( i != ll->count ) {
+				continue;
+			}
+		}
 		for ( i = 0 ; i < 3 ; i++ ) {
 			if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
 				break;
@@ -172,8 +182,6 @@ CM_BoxLeafnums
 int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -197,8 +205,6 @@ CM_BoxBrushes
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
@@ -207,6 +213,7 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 	ll.storeLeafs = CM_StoreBrushes;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
+	CM_ClearVisited( &ll.visited );
 	
 	CM_BoxLeafnums_r( &ll, 0 );
 
@@ -247,8 +254,12 @@ int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 
 	contents = 0;
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
-		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
+		if ( leaf == &box_model.leaf ) {
+			b = &box_brush;		// the temporary box model isn't part of the map
+		} else {
+			brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
+			b = &cm.brushes[brushnum];
+		}
 
 		// see if the point is in the brush
 		for ( i = 0 ; i < b->numsides ; i++ ) {
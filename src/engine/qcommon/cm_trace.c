@@ -21,6 +21,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#if idsse
+#include <xmmintrin.h>
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -146,6 +150,303 @@ float SquareRootFloat(float number) {
 }
 
 
+#if idsse
+/*
+===============================================================================
+
+SSE BRUSH SIDES
+
+The distances from the trace to four brush sides are computed at once, with
+the same float operations in the same order as the scalar loops, so the
+results don't change.  The few sides a trace actually crosses are still
+handled one at a time.
+
+===============================================================================
+*/
+
+static qboolean	cm_noBrushPlanes;		// only set by cm_brushBench
+
+/*
+================
+CM_BrushPlaneDistances
+
+Distances of the trace start and end to four brush sides, with the plane
+pushed out by the box or capsule size.  end can be NULL.
+================
+*/
+static ID_INLINE void CM_BrushPlaneDistances( const traceWork_t *tw, const cbrushPlanes_t *planes, __m128 *start, __m128 *end ) {
+	__m128	n[3];
+	__m128	dist, t, neg, sel, p[3];
+	__m128	zero;
+	int		i;
+
+	zero = _mm_setzero_ps();
+	n[0] = _mm_load_ps( planes->normal[0] );
+	n[1] = _mm_load_ps( planes->normal[1] );
+	n[2] = _mm_load_ps( planes->normal[2] );
+
+	if ( tw->sphere.use ) {
+		// adjust the plane distance apropriately for radius
+		dist = _mm_add_ps( _mm_load_ps( planes->dist ), _mm_set1_ps( tw->sphere.radius ) );
+
+		// find the closest point on the capsule to the plane
+		t = _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( n[0], _mm_set1_ps( tw->sphere.offset[0] ) ),
+			_mm_mul_ps( n[1], _mm_set1_ps( tw->sphere.offset[1] ) ) ),
+			_mm_mul_ps( n[2], _mm_set1_ps( tw->sphere.offset[2] ) ) );
+		sel = _mm_cmpgt_ps( t, zero );
+
+		for ( i = 0 ; i < 3 ; i++ ) {
+			p[i] = _mm_or_ps(
+				_mm_and_ps( sel, _mm_sub_ps( _mm_set1_ps( tw->start[i] ), _mm_set1_ps( tw->sphere.offset[i] ) ) ),
+				_mm_andnot_ps( sel, _mm_add_ps( _mm_set1_ps( tw->start[i] ), _mm_set1_ps( tw->sphere.offset[i] ) ) ) );
+		}
+		*start = _mm_sub_ps( _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( p[0], n[0] ), _mm_mul_ps( p[1], n[1] ) ), _mm_mul_ps( p[2], n[2] ) ), dist );
+
+		if ( end ) {
+			for ( i = 0 ; i < 3 ; i++ ) {
+				p[i] = _mm_or_ps(
+					_mm_and_ps( sel, _mm_sub_ps( _mm_set1_ps( tw->end[i] ), _mm_set1_ps( tw->sphere.offset[i] ) ) ),
+					_mm_andnot_ps( sel, _mm_add_ps( _mm_set1_ps( tw->end[i] ), _mm_set1_ps( tw->sphere.offset[i] ) ) ) );
+			}
+			*end = _mm_sub_ps( _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( p[0], n[0] ), _mm_mul_ps( p[1], n[1] ) ), _mm_mul_ps( p[2], n[2] ) ), dist );
+		}
+	} else {
+		// adjust the plane distance apropriately for mins/maxs, the
+		// corner is picked by the sign of each axis like signbits
+		for ( i = 0 ; i < 3 ; i++ ) {
+			neg = _mm_cmplt_ps( n[i], zero );
+			p[i] = _mm_or_ps( _mm_and_ps( neg, _mm_set1_ps( tw->size[1][i] ) ),
+				_mm_andnot_ps( neg, _mm_set1_ps( tw->size[0][i] ) ) );
+		}
+		dist = _mm_sub_ps( _mm_load_ps( planes->dist ), _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( p[0], n[0] ), _mm_mul_ps( p[1], n[1] ) ), _mm_mul_ps( p[2], n[2] ) ) );
+
+		*start = _mm_sub_ps( _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( _mm_set1_ps( tw->start[0] ), n[0] ),
+			_mm_mul_ps( _mm_set1_ps( tw->start[1] ), n[1] ) ),
+			_mm_mul_ps( _mm_set1_ps( tw->start[2] ), n[2] ) ), dist );
+
+		if ( end ) {
+			*end = _mm_sub_ps( _mm_add_ps( _mm_add_ps(
+				_mm_mul_ps( _mm_set1_ps( tw->end[0] ), n[0] ),
+				_mm_mul_ps( _mm_set1_ps( tw->end[1] ), n[1] ) ),
+				_mm_mul_ps( _mm_set1_ps( tw->end[2] ), n[2] ) ), dist );
+		}
+	}
+}
+
+/*
+================
+CM_BrushPlaneLanes
+
+Mask of the lanes of a group that hold real brush sides
+================
+*/
+static ID_INLINE int CM_BrushPlaneLanes( const cbrush_t *brush, int first ) {
+	if ( brush->numsides - first >= 4 ) {
+		return 15;
+	}
+	return ( 1 << ( brush->numsides - first ) ) - 1;
+}
+
+/*
+================
+CM_TestBoxInBrushPlanes
+
+Returns qtrue if the start of the trace is behind every side
+================
+*/
+static qboolean CM_TestBoxInBrushPlanes( traceWork_t *tw, cbrush_t *brush ) {
+	const cbrushPlanes_t	*planes;
+	__m128		d1;
+	int			i, lanes;
+
+	// the first six planes are the axial planes, so we only
+	// need to test the remainder
+	for ( i = 4, planes = brush->planes + 1 ; i < brush->numsides ; i += 4, planes++ ) {
+		CM_BrushPlaneDistances( tw, planes, &d1, NULL );
+
+		lanes = CM_BrushPlaneLanes( brush, i );
+		if ( i == 4 ) {
+			lanes &= ~3;
+		}
+
+		// if completely in front of face, no intersection
+		if ( _mm_movemask_ps( _mm_cmpgt_ps( d1, _mm_setzero_ps() ) ) & lanes ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+================
+CM_ClipToBrushPlanes
+
+The plane loop of CM_TraceThroughBrush.  Returns qfalse if the trace is
+completely in front of one of the sides.
+================
+*/
+static qboolean CM_ClipToBrushPlanes( traceWork_t *tw, cbrush_t *brush, float *enterFrac, float *leaveFrac,
+								   cbrushside_t **leadside, qboolean *getout, qboolean *startout ) {
+	const cbrushPlanes_t	*planes;
+	__m128		d1v, d2v, zero, eps;
+	float		d1s[4], d2s[4];
+	float		d1, d2, f;
+	float		enter, leave;
+	int			lead;
+	int			i, j, lanes, front, cross;
+	int			outEnd, outStart;
+
+	zero = _mm_setzero_ps();
+	eps = _mm_set1_ps( SURFACE_CLIP_EPSILON );
+
+	// work on locals, so the compiler knows nothing in tw changes
+	enter = *enterFrac;
+	leave = *leaveFrac;
+	lead = -1;
+	outEnd = outStart = 0;
+
+	for ( i = 0, planes = brush->planes ; i < brush->numsides ; i += 4, planes++ ) {
+		CM_BrushPlaneDistances( tw, planes, &d1v, &d2v );
+		lanes = CM_BrushPlaneLanes( brush, i );
+
+		// if completely in front of face, no intersection with the entire brush
+		front = _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( d1v, zero ),
+			_mm_or_ps( _mm_cmpge_ps( d2v, eps ), _mm_cmpge_ps( d2v, d1v ) ) ) );
+		if ( front & lanes ) {
+			return qfalse;
+		}
+
+		outEnd |= _mm_movemask_ps( _mm_cmpgt_ps( d2v, zero ) ) & lanes;
+		outStart |= _mm_movemask_ps( _mm_cmpgt_ps( d1v, zero ) ) & lanes;
+
+		// if it doesn't cross the plane, the plane isn't relevent
+		cross = _mm_movemask_ps( _mm_or_ps( _mm_cmpnle_ps( d1v, zero ), _mm_cmpnle_ps( d2v, zero ) ) ) & lanes;
+		if ( !cross ) {
+			continue;
+		}
+
+		_mm_storeu_ps( d1s, d1v );
+		_mm_storeu_ps( d2s, d2v );
+		for ( j = 0 ; j < 4 ; j++ ) {
+			if ( !( cross & ( 1 << j ) ) ) {
+				continue;
+			}
+			d1 = d1s[j];
+			d2 = d2s[j];
+
+			// crosses face
+			if (d1 > d2) {	// enter
+				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f < 0 ) {
+					f = 0;
+				}
+				if (f > enter) {
+					enter = f;
+					lead = i + j;
+				}
+			} else {	// leave
+				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+				if ( f > 1 ) {
+					f = 1;
+				}
+				if (f < leave) {
+					leave = f;
+				}
+			}
+		}
+	}
+
+	*enterFrac = enter;
+	*leaveFrac = leave;
+	if ( lead >= 0 ) {
+		*leadside = brush->sides + lead;
+	}
+	if ( outEnd ) {
+		*getout = qtrue;	// endpoint is not in solid
+	}
+	if ( outStart ) {
+		*startout = qtrue;
+	}
+
+	return qtrue;
+}
+#endif
+
+/*
+===============================================================================
+
+BRUSH TREES
+
+===============================================================================
+*/
+
+// a sweep stops SURFACE_CLIP_EPSILON short of a brush, so brushes that just
+// miss the swept bounds can still clip it, this covers that and rounding
+#define	TREE_TRACE_EPSILON	1.0f
+
+static qboolean	cm_noBrushTrees;		// only set by cm_brushTreeStats
+
+/*
+================
+CM_MarkTreeBrushes
+
+Sets the bit of every position in the leaf brush list whose brush comes
+within epsilon of the bounds of the trace and has contents it cares about
+================
+*/
+static void CM_MarkTreeBrushes( const traceWork_t *tw, const cLeaf_t *leaf, float epsilon, unsigned int *marks ) {
+	const cbrushNode_t	*node;
+	const cbrush_t		*b;
+	int					stack[32];
+	int					depth;
+	vec3_t				mins, maxs;
+	int					i, k;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = tw->bounds[0][i] - epsilon;
+		maxs[i] = tw->bounds[1][i] + epsilon;
+	}
+	Com_Memset( marks, 0, ( ( leaf->numLeafBrushes + 31 ) >> 5 ) * sizeof( *marks ) );
+
+	stack[0] = leaf->brushTree;
+	depth = 1;
+	while ( depth ) {
+		node = &cm.brushNodes[ stack[--depth] ];
+
+		if ( !( node->contents & tw->contents ) ) {
+			continue;
+		}
+		if ( node->bounds[0][0] > maxs[0] || node->bounds[1][0] < mins[0]
+			|| node->bounds[0][1] > maxs[1] || node->bounds[1][1] < mins[1]
+			|| node->bounds[0][2] > maxs[2] || node->bounds[1][2] < mins[2] ) {
+			continue;
+		}
+
+		if ( node->children ) {
+			stack[depth++] = node->children;
+			stack[depth++] = node->children + 1;
+			continue;
+		}
+
+		for ( i = 0 ; i < node->numBrushes ; i++ ) {
+			k = cm.treeBrushes[ node->firstBrush + i ];
+			b = &cm.brushes[ cm.leafbrushes[ leaf->firstLeafBrush + k ] ];
+			if ( b->bounds[0][0] > maxs[0] || b->bounds[1][0] < mins[0]
+				|| b->bounds[0][1] > maxs[1] || b->bounds[1][1] < mins[1]
+				|| b->bounds[0][2] > maxs[2] || b->bounds[1][2] < mins[2] ) {
+				continue;
+			}
+			marks[k >> 5] |= 1U << ( k & 31 );
+		}
+	}
+}
+
 /*
 ===============================================================================
 
@@ -183,6 +484,13 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 		return;
 	}
 
+#if idsse
+	if ( brush->planes && !cm_noBrushPlanes ) {
+		if ( !CM_TestBoxInBrushPlanes( tw, brush ) ) {
+			return;
+		}
+	} else
+#endif
    if ( tw->sphere.use ) {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
@@ -243,17 +551,43 @@ CM_TestInLeaf
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
+	unsigned int	treeMarks[MAX_TREE_BRUSHES / 32];
+	unsigned int	*marks;
+
+	if ( leaf == &box_model.leaf ) {
+		// the temporary box model isn't part of the map
+		if ( box_brush.contents & tw->contents ) {
+			CM_TestBoxInBrush( tw, &box_brush );
+		}
+		return;
+	}
+
+	// big leafs have a tree to find the brushes that can be near the trace
+	marks = NULL;
+	if ( leaf->brushTree && !cm_noBrushTrees ) {
+		CM_MarkTreeBrushes( tw, leaf, 0, treeMarks );
+		marks = treeMarks;
+	}
 
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
+		if ( marks ) {
+			if ( !marks[k >> 5] ) {
+				k |= 31;
+				continue;
+			}
+			if ( !( marks[k >> 5] & ( 1U << ( k & 31 ) ) ) ) {
+				continue;	// too far from the trace to touch it
+			}
+		}
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if ( CM_CheckVisited( &tw->visited, VISITED_BRUSH( brushnum ) ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -272,14 +606,14 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
-				continue;	// already checked this brush in another leaf
+			if ( CM_CheckVisited( &tw->visited, VISITED_PATCH( surfnum ) ) ) {
+				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -429,13 +763,9 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
-
 	CM_BoxLeafnums_r( &ll, 0 );
 
 
-	cm.checkcount++;
-
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
 		CM_TestInLeaf( tw, &cm.leafs[leafs[i]] );
@@ -508,6 +838,16 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 	leadside = NULL;
 
+#if idsse
+	if ( brush->planes && !cm_noBrushPlanes ) {
+		if ( !CM_ClipToBrushPlanes( tw, brush, &enterFrac, &leaveFrac, &leadside, &getout, &startout ) ) {
+			return;
+		}
+		if ( leadside ) {
+			clipplane = leadside->plane;
+		}
+	} else
+#endif
 	if ( tw->sphere.use ) {
 		//
 		// compare the trace against all planes of the brush
@@ -666,18 +1006,43 @@ CM_TraceThroughLeaf
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
 	int			brushnum;
+	int			surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
+	unsigned int	treeMarks[MAX_TREE_BRUSHES / 32];
+	unsigned int	*marks;
+
+	if ( leaf == &box_model.leaf ) {
+		// the temporary box model isn't part of the map
+		if ( box_brush.contents & tw->contents ) {
+			CM_TraceThroughBrush( tw, &box_brush );
+		}
+		return;
+	}
+
+	// big leafs have a tree to find the brushes that can be near the trace
+	marks = NULL;
+	if ( leaf->brushTree && !cm_noBrushTrees ) {
+		CM_MarkTreeBrushes( tw, leaf, TREE_TRACE_EPSILON, treeMarks );
+		marks = treeMarks;
+	}
 
 	// trace line against all brushes in the leaf
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
+		if ( marks ) {
+			if ( !marks[k >> 5] ) {
+				k |= 31;
+				continue;
+			}
+			if ( !( marks[k >> 5] & ( 1U << ( k & 31 ) ) ) ) {
+				continue;	// too far from the trace to touch it
+			}
+		}
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
-
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( CM_CheckVisited( &tw->visited, VISITED_BRUSH( brushnum ) ) ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b = &cm.brushes[brushnum];
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -696,14 +1061,14 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( CM_CheckVisited( &tw->visited, VISITED_PATCH( surfnum ) ) ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1143,126 +1508,185 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 
 /*
 ==================
-CM_Trace
+CM_InitTraceWork
+
+Fills in everything about a trace that doesn't depend on what it is
+clipped against
 ==================
 */
-void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
-						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+static void CM_InitTraceWork( traceWork_t *tw, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+						  const vec3_t origin, int brushmask, int capsule, const sphere_t *sphere ) {
 	int			i;
-	traceWork_t	tw;
 	vec3_t		offset;
-	cmodel_t	*cmod;
-
-	cmod = CM_ClipHandleToModel( model );
-
-	cm.checkcount++;		// for multi-check avoidance
-
-	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
-	Com_Memset( &tw, 0, sizeof(tw) );
-	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
-	VectorCopy(origin, tw.modelOrigin);
-
-	if (!cm.numNodes) {
-		*results = tw.trace;
-
-		return;	// map not loaded, shouldn't happen
-	}
-
-	// allow NULL to be passed in for 0,0,0
-	if ( !mins ) {
-		mins = vec3_origin;
-	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
-	}
+	Com_Memset( tw, 0, sizeof(*tw) );
+	tw->trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	VectorCopy(origin, tw->modelOrigin);
 
 	// set basic parms
-	tw.contents = brushmask;
+	tw->contents = brushmask;
 
 	// adjust so that mins and maxs are always symetric, which
 	// avoids some complications with plane expanding of rotated
 	// bmodels
 	for ( i = 0 ; i < 3 ; i++ ) {
 		offset[i] = ( mins[i] + maxs[i] ) * 0.5;
-		tw.size[0][i] = mins[i] - offset[i];
-		tw.size[1][i] = maxs[i] - offset[i];
-		tw.start[i] = start[i] + offset[i];
-		tw.end[i] = end[i] + offset[i];
+		tw->size[0][i] = mins[i] - offset[i];
+		tw->size[1][i] = maxs[i] - offset[i];
+		tw->start[i] = start[i] + offset[i];
+		tw->end[i] = end[i] + offset[i];
 	}
 
 	// if a sphere is already specified
 	if ( sphere ) {
-		tw.sphere = *sphere;
+		tw->sphere = *sphere;
 	}
 	else {
-		tw.sphere.use = (qboolean) capsule;
-		tw.sphere.radius = ( tw.size[1][0] > tw.size[1][2] ) ? tw.size[1][2]: tw.size[1][0];
-		tw.sphere.halfheight = tw.size[1][2];
-		VectorSet( tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius );
+		tw->sphere.use = (qboolean) capsule;
+		tw->sphere.radius = ( tw->size[1][0] > tw->size[1][2] ) ? tw->size[1][2]: tw->size[1][0];
+		tw->sphere.halfheight = tw->size[1][2];
+		VectorSet( tw->sphere.offset, 0, 0, tw->size[1][2] - tw->sphere.radius );
 	}
 
-	tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
+	tw->maxOffset = tw->size[1][0] + tw->size[1][1] + tw->size[1][2];
 
-	// tw.offsets[signbits] = vector to apropriate corner from origin
-	tw.offsets[0][0] = tw.size[0][0];
-	tw.offsets[0][1] = tw.size[0][1];
-	tw.offsets[0][2] = tw.size[0][2];
+	// tw->offsets[signbits] = vector to apropriate corner from origin
+	tw->offsets[0][0] = tw->size[0][0];
+	tw->offsets[0][1] = tw->size[0][1];
+	tw->offsets[0][2] = tw->size[0][2];
 
-	tw.offsets[1][0] = tw.size[1][0];
-	tw.offsets[1][1] = tw.size[0][1];
-	tw.offsets[1][2] = tw.size[0][2];
+	tw->offsets[1][0] = tw->size[1][0];
+	tw->offsets[1][1] = tw->size[0][1];
+	tw->offsets[1][2] = tw->size[0][2];
 
-	tw.offsets[2][0] = tw.size[0][0];
-	tw.offsets[2][1] = tw.size[1][1];
-	tw.offsets[2][2] = tw.size[0][2];
+	tw->offsets[2][0] = tw->size[0][0];
+	tw->offsets[2][1] = tw->size[1][1];
+	tw->offsets[2][2] = tw->size[0][2];
 
-	tw.offsets[3][0] = tw.size[1][0];
-	tw.offsets[3][1] = tw.size[1][1];
-	tw.offsets[3][2] = tw.size[0][2];
+	tw->offsets[3][0] = tw->size[1][0];
+	tw->offsets[3][1] = tw->size[1][1];
+	tw->offsets[3][2] = tw->size[0][2];
 
-	tw.offsets[4][0] = tw.size[0][0];
-	tw.offsets[4][1] = tw.size[0][1];
-	tw.offsets[4][2] = tw.size[1][2];
+	tw->offsets[4][0] = tw->size[0][0];
+	tw->offsets[4][1] = tw->size[0][1];
+	tw->offsets[4][2] = tw->size[1][2];
 
-	tw.offsets[5][0] = tw.size[1][0];
-	tw.offsets[5][1] = tw.size[0][1];
-	tw.offsets[5][2] = tw.size[1][2];
+	tw->offsets[5][0] = tw->size[1][0];
+	tw->offsets[5][1] = tw->size[0][1];
+	tw->offsets[5][2] = tw->size[1][2];
 
-	tw.offsets[6][0] = tw.size[0][0];
-	tw.offsets[6][1] = tw.size[1][1];
-	tw.offsets[6][2] = tw.size[1][2];
+	tw->offsets[6][0] = tw->size[0][0];
+	tw->offsets[6][1] = tw->size[1][1];
+	tw->offsets[6][2] = tw->size[1][2];
 
-	tw.offsets[7][0] = tw.size[1][0];
-	tw.offsets[7][1] = tw.size[1][1];
-	tw.offsets[7][2] = tw.size[1][2];
+	tw->offsets[7][0] = tw->size[1][0];
+	tw->offsets[7][1] = tw->size[1][1];
+	tw->offsets[7][2] = tw->size[1][2];
 
 	//
 	// calculate bounds
 	//
-	if ( tw.sphere.use ) {
+	if ( tw->sphere.use ) {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.end[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->end[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			} else {
-				tw.bounds[0][i] = tw.end[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.start[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+				tw->bounds[0][i] = tw->end[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->start[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			}
 		}
 	}
 	else {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->end[i] + tw->size[1][i];
 			} else {
-				tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
+				tw->bounds[0][i] = tw->end[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->start[i] + tw->size[1][i];
 			}
 		}
 	}
+}
+
+/*
+==================
+CM_InitSweep
+==================
+*/
+static void CM_InitSweep( traceWork_t *tw ) {
+	//
+	// check for point special case
+	//
+	if ( tw->size[0][0] == 0 && tw->size[0][1] == 0 && tw->size[0][2] == 0 ) {
+		tw->isPoint = qtrue;
+		VectorClear( tw->extents );
+	} else {
+		tw->isPoint = qfalse;
+		tw->extents[0] = tw->size[1][0];
+		tw->extents[1] = tw->size[1][1];
+		tw->extents[2] = tw->size[1][2];
+	}
+}
+
+/*
+==================
+CM_FinishTrace
+==================
+*/
+static void CM_FinishTrace( traceWork_t *tw, const vec3_t start, const vec3_t end, trace_t *results ) {
+	int			i;
+
+	// generate endpos from the original, unmodified start/end
+	if ( tw->trace.fraction == 1 ) {
+		VectorCopy (end, tw->trace.endpos);
+	} else {
+		for ( i=0 ; i<3 ; i++ ) {
+			tw->trace.endpos[i] = start[i] + tw->trace.fraction * (end[i] - start[i]);
+		}
+	}
+
+        // If allsolid is set (was entirely inside something solid), the plane is not valid.
+        // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
+        // Otherwise, the normal on the plane should have unit length
+        assert(tw->trace.allsolid ||
+               tw->trace.fraction == 1.0 ||
+               VectorLengthSquared(tw->trace.plane.normal) > 0.9999);
+	*results = tw->trace;
+}
+
+/*
+==================
+CM_Trace
+==================
+*/
+void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+	traceWork_t	tw;
+	cmodel_t	*cmod;
+
+	cmod = CM_ClipHandleToModel( model );
+
+	c_traces++;				// for statistics, may be zeroed
+
+	if (!cm.numNodes) {
+		Com_Memset( results, 0, sizeof( *results ) );
+		results->fraction = 1;
+
+		return;	// map not loaded, shouldn't happen
+	}
+
+	// allow NULL to be passed in for 0,0,0
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	CM_InitTraceWork( &tw, start, end, mins, maxs, origin, brushmask, capsule, sphere );
 
 	//
 	// check for position test special case
@@ -1296,18 +1720,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 			CM_PositionTest( &tw );
 		}
 	} else {
-		//
-		// check for point special case
-		//
-		if ( tw.size[0][0] == 0 && tw.size[0][1] == 0 && tw.size[0][2] == 0 ) {
-			tw.isPoint = qtrue;
-			VectorClear( tw.extents );
-		} else {
-			tw.isPoint = qfalse;
-			tw.extents[0] = tw.size[1][0];
-			tw.extents[1] = tw.size[1][1];
-			tw.extents[2] = tw.size[1][2];
-		}
+		CM_InitSweep( &tw );
 
 		//
 		// general sweeping through world
@@ -1341,22 +1754,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 		}
 	}
 
-	// generate endpos from the original, unmodified start/end
-	if ( tw.trace.fraction == 1 ) {
-		VectorCopy (end, tw.trace.endpos);
-	} else {
-		for ( i=0 ; i<3 ; i++ ) {
-			tw.trace.endpos[i] = start[i] + tw.trace.fraction * (end[i] - start[i]);
-		}
-	}
-
-        // If allsolid is set (was entirely inside something solid), the plane is not valid.
-        // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
-        // Otherwise, the normal on the plane should have unit length
-        assert(tw.trace.allsolid ||
-               tw.trace.fraction == 1.0 ||
-               VectorLengthSquared(tw.trace.plane.normal) > 0.9999);
-	*results = tw.trace;
+	CM_FinishTrace( &tw, start, end, results );
 }
 
 /*
@@ -1469,3 +1867,924 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+#ifndef BSPC
+/*
+===============================================================================
+
+PARALLEL QUERIES
+
+A small pool of worker threads for running independent collision queries.
+Threads are started on first use and kept until the process exits.
+
+===============================================================================
+*/
+
+#define	MAX_CM_THREADS		8
+
+static void		*cm_jobLock;
+static void		*cm_jobWork;
+static void		*cm_jobDone;
+static int		cm_numWorkers;
+
+static void		(*cm_jobFunction)( void *data, int index );
+static void		*cm_jobData;
+static int		cm_jobCount;
+static int		cm_jobNext;
+
+/*
+==================
+CM_RunJobs
+==================
+*/
+static void CM_RunJobs( void ) {
+	int		index;
+
+	while ( 1 ) {
+		Sys_LockMutex( cm_jobLock );
+		index = cm_jobNext++;
+		Sys_UnlockMutex( cm_jobLock );
+
+		if ( index >= cm_jobCount ) {
+			return;
+		}
+		cm_jobFunction( cm_jobData, index );
+	}
+}
+
+/*
+==================
+CM_Worker
+==================
+*/
+static void CM_Worker( void *data ) {
+	while ( 1 ) {
+		Sys_WaitSemaphore( cm_jobWork );
+		CM_RunJobs();
+		Sys_SignalSemaphore( cm_jobDone );
+	}
+}
+
+/*
+==================
+CM_RunParallel
+
+Calls function for every index below count, spread over at most threads
+threads including the calling one.  The function may only do collision
+queries, nothing else in the engine is safe to call from a worker.
+==================
+*/
+void CM_RunParallel( void (*function)( void *data, int index ), void *data, int count, int threads ) {
+	int		i;
+	int		workers;
+
+	workers = threads - 1;
+	if ( workers > MAX_CM_THREADS - 1 ) {
+		workers = MAX_CM_THREADS - 1;
+	}
+	if ( workers > count - 1 ) {
+		workers = count - 1;
+	}
+
+	if ( workers > 0 && !cm_jobLock ) {
+		cm_jobLock = Sys_CreateMutex();
+		cm_jobWork = Sys_CreateSemaphore();
+		cm_jobDone = Sys_CreateSemaphore();
+	}
+	while ( cm_numWorkers < workers ) {
+		if ( !Sys_CreateThread( CM_Worker, NULL ) ) {
+			break;
+		}
+		cm_numWorkers++;
+	}
+	if ( workers > cm_numWorkers ) {
+		workers = cm_numWorkers;
+	}
+
+	if ( workers <= 0 ) {
+		for ( i = 0 ; i < count ; i++ ) {
+			function( data, i );
+		}
+		return;
+	}
+
+	cm_jobFunction = function;
+	cm_jobData = data;
+	cm_jobCount = count;
+	cm_jobNext = 0;
+
+	for ( i = 0 ; i < workers ; i++ ) {
+		Sys_SignalSemaphore( cm_jobWork );
+	}
+	CM_RunJobs();
+	for ( i = 0 ; i < workers ; i++ ) {
+		Sys_WaitSemaphore( cm_jobDone );
+	}
+}
+
+/*
+===============================================================================
+
+BATCHED TRACES
+
+Traces are sorted along a space filling curve and walked down the tree in
+packets, so the nodes near the root are only visited once for a whole
+packet of nearby traces.  Every trace still sees exactly the leafs and
+intercepts it would have seen on its own, in the same order, so the
+results are identical to CM_BoxTrace.
+
+===============================================================================
+*/
+
+#define	TRACE_PACKET		32		// traces walked down the tree together
+#define	TRACE_BATCH_CHUNK	1024	// traces sorted at once
+#define	MAX_TRACE_SEGMENTS	1024
+
+typedef struct {
+	traceWork_t		*tw;
+	float			p1f, p2f;
+	vec3_t			p1, p2;
+} traceSegment_t;
+
+typedef struct {
+	unsigned int	key;
+	int				index;
+} traceOrder_t;
+
+typedef struct {
+	trace_t				*results;
+	const traceQuery_t	*queries;
+	const traceOrder_t	*order;
+	int					count;
+} traceBatch_t;
+
+/*
+==================
+CM_SplitSegment
+
+Cuts a segment at the node crosspoints exactly like CM_TraceThroughTree
+==================
+*/
+static ID_INLINE void CM_SplitSegment( const traceSegment_t *seg, traceSegment_t *nearSeg, traceSegment_t *farSeg, float frac, float frac2 ) {
+	const float	*p1 = seg->p1;
+	const float	*p2 = seg->p2;
+
+	nearSeg->tw = seg->tw;
+	nearSeg->p1f = seg->p1f;
+	nearSeg->p2f = seg->p1f + (seg->p2f - seg->p1f)*frac;
+	VectorCopy( p1, nearSeg->p1 );
+	nearSeg->p2[0] = p1[0] + frac*(p2[0] - p1[0]);
+	nearSeg->p2[1] = p1[1] + frac*(p2[1] - p1[1]);
+	nearSeg->p2[2] = p1[2] + frac*(p2[2] - p1[2]);
+
+	farSeg->tw = seg->tw;
+	farSeg->p1f = seg->p1f + (seg->p2f - seg->p1f)*frac2;
+	farSeg->p2f = seg->p2f;
+	farSeg->p1[0] = p1[0] + frac2*(p2[0] - p1[0]);
+	farSeg->p1[1] = p1[1] + frac2*(p2[1] - p1[1]);
+	farSeg->p1[2] = p1[2] + frac2*(p2[2] - p1[2]);
+	VectorCopy( p2, farSeg->p2 );
+}
+
+/*
+==================
+CM_TraceSegmentsThroughTree
+
+The packet version of CM_TraceThroughTree.  Segments that cross the node
+plane are split the same way, and the children are visited in an order
+that keeps the near piece of every segment ahead of its far piece.
+==================
+*/
+static void CM_TraceSegmentsThroughTree( traceSegment_t *segs, int count, int num, traceSegment_t *free, int numFree ) {
+	cNode_t			*node;
+	cplane_t		*plane;
+	traceSegment_t	*seg, *front, *back, *far;
+	int				numFront, numBack, numFar;
+	traceWork_t		*tw;
+	float			t1, t2, offset;
+	float			frac, frac2;
+	float			idist;
+	int				side;
+	int				i;
+
+	// if < 0, we are in a leaf node
+	if ( num < 0 ) {
+		for ( i = 0, seg = segs ; i < count ; i++, seg++ ) {
+			if ( seg->tw->trace.fraction > seg->p1f ) {
+				CM_TraceThroughLeaf( seg->tw, &cm.leafs[-1-num] );
+			}
+		}
+		return;
+	}
+
+	// once the packet has spread out there is nothing left to share
+	if ( count == 1 || numFree < count * 3 ) {
+		for ( i = 0, seg = segs ; i < count ; i++, seg++ ) {
+			CM_TraceThroughTree( seg->tw, num, seg->p1f, seg->p2f, seg->p1, seg->p2 );
+		}
+		return;
+	}
+
+	node = cm.nodes + num;
+	plane = node->plane;
+
+	// segments for the front child, the back child, and the pieces
+	// of segments that start on the back side and continue in front
+	front = free;
+	back = free + count;
+	far = free + count * 2;
+	numFront = numBack = numFar = 0;
+
+	for ( i = 0, seg = segs ; i < count ; i++, seg++ ) {
+		tw = seg->tw;
+		if ( tw->trace.fraction <= seg->p1f ) {
+			continue;		// already hit something nearer
+		}
+
+		// adjust the plane distance apropriately for mins/maxs
+		if ( plane->type < 3 ) {
+			t1 = seg->p1[plane->type] - plane->dist;
+			t2 = seg->p2[plane->type] - plane->dist;
+			offset = tw->extents[plane->type];
+		} else {
+			t1 = DotProduct (plane->normal, seg->p1) - plane->dist;
+			t2 = DotProduct (plane->normal, seg->p2) - plane->dist;
+			if ( tw->isPoint ) {
+				offset = 0;
+			} else {
+				offset = 2048;
+			}
+		}
+
+		// see which sides we need to consider
+		if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
+			front[numFront++] = *seg;
+			continue;
+		}
+		if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
+			back[numBack++] = *seg;
+			continue;
+		}
+
+		// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+		if ( t1 < t2 ) {
+			idist = 1.0/(t1-t2);
+			side = 1;
+			frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+		} else if (t1 > t2) {
+			idist = 1.0/(t1-t2);
+			side = 0;
+			frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+		} else {
+			side = 0;
+			frac = 1;
+			frac2 = 0;
+		}
+
+		if ( frac < 0 ) {
+			frac = 0;
+		}
+		if ( frac > 1 ) {
+			frac = 1;
+		}
+		if ( frac2 < 0 ) {
+			frac2 = 0;
+		}
+		if ( frac2 > 1 ) {
+			frac2 = 1;
+		}
+
+		// the piece up to the node, and the piece past it
+		if ( side == 0 ) {
+			CM_SplitSegment( seg, &front[numFront++], &back[numBack++], frac, frac2 );
+		} else {
+			CM_SplitSegment( seg, &back[numBack++], &far[numFar++], frac, frac2 );
+		}
+	}
+
+	// pack the lists together so the children get all the free space
+	memmove( free + numFront, back, numBack * sizeof( *back ) );
+	back = free + numFront;
+	memmove( back + numBack, far, numFar * sizeof( *far ) );
+	far = back + numBack;
+
+	free = far + numFar;
+	numFree -= numFront + numBack + numFar;
+
+	if ( numFront ) {
+		CM_TraceSegmentsThroughTree( front, numFront, node->children[0], free, numFree );
+	}
+	if ( numBack ) {
+		CM_TraceSegmentsThroughTree( back, numBack, node->children[1], free, numFree );
+	}
+	if ( numFar ) {
+		CM_TraceSegmentsThroughTree( far, numFar, node->children[0], free, numFree );
+	}
+}
+
+/*
+==================
+CM_TracePacket
+
+Runs one packet of a batch, may be called from a worker thread
+==================
+*/
+static void CM_TracePacket( void *data, int index ) {
+	traceBatch_t		*batch = (traceBatch_t *)data;
+	traceWork_t			work[TRACE_PACKET];
+	traceSegment_t		segments[MAX_TRACE_SEGMENTS];
+	const traceQuery_t	*query;
+	traceWork_t			*tw;
+	int					first, count;
+	int					numSegments;
+	int					i;
+
+	first = index * TRACE_PACKET;
+	count = batch->count - first;
+	if ( count > TRACE_PACKET ) {
+		count = TRACE_PACKET;
+	}
+
+	numSegments = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		query = &batch->queries[ batch->order[first + i].index ];
+		tw = &work[i];
+
+		c_traces++;				// for statistics, may be zeroed
+
+		CM_InitTraceWork( tw, query->start, query->end, query->mins, query->maxs,
+			vec3_origin, query->contentmask, query->capsule, NULL );
+
+		// position tests don't walk the tree
+		if ( VectorCompare( query->start, query->end ) ) {
+			CM_PositionTest( tw );
+			continue;
+		}
+
+		CM_InitSweep( tw );
+
+		segments[numSegments].tw = tw;
+		segments[numSegments].p1f = 0;
+		segments[numSegments].p2f = 1;
+		VectorCopy( tw->start, segments[numSegments].p1 );
+		VectorCopy( tw->end, segments[numSegments].p2 );
+		numSegments++;
+	}
+
+	if ( numSegments ) {
+		CM_TraceSegmentsThroughTree( segments, numSegments, 0,
+			segments + numSegments, MAX_TRACE_SEGMENTS - numSegments );
+	}
+
+	for ( i = 0 ; i < count ; i++ ) {
+		query = &batch->queries[ batch->order[first + i].index ];
+		CM_FinishTrace( &work[i], query->start, query->end, &batch->results[ batch->order[first + i].index ] );
+	}
+}
+
+/*
+==================
+CM_MortonKey
+
+Interleaves the bits of a point quantized to 10 bits per axis
+==================
+*/
+static unsigned int CM_MortonKey( const vec3_t point, const vec3_t mins, const vec3_t scale ) {
+	unsigned int	key;
+	unsigned int	v;
+	int				i, j;
+
+	key = 0;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		j = (int)( ( point[i] - mins[i] ) * scale[i] );
+		if ( j < 0 ) {
+			j = 0;
+		} else if ( j > 1023 ) {
+			j = 1023;
+		}
+		v = j;
+		v = ( v | ( v << 16 ) ) & 0x030000ff;
+		v = ( v | ( v << 8 ) ) & 0x0300f00f;
+		v = ( v | ( v << 4 ) ) & 0x030c30c3;
+		v = ( v | ( v << 2 ) ) & 0x09249249;
+		key |= v << i;
+	}
+
+	return key;
+}
+
+static int CM_CompareTraceOrder( const void *a, const void *b ) {
+	unsigned int	ka = ( (const traceOrder_t *)a )->key;
+	unsigned int	kb = ( (const traceOrder_t *)b )->key;
+
+	if ( ka != kb ) {
+		return ka < kb ? -1 : 1;
+	}
+	return ( (const traceOrder_t *)a )->index - ( (const traceOrder_t *)b )->index;
+}
+
+/*
+==================
+CM_BoxTraceBatch
+
+Traces every query through the world model, the same as calling
+CM_BoxTrace on each of them.  Up to threads threads are used.
+==================
+*/
+void CM_BoxTraceBatch( trace_t *results, const traceQuery_t *queries, int count, int threads ) {
+	traceOrder_t	order[TRACE_BATCH_CHUNK];
+	traceBatch_t	batch;
+	cmodel_t		*world;
+	vec3_t			mid, scale;
+	int				chunk;
+	int				i;
+
+	if ( !cm.numNodes ) {
+		for ( i = 0 ; i < count ; i++ ) {
+			c_traces++;
+			Com_Memset( &results[i], 0, sizeof( results[i] ) );
+			results[i].fraction = 1;
+		}
+		return;	// map not loaded, shouldn't happen
+	}
+
+	world = &cm.cmodels[0];
+	for ( i = 0 ; i < 3 ; i++ ) {
+		if ( world->maxs[i] > world->mins[i] ) {
+			scale[i] = 1024 / ( world->maxs[i] - world->mins[i] );
+		} else {
+			scale[i] = 0;
+		}
+	}
+
+	while ( count > 0 ) {
+		chunk = count;
+		if ( chunk > TRACE_BATCH_CHUNK ) {
+			chunk = TRACE_BATCH_CHUNK;
+		}
+
+		// traces that start close together tend to walk the same nodes
+		for ( i = 0 ; i < chunk ; i++ ) {
+			VectorAdd( queries[i].start, queries[i].end, mid );
+			VectorScale( mid, 0.5f, mid );
+			order[i].key = CM_MortonKey( mid, world->mins, scale );
+			order[i].index = i;
+		}
+		qsort( order, chunk, sizeof( order[0] ), CM_CompareTraceOrder );
+
+		batch.results = results;
+		batch.queries = queries;
+		batch.order = order;
+		batch.count = chunk;
+		CM_RunParallel( CM_TracePacket, &batch, ( chunk + TRACE_PACKET - 1 ) / TRACE_PACKET, threads );
+
+		results += chunk;
+		queries += chunk;
+		count -= chunk;
+	}
+}
+
+/*
+===============================================================================
+
+TRACE STRESS TEST
+
+===============================================================================
+*/
+
+#define	STRESS_BLOCK		64		// queries per job
+#define	STRESS_CONTENTS		( CONTENTS_SOLID | CONTENTS_PLAYERCLIP | CONTENTS_BODY )
+
+typedef enum {
+	STRESS_TRACE,			// box, point or capsule trace through the world
+	STRESS_POSITION,		// position test in the world
+	STRESS_INLINE,			// possibly rotated trace against an inline model
+	STRESS_TEMPBOX,			// trace against a temporary box model
+	STRESS_NUM_TYPES
+} stressType_t;
+
+typedef struct {
+	stressType_t	type;
+	vec3_t			start, end;
+	vec3_t			mins, maxs;
+	clipHandle_t	model;
+	vec3_t			origin, angles;		// inline and temporary box models
+	vec3_t			boxMins, boxMaxs;	// temporary box model
+	int				capsule;
+} stressQuery_t;
+
+typedef struct {
+	trace_t			trace;
+	int				contents;
+} stressResult_t;
+
+typedef struct {
+	int				numQueries;
+	int				numBlocks;
+	stressQuery_t	*queries;
+	stressResult_t	*expected;
+	int				*mismatches;		// [job index]
+} stressJob_t;
+
+/*
+==================
+CM_RandomPoint
+==================
+*/
+static void CM_RandomPoint( int *seed, const vec3_t mins, const vec3_t maxs, vec3_t out ) {
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		out[i] = mins[i] + Q_random( seed ) * ( maxs[i] - mins[i] );
+	}
+}
+
+/*
+==================
+CM_RandomQuery
+==================
+*/
+static void CM_RandomQuery( int *seed, stressQuery_t *q ) {
+	vec3_t		mins, maxs;
+	float		size;
+	int			i;
+
+	Com_Memset( q, 0, sizeof( *q ) );
+
+	q->type = (stressType_t)( ( Q_rand( seed ) & 0x7fff ) % STRESS_NUM_TYPES );
+	if ( q->type == STRESS_INLINE && cm.numSubModels < 2 ) {
+		q->type = STRESS_TRACE;
+	}
+
+	// a third of the queries are point traces
+	if ( ( Q_rand( seed ) & 0x7fff ) % 3 ) {
+		size = 4 + Q_random( seed ) * 28;
+		VectorSet( q->mins, -size, -size, -size * 2 );
+		VectorSet( q->maxs, size, size, size * 2 );
+		q->capsule = Q_rand( seed ) & 1;
+	}
+
+	if ( q->type == STRESS_INLINE ) {
+		q->model = 1 + ( Q_rand( seed ) & 0x7fff ) % ( cm.numSubModels - 1 );
+		VectorCopy( cm.cmodels[q->model].mins, mins );
+		VectorCopy( cm.cmodels[q->model].maxs, maxs );
+		for ( i = 0 ; i < 3 ; i++ ) {
+			q->origin[i] = Q_crandom( seed ) * 32;
+			if ( Q_rand( seed ) & 1 ) {
+				q->angles[i] = Q_random( seed ) * 360;
+			}
+		}
+	} else if ( q->type == STRESS_TEMPBOX ) {
+		VectorCopy( cm.cmodels[0].mins, mins );
+		VectorCopy( cm.cmodels[0].maxs, maxs );
+		CM_RandomPoint( seed, mins, maxs, q->origin );
+		for ( i = 0 ; i < 3 ; i++ ) {
+			q->boxMins[i] = -8 - Q_random( seed ) * 24;
+			q->boxMaxs[i] = 8 + Q_random( seed ) * 24;
+		}
+		VectorCopy( q->origin, mins );
+		VectorCopy( q->origin, maxs );
+	} else {
+		VectorCopy( cm.cmodels[0].mins, mins );
+		VectorCopy( cm.cmodels[0].maxs, maxs );
+	}
+
+	// start somewhere around the model and move up to 1024 units
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] -= 64;
+		maxs[i] += 64;
+	}
+	CM_RandomPoint( seed, mins, maxs, q->start );
+	if ( q->type == STRESS_POSITION ) {
+		VectorCopy( q->start, q->end );
+	} else {
+		for ( i = 0 ; i < 3 ; i++ ) {
+			q->end[i] = q->start[i] + Q_crandom( seed ) * 1024;
+		}
+	}
+}
+
+/*
+==================
+CM_RunQuery
+==================
+*/
+static void CM_RunQuery( const stressQuery_t *q, stressResult_t *result ) {
+	clipHandle_t	model;
+
+	Com_Memset( result, 0, sizeof( *result ) );
+
+	switch ( q->type ) {
+	case STRESS_TRACE:
+	case STRESS_POSITION:
+		CM_BoxTrace( &result->trace, q->start, q->end, (float *)q->mins, (float *)q->maxs,
+			0, STRESS_CONTENTS, q->capsule );
+		result->contents = CM_PointContents( q->end, 0 );
+		break;
+	case STRESS_INLINE:
+		CM_TransformedBoxTrace( &result->trace, q->start, q->end, (float *)q->mins, (float *)q->maxs,
+			q->model, STRESS_CONTENTS, q->origin, q->angles, q->capsule );
+		result->contents = CM_TransformedPointContents( q->end, q->model, q->origin, q->angles );
+		break;
+	default:
+		model = CM_TempBoxModel( q->boxMins, q->boxMaxs, qfalse );
+		CM_TransformedBoxTrace( &result->trace, q->start, q->end, (float *)q->mins, (float *)q->maxs,
+			model, STRESS_CONTENTS, q->origin, vec3_origin, q->capsule );
+		result->contents = CM_TransformedPointContents( q->end, model, q->origin, vec3_origin );
+		break;
+	}
+}
+
+/*
+==================
+CM_StressJob
+==================
+*/
+static void CM_StressJob( void *data, int index ) {
+	stressJob_t		*job;
+	stressResult_t	result;
+	int				i, first, last;
+
+	job = (stressJob_t *)data;
+	first = ( index % job->numBlocks ) * STRESS_BLOCK;
+	last = first + STRESS_BLOCK;
+	if ( last > job->numQueries ) {
+		last = job->numQueries;
+	}
+
+	for ( i = first ; i < last ; i++ ) {
+		CM_RunQuery( &job->queries[i], &result );
+		if ( memcmp( &result, &job->expected[i], sizeof( result ) ) ) {
+			job->mismatches[index]++;
+		}
+	}
+}
+
+/*
+==================
+CM_TraceStress_f
+
+Runs the same random traces, position tests and point contents queries
+against the world, inline models and temporary box models serially and
+then on several threads, and counts the parallel results that differ.
+
+cm_traceStress [queries] [threads] [passes]
+==================
+*/
+void CM_TraceStress_f( void ) {
+	stressJob_t		job;
+	int				numQueries, threads, passes;
+	int				numJobs, mismatches;
+	int				serialMsec, parallelMsec;
+	int				seed;
+	int				i;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "cm_traceStress: no map loaded\n" );
+		return;
+	}
+
+	numQueries = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20000;
+	threads = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : Sys_ProcessorCount();
+	passes = Cmd_Argc() > 3 ? atoi( Cmd_Argv( 3 ) ) : 4;
+	if ( numQueries < 1 ) {
+		numQueries = 1;
+	}
+	if ( threads < 1 ) {
+		threads = 1;
+	} else if ( threads > MAX_CM_THREADS ) {
+		threads = MAX_CM_THREADS;
+	}
+	if ( passes < 1 ) {
+		passes = 1;
+	}
+
+	job.numQueries = numQueries;
+	job.numBlocks = ( numQueries + STRESS_BLOCK - 1 ) / STRESS_BLOCK;
+	numJobs = job.numBlocks * passes;
+	job.queries = (stressQuery_t *)Z_Malloc( numQueries * sizeof( *job.queries ) );
+	job.expected = (stressResult_t *)Z_Malloc( numQueries * sizeof( *job.expected ) );
+	job.mismatches = (int *)Z_Malloc( numJobs * sizeof( *job.mismatches ) );
+
+	seed = 0x5eed;
+	for ( i = 0 ; i < numQueries ; i++ ) {
+		CM_RandomQuery( &seed, &job.queries[i] );
+	}
+
+	serialMsec = Sys_Milliseconds();
+	for ( i = 0 ; i < numQueries ; i++ ) {
+		CM_RunQuery( &job.queries[i], &job.expected[i] );
+	}
+	serialMsec = Sys_Milliseconds() - serialMsec;
+
+	parallelMsec = Sys_Milliseconds();
+	CM_RunParallel( CM_StressJob, &job, numJobs, threads );
+	parallelMsec = Sys_Milliseconds() - parallelMsec;
+
+	mismatches = 0;
+	for ( i = 0 ; i < numJobs ; i++ ) {
+		mismatches += job.mismatches[i];
+	}
+
+	Com_Printf( "%i queries x %i passes on %i threads\n", numQueries, passes, threads );
+	Com_Printf( "serial:   %5i msec per pass\n", serialMsec );
+	Com_Printf( "parallel: %5i msec per pass\n", parallelMsec / passes );
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_RED "%i of %i parallel results differ from the serial run\n",
+			mismatches, numQueries * passes );
+	} else {
+		Com_Printf( "all parallel results match the serial run\n" );
+	}
+
+	Z_Free( job.mismatches );
+	Z_Free( job.expected );
+	Z_Free( job.queries );
+}
+#if idsse
+/*
+==================
+CM_BrushBench_f
+
+Runs the same random queries through the scalar and the SSE brush side
+loops, checks that both give the same results and reports the best time
+of each.
+
+cm_brushBench [queries] [passes]
+==================
+*/
+void CM_BrushBench_f( void ) {
+	stressQuery_t	*queries;
+	stressResult_t	*scalar, *sse;
+	int				numQueries, passes;
+	int				best[2], usec;
+	int				mismatches;
+	int				seed;
+	int				i, pass;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "cm_brushBench: no map loaded\n" );
+		return;
+	}
+
+	numQueries = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20000;
+	passes = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 4;
+	if ( numQueries < 1 ) {
+		numQueries = 1;
+	}
+	if ( passes < 1 ) {
+		passes = 1;
+	}
+
+	queries = (stressQuery_t *)Z_Malloc( numQueries * sizeof( *queries ) );
+	scalar = (stressResult_t *)Z_Malloc( numQueries * sizeof( *scalar ) );
+	sse = (stressResult_t *)Z_Malloc( numQueries * sizeof( *sse ) );
+
+	seed = 0x5eed;
+	for ( i = 0 ; i < numQueries ; i++ ) {
+		CM_RandomQuery( &seed, &queries[i] );
+	}
+
+	best[0] = best[1] = 0x7fffffff;
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		cm_noBrushPlanes = qtrue;
+		usec = Sys_Microseconds();
+		for ( i = 0 ; i < numQueries ; i++ ) {
+			CM_RunQuery( &queries[i], &scalar[i] );
+		}
+		usec = Sys_Microseconds() - usec;
+		if ( usec < best[0] ) {
+			best[0] = usec;
+		}
+
+		cm_noBrushPlanes = qfalse;
+		usec = Sys_Microseconds();
+		for ( i = 0 ; i < numQueries ; i++ ) {
+			CM_RunQuery( &queries[i], &sse[i] );
+		}
+		usec = Sys_Microseconds() - usec;
+		if ( usec < best[1] ) {
+			best[1] = usec;
+		}
+	}
+
+	mismatches = 0;
+	for ( i = 0 ; i < numQueries ; i++ ) {
+		if ( memcmp( &scalar[i], &sse[i], sizeof( scalar[i] ) ) ) {
+			mismatches++;
+		}
+	}
+
+	Com_Printf( "%i queries, best of %i passes\n", numQueries, passes );
+	Com_Printf( "scalar: %8.3f usec per query\n", (float)best[0] / numQueries );
+	Com_Printf( "sse:    %8.3f usec per query\n", (float)best[1] / numQueries );
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_RED "%i of %i sse results differ from the scalar ones\n", mismatches, numQueries );
+	} else {
+		Com_Printf( "all sse results match the scalar ones\n" );
+	}
+
+	Z_Free( sse );
+	Z_Free( scalar );
+	Z_Free( queries );
+}
+#endif
+
+/*
+==================
+CM_BrushTreeStats_f
+
+Prints how much of the map the brush trees cover, then runs the same
+random queries with and without them and reports how many brushes each
+trace had to test.
+
+cm_brushTreeStats [queries]
+==================
+*/
+void CM_BrushTreeStats_f( void ) {
+	stressQuery_t	*queries;
+	stressResult_t	*linear, *tree;
+	cLeaf_t			*leaf;
+	int				numQueries;
+	int				numTrees, treeBrushes, largest;
+	int				tested[2], most[2], usec[2];
+	int				count, mismatches;
+	int				seed;
+	int				i, pass;
+
+	if ( !cm.numNodes ) {
+		Com_Printf( "cm_brushTreeStats: no map loaded\n" );
+		return;
+	}
+
+	numTrees = treeBrushes = largest = 0;
+	for ( i = 0, leaf = cm.leafs ; i < cm.numLeafs ; i++, leaf++ ) {
+		if ( leaf->numLeafBrushes > largest ) {
+			largest = leaf->numLeafBrushes;
+		}
+		if ( leaf->brushTree ) {
+			numTrees++;
+			treeBrushes += leaf->numLeafBrushes;
+		}
+	}
+
+	Com_Printf( "%i leafs, %i leaf brushes, largest leaf has %i\n", cm.numLeafs, cm.numLeafBrushes, largest );
+	Com_Printf( "%i leafs with trees holding %i leaf brushes, %i nodes, %i KB\n", numTrees, treeBrushes,
+		cm.numBrushNodes, (int)( ( cm.numBrushNodes * sizeof( cbrushNode_t ) + treeBrushes * sizeof( int ) ) >> 10 ) );
+	if ( !numTrees ) {
+		return;
+	}
+
+	numQueries = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20000;
+	if ( numQueries < 1 ) {
+		numQueries = 1;
+	}
+
+	queries = (stressQuery_t *)Z_Malloc( numQueries * sizeof( *queries ) );
+	linear = (stressResult_t *)Z_Malloc( numQueries * sizeof( *linear ) );
+	tree = (stressResult_t *)Z_Malloc( numQueries * sizeof( *tree ) );
+
+	seed = 0x5eed;
+	for ( i = 0 ; i < numQueries ; i++ ) {
+		CM_RandomQuery( &seed, &queries[i] );
+	}
+
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		cm_noBrushTrees = (qboolean)!pass;
+		tested[pass] = most[pass] = 0;
+		usec[pass] = Sys_Microseconds();
+		for ( i = 0 ; i < numQueries ; i++ ) {
+			count = c_brush_traces;
+			CM_RunQuery( &queries[i], pass ? &tree[i] : &linear[i] );
+			count = c_brush_traces - count;
+			tested[pass] += count;
+			if ( count > most[pass] ) {
+				most[pass] = count;
+			}
+		}
+		usec[pass] = Sys_Microseconds() - usec[pass];
+	}
+	cm_noBrushTrees = qfalse;
+
+	mismatches = 0;
+	for ( i = 0 ; i < numQueries ; i++ ) {
+		if ( memcmp( &linear[i], &tree[i], sizeof( linear[i] ) ) ) {
+			mismatches++;
+		}
+	}
+
+	Com_Printf( "%i queries       brushes per trace   most   usec per query\n", numQueries );
+	Com_Printf( "without trees: %16.2f %7i %12.3f\n", (float)tested[0] / numQueries, most[0], (float)usec[0] / numQueries );
+	Com_Printf( "with trees:    %16.2f %7i %12.3f\n", (float)tested[1] / numQueries, most[1], (float)usec[1] / numQueries );
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_RED "%i of %i results differ with the trees\n", mismatches, numQueries );
+	} else {
+		Com_Printf( "all results match\n" );
+	}
+
+	Z_Free( tree );
+	Z_Free( linear );
+	Z_Free( queries );
+}
+#endif //BSPC
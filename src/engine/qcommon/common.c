@@ -48,6 +48,8 @@ int demo_protocols[] =
 #define DEF_COMHUNKMEGS "56"
 #define DEF_COMZONEMEGS "16"
 #endif
+#define DEF_COMHUNKRESERVEMEGS "1024"
+#define MAX_COMHUNKRESERVEMEGS 2047
 
 int		com_argc;
 char	*com_argv[MAX_NUM_ARGVS+1];
@@ -719,6 +721,7 @@ all big things are allocated on the hunk.
 
 #define	ZONEID	0x1d4a11
 #define MINFRAGMENT	64
+#define ZONE_MAX_TAGS	(TAG_STATIC+1)
 
 typedef struct zonedebug_s {
 	char *label;
@@ -750,8 +753,363 @@ memzone_t	*mainzone;
 // fragment the main zone (think of cvar and cmd strings)
 memzone_t	*smallzone;
 
+// running totals per tag for the memory telemetry, slab objects included
+static int	zoneTagBytes[ZONE_MAX_TAGS];
+static int	zoneTagBlocks[ZONE_MAX_TAGS];
+static int	zoneTagPeak[ZONE_MAX_TAGS];
+
 void Z_CheckHeap( void );
 
+/*
+========================
+Z_CountAlloc
+========================
+*/
+static ID_INLINE void Z_CountAlloc( int tag, int size ) {
+	if ( tag < ZONE_MAX_TAGS ) {
+		zoneTagBytes[tag] += size;
+		zoneTagBlocks[tag]++;
+		if ( zoneTagBytes[tag] > zoneTagPeak[tag] ) {
+			zoneTagPeak[tag] = zoneTagBytes[tag];
+		}
+	}
+}
+
+/*
+========================
+Z_CountFree
+========================
+*/
+static ID_INLINE void Z_CountFree( int tag, int size, int blocks ) {
+	if ( tag < ZONE_MAX_TAGS ) {
+		zoneTagBytes[tag] -= size;
+		zoneTagBlocks[tag] -= blocks;
+	}
+}
+
+/*
+==============================================================================
+
+						SMALL OBJECT SLABS
+
+Allocations up to ZSLAB_MAX_SIZE bytes (including the trash tester) are
+served from fixed size classes carved out of a separate arena, so the
+constant churn of cvar strings, command strings and small structures
+never reaches the zone block lists.
+
+The arena is split into ZSLAB_PAGE_SIZE pages.  A page holds objects of a
+single size class and a single tag, so Z_FreeTags can release whole pages
+and an object needs no header: the page is found from the address, the
+size class and tag from the page.  Empty pages go back to a common pool
+and can be reused by any class or tag.
+
+Anything too big for a slab, or any allocation made after the arena is
+full, falls back to the zone rover.
+==============================================================================
+*/
+
+#define ZSLAB_ARENA_SIZE	(4*1024*1024)
+#define ZSLAB_PAGE_SIZE		(16*1024)
+#define ZSLAB_PAGES			(ZSLAB_ARENA_SIZE/ZSLAB_PAGE_SIZE)
+#define ZSLAB_MIN_SIZE		16
+#define ZSLAB_MAX_SIZE		512
+#define ZSLAB_MAX_OBJECTS	(ZSLAB_PAGE_SIZE/ZSLAB_MIN_SIZE)
+
+static const int zslabClassSize[] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+#define ZSLAB_CLASSES		ARRAY_LEN( zslabClassSize )
+
+typedef struct zslab_s {
+	struct zslab_s	*next, *prev;	// partial list of the class / tag, or the free pool
+	int			sizeClass;			// -1 if the page is in the free pool
+	int			tag;
+	int			objectSize;
+	int			capacity;
+	int			used;
+	int			carved;				// objects below this have been handed out at least once
+	int			freeHead;			// index of the first free object, -1 if none
+	qboolean	partial;			// linked on zslabPartial
+	unsigned int	inUse[ZSLAB_MAX_OBJECTS/32];
+} zslab_t;
+
+static byte		*zslabBase;
+static zslab_t	zslabPages[ZSLAB_PAGES];
+static zslab_t	*zslabFreePages;
+static zslab_t	*zslabPartial[ZSLAB_CLASSES][ZONE_MAX_TAGS];
+static byte		zslabClassForSize[ZSLAB_MAX_SIZE/ZSLAB_MIN_SIZE+1];
+static int		zslabPagesUsed;
+static qboolean	zslabEnabled;
+
+/*
+========================
+Z_InitSlabs
+========================
+*/
+static void Z_InitSlabs( void ) {
+	int		i, c;
+
+	zslabBase = (byte *) calloc( ZSLAB_ARENA_SIZE, 1 );
+	if ( !zslabBase ) {
+		Com_Error( ERR_FATAL, "Zone slabs failed to allocate %i megs", ZSLAB_ARENA_SIZE / (1024*1024) );
+	}
+
+	c = 0;
+	for ( i = 0 ; i <= ZSLAB_MAX_SIZE/ZSLAB_MIN_SIZE ; i++ ) {
+		while ( zslabClassSize[c] < i * ZSLAB_MIN_SIZE ) {
+			c++;
+		}
+		zslabClassForSize[i] = c;
+	}
+
+	zslabFreePages = NULL;
+	for ( i = ZSLAB_PAGES - 1 ; i >= 0 ; i-- ) {
+		zslabPages[i].sizeClass = -1;
+		zslabPages[i].next = zslabFreePages;
+		zslabFreePages = &zslabPages[i];
+	}
+	zslabPagesUsed = 0;
+	zslabEnabled = qtrue;
+}
+
+/*
+========================
+Z_IsSlabPointer
+========================
+*/
+static ID_INLINE qboolean Z_IsSlabPointer( const void *ptr ) {
+	return (qboolean)( (const byte *)ptr >= zslabBase && (const byte *)ptr < zslabBase + ZSLAB_ARENA_SIZE );
+}
+
+/*
+========================
+Z_SlabUnlink
+========================
+*/
+static void Z_SlabUnlink( zslab_t *page ) {
+	if ( page->prev ) {
+		page->prev->next = page->next;
+	} else {
+		zslabPartial[page->sizeClass][page->tag] = page->next;
+	}
+	if ( page->next ) {
+		page->next->prev = page->prev;
+	}
+	page->next = page->prev = NULL;
+	page->partial = qfalse;
+}
+
+/*
+========================
+Z_SlabLink
+========================
+*/
+static void Z_SlabLink( zslab_t *page ) {
+	page->prev = NULL;
+	page->next = zslabPartial[page->sizeClass][page->tag];
+	if ( page->next ) {
+		page->next->prev = page;
+	}
+	zslabPartial[page->sizeClass][page->tag] = page;
+	page->partial = qtrue;
+}
+
+/*
+========================
+Z_SlabReleasePage
+
+Returns an empty page to the free pool
+========================
+*/
+static void Z_SlabReleasePage( zslab_t *page ) {
+	if ( page->partial ) {
+		Z_SlabUnlink( page );
+	}
+	Com_Memset( page->inUse, 0, sizeof( page->inUse ) );
+	page->sizeClass = -1;
+	page->used = 0;
+	page->next = zslabFreePages;
+	zslabFreePages = page;
+	zslabPagesUsed--;
+}
+
+/*
+========================
+Z_SlabAlloc
+
+Returns NULL if the request has to go to the zone instead
+========================
+*/
+static void *Z_SlabAlloc( int size, int tag ) {
+	zslab_t	*page;
+	byte	*obj;
+	int		c, index;
+
+	size += 4;		// space for memory trash tester
+	if ( !zslabEnabled || size > ZSLAB_MAX_SIZE || tag >= ZONE_MAX_TAGS ) {
+		return NULL;
+	}
+	c = zslabClassForSize[( size + ZSLAB_MIN_SIZE - 1 ) / ZSLAB_MIN_SIZE];
+
+	page = zslabPartial[c][tag];
+	if ( !page ) {
+		page = zslabFreePages;
+		if ( !page ) {
+			return NULL;
+		}
+		zslabFreePages = page->next;
+		zslabPagesUsed++;
+
+		page->sizeClass = c;
+		page->tag = tag;
+		page->objectSize = zslabClassSize[c];
+		page->capacity = ZSLAB_PAGE_SIZE / page->objectSize;
+		page->used = 0;
+		page->carved = 0;
+		page->freeHead = -1;
+		Z_SlabLink( page );
+	}
+
+	obj = zslabBase + ( page - zslabPages ) * ZSLAB_PAGE_SIZE;
+	if ( page->freeHead >= 0 ) {
+		index = page->freeHead;
+		obj += index * page->objectSize;
+		page->freeHead = *(int *)obj;
+	} else {
+		index = page->carved++;
+		obj += index * page->objectSize;
+	}
+
+	page->inUse[index >> 5] |= 1u << ( index & 31 );
+	if ( ++page->used == page->capacity ) {
+		Z_SlabUnlink( page );
+	}
+
+	// marker for memory trash testing
+	*(int *)( obj + page->objectSize - 4 ) = ZONEID;
+
+	Z_CountAlloc( tag, page->objectSize );
+
+	return obj;
+}
+
+/*
+========================
+Z_SlabFree
+========================
+*/
+static void Z_SlabFree( void *ptr ) {
+	zslab_t	*page;
+	byte	*obj;
+	int		offset, index;
+
+	offset = (int)( (byte *)ptr - zslabBase );
+	page = &zslabPages[offset / ZSLAB_PAGE_SIZE];
+	offset &= ZSLAB_PAGE_SIZE - 1;
+
+	if ( page->sizeClass < 0 || offset % page->objectSize ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
+	}
+	index = offset / page->objectSize;
+	if ( !( page->inUse[index >> 5] & ( 1u << ( index & 31 ) ) ) ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
+	}
+
+	obj = (byte *)ptr;
+	if ( *(int *)( obj + page->objectSize - 4 ) != ZONEID ) {
+		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
+	}
+
+	Z_CountFree( page->tag, page->objectSize, 1 );
+
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset( obj, 0xaa, page->objectSize );
+
+	page->inUse[index >> 5] &= ~( 1u << ( index & 31 ) );
+	if ( --page->used == 0 ) {
+		Z_SlabReleasePage( page );
+		return;
+	}
+
+	*(int *)obj = page->freeHead;
+	page->freeHead = index;
+	if ( !page->partial ) {
+		Z_SlabLink( page );
+	}
+}
+
+/*
+========================
+Z_SlabFreeTags
+========================
+*/
+static void Z_SlabFreeTags( int tag ) {
+	zslab_t	*page;
+	int		i;
+
+	for ( i = 0, page = zslabPages ; i < ZSLAB_PAGES ; i++, page++ ) {
+		if ( page->sizeClass >= 0 && page->tag == tag ) {
+			Z_CountFree( tag, page->used * page->objectSize, page->used );
+			Com_Memset( zslabBase + i * ZSLAB_PAGE_SIZE, 0xaa, ZSLAB_PAGE_SIZE );
+			Z_SlabReleasePage( page );
+		}
+	}
+}
+
+/*
+========================
+Z_CheckSlabs
+========================
+*/
+static void Z_CheckSlabs( void ) {
+	zslab_t	*page;
+	int		i, j, count;
+	unsigned int bits;
+
+	for ( i = 0, page = zslabPages ; i < ZSLAB_PAGES ; i++, page++ ) {
+		count = 0;
+		for ( j = 0 ; j < ZSLAB_MAX_OBJECTS/32 ; j++ ) {
+			for ( bits = page->inUse[j] ; bits ; bits &= bits - 1 ) {
+				count++;
+			}
+		}
+		if ( page->sizeClass < 0 ) {
+			if ( count ) {
+				Com_Error( ERR_FATAL, "Z_CheckHeap: free slab page has objects in use\n" );
+			}
+			continue;
+		}
+		if ( count != page->used ) {
+			Com_Error( ERR_FATAL, "Z_CheckHeap: slab page use count is wrong\n" );
+		}
+		if ( page->partial != ( page->used < page->capacity ) ) {
+			Com_Error( ERR_FATAL, "Z_CheckHeap: slab page is on the wrong list\n" );
+		}
+	}
+}
+
+/*
+========================
+Z_SlabStats
+
+Bytes of objects in use per tag, and the number of objects
+========================
+*/
+static int Z_SlabStats( int tagBytes[ZONE_MAX_TAGS], int *pageBytes ) {
+	zslab_t	*page;
+	int		i, objects;
+
+	Com_Memset( tagBytes, 0, ZONE_MAX_TAGS * sizeof( tagBytes[0] ) );
+	objects = 0;
+	for ( i = 0, page = zslabPages ; i < ZSLAB_PAGES ; i++, page++ ) {
+		if ( page->sizeClass >= 0 ) {
+			tagBytes[page->tag] += page->used * page->objectSize;
+			objects += page->used;
+		}
+	}
+	*pageBytes = zslabPagesUsed * ZSLAB_PAGE_SIZE;
+	return objects;
+}
+
 /*
 ========================
 Z_ClearZone
@@ -786,6 +1144,28 @@ int Z_AvailableZoneMemory( memzone_t *zone ) {
 	return zone->size - zone->used;
 }
 
+/*
+========================
+Z_ZoneFragmentation
+
+Free space left in the zone and how badly it is split up
+========================
+*/
+static void Z_ZoneFragmentation( memzone_t *zone, int *freeBytes, int *freeBlocks, int *largest ) {
+	memblock_t	*block;
+
+	*freeBytes = *freeBlocks = *largest = 0;
+	for ( block = zone->blocklist.next ; block != &zone->blocklist ; block = block->next ) {
+		if ( !block->tag ) {
+			*freeBytes += block->size;
+			(*freeBlocks)++;
+			if ( block->size > *largest ) {
+				*largest = block->size;
+			}
+		}
+	}
+}
+
 /*
 ========================
 Z_AvailableMemory
@@ -808,6 +1188,11 @@ void Z_Free( void *ptr ) {
 		Com_Error( ERR_DROP, "Z_Free: NULL pointer" );
 	}
 
+	if ( Z_IsSlabPointer( ptr ) ) {
+		Z_SlabFree( ptr );
+		return;
+	}
+
 	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
 	if (block->id != ZONEID) {
 		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
@@ -833,6 +1218,7 @@ void Z_Free( void *ptr ) {
 	}
 
 	zone->used -= block->size;
+	Z_CountFree( block->tag, block->size, 1 );
 	// set the block to something that should cause problems
 	// if it is referenced...
 	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
@@ -875,6 +1261,8 @@ void Z_FreeTags( int tag ) {
 	int			count;
 	memzone_t	*zone;
 
+	Z_SlabFreeTags( tag );
+
 	if ( tag == TAG_SMALL ) {
 		zone = smallzone;
 	}
@@ -914,6 +1302,14 @@ void *Z_TagMalloc( int size, int tag ) {
 		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag" );
 	}
 
+#ifndef ZONE_DEBUG
+	// zonelog needs the debug header, so debug builds keep everything in the zone
+	base = (memblock_t *) Z_SlabAlloc( size, tag );
+	if ( base ) {
+		return base;
+	}
+#endif
+
 	if ( tag == TAG_SMALL ) {
 		zone = smallzone;
 	}
@@ -971,6 +1367,7 @@ void *Z_TagMalloc( int size, int tag ) {
 	
 	zone->rover = base->next;	// next allocation will start looking here
 	zone->used += base->size;	//
+	Z_CountAlloc( tag, base->size );
 	
 	base->id = ZONEID;
 
@@ -1028,6 +1425,8 @@ Z_CheckHeap
 */
 void Z_CheckHeap( void ) {
 	memblock_t	*block;
+
+	Z_CheckSlabs();
 	
 	for (block = mainzone->blocklist.next ; ; block = block->next) {
 		if (block->next == &mainzone->blocklist) {
@@ -1164,6 +1563,11 @@ Goals:
 
   Single block of memory with stack allocators coming from both ends towards the middle.
 
+  The block is only reserved address space.  Each end is committed in
+  HUNK_COMMIT_CHUNK steps as the allocators grow into it, and given back
+  to the system when the hunk is cleared, so the resident size follows
+  what the current map actually uses.
+
   One side is designated the temporary memory allocator.
 
   Temporary memory can be allocated and freed in any order.
@@ -1219,10 +1623,28 @@ static	hunkUsed_t	*hunk_permanent, *hunk_temp;
 
 static	byte	*s_hunkData = NULL;
 static	int		s_hunkTotal;
+static	int		s_hunkLowCommit, s_hunkHighCommit;	// committed bytes at each end, may overlap
+static	int		s_hunkPeak;			// most in use since the last Hunk_Clear
+
+#define	HUNK_COMMIT_CHUNK	(1024*1024)
 
 static	int		s_zoneTotal;
 static	int		s_smallZoneTotal;
 
+/*
+====================
+Hunk_Committed
+
+Bytes of the hunk backed by memory, counting an overlap of the ends once
+====================
+*/
+static int Hunk_Committed( void ) {
+	int		overlap;
+
+	overlap = s_hunkLowCommit + s_hunkHighCommit - s_hunkTotal;
+	return s_hunkLowCommit + s_hunkHighCommit - ( overlap > 0 ? overlap : 0 );
+}
+
 
 /*
 =================
@@ -1235,6 +1657,9 @@ void Com_Meminfo_f( void ) {
 	int			smallZoneBytes, smallZoneBlocks;
 	int			botlibBytes, rendererBytes;
 	int			unused;
+	int			slabBytes[ZONE_MAX_TAGS], slabPageBytes, slabObjects, slabTotal;
+	int			freeBytes, freeBlocks, largest;
+	int			i, j, pages, objects;
 
 	zoneBytes = 0;
 	botlibBytes = 0;
@@ -1283,6 +1708,7 @@ void Com_Meminfo_f( void ) {
 	}
 
 	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
+	Com_Printf( "%8i bytes committed hunk\n", Hunk_Committed() );
 	Com_Printf( "%8i bytes total zone\n", s_zoneTotal );
 	Com_Printf( "\n" );
 	Com_Printf( "%8i low mark\n", hunk_low.mark );
@@ -1314,6 +1740,40 @@ void Com_Meminfo_f( void ) {
 	Com_Printf( "        %8i bytes in dynamic renderer\n", rendererBytes );
 	Com_Printf( "        %8i bytes in dynamic other\n", zoneBytes - ( botlibBytes + rendererBytes ) );
 	Com_Printf( "        %8i bytes in small Zone memory\n", smallZoneBytes );
+
+	slabObjects = Z_SlabStats( slabBytes, &slabPageBytes );
+	slabTotal = 0;
+	for ( i = 0 ; i < ZONE_MAX_TAGS ; i++ ) {
+		slabTotal += slabBytes[i];
+	}
+	Com_Printf( "\n" );
+	Com_Printf( "%8i bytes in %i slab objects\n", slabTotal, slabObjects );
+	Com_Printf( "        %8i bytes in slab botlib\n", slabBytes[TAG_BOTLIB] );
+	Com_Printf( "        %8i bytes in slab renderer\n", slabBytes[TAG_RENDERER] );
+	Com_Printf( "        %8i bytes in slab small\n", slabBytes[TAG_SMALL] );
+	Com_Printf( "        %8i bytes in slab other\n", slabTotal - ( slabBytes[TAG_BOTLIB] + slabBytes[TAG_RENDERER] + slabBytes[TAG_SMALL] ) );
+	Com_Printf( "%8i bytes in %i of %i slab pages (%i unused)\n", slabPageBytes, zslabPagesUsed, ZSLAB_PAGES, slabPageBytes - slabTotal );
+	if ( Cmd_Argc() != 1 ) {
+		for ( i = 0 ; i < ZSLAB_CLASSES ; i++ ) {
+			pages = objects = 0;
+			for ( j = 0 ; j < ZSLAB_PAGES ; j++ ) {
+				if ( zslabPages[j].sizeClass == i ) {
+					pages++;
+					objects += zslabPages[j].used;
+				}
+			}
+			Com_Printf( "class:%4i    pages:%4i    objects:%6i of %6i\n",
+				zslabClassSize[i], pages, objects, pages * ( ZSLAB_PAGE_SIZE / zslabClassSize[i] ) );
+		}
+	}
+
+	Com_Printf( "\n" );
+	Z_ZoneFragmentation( mainzone, &freeBytes, &freeBlocks, &largest );
+	Com_Printf( "%8i bytes free in %i main zone fragments, largest %i (%i%% fragmented)\n",
+		freeBytes, freeBlocks, largest, freeBytes ? 100 - (int)( (double)largest * 100 / freeBytes ) : 0 );
+	Z_ZoneFragmentation( smallzone, &freeBytes, &freeBlocks, &largest );
+	Com_Printf( "%8i bytes free in %i small zone fragments, largest %i (%i%% fragmented)\n",
+		freeBytes, freeBlocks, largest, freeBytes ? 100 - (int)( (double)largest * 100 / freeBytes ) : 0 );
 }
 
 /*
@@ -1358,12 +1818,420 @@ void Com_TouchMemory( void ) {
 		}
 	}
 
+	for ( i = 0 ; i < ZSLAB_PAGES ; i++ ) {
+		if ( zslabPages[i].sizeClass >= 0 ) {
+			for ( j = 0 ; j < ZSLAB_PAGE_SIZE >> 2 ; j += 64 ) {
+				sum += ((int *)( zslabBase + i * ZSLAB_PAGE_SIZE ))[j];
+			}
+		}
+	}
+
 	end = Sys_Milliseconds();
 
 	Com_Printf( "Com_TouchMemory: %i msec\n", end - start );
 }
 
+/*
+=================
+Com_ZoneChurn
+
+Allocates and frees random sized blocks the way cvar and string
+handling does over a long session, and returns the elapsed usec
+=================
+*/
+#define ZONEBENCH_SLOTS	2048
+
+static int Com_ZoneChurn( int iterations, int *freeBlocks, int *largest ) {
+	void			*slots[ZONEBENCH_SLOTS];
+	unsigned int	seed;
+	int				i, r, slot, size, start, usec, freeBytes;
+
+	Com_Memset( slots, 0, sizeof( slots ) );
+	seed = 0x1d4a11;
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < iterations ; i++ ) {
+		seed = seed * 1664525 + 1013904223;
+		r = seed >> 8;
+		slot = r % ZONEBENCH_SLOTS;
+		if ( slots[slot] ) {
+			Z_Free( slots[slot] );
+			slots[slot] = NULL;
+			continue;
+		}
+		// mostly short strings, some structures, the odd big block
+		r >>= 11;
+		if ( ( r & 15 ) < 11 ) {
+			size = 4 + ( r >> 4 ) % 60;
+		} else if ( ( r & 15 ) < 15 ) {
+			size = 64 + ( r >> 4 ) % 400;
+		} else {
+			size = 512 + ( r >> 4 ) % 4096;
+		}
+		slots[slot] = Z_TagMalloc( size, TAG_GENERAL );
+	}
+	usec = Sys_Microseconds() - start;
+
+	Z_ZoneFragmentation( mainzone, &freeBytes, freeBlocks, largest );
+
+	for ( i = 0 ; i < ZONEBENCH_SLOTS ; i++ ) {
+		if ( slots[i] ) {
+			Z_Free( slots[i] );
+		}
+	}
+	return usec;
+}
+
+/*
+=================
+Com_ZoneBench_f
+
+zonebench [iterations]
+=================
+*/
+void Com_ZoneBench_f( void ) {
+	int			iterations, usec, freeBlocks, largest;
+	qboolean	enabled;
+
+	iterations = 1000000;
+	if ( Cmd_Argc() > 1 ) {
+		iterations = atoi( Cmd_Argv( 1 ) );
+		if ( iterations < 1 ) {
+			iterations = 1;
+		}
+	}
+
+	enabled = zslabEnabled;
+
+	zslabEnabled = qtrue;
+	usec = Com_ZoneChurn( iterations, &freeBlocks, &largest );
+	Com_Printf( "slabs:   %8i usec, %6.1f nsec per call, %i main zone fragments, largest %i\n",
+		usec, usec * 1000.0 / iterations, freeBlocks, largest );
+
+	zslabEnabled = qfalse;
+	usec = Com_ZoneChurn( iterations, &freeBlocks, &largest );
+	Com_Printf( "zone:    %8i usec, %6.1f nsec per call, %i main zone fragments, largest %i\n",
+		usec, usec * 1000.0 / iterations, freeBlocks, largest );
+
+	zslabEnabled = enabled;
+}
+
+
+
+/*
+==============================================================================
+
+						MEMORY TELEMETRY
+
+meminfo_json writes one line of JSON describing the zone, hunk, botlib and
+renderer pools.  Everything comes from running counters or short walks,
+so com_memDump can stay on in production and chart memory per map.
+Per-label totals are only there in ZONE_DEBUG and HUNK_DEBUG builds.
+==============================================================================
+*/
+
+#define	MEMJSON_SIZE		0x10000
+#define	MEMJSON_MAX_LABELS	512
+
+static char		memJson[MEMJSON_SIZE];
+static int		memJsonLength;
+
+static cvar_t	*com_memDump;
+static cvar_t	*com_memDumpFile;
+static int		com_memDumpTime;
+
+static const char *memTagNames[ZONE_MAX_TAGS] = {
+	"free", "general", "botlib", "renderer", "small", "static"
+};
+
+#ifndef DEDICATED
+qboolean CL_RendererMemoryStats( int *images, int *imageTexels, int *usedImageTexels, int *models, int *modelBytes );
+#endif
+void SV_BotLibMemoryStats( int *allocated, int *blocks );
+
+/*
+=================
+Com_MemJsonPrintf
+=================
+*/
+static void QDECL Com_MemJsonPrintf( const char *fmt, ... ) {
+	va_list		argptr;
+	int			len;
+
+	va_start( argptr, fmt );
+	len = Q_vsnprintf( memJson + memJsonLength, MEMJSON_SIZE - memJsonLength, fmt, argptr );
+	va_end( argptr );
+
+	if ( len < 0 || memJsonLength + len >= MEMJSON_SIZE ) {
+		memJsonLength = MEMJSON_SIZE - 1;	// truncated, the reader will reject it
+	} else {
+		memJsonLength += len;
+	}
+}
+
+/*
+=================
+Com_MemJsonString
+=================
+*/
+static void Com_MemJsonString( const char *s ) {
+	Com_MemJsonPrintf( "\"" );
+	for ( ; s && *s ; s++ ) {
+		if ( *s == '"' || *s == '\\' ) {
+			Com_MemJsonPrintf( "\\%c", *s );
+		} else if ( (unsigned char)*s < ' ' ) {
+			Com_MemJsonPrintf( "\\u%04x", (unsigned char)*s );
+		} else {
+			Com_MemJsonPrintf( "%c", *s );
+		}
+	}
+	Com_MemJsonPrintf( "\"" );
+}
+
+#if defined( ZONE_DEBUG ) || defined( HUNK_DEBUG )
+typedef struct {
+	const char	*pool;
+	const char	*label;
+	const char	*file;
+	int			line;
+	int			bytes;
+	int			count;
+} memLabel_t;
+
+static memLabel_t	memLabels[MEMJSON_MAX_LABELS];
+static int			numMemLabels;
+
+/*
+=================
+Com_MemJsonAddLabel
+=================
+*/
+static void Com_MemJsonAddLabel( const char *pool, const char *label, const char *file, int line, int bytes ) {
+	memLabel_t	*l;
+	int			i;
+
+	for ( i = 0, l = memLabels ; i < numMemLabels ; i++, l++ ) {
+		if ( l->pool == pool && l->line == line && !strcmp( l->file, file ) && !strcmp( l->label, label ) ) {
+			break;
+		}
+	}
+	if ( i == numMemLabels ) {
+		if ( numMemLabels == MEMJSON_MAX_LABELS ) {
+			return;
+		}
+		numMemLabels++;
+		l->pool = pool;
+		l->label = label;
+		l->file = file;
+		l->line = line;
+		l->bytes = l->count = 0;
+	}
+	l->bytes += bytes;
+	l->count++;
+}
+
+/*
+=================
+Com_MemJsonLabels
+=================
+*/
+static void Com_MemJsonLabels( void ) {
+	int			i;
+
+	numMemLabels = 0;
+#ifdef ZONE_DEBUG
+	{
+		memblock_t	*block;
+
+		for ( block = mainzone->blocklist.next ; block != &mainzone->blocklist ; block = block->next ) {
+			if ( block->tag ) {
+				Com_MemJsonAddLabel( "zone", block->d.label, block->d.file, block->d.line, block->d.allocSize );
+			}
+		}
+		for ( block = smallzone->blocklist.next ; block != &smallzone->blocklist ; block = block->next ) {
+			if ( block->tag ) {
+				Com_MemJsonAddLabel( "small", block->d.label, block->d.file, block->d.line, block->d.allocSize );
+			}
+		}
+	}
+#endif
+#ifdef HUNK_DEBUG
+	{
+		hunkblock_t	*block;
+
+		for ( block = hunkblocks ; block ; block = block->next ) {
+			Com_MemJsonAddLabel( "hunk", block->label, block->file, block->line, block->size );
+		}
+	}
+#endif
+
+	Com_MemJsonPrintf( ",\"labels\":[" );
+	for ( i = 0 ; i < numMemLabels ; i++ ) {
+		Com_MemJsonPrintf( "%s{\"pool\":\"%s\",\"label\":", i ? "," : "", memLabels[i].pool );
+		Com_MemJsonString( memLabels[i].label );
+		Com_MemJsonPrintf( ",\"file\":" );
+		Com_MemJsonString( memLabels[i].file );
+		Com_MemJsonPrintf( ",\"line\":%i,\"bytes\":%i,\"count\":%i}",
+			memLabels[i].line, memLabels[i].bytes, memLabels[i].count );
+	}
+	Com_MemJsonPrintf( "]" );
+}
+#endif
+
+/*
+=================
+Com_MemJsonHunkSide
+=================
+*/
+static void Com_MemJsonHunkSide( const char *name, hunkUsed_t *side ) {
+	Com_MemJsonPrintf( "\"%s\":{\"mark\":%i,\"permanent\":%i,\"temp\":%i,\"tempHighwater\":%i}",
+		name, side->mark, side->permanent, side->temp, side->tempHighwater );
+}
+
+/*
+=================
+Com_BuildMemJson
+
+Fills memJson with a single line describing every memory pool
+=================
+*/
+static void Com_BuildMemJson( const char *event ) {
+	int		i, freeBytes, freeBlocks, largest;
+	int		slabBytes[ZONE_MAX_TAGS], slabPageBytes, slabObjects;
+	int		allocated, blocks;
+
+	memJsonLength = 0;
+	memJson[0] = '\0';
+
+	Com_MemJsonPrintf( "{\"time\":%i,\"event\":", Sys_Milliseconds() );
+	Com_MemJsonString( event );
+	Com_MemJsonPrintf( ",\"map\":" );
+	Com_MemJsonString( Cvar_VariableString( "mapname" ) );
+
+	// zone
+	Z_ZoneFragmentation( mainzone, &freeBytes, &freeBlocks, &largest );
+	Com_MemJsonPrintf( ",\"zone\":{\"size\":%i,\"used\":%i,\"free\":%i,\"fragments\":%i,\"largestFree\":%i",
+		mainzone->size, mainzone->used, freeBytes, freeBlocks, largest );
+	Z_ZoneFragmentation( smallzone, &freeBytes, &freeBlocks, &largest );
+	Com_MemJsonPrintf( ",\"small\":{\"size\":%i,\"used\":%i,\"free\":%i,\"fragments\":%i,\"largestFree\":%i}",
+		smallzone->size, smallzone->used, freeBytes, freeBlocks, largest );
+	slabObjects = Z_SlabStats( slabBytes, &slabPageBytes );
+	Com_MemJsonPrintf( ",\"slab\":{\"pages\":%i,\"pageBytes\":%i,\"objects\":%i}",
+		zslabPagesUsed, slabPageBytes, slabObjects );
+	Com_MemJsonPrintf( ",\"tags\":{" );
+	for ( i = TAG_GENERAL ; i < TAG_STATIC ; i++ ) {
+		Com_MemJsonPrintf( "%s\"%s\":{\"bytes\":%i,\"blocks\":%i,\"peak\":%i}", i == TAG_GENERAL ? "" : ",",
+			memTagNames[i], zoneTagBytes[i], zoneTagBlocks[i], zoneTagPeak[i] );
+	}
+	Com_MemJsonPrintf( "}}" );
+
+	// hunk
+	Com_MemJsonPrintf( ",\"hunk\":{\"reserved\":%i,\"committed\":%i,\"peak\":%i,",
+		s_hunkTotal, Hunk_Committed(), s_hunkPeak );
+	Com_MemJsonHunkSide( "low", &hunk_low );
+	Com_MemJsonPrintf( "," );
+	Com_MemJsonHunkSide( "high", &hunk_high );
+	Com_MemJsonPrintf( "}" );
+
+	// botlib
+	SV_BotLibMemoryStats( &allocated, &blocks );
+	Com_MemJsonPrintf( ",\"botlib\":{\"bytes\":%i,\"blocks\":%i}", allocated, blocks );
+
+#ifndef DEDICATED
+	{
+		int		images, imageTexels, usedImageTexels, models, modelBytes;
+
+		if ( CL_RendererMemoryStats( &images, &imageTexels, &usedImageTexels, &models, &modelBytes ) ) {
+			Com_MemJsonPrintf( ",\"renderer\":{\"images\":%i,\"imageTexels\":%i,\"usedImageTexels\":%i,\"models\":%i,\"modelBytes\":%i}",
+				images, imageTexels, usedImageTexels, models, modelBytes );
+		}
+	}
+#endif
+
+#if defined( ZONE_DEBUG ) || defined( HUNK_DEBUG )
+	Com_MemJsonLabels();
+#endif
+
+	Com_MemJsonPrintf( "}\n" );
+}
+
+/*
+=================
+Com_WriteMemJson
+=================
+*/
+static void Com_WriteMemJson( const char *filename, const char *event ) {
+	fileHandle_t	f;
+
+	if ( !FS_Initialized() ) {
+		return;
+	}
+	Com_BuildMemJson( event );
+	FS_FOpenFileByMode( filename, &f, FS_APPEND );
+	if ( !f ) {
+		Com_Printf( "Com_WriteMemJson: couldn't open %s\n", filename );
+		return;
+	}
+	FS_Write( memJson, memJsonLength, f );
+	FS_FCloseFile( f );
+}
+
+/*
+=================
+Com_MemDump
+
+Appends the telemetry to com_memDumpFile if com_memDump is on
+=================
+*/
+void Com_MemDump( const char *event ) {
+	if ( com_memDump && com_memDump->integer > 0 ) {
+		Com_WriteMemJson( com_memDumpFile->string, event );
+	}
+}
+
+/*
+=================
+Com_MemDumpFrame
 
+Called every frame, dumps every com_memDump seconds
+=================
+*/
+static void Com_MemDumpFrame( void ) {
+	int		now;
+
+	if ( com_memDump->integer <= 0 ) {
+		return;
+	}
+	now = Sys_Milliseconds();
+	if ( now - com_memDumpTime < com_memDump->integer * 1000 ) {
+		return;
+	}
+	com_memDumpTime = now;
+	Com_WriteMemJson( com_memDumpFile->string, "periodic" );
+}
+
+/*
+=================
+Com_MeminfoJson_f
+
+meminfo_json [file]
+=================
+*/
+void Com_MeminfoJson_f( void ) {
+	char	chunk[1024];
+	int		i;
+
+	if ( Cmd_Argc() > 1 ) {
+		Com_WriteMemJson( Cmd_Argv( 1 ), "command" );
+		return;
+	}
+
+	// Com_Printf can't take all of it at once
+	Com_BuildMemJson( "command" );
+	for ( i = 0 ; i < memJsonLength ; i += sizeof( chunk ) - 1 ) {
+		Q_strncpyz( chunk, memJson + i, sizeof( chunk ) );
+		Com_Printf( "%s", chunk );
+	}
+}
 
 /*
 =================
@@ -1378,6 +2246,7 @@ void Com_InitSmallZoneMemory( void ) {
 		Com_Error( ERR_FATAL, "Small zone data failed to allocate %1.1f megs", (float)s_smallZoneTotal / (1024*1024) );
 	}
 	Z_ClearZone( smallzone, s_smallZoneTotal );
+	Z_InitSlabs();
 	
 	return;
 }
@@ -1487,7 +2356,7 @@ Com_InitZoneMemory
 */
 void Com_InitHunkMemory( void ) {
 	cvar_t	*cv;
-	int nMinAlloc;
+	int nMinAlloc, nReserve;
 	char *pMsg = NULL;
 
 	// make sure the file system has allocated and "not" freed any temp blocks
@@ -1518,17 +2387,33 @@ void Com_InitHunkMemory( void ) {
 		s_hunkTotal = cv->integer * 1024 * 1024;
 	}
 
+	// com_hunkMegs is now only the least we insist on, reserve as much
+	// address space as we are allowed to and commit it as it gets used
+	cv = Cvar_Get( "com_hunkReserveMegs", DEF_COMHUNKRESERVEMEGS, CVAR_LATCH | CVAR_ARCHIVE );
+	nReserve = cv->integer;
+	if ( nReserve > MAX_COMHUNKRESERVEMEGS ) {
+		nReserve = MAX_COMHUNKRESERVEMEGS;
+	}
 
-	// bk001205 - was malloc
-	s_hunkData = (byte*) calloc( s_hunkTotal + 31, 1 );
+	for ( ; nReserve * 1024 * 1024 > s_hunkTotal ; nReserve /= 2 ) {
+		s_hunkData = (byte *) Sys_ReserveMemory( nReserve * 1024 * 1024 );
+		if ( s_hunkData ) {
+			s_hunkTotal = nReserve * 1024 * 1024;
+			break;
+		}
+	}
+	if ( !s_hunkData ) {
+		s_hunkData = (byte *) Sys_ReserveMemory( s_hunkTotal );
+	}
 	if ( !s_hunkData ) {
 		Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
 	}
-	// cacheline align
-	s_hunkData = (byte *) ( ( (intptr_t)s_hunkData + 31 ) & ~31 );
+	s_hunkLowCommit = s_hunkHighCommit = 0;
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "zonebench", Com_ZoneBench_f );
+	Cmd_AddCommand( "meminfo_json", Com_MeminfoJson_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
@@ -1538,6 +2423,132 @@ void Com_InitHunkMemory( void ) {
 #endif
 }
 
+/*
+====================
+Hunk_CommitRange
+
+Commits [start, end) of the hunk where neither end has committed it yet.
+The ends are rounded to whole chunks, so they can overlap once the low end
+has grown into a chunk the high end committed, or the other way round.
+====================
+*/
+static qboolean Hunk_CommitRange( int start, int end ) {
+	int		highStart;
+
+	highStart = s_hunkTotal - s_hunkHighCommit;
+	if ( start < s_hunkLowCommit ) {
+		start = s_hunkLowCommit;
+	}
+	if ( end > highStart ) {
+		end = highStart;
+	}
+	if ( start >= end ) {
+		return qtrue;
+	}
+	return Sys_CommitMemory( s_hunkData + start, end - start );
+}
+
+/*
+====================
+Hunk_DecommitRange
+
+Gives back [start, end) of the hunk, less what either end still has
+committed
+====================
+*/
+static void Hunk_DecommitRange( int start, int end ) {
+	int		highStart;
+
+	highStart = s_hunkTotal - s_hunkHighCommit;
+	if ( start < s_hunkLowCommit ) {
+		start = s_hunkLowCommit;
+	}
+	if ( end > highStart ) {
+		end = highStart;
+	}
+	if ( start < end ) {
+		Sys_DecommitMemory( s_hunkData + start, end - start );
+	}
+}
+
+/*
+====================
+Hunk_Commit
+
+Makes sure everything both ends have allocated is backed by memory,
+and keeps the peak usage for the memory telemetry
+====================
+*/
+static qboolean Hunk_Commit( void ) {
+	int		need, used;
+
+	used = ( hunk_low.permanent > hunk_low.temp ? hunk_low.permanent : hunk_low.temp )
+		+ ( hunk_high.permanent > hunk_high.temp ? hunk_high.permanent : hunk_high.temp );
+	if ( used > s_hunkPeak ) {
+		s_hunkPeak = used;
+	}
+
+	// s_hunkLowCommit is where the low end's committed range ends and
+	// s_hunkHighCommit how far the high end's reaches down from the top
+	need = hunk_low.permanent > hunk_low.temp ? hunk_low.permanent : hunk_low.temp;
+	if ( need > s_hunkLowCommit ) {
+		need = ( need + HUNK_COMMIT_CHUNK - 1 ) & ~( HUNK_COMMIT_CHUNK - 1 );
+		if ( need > s_hunkTotal ) {
+			need = s_hunkTotal;
+		}
+		if ( !Hunk_CommitRange( s_hunkLowCommit, need ) ) {
+			return qfalse;
+		}
+		s_hunkLowCommit = need;
+	}
+
+	need = hunk_high.permanent > hunk_high.temp ? hunk_high.permanent : hunk_high.temp;
+	if ( need > s_hunkHighCommit ) {
+		need = ( need + HUNK_COMMIT_CHUNK - 1 ) & ~( HUNK_COMMIT_CHUNK - 1 );
+		if ( need > s_hunkTotal ) {
+			need = s_hunkTotal;
+		}
+		if ( !Hunk_CommitRange( s_hunkTotal - need, s_hunkTotal - s_hunkHighCommit ) ) {
+			return qfalse;
+		}
+		s_hunkHighCommit = need;
+	}
+
+	return qtrue;
+}
+
+/*
+====================
+Hunk_Decommit
+
+Gives back the memory past what both ends are using.  A chunk in the
+range of both ends is only given back once neither needs it.
+====================
+*/
+static void Hunk_Decommit( void ) {
+	int		keep, old;
+
+	if ( s_hunkData == NULL ) {
+		return;
+	}
+
+	keep = hunk_low.permanent > hunk_low.temp ? hunk_low.permanent : hunk_low.temp;
+	keep = ( keep + HUNK_COMMIT_CHUNK - 1 ) & ~( HUNK_COMMIT_CHUNK - 1 );
+	if ( keep < s_hunkLowCommit ) {
+		old = s_hunkLowCommit;
+		s_hunkLowCommit = keep;
+		Hunk_DecommitRange( keep, old );
+	}
+
+	keep = hunk_high.permanent > hunk_high.temp ? hunk_high.permanent : hunk_high.temp;
+	keep = ( keep + HUNK_COMMIT_CHUNK - 1 ) & ~( HUNK_COMMIT_CHUNK - 1 );
+	if ( keep < s_hunkHighCommit ) {
+		old = s_hunkHighCommit;
+		s_hunkHighCommit = keep;
+		Hunk_DecommitRange( s_hunkTotal - old, s_hunkTotal - keep );
+	}
+}
+
 /*
 ====================
 Hunk_MemoryRemaining
@@ -1574,6 +2585,7 @@ The client calls this before starting a vid_restart or snd_restart
 void Hunk_ClearToMark( void ) {
 	hunk_low.permanent = hunk_low.temp = hunk_low.mark;
 	hunk_high.permanent = hunk_high.temp = hunk_high.mark;
+	Hunk_Decommit();
 }
 
 /*
@@ -1588,6 +2600,41 @@ qboolean Hunk_CheckMark( void ) {
 	return qfalse;
 }
 
+/*
+=================
+Hunk_GetPosition
+
+For commands that load something only for a moment, everything allocated
+after this can be given back with Hunk_ClearToPosition.  Returns qfalse
+while temp memory is in use, the position can't be taken then.
+=================
+*/
+qboolean Hunk_GetPosition( int *low, int *high ) {
+	if ( hunk_low.temp != hunk_low.permanent || hunk_high.temp != hunk_high.permanent ) {
+		return qfalse;
+	}
+	*low = hunk_low.permanent;
+	*high = hunk_high.permanent;
+	return qtrue;
+}
+
+/*
+=================
+Hunk_ClearToPosition
+=================
+*/
+void Hunk_ClearToPosition( int low, int high ) {
+	if ( hunk_low.temp != hunk_low.permanent || hunk_high.temp != hunk_high.permanent ) {
+		Com_Error( ERR_DROP, "Hunk_ClearToPosition: temp memory in use" );
+	}
+	if ( low < hunk_low.mark || high < hunk_high.mark || low > hunk_low.permanent || high > hunk_high.permanent ) {
+		Com_Error( ERR_DROP, "Hunk_ClearToPosition: bad position" );
+	}
+	hunk_low.permanent = hunk_low.temp = low;
+	hunk_high.permanent = hunk_high.temp = high;
+	Hunk_Decommit();
+}
+
 void CL_ShutdownCGame( void );
 void CL_ShutdownUI( void );
 void SV_ShutdownGameProgs( void );
@@ -1622,6 +2669,9 @@ void Hunk_Clear( void ) {
 	hunk_permanent = &hunk_low;
 	hunk_temp = &hunk_high;
 
+	s_hunkPeak = 0;
+	Hunk_Decommit();
+
 	Com_Printf( "Hunk_Clear: reset the hunk ok\n" );
 	VM_Clear();
 #ifdef HUNK_DEBUG
@@ -1702,6 +2752,12 @@ void *Hunk_Alloc( int size, ha_pref preference ) {
 
 	hunk_permanent->temp = hunk_permanent->permanent;
 
+	if ( !Hunk_Commit() ) {
+		hunk_permanent->permanent -= size;
+		hunk_permanent->temp = hunk_permanent->permanent;
+		Com_Error( ERR_DROP, "Hunk_Alloc failed to commit %i", size );
+	}
+
 	Com_Memset( buf, 0, size );
 
 #ifdef HUNK_DEBUG
@@ -1759,6 +2815,11 @@ void *Hunk_AllocateTempMemory( int size ) {
 		buf = (void *)(s_hunkData + s_hunkTotal - hunk_temp->temp );
 	}
 
+	if ( !Hunk_Commit() ) {
+		hunk_temp->temp -= size;
+		Com_Error( ERR_DROP, "Hunk_AllocateTempMemory: failed to commit %i", size );
+	}
+
 	if ( hunk_temp->temp > hunk_temp->tempHighwater ) {
 		hunk_temp->tempHighwater = hunk_temp->temp;
 	}
@@ -2426,6 +3487,8 @@ void Com_Init( char *commandLine ) {
 	com_dropsim = Cvar_Get ("com_dropsim", "0", CVAR_CHEAT);
 	com_viewlog = Cvar_Get( "viewlog", "0", CVAR_CHEAT );
 	com_speeds = Cvar_Get ("com_speeds", "0", 0);
+	com_memDump = Cvar_Get ("com_memDump", "0", 0);
+	com_memDumpFile = Cvar_Get ("com_memDumpFile", "meminfo.json", 0);
 	com_timedemo = Cvar_Get ("timedemo", "0", CVAR_CHEAT);
 	com_cameraMode = Cvar_Get ("com_cameraMode", "0", CVAR_CHEAT);
 
@@ -2454,6 +3517,11 @@ void Com_Init( char *commandLine ) {
 	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand ("cm_traceStress", CM_TraceStress_f );
+#if idsse
+	Cmd_AddCommand ("cm_brushBench", CM_BrushBench_f );
+#endif
+	Cmd_AddCommand ("cm_brushTreeStats", CM_BrushTreeStats_f );
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f );
 
 	s = va("%s %s %s", Q3_VERSION, CPUSTRING, __DATE__ );
@@ -2695,6 +3763,9 @@ void Com_Frame( void ) {
 	} while ( msec < minMsec );
 	Cbuf_Execute ();
 
+	// callbacks of background file reads
+	FS_AsyncFrame();
+
 	lastTime = com_frameTime;
 
 	// mess with msec if needed
@@ -2778,8 +3849,8 @@ void Com_Frame( void ) {
 	//
 	if ( com_showtrace->integer ) {
 	
-		extern	int c_traces, c_brush_traces, c_patch_traces;
-		extern	int	c_pointcontents;
+		extern	QTHREAD int c_traces, c_brush_traces, c_patch_traces;
+		extern	QTHREAD int	c_pointcontents;
 
 		Com_Printf ("%4i traces  (%ib %ip) %4i points\n", c_traces,
 			c_brush_traces, c_patch_traces, c_pointcontents);
@@ -2789,6 +3860,8 @@ void Com_Frame( void ) {
 		c_pointcontents = 0;
 	}
 
+	Com_MemDumpFrame();
+
 	// old net chan encryption key
 	key = lastTime * 0x87243987;
 
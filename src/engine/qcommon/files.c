@@ -232,6 +232,13 @@ typedef struct {
 	int				hashSize;					// hash table size (power of 2)
 	fileInPack_t*	*hashTable;					// hash table
 	fileInPack_t*	buildBuffer;				// buffer with the filenames etc.
+	int				fileSize;					// for the pk3 index, 0 if it can't be indexed
+	int				fileTime;
+	int				numHeaderLongs;				// crcs the checksums are made from
+	int				*headerLongs;
+	const byte		*mapped;					// whole pk3 mapped read only, or NULL
+	int				mappedLength;
+	fileInPack_t*	*sortedFiles;				// by name, made by the first listing
 } pack_t;
 
 typedef struct {
@@ -255,6 +262,8 @@ static	cvar_t		*fs_cdpath;
 static	cvar_t		*fs_copyfiles;
 static	cvar_t		*fs_gamedirvar;
 static	cvar_t		*fs_restrict;
+static	cvar_t		*fs_pk3Index;
+static	cvar_t		*fs_mapPaks;
 static	searchpath_t	*fs_searchpaths;
 static	int			fs_readCount;			// total bytes read
 static	int			fs_loadCount;			// total files read
@@ -281,6 +290,7 @@ typedef struct {
 	int			fileSize;
 	int			zipFilePos;
 	qboolean	zipFile;
+	pack_t		*zipPack;
 	qboolean	streamed;
 	char		name[MAX_ZPATH];
 } fileHandleData_t;
@@ -774,6 +784,35 @@ void FS_SV_Rename( const char *from, const char *to ) {
 	}
 }
 
+/*
+===========
+FS_ReplaceFile
+
+Renames a file written next to a file that may be in use over it.  A
+reader sees either the old file or the new one, never a partial copy.
+===========
+*/
+qboolean FS_ReplaceFile( const char *from, const char *to ) {
+	char			*from_ospath, *to_ospath;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	from_ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, from );
+	to_ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, to );
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_ReplaceFile: %s --> %s\n", from_ospath, to_ospath );
+	}
+
+	if ( !Sys_ReplaceFile( from_ospath, to_ospath ) ) {
+		FS_Remove( from_ospath );
+		return qfalse;
+	}
+	return qtrue;
+}
+
 
 
 /*
@@ -973,6 +1012,280 @@ char *FS_ShiftedStrStr(const char *string, const char *substring, int shift) {
 	return (char*) strstr(string, buf);
 }
 
+/*
+=================================================================================
+
+FILE INDEX
+
+One open addressed table over the files of every pk3 on the search path,
+built at the end of FS_Startup.  Each name keeps the list of packs that
+contain it in search order, so the pure check can still skip packs that
+the server doesn't allow without rebuilding anything when the pure list
+changes.  Directories aren't indexed, FS_FOpenFileRead still probes the
+ones in front of the pack the index found.
+
+=================================================================================
+*/
+
+typedef struct {
+	searchpath_t	*search;
+	fileInPack_t	*file;
+	int				next;			// next pack with the same name, -1 at the end
+} fileIndexSource_t;
+
+typedef struct {
+	const char		*name;			// NULL for an empty slot
+	unsigned		hash;
+	int				firstSource;
+	int				lastSource;
+} fileIndexEntry_t;
+
+static	fileIndexEntry_t	*fs_fileIndex;
+static	int					fs_fileIndexSize;		// power of 2
+static	fileIndexSource_t	*fs_fileIndexSources;
+static	qboolean			fs_fileIndexDisabled;	// for fs_lookupbench
+static	int					fs_lookups;				// since FS_Startup
+static	int					fs_lookupUsec;
+
+/*
+================
+FS_IndexHash
+
+Case and separator insensitive like FS_FilenameCompare
+================
+*/
+static unsigned FS_IndexHash( const char *fname ) {
+	unsigned	hash;
+	int			c;
+
+	hash = 2166136261u;
+	while ( ( c = *fname++ ) != 0 ) {
+		if ( c >= 'A' && c <= 'Z' ) {
+			c += 'a' - 'A';
+		} else if ( c == '\\' || c == ':' ) {
+			c = '/';
+		}
+		hash = ( hash ^ c ) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+================
+FS_IndexSlot
+
+Returns the slot holding the name, or the empty slot it would go in
+================
+*/
+static fileIndexEntry_t *FS_IndexSlot( const char *fname, unsigned hash ) {
+	fileIndexEntry_t	*entry;
+	int					i;
+
+	i = hash & ( fs_fileIndexSize - 1 );
+	while ( 1 ) {
+		entry = &fs_fileIndex[i];
+		if ( !entry->name ) {
+			return entry;
+		}
+		if ( entry->hash == hash && !FS_FilenameCompare( entry->name, fname ) ) {
+			return entry;
+		}
+		i = ( i + 1 ) & ( fs_fileIndexSize - 1 );
+	}
+}
+
+/*
+================
+FS_FreeFileIndex
+================
+*/
+static void FS_FreeFileIndex( void ) {
+	if ( fs_fileIndex ) {
+		Z_Free( fs_fileIndex );
+	}
+	if ( fs_fileIndexSources ) {
+		Z_Free( fs_fileIndexSources );
+	}
+	fs_fileIndex = NULL;
+	fs_fileIndexSources = NULL;
+	fs_fileIndexSize = 0;
+}
+
+/*
+================
+FS_BuildFileIndex
+================
+*/
+static void FS_BuildFileIndex( void ) {
+	searchpath_t		*search;
+	fileIndexEntry_t	*entry;
+	fileIndexSource_t	*source;
+	int					numFiles, numSources, i;
+	unsigned			hash;
+
+	FS_FreeFileIndex();
+
+	numFiles = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			numFiles += search->pack->numfiles;
+		}
+	}
+	if ( !numFiles ) {
+		return;
+	}
+
+	// at most half full
+	for ( fs_fileIndexSize = 64 ; fs_fileIndexSize < numFiles * 2 ; fs_fileIndexSize <<= 1 ) {
+	}
+	fs_fileIndex = (fileIndexEntry_t *) Z_Malloc( fs_fileIndexSize * sizeof( *fs_fileIndex ) );
+	fs_fileIndexSources = (fileIndexSource_t *) Z_Malloc( numFiles * sizeof( *fs_fileIndexSources ) );
+
+	numSources = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( !search->pack ) {
+			continue;
+		}
+		// backwards, because the pack's own hash chains find the last
+		// of two files with the same name
+		for ( i = search->pack->numfiles - 1 ; i >= 0 ; i-- ) {
+			fileInPack_t	*file = &search->pack->buildBuffer[i];
+
+			hash = FS_IndexHash( file->name );
+			entry = FS_IndexSlot( file->name, hash );
+			if ( entry->name && fs_fileIndexSources[entry->lastSource].search == search ) {
+				continue;
+			}
+
+			source = &fs_fileIndexSources[numSources];
+			source->search = search;
+			source->file = file;
+			source->next = -1;
+
+			if ( !entry->name ) {
+				entry->name = file->name;
+				entry->hash = hash;
+				entry->firstSource = numSources;
+			} else {
+				fs_fileIndexSources[entry->lastSource].next = numSources;
+			}
+			entry->lastSource = numSources;
+			numSources++;
+		}
+	}
+}
+
+/*
+================
+FS_FindInPaks
+
+Returns the first pack on the search path that has the file, skipping
+packs the pure server doesn't allow if pureOnly
+================
+*/
+static searchpath_t *FS_FindInPaks( const char *filename, fileInPack_t **pakFile, qboolean pureOnly ) {
+	searchpath_t		*search;
+	fileIndexEntry_t	*entry;
+	fileIndexSource_t	*source;
+	fileInPack_t		*file;
+	long				hash;
+	int					i, start;
+
+	start = Sys_Microseconds();
+	fs_lookups++;
+
+	search = NULL;
+	*pakFile = NULL;
+	if ( fs_fileIndex && !fs_fileIndexDisabled ) {
+		entry = FS_IndexSlot( filename, FS_IndexHash( filename ) );
+		for ( i = entry->name ? entry->firstSource : -1 ; i >= 0 ; i = source->next ) {
+			source = &fs_fileIndexSources[i];
+			if ( !pureOnly || FS_PakIsPure( source->search->pack ) ) {
+				search = source->search;
+				*pakFile = source->file;
+				break;
+			}
+		}
+	} else {
+		for ( search = fs_searchpaths ; search ; search = search->next ) {
+			if ( !search->pack ) {
+				continue;
+			}
+			hash = FS_HashFileName( filename, search->pack->hashSize );
+			if ( !search->pack->hashTable[hash] ) {
+				continue;
+			}
+			if ( pureOnly && !FS_PakIsPure( search->pack ) ) {
+				continue;
+			}
+			for ( file = search->pack->hashTable[hash] ; file ; file = file->next ) {
+				// case and separator insensitive comparisons
+				if ( !FS_FilenameCompare( file->name, filename ) ) {
+					break;
+				}
+			}
+			if ( file ) {
+				*pakFile = file;
+				break;
+			}
+		}
+	}
+
+	fs_lookupUsec += Sys_Microseconds() - start;
+	return search;
+}
+
+/*
+================
+FS_LookupBench_f
+
+fs_lookupbench [iterations]
+
+Looks up every file in the pk3s with and without the index
+================
+*/
+static void FS_LookupBench_f( void ) {
+	fileInPack_t	*pakFile;
+	int				iterations, pass, i, n, count, usec, found;
+
+	Com_Printf( "%i lookups since startup, %i usec\n", fs_lookups, fs_lookupUsec );
+
+	if ( !fs_fileIndex ) {
+		Com_Printf( "no pk3 files\n" );
+		return;
+	}
+
+	iterations = 10;
+	if ( Cmd_Argc() > 1 ) {
+		iterations = atoi( Cmd_Argv( 1 ) );
+		if ( iterations < 1 ) {
+			iterations = 1;
+		}
+	}
+
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		fs_fileIndexDisabled = (qboolean)( pass == 1 );
+		count = 0;
+		found = 0;
+		usec = Sys_Microseconds();
+		for ( n = 0 ; n < iterations ; n++ ) {
+			for ( i = 0 ; i < fs_fileIndexSize ; i++ ) {
+				if ( !fs_fileIndex[i].name ) {
+					continue;
+				}
+				if ( FS_FindInPaks( fs_fileIndex[i].name, &pakFile, qtrue ) ) {
+					found++;
+				}
+				count++;
+			}
+		}
+		usec = Sys_Microseconds() - usec;
+		Com_Printf( "%s %8i lookups, %8i usec, %6.1f nsec per lookup, %i found\n",
+			pass ? "search path:" : "index:      ", count, usec, usec * 1000.0 / count, found );
+	}
+	fs_fileIndexDisabled = qfalse;
+}
+
 /*
 ===========
 FS_FOpenFileRead
@@ -987,43 +1300,27 @@ extern qboolean		com_fullyInitialized;
 
 int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
 	searchpath_t	*search;
+	searchpath_t	*pakSearch;
 	char			*netpath;
 	pack_t			*pak;
 	fileInPack_t	*pakFile;
 	directory_t		*dir;
-	long			hash;
 	unz_s			*zfi;
 	FILE			*temp;
 	int				l;
 	char demoExt[16];
 
-	hash = 0;
-
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
 	}
 
 	if ( file == NULL ) {
 		// just wants to see if file is there
+		if ( FS_FindInPaks( filename, &pakFile, qfalse ) ) {
+			return qtrue;
+		}
 		for ( search = fs_searchpaths ; search ; search = search->next ) {
-			//
-			if ( search->pack ) {
-				hash = FS_HashFileName(filename, search->pack->hashSize);
-			}
-			// is the element a pak file?
-			if ( search->pack && search->pack->hashTable[hash] ) {
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do {
-					// case and separator insensitive comparisons
-					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-						// found it!
-						return qtrue;
-					}
-					pakFile = pakFile->next;
-				} while(pakFile != NULL);
-			} else if ( search->dir ) {
+			if ( search->dir ) {
 				dir = search->dir;
 			
 				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
@@ -1070,92 +1367,77 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 	*file = FS_HandleForFile();
 	fsh[*file].handleFiles.unique = uniqueFILE;
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if ( search->pack ) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
-		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure(search->pack) ) {
-				continue;
-			}
+	pakSearch = FS_FindInPaks( filename, &pakFile, qtrue );
 
-			// look through all the pak file elements
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		// is the element the pak file that has it?
+		if ( search == pakSearch ) {
 			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-
-					// mark the pak as having been referenced and mark specifics on cgame and ui
-					// shaders, txt, arena files  by themselves do not count as a reference as 
-					// these are loaded from all pk3s 
-					// from every pk3 file.. 
-					l = (int)strlen( filename );
-					if ( !(pak->referenced & FS_GENERAL_REF)) {
-						if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
-							Q_stricmp(filename + l - 4, ".txt") != 0 &&
-							Q_stricmp(filename + l - 4, ".cfg") != 0 &&
-							Q_stricmp(filename + l - 7, ".config") != 0 &&
-							strstr(filename, "levelshots") == NULL &&
-							Q_stricmp(filename + l - 4, ".bot") != 0 &&
-							Q_stricmp(filename + l - 6, ".arena") != 0 &&
-							Q_stricmp(filename + l - 5, ".menu") != 0) {
-							pak->referenced |= FS_GENERAL_REF;
-						}
-					}
 
-					// qagame.qvm	- 13
-					// dTZT`X!di`
-					if (!(pak->referenced & FS_QAGAME_REF) && FS_ShiftedStrStr(filename, "dTZT`X!di`", 13)) {
-						pak->referenced |= FS_QAGAME_REF;
-					}
-					// cgame.qvm	- 7
-					// \`Zf^'jof
-					if (!(pak->referenced & FS_CGAME_REF) && FS_ShiftedStrStr(filename , "\\`Zf^'jof", 7)) {
-						pak->referenced |= FS_CGAME_REF;
-					}
-					// ui.qvm		- 5
-					// pd)lqh
-					if (!(pak->referenced & FS_UI_REF) && FS_ShiftedStrStr(filename , "pd)lqh", 5)) {
-						pak->referenced |= FS_UI_REF;
-					}
+			// mark the pak as having been referenced and mark specifics on cgame and ui
+			// shaders, txt, arena files  by themselves do not count as a reference as 
+			// these are loaded from all pk3s 
+			// from every pk3 file.. 
+			l = (int)strlen( filename );
+			if ( !(pak->referenced & FS_GENERAL_REF)) {
+				if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
+					Q_stricmp(filename + l - 4, ".txt") != 0 &&
+					Q_stricmp(filename + l - 4, ".cfg") != 0 &&
+					Q_stricmp(filename + l - 7, ".config") != 0 &&
+					strstr(filename, "levelshots") == NULL &&
+					Q_stricmp(filename + l - 4, ".bot") != 0 &&
+					Q_stricmp(filename + l - 6, ".arena") != 0 &&
+					Q_stricmp(filename + l - 5, ".menu") != 0) {
+					pak->referenced |= FS_GENERAL_REF;
+				}
+			}
 
-					if ( uniqueFILE ) {
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
-						if (fsh[*file].handleFiles.file.z == NULL) {
-							Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
-						}
-					} else {
-						fsh[*file].handleFiles.file.z = pak->handle;
-					}
-					Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-					fsh[*file].zipFile = qtrue;
-					zfi = (unz_s *)fsh[*file].handleFiles.file.z;
-					// in case the file was new
-					temp = zfi->file;
-					// set the file position in the zip file (also sets the current file info)
-					unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
-					// copy the file info into the unzip structure
-					Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
-					// we copy this back into the structure
-					zfi->file = temp;
-					// open the file in the zip
-					unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
-					fsh[*file].zipFilePos = pakFile->pos;
-
-					if ( fs_debug->integer ) {
-						Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n", 
-							filename, pak->pakFilename );
-					}
-					return zfi->cur_file_info.uncompressed_size;
+			// qagame.qvm	- 13
+			// dTZT`X!di`
+			if (!(pak->referenced & FS_QAGAME_REF) && FS_ShiftedStrStr(filename, "dTZT`X!di`", 13)) {
+				pak->referenced |= FS_QAGAME_REF;
+			}
+			// cgame.qvm	- 7
+			// \`Zf^'jof
+			if (!(pak->referenced & FS_CGAME_REF) && FS_ShiftedStrStr(filename , "\\`Zf^'jof", 7)) {
+				pak->referenced |= FS_CGAME_REF;
+			}
+			// ui.qvm		- 5
+			// pd)lqh
+			if (!(pak->referenced & FS_UI_REF) && FS_ShiftedStrStr(filename , "pd)lqh", 5)) {
+				pak->referenced |= FS_UI_REF;
+			}
+
+			if ( uniqueFILE ) {
+				// open a new file on the pakfile
+				fsh[*file].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
+				if (fsh[*file].handleFiles.file.z == NULL) {
+					Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
 				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
+			} else {
+				fsh[*file].handleFiles.file.z = pak->handle;
+			}
+			Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
+			fsh[*file].zipFile = qtrue;
+			fsh[*file].zipPack = pak;
+			zfi = (unz_s *)fsh[*file].handleFiles.file.z;
+			// in case the file was new
+			temp = zfi->file;
+			// set the file position in the zip file (also sets the current file info)
+			unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
+			// copy the file info into the unzip structure
+			Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
+			// we copy this back into the structure
+			zfi->file = temp;
+			// open the file in the zip
+			unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
+			fsh[*file].zipFilePos = pakFile->pos;
+
+			if ( fs_debug->integer ) {
+				Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n", 
+					filename, pak->pakFilename );
+			}
+			return zfi->cur_file_info.uncompressed_size;
 		} else if ( search->dir ) {
 			// check a file in the directory tree
 
@@ -1430,9 +1712,7 @@ CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 
 int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 	searchpath_t	*search;
-	pack_t			*pak;
 	fileInPack_t	*pakFile;
-	long			hash = 0;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
@@ -1454,38 +1734,64 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 		return -1;
 	}
 
-	//
-	// search through the path, one element at a time
-	//
-
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if (search->pack) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
+	search = FS_FindInPaks( filename, &pakFile, qtrue );
+	if ( search ) {
+		if (pChecksum) {
+			*pChecksum = search->pack->pure_checksum;
 		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure(search->pack) ) {
-				continue;
-			}
+		return 1;
+	}
+	return -1;
+}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					if (pChecksum) {
-						*pChecksum = pak->pure_checksum;
-					}
-					return 1;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
+/*
+============
+FS_FileView
+
+Points into the mapped pk3 at the data of a file, NULL if it has to be
+read.  *compressedLength is 0 for stored files, which can be used as is,
+and the length of the deflate data for the others.
+============
+*/
+static const byte *FS_FileView( fileHandle_t h, int len, int *compressedLength ) {
+	pack_t			*pak;
+	unsigned long	offset;
+	int				stored;
+
+	pak = fsh[h].zipPack;
+	if ( !fsh[h].zipFile || !pak || !pak->mapped || len <= 0 ) {
+		return NULL;
+	}
+	if ( unzGetCurrentFileDataOffset( fsh[h].handleFiles.file.z, &offset, &stored ) != UNZ_OK ) {
+		return NULL;
+	}
+	*compressedLength = stored ? 0 : (int)((unz_s *)fsh[h].handleFiles.file.z)->cur_file_info.compressed_size;
+	if ( !stored ) {
+		len = *compressedLength;
+	}
+	if ( offset > (unsigned long)pak->mappedLength || (unsigned long)len > pak->mappedLength - offset ) {
+		return NULL;
+	}
+	return pak->mapped + offset;
+}
+
+/*
+============
+FS_IsFileView
+============
+*/
+static qboolean FS_IsFileView( const void *buffer ) {
+	searchpath_t	*search;
+	const byte		*p;
+
+	p = (const byte *)buffer;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->mapped && p >= search->pack->mapped
+			&& p < search->pack->mapped + search->pack->mappedLength ) {
+			return qtrue;
 		}
 	}
-	return -1;
+	return qfalse;
 }
 
 /*
@@ -1499,8 +1805,9 @@ a null buffer will just return the file length without loading
 int FS_ReadFile( const char *qpath, void **buffer ) {
 	fileHandle_t	h;
 	byte*			buf;
+	const byte		*view;
 	qboolean		isConfig;
-	int				len;
+	int				len, compressedLength;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
@@ -1540,131 +1847,1159 @@ int FS_ReadFile( const char *qpath, void **buffer ) {
 			buf = (byte*) Hunk_AllocateTempMemory(len+1);
 			*buffer = buf;
 
-			r = FS_Read( buf, len, com_journalDataFile );
-			if ( r != len ) {
-				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
-			}
+			r = FS_Read( buf, len, com_journalDataFile );
+			if ( r != len ) {
+				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
+			}
+
+			fs_loadCount++;
+			fs_loadStack++;
+
+			// guarantee that it will have a trailing 0 for string operations
+			buf[len] = 0;
+
+			return len;
+		}
+	} else {
+		isConfig = qfalse;
+	}
+
+	// look for it in the filesystem or pack files
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		if ( buffer ) {
+			*buffer = NULL;
+		}
+		// if we are journalling and it is a config file, write a zero to the journal file
+		if ( isConfig && com_journal && com_journal->integer == 1 ) {
+			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
+			len = 0;
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		return -1;
+	}
+	
+	if ( !buffer ) {
+		if ( isConfig && com_journal && com_journal->integer == 1 ) {
+			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		FS_FCloseFile( h);
+		return len;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	buf = (byte*) Hunk_AllocateTempMemory(len+1);
+	*buffer = buf;
+
+	// deflated files in a mapped pk3 are inflated straight from the mapping
+	view = FS_FileView( h, len, &compressedLength );
+	if ( view && !compressedLength ) {
+		Com_Memcpy( buf, view, len );
+	} else if ( !view || unzInflateBuffer( buf, len, view, compressedLength ) != UNZ_OK ) {
+		FS_Read (buf, len, h);
+	}
+
+	// guarantee that it will have a trailing 0 for string operations
+	buf[len] = 0;
+	FS_FCloseFile( h );
+
+	// if we are journalling and it is a config file, write it to the journal file
+	if ( isConfig && com_journal && com_journal->integer == 1 ) {
+		Com_DPrintf( "Writing %s to journal file.\n", qpath );
+		FS_Write( &len, sizeof( len ), com_journalDataFile );
+		FS_Write( buf, len, com_journalDataFile );
+		FS_Flush( com_journalDataFile );
+	}
+	return len;
+}
+
+/*
+============
+FS_ReadFileView
+
+Stored pk3 files are returned as a view of the mapped pk3, anything else
+is read into temp memory like FS_ReadFile.  Either is freed with FS_FreeFile.
+============
+*/
+int FS_ReadFileView( const char *qpath, const void **buffer ) {
+	fileHandle_t	h;
+	byte			*buf;
+	const byte		*view;
+	int				len, compressedLength;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileView with empty name\n" );
+	}
+
+	// config files can come from the journal
+	if ( strstr( qpath, ".cfg" ) ) {
+		return FS_ReadFile( qpath, (void **)buffer );
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		*buffer = NULL;
+		return -1;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	view = FS_FileView( h, len, &compressedLength );
+	if ( view && !compressedLength ) {
+		*buffer = view;
+	} else {
+		buf = (byte*) Hunk_AllocateTempMemory(len+1);
+		if ( !view || unzInflateBuffer( buf, len, view, compressedLength ) != UNZ_OK ) {
+			FS_Read (buf, len, h);
+		}
+		buf[len] = 0;
+		*buffer = buf;
+	}
+	FS_FCloseFile( h );
+
+	return len;
+}
+
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile( void *buffer ) {
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	}
+	fs_loadStack--;
+
+	// views of a mapped pk3 have nothing to free
+	if ( !FS_IsFileView( buffer ) ) {
+		Hunk_FreeTempMemory( buffer );
+	}
+
+	// if all of our temp files are free, clear all of our space
+	if ( fs_loadStack == 0 ) {
+		Hunk_ClearTempMemory();
+	}
+}
+
+/*
+=================================================================================
+
+ASYNCHRONOUS READS
+
+FS_ReadFileAsync and FS_Prefetch look the file up on the main thread, with
+all the pure and reference rules of FS_FOpenFileRead, and leave the disk
+reads and the inflating to the worker threads, so a batch of reads is
+decompressed on all of them at once.  unzInflateBuffer allocates nothing
+and the buffers are malloced, so nothing the workers touch needs the zone
+or the hunk; the buffers cross threads and can be bigger than the zone.
+The callbacks run on the main thread in submission order, from
+FS_AsyncFrame or FS_FinishAsync.
+
+A prefetch faults in the pages of the file in a mapped pk3, so the loader
+that opens it later finds it in the cache.  Without fs_mapPaks it does
+nothing, reading the file only to drop it costs more than it saves.
+
+=================================================================================
+*/
+
+#define	FS_ASYNC_JOBS		1024		// in flight, enough for a map's prefetches
+#define	FS_ASYNC_MAX_FILES	32			// loose files held open by jobs
+#define	FS_ASYNC_MAX_THREADS	8
+
+typedef enum {
+	ASYNC_FREE,
+	ASYNC_QUEUED,
+	ASYNC_RUNNING,
+	ASYNC_DONE
+} asyncState_t;
+
+typedef struct {
+	char				qpath[MAX_QPATH];
+	fsAsyncCallback_t	callback;		// NULL for prefetches
+	void				*data;
+
+	// one of the three sources
+	const byte			*view;			// mapped pk3
+	const char			*pakFilename;	// FS_Shutdown finishes the jobs before freeing it
+	FILE				*file;			// loose file, closed by the worker
+
+	int					offset;
+	int					compressedLength;
+	int					length;
+	qboolean			stored;
+
+	byte				*raw;			// what the worker read
+	byte				*buffer;		// what the callback gets
+	qboolean			failed;
+	qboolean			damaged;		// the deflate data didn't inflate
+	volatile asyncState_t	state;
+} asyncJob_t;
+
+static	cvar_t		*fs_asyncThreads;
+static	asyncJob_t	fs_asyncJobs[FS_ASYNC_JOBS];
+static	int			fs_asyncHead;		// oldest job the main thread hasn't finished
+static	int			fs_asyncTail;		// next free job
+static	int			fs_asyncNext;		// next job for the workers
+static	int			fs_asyncWorkers;
+static	int			fs_asyncFiles;		// jobs with a loose file
+static	void		*fs_asyncLock;
+static	void		*fs_asyncWork;		// one signal per queued job
+static	void		*fs_asyncDone;		// one signal per finished job
+
+/*
+================
+FS_AsyncRead
+
+Runs on a worker thread, or on the main thread without workers
+================
+*/
+static void FS_AsyncRead( asyncJob_t *job ) {
+	FILE			*f;
+	const byte		*source;
+	int				i;
+
+	if ( job->view ) {
+		if ( !job->callback ) {
+			// fault the pages in
+			for ( i = 0 ; i < job->compressedLength ; i += 4096 ) {
+				(void)*(const volatile byte *)&job->view[i];
+			}
+			return;
+		}
+		source = job->view;
+	} else {
+		// room for the trailing 0, so stored data can be handed over as is
+		job->raw = (byte *) malloc( job->compressedLength + 1 );
+		if ( !job->raw ) {
+			job->failed = qtrue;
+			if ( job->file ) {
+				fclose( job->file );
+			}
+			return;
+		}
+
+		f = job->file;
+		if ( !f ) {
+			f = fopen( job->pakFilename, "rb" );
+			if ( !f || fseek( f, job->offset, SEEK_SET ) ) {
+				job->failed = qtrue;
+			}
+		}
+		if ( f && !job->failed && fread( job->raw, 1, job->compressedLength, f ) != (size_t)job->compressedLength ) {
+			job->failed = qtrue;
+		}
+		if ( f ) {
+			fclose( f );
+		}
+		source = job->raw;
+	}
+
+	if ( !job->callback || job->failed ) {
+		return;
+	}
+
+	if ( job->stored && job->raw ) {
+		job->buffer = job->raw;
+		job->raw = NULL;
+		return;
+	}
+
+	job->buffer = (byte *) malloc( job->length + 1 );
+	if ( !job->buffer ) {
+		job->failed = qtrue;
+	} else if ( job->stored ) {
+		memcpy( job->buffer, source, job->length );
+	} else if ( unzInflateBuffer( job->buffer, job->length, source, job->compressedLength ) != UNZ_OK ) {
+		job->failed = qtrue;
+		job->damaged = qtrue;
+	}
+}
+
+/*
+================
+FS_AsyncWorker
+================
+*/
+static void FS_AsyncWorker( void *data ) {
+	asyncJob_t	*job;
+
+	while ( 1 ) {
+		Sys_WaitSemaphore( fs_asyncWork );
+
+		Sys_LockMutex( fs_asyncLock );
+		job = &fs_asyncJobs[fs_asyncNext];
+		fs_asyncNext = ( fs_asyncNext + 1 ) % FS_ASYNC_JOBS;
+		job->state = ASYNC_RUNNING;
+		Sys_UnlockMutex( fs_asyncLock );
+
+		FS_AsyncRead( job );
+
+		Sys_LockMutex( fs_asyncLock );
+		job->state = ASYNC_DONE;
+		Sys_UnlockMutex( fs_asyncLock );
+
+		Sys_SignalSemaphore( fs_asyncDone );
+	}
+}
+
+/*
+================
+FS_InitAsync
+
+The workers outlive filesystem restarts
+================
+*/
+static void FS_InitAsync( void ) {
+	int		count;
+
+	fs_asyncThreads = Cvar_Get( "fs_asyncThreads", "2", CVAR_INIT );
+
+	if ( fs_asyncLock ) {
+		return;
+	}
+	fs_asyncLock = Sys_CreateMutex();
+	fs_asyncWork = Sys_CreateSemaphore();
+	fs_asyncDone = Sys_CreateSemaphore();
+
+	count = fs_asyncThreads->integer;
+	if ( count > FS_ASYNC_MAX_THREADS ) {
+		count = FS_ASYNC_MAX_THREADS;
+	}
+	for ( fs_asyncWorkers = 0 ; fs_asyncWorkers < count ; fs_asyncWorkers++ ) {
+		if ( !Sys_CreateThread( FS_AsyncWorker, NULL ) ) {
+			break;
+		}
+	}
+}
+
+/*
+================
+FS_AsyncJobDone
+================
+*/
+static qboolean FS_AsyncJobDone( asyncJob_t *job ) {
+	qboolean	done;
+
+	if ( !fs_asyncWorkers ) {
+		return (qboolean)( job->state == ASYNC_DONE );
+	}
+	Sys_LockMutex( fs_asyncLock );
+	done = (qboolean)( job->state == ASYNC_DONE );
+	Sys_UnlockMutex( fs_asyncLock );
+	return done;
+}
+
+/*
+================
+FS_FinishAsyncJob
+
+Completes the oldest job on the main thread
+================
+*/
+static void FS_FinishAsyncJob( void ) {
+	asyncJob_t	*job;
+
+	job = &fs_asyncJobs[fs_asyncHead];
+
+	while ( !FS_AsyncJobDone( job ) ) {
+		Sys_WaitSemaphore( fs_asyncDone );
+	}
+
+	if ( job->callback ) {
+		if ( job->damaged ) {
+			Com_Printf( "FS_ReadFileAsync: %s is damaged\n", job->qpath );
+		}
+		if ( !job->failed ) {
+			// guarantee that it will have a trailing 0 for string operations
+			job->buffer[job->length] = 0;
+			fs_loadCount++;
+			job->callback( job->qpath, job->buffer, job->length, job->data );
+		} else {
+			job->callback( job->qpath, NULL, -1, job->data );
+		}
+	}
+
+	if ( job->raw ) {
+		free( job->raw );
+	}
+	if ( job->buffer ) {
+		free( job->buffer );
+	}
+	if ( job->file ) {
+		fs_asyncFiles--;
+	}
+	Com_Memset( job, 0, sizeof( *job ) );
+	fs_asyncHead = ( fs_asyncHead + 1 ) % FS_ASYNC_JOBS;
+}
+
+/*
+================
+FS_QueueAsync
+================
+*/
+static qboolean FS_QueueAsync( const char *qpath, fsAsyncCallback_t callback, void *data ) {
+	asyncJob_t		*job;
+	fileHandle_t	h;
+	fileInPack_t	*pakFile;
+	searchpath_t	*search;
+	pack_t			*pak;
+	unz_s			*zfi;
+	unsigned long	offset;
+	int				stored, len, referenced;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync with empty name\n" );
+	}
+
+	// a prefetch can look at files the loaders never ask for, which
+	// must not make the pk3 look referenced to a pure server
+	search = NULL;
+	referenced = 0;
+	if ( !callback ) {
+		search = FS_FindInPaks( qpath, &pakFile, qtrue );
+		if ( search ) {
+			referenced = search->pack->referenced;
+		}
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+
+	if ( search ) {
+		search->pack->referenced = referenced;
+	}
+	if ( !h ) {
+		return qfalse;
+	}
+
+	// a prefetch only faults in the pages of a mapped pk3, reading the
+	// file into memory just to drop it costs more than it saves
+	if ( !callback && ( !fsh[h].zipFile || !fsh[h].zipPack->mapped ) ) {
+		FS_FCloseFile( h );
+		return qfalse;
+	}
+
+	while ( ( fs_asyncTail + 1 ) % FS_ASYNC_JOBS == fs_asyncHead
+		|| ( !fsh[h].zipFile && fs_asyncFiles >= FS_ASYNC_MAX_FILES ) ) {
+		FS_FinishAsyncJob();
+	}
+	job = &fs_asyncJobs[fs_asyncTail];
+
+	Q_strncpyz( job->qpath, qpath, sizeof( job->qpath ) );
+	job->callback = callback;
+	job->data = data;
+	job->length = len;
+
+	if ( fsh[h].zipFile ) {
+		pak = fsh[h].zipPack;
+		zfi = (unz_s *)fsh[h].handleFiles.file.z;
+		unzGetCurrentFileDataOffset( zfi, &offset, &stored );
+		job->stored = (qboolean)stored;
+		job->offset = (int)offset;
+		job->compressedLength = stored ? len : (int)zfi->cur_file_info.compressed_size;
+		if ( pak->mapped && job->offset + job->compressedLength <= pak->mappedLength ) {
+			job->view = pak->mapped + job->offset;
+		} else if ( callback ) {
+			job->pakFilename = pak->pakFilename;
+		} else {
+			FS_FCloseFile( h );
+			return qfalse;
+		}
+		FS_FCloseFile( h );
+	} else {
+		// the worker gets the open file, the handle is released without closing it
+		job->stored = qtrue;
+		job->compressedLength = len;
+		job->file = fsh[h].handleFiles.file.o;
+		Com_Memset( &fsh[h], 0, sizeof( fsh[h] ) );
+		fs_asyncFiles++;
+	}
+
+	fs_asyncTail = ( fs_asyncTail + 1 ) % FS_ASYNC_JOBS;
+
+	if ( !fs_asyncWorkers ) {
+		FS_AsyncRead( job );
+		job->state = ASYNC_DONE;
+		return qtrue;
+	}
+
+	Sys_LockMutex( fs_asyncLock );
+	job->state = ASYNC_QUEUED;
+	Sys_UnlockMutex( fs_asyncLock );
+	Sys_SignalSemaphore( fs_asyncWork );
+
+	return qtrue;
+}
+
+/*
+================
+FS_ReadFileAsync
+================
+*/
+qboolean FS_ReadFileAsync( const char *qpath, fsAsyncCallback_t callback, void *data ) {
+	if ( !callback ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync: NULL callback" );
+	}
+	return FS_QueueAsync( qpath, callback, data );
+}
+
+/*
+================
+FS_Prefetch
+================
+*/
+qboolean FS_Prefetch( const char *qpath ) {
+	return FS_QueueAsync( qpath, NULL, NULL );
+}
+
+/*
+================
+FS_AsyncFrame
+
+Runs the callbacks of the reads that are done
+================
+*/
+void FS_AsyncFrame( void ) {
+	while ( fs_asyncHead != fs_asyncTail && FS_AsyncJobDone( &fs_asyncJobs[fs_asyncHead] ) ) {
+		FS_FinishAsyncJob();
+	}
+}
+
+/*
+================
+FS_FinishAsync
+
+Waits for every queued read and runs its callback
+================
+*/
+void FS_FinishAsync( void ) {
+	while ( fs_asyncHead != fs_asyncTail ) {
+		FS_FinishAsyncJob();
+	}
+}
+
+/*
+================
+FS_InflateBenchDone
+================
+*/
+static int	fs_inflateBenchBytes;
+
+static void FS_InflateBenchDone( const char *qpath, void *buffer, int length, void *data ) {
+	if ( buffer ) {
+		fs_inflateBenchBytes += length;
+	}
+}
+
+/*
+================
+FS_InflateBench_f
+
+fs_inflatebench [megabytes]
+
+Inflates the deflated files of the pk3s with the old streaming decoder,
+with unzInflateBuffer, and through the async workers, which also look
+the files up and read them
+================
+*/
+static void FS_InflateBench_f( void ) {
+	searchpath_t	*search;
+	pack_t			*pak;
+	unzFile			zf;
+	unz_file_info	info;
+	unsigned long	offset;
+	int				stored;
+	const char		**names;
+	byte			**sources;
+	int				*lengths, *compressedLengths;
+	byte			*out, *check;
+	int				limit, total, compressed, maxLength, maxFiles, count;
+	int				i, pass, usec, bad, queued;
+
+	limit = 32;
+	if ( Cmd_Argc() > 1 ) {
+		limit = atoi( Cmd_Argv( 1 ) );
+		if ( limit < 1 ) {
+			limit = 1;
+		}
+	}
+	limit *= 1024 * 1024;
+
+	maxFiles = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			maxFiles += search->pack->numfiles;
+		}
+	}
+	if ( !maxFiles ) {
+		Com_Printf( "no pk3 files\n" );
+		return;
+	}
+
+	// the corpus can be bigger than the zone
+	names = (const char **) malloc( maxFiles * sizeof( *names ) );
+	sources = (byte **) malloc( maxFiles * sizeof( *sources ) );
+	lengths = (int *) malloc( maxFiles * sizeof( *lengths ) );
+	compressedLengths = (int *) malloc( maxFiles * sizeof( *compressedLengths ) );
+
+	count = 0;
+	total = 0;
+	compressed = 0;
+	maxLength = 0;
+	for ( search = fs_searchpaths ; search && total < limit ; search = search->next ) {
+		pak = search->pack;
+		if ( !pak ) {
+			continue;
+		}
+		zf = unzOpen( pak->pakFilename );
+		if ( !zf ) {
+			continue;
+		}
+		for ( i = 0 ; i < pak->numfiles && total < limit ; i++ ) {
+			if ( unzSetCurrentFileInfoPosition( zf, pak->buildBuffer[i].pos ) != UNZ_OK
+				|| unzGetCurrentFileInfo( zf, &info, NULL, 0, NULL, 0, NULL, 0 ) != UNZ_OK
+				|| info.compression_method == 0 || !info.uncompressed_size ) {
+				continue;
+			}
+			if ( unzOpenCurrentFile( zf ) != UNZ_OK ) {
+				continue;
+			}
+			unzGetCurrentFileDataOffset( zf, &offset, &stored );
+			sources[count] = (byte *) malloc( info.compressed_size );
+			if ( fseek( ((unz_s *)zf)->file, offset, SEEK_SET )
+				|| fread( sources[count], info.compressed_size, 1, ((unz_s *)zf)->file ) != 1 ) {
+				free( sources[count] );
+				unzCloseCurrentFile( zf );
+				continue;
+			}
+			unzCloseCurrentFile( zf );
+
+			names[count] = pak->buildBuffer[i].name;
+			lengths[count] = info.uncompressed_size;
+			compressedLengths[count] = info.compressed_size;
+			total += lengths[count];
+			compressed += compressedLengths[count];
+			if ( lengths[count] > maxLength ) {
+				maxLength = lengths[count];
+			}
+			count++;
+		}
+		unzClose( zf );
+	}
+
+	if ( !count ) {
+		Com_Printf( "no deflated files in the pk3s\n" );
+	} else {
+		Com_Printf( "%i deflated files, %i KB inflating to %i KB\n", count, compressed / 1024, total / 1024 );
+
+		out = (byte *) malloc( maxLength );
+		check = (byte *) malloc( maxLength );
+
+		for ( pass = 0 ; pass < 2 ; pass++ ) {
+			usec = Sys_Microseconds();
+			for ( i = 0 ; i < count ; i++ ) {
+				if ( pass == 0 ) {
+					unzInflateBufferZlib( out, lengths[i], sources[i], compressedLengths[i] );
+				} else {
+					unzInflateBuffer( out, lengths[i], sources[i], compressedLengths[i] );
+				}
+			}
+			usec = Sys_Microseconds() - usec;
+			if ( usec < 1 ) {
+				usec = 1;
+			}
+			Com_Printf( "%s %8i usec, %7.1f MB/s\n", pass ? "table:    " : "streaming:", usec, (float)total / usec );
+		}
+
+		// both decoders have to agree
+		bad = 0;
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( unzInflateBufferZlib( check, lengths[i], sources[i], compressedLengths[i] ) != UNZ_OK
+				|| unzInflateBuffer( out, lengths[i], sources[i], compressedLengths[i] ) != UNZ_OK
+				|| memcmp( out, check, lengths[i] ) ) {
+				bad++;
+			}
+		}
+		if ( bad ) {
+			Com_Printf( "^1%i files inflated differently\n", bad );
+		}
+
+		// the same names can resolve to other pk3s, so count what comes back
+		FS_FinishAsync();
+		fs_inflateBenchBytes = 0;
+		queued = 0;
+		usec = Sys_Microseconds();
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( FS_ReadFileAsync( names[i], FS_InflateBenchDone, NULL ) ) {
+				queued++;
+			}
+		}
+		FS_FinishAsync();
+		usec = Sys_Microseconds() - usec;
+		if ( usec < 1 ) {
+			usec = 1;
+		}
+		Com_Printf( "async:     %8i usec, %7.1f MB/s, %i files on %i workers\n",
+			usec, (float)fs_inflateBenchBytes / usec, queued, fs_asyncWorkers );
+
+		free( out );
+		free( check );
+	}
+
+	for ( i = 0 ; i < count ; i++ ) {
+		free( sources[i] );
+	}
+	free( names );
+	free( sources );
+	free( lengths );
+	free( compressedLengths );
+}
+
+/*
+============
+FS_WriteFile
+
+Filename are reletive to the quake search path
+============
+*/
+void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
+	fileHandle_t f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !buffer ) {
+		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	}
+
+	f = FS_FOpenFileWrite( qpath );
+	if ( !f ) {
+		Com_Printf( "Failed to open %s\n", qpath );
+		return;
+	}
+
+	FS_Write( buffer, size, f );
+
+	FS_FCloseFile( f );
+}
+
+/*
+============
+FS_MapFile
+
+Maps a file that FS_WriteFile wrote to the home path read only, NULL if it
+isn't there or can't be mapped.  Pk3 files and the other search paths are
+not looked at.  Sys_UnmapFile releases it.
+============
+*/
+const void *FS_MapFile( const char *qpath, int *length ) {
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_MapFile with empty name\n" );
+	}
+
+	return Sys_MapFile( FS_BuildOSPath( fs_homepath->string, fs_gamedir, qpath ), length );
+}
+
+
+
+/*
+==========================================================================
+
+ZIP FILE LOADING
+
+==========================================================================
+*/
+
+/*
+=================================================================================
+
+PK3 INDEX
+
+Walking the central directory of every pk3 costs a read per file, which adds
+up to most of the startup time with a few hundred pk3s.  The file list,
+central directory positions and header checksums of each pk3 are kept in
+fs_homepath/pk3index.dat, keyed by the pk3 path, size and modification time.
+The index is read in one go at FS_Startup and rewritten at the end of it if
+any pk3 had to be scanned.  The pure checksum depends on fs_checksumFeed, so
+the header checksums it is made from are stored rather than the result.
+
+All ints are little endian, every section is padded to four bytes:
+
+	ident, version, numEntries
+	per entry:
+		pathLength, path, size, mtime, numFiles, numHeaderLongs, namesLength
+		pos[numFiles], headerLongs[numHeaderLongs], names
+=================================================================================
+*/
+
+#define	PK3INDEX_IDENT		(('I'<<24)+('3'<<16)+('K'<<8)+'P')
+#define	PK3INDEX_VERSION	1
+#define	PK3INDEX_HASH_SIZE	1024
+#define	PK3INDEX_NAME		"pk3index.dat"
+
+typedef struct pk3IndexEntry_s {
+	const char		*path;
+	int				size;
+	int				mtime;
+	int				numFiles;
+	int				numHeaderLongs;
+	int				namesLength;
+	const int		*pos;
+	const int		*headerLongs;
+	const char		*names;
+	qboolean		used;			// a pk3 with this path was loaded, don't write the old entry back
+	struct pk3IndexEntry_s	*next;
+} pk3IndexEntry_t;
+
+static	byte			*fs_indexData;
+static	pk3IndexEntry_t	*fs_indexEntries;
+static	int				fs_numIndexEntries;
+static	pk3IndexEntry_t	*fs_indexHash[PK3INDEX_HASH_SIZE];
+static	qboolean		fs_indexDirty;
+
+/*
+================
+FS_IndexPath
+================
+*/
+static const char *FS_IndexPath( void ) {
+	return va( "%s%c%s", fs_homepath->string, PATH_SEP, PK3INDEX_NAME );
+}
+
+/*
+================
+FS_IndexInt
+
+Reads the next int of the index, qfalse if the data runs out
+================
+*/
+static qboolean FS_IndexInt( byte **p, byte *end, int *value ) {
+	if ( end - *p < 4 ) {
+		return qfalse;
+	}
+	*value = LittleLong( *(int *)*p );
+	*(int *)*p = *value;
+	*p += 4;
+	return qtrue;
+}
+
+/*
+================
+FS_IndexArray
+
+Converts count ints in place
+================
+*/
+static qboolean FS_IndexArray( byte **p, byte *end, int count, const int **array ) {
+	int		i, value;
+
+	if ( count < 0 || ( end - *p ) / 4 < count ) {
+		return qfalse;
+	}
+	*array = (const int *)*p;
+	for ( i = 0 ; i < count ; i++ ) {
+		FS_IndexInt( p, end, &value );
+	}
+	return qtrue;
+}
+
+/*
+================
+FS_IndexStrings
+
+Checks that length bytes hold exactly count strings.  A pk3 without
+files has an empty block.
+================
+*/
+static qboolean FS_IndexStrings( byte **p, byte *end, int length, int count, const char **strings ) {
+	int		i, found;
+
+	if ( length < 0 || end - *p < length || ( length > 0 && (*p)[length - 1] != '\0' ) ) {
+		return qfalse;
+	}
+	found = 0;
+	for ( i = 0 ; i < length ; i++ ) {
+		if ( !(*p)[i] ) {
+			found++;
+		}
+	}
+	if ( found != count ) {
+		return qfalse;
+	}
+	*strings = (const char *)*p;
+	*p += ( length + 3 ) & ~3;
+	if ( *p > end ) {
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+================
+FS_FreeIndex
+================
+*/
+static void FS_FreeIndex( void ) {
+	if ( fs_indexData ) {
+		Z_Free( fs_indexData );
+	}
+	if ( fs_indexEntries ) {
+		Z_Free( fs_indexEntries );
+	}
+	fs_indexData = NULL;
+	fs_indexEntries = NULL;
+	fs_numIndexEntries = 0;
+	Com_Memset( fs_indexHash, 0, sizeof( fs_indexHash ) );
+	fs_indexDirty = qfalse;
+}
 
-			fs_loadCount++;
-			fs_loadStack++;
+/*
+================
+FS_LoadIndex
+================
+*/
+static void FS_LoadIndex( void ) {
+	FILE			*f;
+	int				length, ident, version, count, i;
+	byte			*p, *end;
+	pk3IndexEntry_t	*entry;
+	long			hash;
 
-			// guarantee that it will have a trailing 0 for string operations
-			buf[len] = 0;
+	FS_FreeIndex();
 
-			return len;
-		}
-	} else {
-		isConfig = qfalse;
+	if ( !fs_pk3Index->integer ) {
+		return;
 	}
 
-	// look for it in the filesystem or pack files
-	len = FS_FOpenFileRead( qpath, &h, qfalse );
-	if ( h == 0 ) {
-		if ( buffer ) {
-			*buffer = NULL;
-		}
-		// if we are journalling and it is a config file, write a zero to the journal file
-		if ( isConfig && com_journal && com_journal->integer == 1 ) {
-			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
-			len = 0;
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
-		}
-		return -1;
+	f = fopen( FS_IndexPath(), "rb" );
+	if ( !f ) {
+		return;
 	}
-	
-	if ( !buffer ) {
-		if ( isConfig && com_journal && com_journal->integer == 1 ) {
-			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
-		}
-		FS_FCloseFile( h);
-		return len;
+	fseek( f, 0, SEEK_END );
+	length = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	if ( length < 12 ) {
+		fclose( f );
+		return;
+	}
+	fs_indexData = (byte *) Z_Malloc( length );
+	if ( fread( fs_indexData, 1, length, f ) != length ) {
+		fclose( f );
+		FS_FreeIndex();
+		return;
 	}
+	fclose( f );
 
-	fs_loadCount++;
-	fs_loadStack++;
+	p = fs_indexData;
+	end = fs_indexData + length;
+	FS_IndexInt( &p, end, &ident );
+	FS_IndexInt( &p, end, &version );
+	FS_IndexInt( &p, end, &count );
+	if ( ident != PK3INDEX_IDENT || version != PK3INDEX_VERSION || count <= 0 || count > length / 28 ) {
+		FS_FreeIndex();
+		return;
+	}
 
-	buf = (byte*) Hunk_AllocateTempMemory(len+1);
-	*buffer = buf;
+	fs_indexEntries = (pk3IndexEntry_t *) Z_Malloc( count * sizeof( *fs_indexEntries ) );
+	for ( i = 0, entry = fs_indexEntries ; i < count ; i++, entry++ ) {
+		int		pathLength;
+
+		if ( !FS_IndexInt( &p, end, &pathLength )
+			|| !FS_IndexStrings( &p, end, pathLength, 1, &entry->path )
+			|| !FS_IndexInt( &p, end, &entry->size )
+			|| !FS_IndexInt( &p, end, &entry->mtime )
+			|| !FS_IndexInt( &p, end, &entry->numFiles )
+			|| !FS_IndexInt( &p, end, &entry->numHeaderLongs )
+			|| !FS_IndexInt( &p, end, &entry->namesLength )
+			|| !FS_IndexArray( &p, end, entry->numFiles, &entry->pos )
+			|| !FS_IndexArray( &p, end, entry->numHeaderLongs, &entry->headerLongs )
+			|| !FS_IndexStrings( &p, end, entry->namesLength, entry->numFiles, &entry->names ) ) {
+			Com_Printf( "%s is damaged, rescanning all pk3 files\n", PK3INDEX_NAME );
+			FS_FreeIndex();
+			return;
+		}
 
-	FS_Read (buf, len, h);
+		hash = FS_HashFileName( entry->path, PK3INDEX_HASH_SIZE );
+		entry->next = fs_indexHash[hash];
+		fs_indexHash[hash] = entry;
+	}
+	fs_numIndexEntries = count;
+}
 
-	// guarantee that it will have a trailing 0 for string operations
-	buf[len] = 0;
-	FS_FCloseFile( h );
+/*
+================
+FS_FindIndexEntry
 
-	// if we are journalling and it is a config file, write it to the journal file
-	if ( isConfig && com_journal && com_journal->integer == 1 ) {
-		Com_DPrintf( "Writing %s to journal file.\n", qpath );
-		FS_Write( &len, sizeof( len ), com_journalDataFile );
-		FS_Write( buf, len, com_journalDataFile );
-		FS_Flush( com_journalDataFile );
+Returns the index entry for the pk3 if it is still current
+================
+*/
+static pk3IndexEntry_t *FS_FindIndexEntry( const char *zipfile, int size, int mtime, int numFiles ) {
+	pk3IndexEntry_t	*entry;
+
+	for ( entry = fs_indexHash[FS_HashFileName( zipfile, PK3INDEX_HASH_SIZE )] ; entry ; entry = entry->next ) {
+		if ( !strcmp( entry->path, zipfile ) ) {
+			entry->used = qtrue;
+			if ( entry->size == size && entry->mtime == mtime && entry->numFiles == numFiles ) {
+				return entry;
+			}
+			return NULL;
+		}
 	}
-	return len;
+	return NULL;
 }
 
 /*
-=============
-FS_FreeFile
-=============
+================
+FS_IndexWrite
+================
 */
-void FS_FreeFile( void *buffer ) {
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
-	}
-	if ( !buffer ) {
-		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+static void FS_IndexWrite( FILE *f, const void *data, int length ) {
+	static const byte	pad[4] = { 0, 0, 0, 0 };
+
+	fwrite( data, 1, length, f );
+	if ( length & 3 ) {
+		fwrite( pad, 1, 4 - ( length & 3 ), f );
 	}
-	fs_loadStack--;
+}
 
-	Hunk_FreeTempMemory( buffer );
+/*
+================
+FS_IndexWriteInts
+================
+*/
+static void FS_IndexWriteInts( FILE *f, const int *values, int count ) {
+	int		i, value;
 
-	// if all of our temp files are free, clear all of our space
-	if ( fs_loadStack == 0 ) {
-		Hunk_ClearTempMemory();
+	for ( i = 0 ; i < count ; i++ ) {
+		value = LittleLong( values[i] );
+		fwrite( &value, 1, 4, f );
 	}
 }
 
 /*
-============
-FS_WriteFile
-
-Filename are reletive to the quake search path
-============
+================
+FS_IndexWriteEntry
+================
 */
-void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
-	fileHandle_t f;
+static void FS_IndexWriteEntry( FILE *f, const char *path, const int header[5],
+							   const int *pos, const int *headerLongs, const char *names ) {
+	int		pathLength;
+
+	pathLength = (int)strlen( path ) + 1;
+	FS_IndexWriteInts( f, &pathLength, 1 );
+	FS_IndexWrite( f, path, pathLength );
+	FS_IndexWriteInts( f, header, 5 );
+	FS_IndexWriteInts( f, pos, header[2] );
+	FS_IndexWriteInts( f, headerLongs, header[3] );
+	FS_IndexWrite( f, names, header[4] );
+}
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+/*
+================
+FS_SaveIndex
+
+Writes the loaded pk3s and the entries for pk3s that weren't loaded this
+time, so switching between mods doesn't keep throwing the index away
+================
+*/
+static void FS_SaveIndex( void ) {
+	FILE			*f;
+	searchpath_t	*search;
+	pack_t			*pack;
+	pk3IndexEntry_t	*entry;
+	int				header[5], *pos;
+	int				i, count;
+	const char		*names;
+	char			path[MAX_OSPATH];
+
+	if ( !fs_indexDirty || !fs_pk3Index->integer ) {
+		FS_FreeIndex();
+		return;
 	}
 
-	if ( !qpath || !buffer ) {
-		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	count = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->fileSize ) {
+			count++;
+		}
+	}
+	for ( i = 0 ; i < fs_numIndexEntries ; i++ ) {
+		if ( !fs_indexEntries[i].used ) {
+			count++;
+		}
 	}
 
-	f = FS_FOpenFileWrite( qpath );
+	Q_strncpyz( path, FS_IndexPath(), sizeof( path ) );
+	FS_CreatePath( path );
+	f = fopen( path, "wb" );
 	if ( !f ) {
-		Com_Printf( "Failed to open %s\n", qpath );
+		Com_Printf( "Couldn't write %s\n", path );
+		FS_FreeIndex();
 		return;
 	}
 
-	FS_Write( buffer, size, f );
-
-	FS_FCloseFile( f );
-}
+	header[0] = PK3INDEX_IDENT;
+	header[1] = PK3INDEX_VERSION;
+	header[2] = count;
+	FS_IndexWriteInts( f, header, 3 );
 
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		pack = search->pack;
+		if ( !pack || !pack->fileSize ) {
+			continue;
+		}
+		names = (const char *)( pack->buildBuffer + pack->numfiles );
+		pos = (int *) Z_Malloc( pack->numfiles * sizeof( int ) );
+		header[4] = 0;
+		for ( i = 0 ; i < pack->numfiles ; i++ ) {
+			pos[i] = (int)pack->buildBuffer[i].pos;
+			header[4] += (int)strlen( pack->buildBuffer[i].name ) + 1;
+		}
+		header[0] = pack->fileSize;
+		header[1] = pack->fileTime;
+		header[2] = pack->numfiles;
+		header[3] = pack->numHeaderLongs;
+		FS_IndexWriteEntry( f, pack->pakFilename, header, pos, pack->headerLongs, names );
+		Z_Free( pos );
+	}
 
+	for ( i = 0, entry = fs_indexEntries ; i < fs_numIndexEntries ; i++, entry++ ) {
+		if ( entry->used ) {
+			continue;
+		}
+		header[0] = entry->size;
+		header[1] = entry->mtime;
+		header[2] = entry->numFiles;
+		header[3] = entry->numHeaderLongs;
+		header[4] = entry->namesLength;
+		FS_IndexWriteEntry( f, entry->path, header, entry->pos, entry->headerLongs, entry->names );
+	}
 
-/*
-==========================================================================
-
-ZIP FILE LOADING
-
-==========================================================================
-*/
+	fclose( f );
+	FS_FreeIndex();
+}
 
 /*
 =================
@@ -1688,6 +3023,8 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 	int				fs_numHeaderLongs;
 	int				*fs_headerLongs;
 	char			*namePtr;
+	int				fileSize, fileTime;
+	pk3IndexEntry_t	*entry;
 
 	fs_numHeaderLongs = 0;
 
@@ -1699,21 +3036,36 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 
 	fs_packFiles += gi.number_entry;
 
+	// a current index entry saves walking the central directory
+	entry = NULL;
+	if ( Sys_StatFile( zipfile, &fileSize, &fileTime ) ) {
+		entry = FS_FindIndexEntry( zipfile, fileSize, fileTime, gi.number_entry );
+	} else {
+		fileSize = 0;
+	}
+	if ( !entry ) {
+		fs_indexDirty = qtrue;
+	}
+
 	len = 0;
-	unzGoToFirstFile(uf);
-	for (i = 0; i < gi.number_entry; i++)
-	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		if (err != UNZ_OK) {
-			break;
+	if ( entry ) {
+		len = entry->namesLength;
+	} else {
+		unzGoToFirstFile(uf);
+		for (i = 0; i < gi.number_entry; i++)
+		{
+			err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
+			if (err != UNZ_OK) {
+				break;
+			}
+			len += (int)strlen(filename_inzip) + 1;
+			unzGoToNextFile(uf);
 		}
-		len += (int)strlen(filename_inzip) + 1;
-		unzGoToNextFile(uf);
 	}
 
 	buildBuffer = (fileInPack_t*) Z_Malloc( (gi.number_entry * sizeof( fileInPack_t )) + len );
 	namePtr = ((char *) buildBuffer) + gi.number_entry * sizeof( fileInPack_t );
-	fs_headerLongs = (int*) Z_Malloc( gi.number_entry * sizeof(int) );
+	fs_headerLongs = (int*) Z_Malloc( ( gi.number_entry ? gi.number_entry : 1 ) * sizeof(int) );
 
 	// get the hash table size from the number of files in the zip
 	// because lots of custom pk3 files have less than 32 or 64 files
@@ -1740,12 +3092,43 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 
 	pack->handle = uf;
 	pack->numfiles = gi.number_entry;
-	unzGoToFirstFile(uf);
+	pack->fileSize = fileSize;
+	pack->fileTime = fileTime;
+
+	// stored files are handed out straight from the mapping, and
+	// processes on the same host share the pages
+	if ( fs_mapPaks->integer ) {
+		pack->mapped = (const byte *) Sys_MapFile( zipfile, &pack->mappedLength );
+	}
+
+	if ( entry ) {
+		const char	*name;
+
+		Com_Memcpy( namePtr, entry->names, len );
+		Com_Memcpy( fs_headerLongs, entry->headerLongs, entry->numHeaderLongs * sizeof( int ) );
+		fs_numHeaderLongs = entry->numHeaderLongs;
+
+		name = namePtr;
+		for (i = 0; i < gi.number_entry; i++)
+		{
+			hash = FS_HashFileName(name, pack->hashSize);
+			buildBuffer[i].name = (char *)name;
+			buildBuffer[i].pos = (unsigned long)entry->pos[i];
+			buildBuffer[i].next = pack->hashTable[hash];
+			pack->hashTable[hash] = &buildBuffer[i];
+			name += strlen( name ) + 1;
+		}
+		i = 0;
+	} else {
+		unzGoToFirstFile(uf);
+		i = 0;
+	}
 
-	for (i = 0; i < gi.number_entry; i++)
+	for ( ; !entry && i < gi.number_entry; i++)
 	{
 		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
 		if (err != UNZ_OK) {
+			pack->fileSize = 0;		// incomplete, don't index it
 			break;
 		}
 		if (file_info.uncompressed_size > 0) {
@@ -1769,7 +3152,9 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 	pack->checksum = LittleLong( pack->checksum );
 	pack->pure_checksum = LittleLong( pack->pure_checksum );
 
-	Z_Free(fs_headerLongs);
+	// kept for the index
+	pack->headerLongs = fs_headerLongs;
+	pack->numHeaderLongs = fs_numHeaderLongs;
 
 	pack->buildBuffer = buildBuffer;
 	return pack;
@@ -1784,6 +3169,9 @@ DIRECTORY SCANNING FUNCTIONS
 */
 
 #define	MAX_FOUND_FILES	0x1000
+#define	FOUND_FILES_HASH	( MAX_FOUND_FILES * 2 )
+
+static	qboolean	fs_listIndexDisabled;		// for fs_listbench
 
 static int FS_ReturnPath( const char *zname, char *zpath, int *depth ) {
 	int len, at, newdep;
@@ -1813,23 +3201,110 @@ static int FS_ReturnPath( const char *zname, char *zpath, int *depth ) {
 FS_AddFileToList
 ==================
 */
-static int FS_AddFileToList( char *name, char *list[MAX_FOUND_FILES], int nfiles ) {
+static int FS_AddFileToList( char *name, char *list[MAX_FOUND_FILES], int nfiles, unsigned short listHash[FOUND_FILES_HASH] ) {
 	int		i;
 
 	if ( nfiles == MAX_FOUND_FILES - 1 ) {
 		return nfiles;
 	}
-	for ( i = 0 ; i < nfiles ; i++ ) {
-		if ( !Q_stricmp( name, list[i] ) ) {
+	// listHash holds list index + 1, it is never more than half full
+	for ( i = FS_IndexHash( name ) & ( FOUND_FILES_HASH - 1 ) ; listHash[i] ; i = ( i + 1 ) & ( FOUND_FILES_HASH - 1 ) ) {
+		if ( !Q_stricmp( name, list[listHash[i] - 1] ) ) {
 			return nfiles;		// allready in list
 		}
 	}
+	listHash[i] = (unsigned short)( nfiles + 1 );
 	list[nfiles] = CopyString( name );
 	nfiles++;
 
 	return nfiles;
 }
 
+/*
+==================
+FS_CompareFileNames
+==================
+*/
+static int FS_CompareFileNames( const void *a, const void *b ) {
+	return Q_stricmp( (*(fileInPack_t **)a)->name, (*(fileInPack_t **)b)->name );
+}
+
+/*
+==================
+FS_CompareFileOrder
+==================
+*/
+static int FS_CompareFileOrder( const void *a, const void *b ) {
+	fileInPack_t	*fa, *fb;
+
+	fa = *(fileInPack_t **)a;
+	fb = *(fileInPack_t **)b;
+	return fa < fb ? -1 : ( fa > fb ? 1 : 0 );
+}
+
+/*
+==================
+FS_PakFilesWithPrefix
+
+Binary searches the name sorted files of the pk3 for the ones that start
+with prefix, case insensitive, and returns them in pk3 order, which is
+the order the listings have always come in.  The sorted list is made on
+the first call and lives as long as the pack.  The caller Z_Frees *files.
+==================
+*/
+static int FS_PakFilesWithPrefix( pack_t *pak, const char *prefix, int prefixLength, fileInPack_t ***files ) {
+	int		i, low, high, mid;
+
+	*files = NULL;
+	if ( !pak->numfiles ) {
+		return 0;
+	}
+
+	if ( fs_listIndexDisabled ) {
+		// every file, for fs_listbench to compare with
+		*files = (fileInPack_t **) Z_Malloc( pak->numfiles * sizeof( **files ) );
+		for ( i = 0 ; i < pak->numfiles ; i++ ) {
+			(*files)[i] = &pak->buildBuffer[i];
+		}
+		return pak->numfiles;
+	}
+
+	if ( !pak->sortedFiles ) {
+		pak->sortedFiles = (fileInPack_t **) Z_Malloc( pak->numfiles * sizeof( *pak->sortedFiles ) );
+		for ( i = 0 ; i < pak->numfiles ; i++ ) {
+			pak->sortedFiles[i] = &pak->buildBuffer[i];
+		}
+		qsort( pak->sortedFiles, pak->numfiles, sizeof( *pak->sortedFiles ), FS_CompareFileNames );
+	}
+
+	// first name that doesn't sort before the prefix
+	low = 0;
+	high = pak->numfiles;
+	while ( low < high ) {
+		mid = ( low + high ) >> 1;
+		if ( Q_stricmpn( pak->sortedFiles[mid]->name, prefix, prefixLength ) < 0 ) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	for ( high = low ; high < pak->numfiles ; high++ ) {
+		if ( Q_stricmpn( pak->sortedFiles[high]->name, prefix, prefixLength ) ) {
+			break;
+		}
+	}
+	if ( high == low ) {
+		return 0;
+	}
+
+	*files = (fileInPack_t **) Z_Malloc( ( high - low ) * sizeof( **files ) );
+	Com_Memcpy( *files, pak->sortedFiles + low, ( high - low ) * sizeof( **files ) );
+	qsort( *files, high - low, sizeof( **files ), FS_CompareFileOrder );
+
+	return high - low;
+}
+
 /*
 ===============
 FS_ListFilteredFiles
@@ -1842,13 +3317,17 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 	int				nfiles;
 	char			**listCopy;
 	char			*list[MAX_FOUND_FILES];
+	unsigned short	listHash[FOUND_FILES_HASH];
 	searchpath_t	*search;
 	int				i;
 	int				pathLength;
 	int				extensionLength;
 	int				length, pathDepth, temp;
 	pack_t			*pak;
-	fileInPack_t	*buildBuffer;
+	fileInPack_t	**pakFiles;
+	int				numPakFiles;
+	char			prefix[MAX_ZPATH];
+	int				prefixLength;
 	char			zpath[MAX_ZPATH];
 
 	if ( !fs_searchpaths ) {
@@ -1869,8 +3348,26 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 	}
 	extensionLength = (int)strlen( extension );
 	nfiles = 0;
+	Com_Memset( listHash, 0, sizeof( listHash ) );
 	FS_ReturnPath(path, zpath, &pathDepth);
 
+	// every pk3 name that can match starts with the path, or with the
+	// literal start of the filter up to a wildcard or a path separator,
+	// which Com_FilterPath doesn't compare as is
+	if ( filter ) {
+		for ( prefixLength = 0 ; prefixLength < MAX_ZPATH - 1 && filter[prefixLength] ; prefixLength++ ) {
+			if ( strchr( "*?[/\\:", filter[prefixLength] ) ) {
+				break;
+			}
+			prefix[prefixLength] = filter[prefixLength];
+		}
+	} else {
+		for ( prefixLength = 0 ; prefixLength < MAX_ZPATH - 1 && prefixLength < pathLength ; prefixLength++ ) {
+			prefix[prefixLength] = path[prefixLength];
+		}
+	}
+	prefix[prefixLength] = 0;
+
 	//
 	// search through the path, one element at a time, adding to list
 	//
@@ -1884,22 +3381,22 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 				continue;
 			}
 
-			// look through all the pak file elements
+			// look through the pak file elements that start right
 			pak = search->pack;
-			buildBuffer = pak->buildBuffer;
-			for (i = 0; i < pak->numfiles; i++) {
+			numPakFiles = FS_PakFilesWithPrefix( pak, prefix, prefixLength, &pakFiles );
+			for (i = 0; i < numPakFiles; i++) {
 				char	*name;
 				int		zpathLen, depth;
 
 				// check for directory match
-				name = buildBuffer[i].name;
+				name = pakFiles[i]->name;
 				//
 				if (filter) {
 					// case insensitive
 					if (!Com_FilterPath( filter, name, qfalse ))
 						continue;
 					// unique the match
-					nfiles = FS_AddFileToList( name, list, nfiles );
+					nfiles = FS_AddFileToList( name, list, nfiles, listHash );
 				}
 				else {
 
@@ -1924,9 +3421,12 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 					if (pathLength) {
 						temp++;		// include the '/'
 					}
-					nfiles = FS_AddFileToList( name + temp, list, nfiles );
+					nfiles = FS_AddFileToList( name + temp, list, nfiles, listHash );
 				}
 			}
+			if ( pakFiles ) {
+				Z_Free( pakFiles );
+			}
 		} else if (search->dir) { // scan for files in the filesystem
 			char	*netpath;
 			int		numSysFiles;
@@ -1942,7 +3442,7 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 				for ( i = 0 ; i < numSysFiles ; i++ ) {
 					// unique the match
 					name = sysFiles[i];
-					nfiles = FS_AddFileToList( name, list, nfiles );
+					nfiles = FS_AddFileToList( name, list, nfiles, listHash );
 				}
 				Sys_FreeFileList( sysFiles );
 			}
@@ -1974,6 +3474,60 @@ char **FS_ListFiles( const char *path, const char *extension, int *numfiles ) {
 	return FS_ListFilteredFiles( path, extension, NULL, numfiles );
 }
 
+/*
+================
+FS_ListBench_f
+
+fs_listbench [path] [extension] [iterations]
+
+Lists the files with and without the sorted pk3 names
+================
+*/
+static void FS_ListBench_f( void ) {
+	char	path[MAX_QPATH];
+	char	extension[MAX_QPATH];
+	char	**lists[2];
+	int		numFiles[2];
+	char	**list;
+	int		iterations, pass, n, i, usec, count;
+
+	Q_strncpyz( path, Cmd_Argc() > 1 ? Cmd_Argv( 1 ) : "scripts", sizeof( path ) );
+	Q_strncpyz( extension, Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : ".shader", sizeof( extension ) );
+	iterations = 100;
+	if ( Cmd_Argc() > 3 ) {
+		iterations = atoi( Cmd_Argv( 3 ) );
+		if ( iterations < 1 ) {
+			iterations = 1;
+		}
+	}
+
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		fs_listIndexDisabled = (qboolean)( pass == 1 );
+		lists[pass] = FS_ListFiles( path, extension, &numFiles[pass] );
+		usec = Sys_Microseconds();
+		for ( n = 0 ; n < iterations ; n++ ) {
+			list = FS_ListFiles( path, extension, &count );
+			FS_FreeFileList( list );
+		}
+		usec = Sys_Microseconds() - usec;
+		Com_Printf( "%s %5i files, %8i usec, %8.1f usec per listing\n",
+			pass ? "full scan:   " : "sorted names:", numFiles[pass], usec, (float)usec / iterations );
+	}
+	fs_listIndexDisabled = qfalse;
+
+	// both have to come out the same, in the same order
+	for ( i = 0 ; i < numFiles[0] && numFiles[0] == numFiles[1] ; i++ ) {
+		if ( strcmp( lists[0][i], lists[1][i] ) ) {
+			break;
+		}
+	}
+	if ( numFiles[0] != numFiles[1] || i < numFiles[0] ) {
+		Com_Printf( "^1listings differ\n" );
+	}
+	FS_FreeFileList( lists[0] );
+	FS_FreeFileList( lists[1] );
+}
+
 /*
 =================
 FS_FreeFileList
@@ -2653,6 +4207,9 @@ void FS_Shutdown( qboolean closemfp ) {
 	searchpath_t	*p, *next;
 	int	i;
 
+	// jobs can point into the packs
+	FS_FinishAsync();
+
 	for(i = 0; i < MAX_FILE_HANDLES; i++) {
 		if (fsh[i].fileSize) {
 			FS_FCloseFile(i);
@@ -2665,7 +4222,14 @@ void FS_Shutdown( qboolean closemfp ) {
 
 		if ( p->pack ) {
 			unzClose(p->pack->handle);
+			if ( p->pack->mapped ) {
+				Sys_UnmapFile( p->pack->mapped, p->pack->mappedLength );
+			}
+			if ( p->pack->sortedFiles ) {
+				Z_Free( p->pack->sortedFiles );
+			}
 			Z_Free( p->pack->buildBuffer );
+			Z_Free( p->pack->headerLongs );
 			Z_Free( p->pack );
 		}
 		if ( p->dir ) {
@@ -2676,11 +4240,15 @@ void FS_Shutdown( qboolean closemfp ) {
 
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
+	FS_FreeFileIndex();
 
 	Cmd_RemoveCommand( "path" );
 	Cmd_RemoveCommand( "dir" );
 	Cmd_RemoveCommand( "fdir" );
 	Cmd_RemoveCommand( "touchFile" );
+	Cmd_RemoveCommand( "fs_lookupbench" );
+	Cmd_RemoveCommand( "fs_inflatebench" );
+	Cmd_RemoveCommand( "fs_listbench" );
 
 #ifdef FS_MISSING
 	if (closemfp) {
@@ -2755,6 +4323,12 @@ static void FS_Startup( const char *gameName ) {
 	fs_homepath = Cvar_Get ("fs_homepath", homePath, CVAR_INIT );
 	fs_gamedirvar = Cvar_Get ("fs_game", "", CVAR_INIT|CVAR_SYSTEMINFO );
 	fs_restrict = Cvar_Get ("fs_restrict", "", CVAR_INIT );
+	fs_pk3Index = Cvar_Get ("fs_pk3Index", "1", CVAR_ARCHIVE );
+	fs_mapPaks = Cvar_Get ("fs_mapPaks", "1", CVAR_INIT );
+
+	FS_InitAsync();
+
+	FS_LoadIndex();
 
 	// add search path elements in reverse priority order
 	if (fs_cdpath->string[0]) {
@@ -2795,6 +4369,8 @@ static void FS_Startup( const char *gameName ) {
 		}
 	}
 
+	FS_SaveIndex();
+
 	Com_ReadCDKey( "baseq3" );
 	fs = Cvar_Get ("fs_game", "", CVAR_INIT|CVAR_SYSTEMINFO );
 	if (fs && fs->string[0] != 0) {
@@ -2806,10 +4382,17 @@ static void FS_Startup( const char *gameName ) {
 	Cmd_AddCommand ("dir", FS_Dir_f );
 	Cmd_AddCommand ("fdir", FS_NewDir_f );
 	Cmd_AddCommand ("touchFile", FS_TouchFile_f );
+	Cmd_AddCommand ("fs_lookupbench", FS_LookupBench_f );
+	Cmd_AddCommand ("fs_inflatebench", FS_InflateBench_f );
+	Cmd_AddCommand ("fs_listbench", FS_ListBench_f );
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=506
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
+
+	FS_BuildFileIndex();
+	fs_lookups = 0;
+	fs_lookupUsec = 0;
 	
 	// print the current search paths
 	FS_Path_f();
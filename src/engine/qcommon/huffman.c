@@ -321,6 +321,95 @@ void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset) {
 	*offset = bloc;
 }
 
+/* Flatten the codes of a subtree into the table */
+static void Huff_TableCodes(huffTable_t *table, node_t *node, unsigned int code, int depth) {
+	int i;
+
+	if (!node) {
+		return;
+	}
+	if (node->symbol != INTERNAL_NODE) {
+		if (depth <= HUFF_MAX_CODE) {
+			table->code[node->symbol] = code;
+			table->codeLength[node->symbol] = (byte)depth;
+		}
+		if (depth <= HUFF_FAST_BITS) {
+			/* every index that starts with the code */
+			for (i = code; i < (1<<HUFF_FAST_BITS); i += 1<<depth) {
+				table->fastSymbol[i] = (short)node->symbol;
+				table->fastLength[i] = (byte)depth;
+			}
+		}
+		return;
+	}
+	if (depth >= 32) {
+		return;		/* left to the tree walk */
+	}
+	Huff_TableCodes(table, node->left, code, depth + 1);
+	Huff_TableCodes(table, node->right, code | (1u << depth), depth + 1);
+}
+
+/* Build the whole symbol codes of a tree that won't change any more */
+void Huff_BuildTable(huff_t *huff, huffTable_t *table) {
+	int i;
+
+	Com_Memset(table, 0, sizeof(*table));
+	for (i = 0; i < (1<<HUFF_FAST_BITS); i++) {
+		table->fastSymbol[i] = -1;
+	}
+	table->huff = huff;
+	Huff_TableCodes(table, huff->tree, 0, 0);
+}
+
+/* Write count bits, first bit in bit 0, exactly as that many Huff_putBit calls would */
+void Huff_putBits(unsigned int bits, int count, byte *fout, int *offset) {
+	int b, n, shift;
+
+	b = *offset;
+	while (count > 0) {
+		shift = b & 7;
+		n = 8 - shift;
+		if (n > count) {
+			n = count;
+		}
+		if (shift == 0) {
+			fout[b>>3] = 0;
+		}
+		fout[b>>3] |= (bits & ((1<<n) - 1)) << shift;
+		bits >>= n;
+		count -= n;
+		b += n;
+	}
+	*offset = b;
+}
+
+/* Get a symbol with one lookup, maxsize is the size of fin in bytes */
+void Huff_offsetReceiveTable(const huffTable_t *table, int *ch, byte *fin, int *offset, int maxsize) {
+	int b, peek, i;
+
+	b = *offset;
+	/* never look past the buffer, even for bits the code doesn't use */
+	if ((b>>3) + 3 <= maxsize) {
+		peek = (fin[b>>3] | (fin[(b>>3)+1] << 8) | (fin[(b>>3)+2] << 16)) >> (b & 7);
+		i = peek & ((1<<HUFF_FAST_BITS) - 1);
+		if (table->fastSymbol[i] >= 0) {
+			*ch = table->fastSymbol[i];
+			*offset = b + table->fastLength[i];
+			return;
+		}
+	}
+	Huff_offsetReceive(table->huff->tree, ch, fin, offset);
+}
+
+/* Send a symbol with one write */
+void Huff_offsetTransmitTable(const huffTable_t *table, int ch, byte *fout, int *offset) {
+	if (!table->codeLength[ch]) {
+		Huff_offsetTransmit(table->huff, ch, fout, offset);
+		return;
+	}
+	Huff_putBits(table->code[ch], table->codeLength[ch], fout, offset);
+}
+
 void Huff_Decompress(msg_t *mbuf, int offset) {
 	int			ch, cch, i, j, size;
 	byte		seq[65536];
@@ -373,8 +462,6 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern 	int oldsize;
-
 void Huff_Compress(msg_t *mbuf, int offset) {
 	int			i, ch, size;
 	byte		seq[65536];
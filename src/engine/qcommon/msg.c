@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 
 static huffman_t		msgHuff;
+static huffTable_t		msgHuffTransmit;	// msgHuff flattened for whole symbols
+static huffTable_t		msgHuffReceive;
 
 static qboolean			msgInit = qfalse;
 
@@ -37,8 +39,6 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-int oldsize = 0;
-
 void MSG_initHuffman();
 
 void MSG_Init( msg_t *buf, byte *data, int length ) {
@@ -64,6 +64,7 @@ void MSG_Clear( msg_t *buf ) {
 	buf->cursize = 0;
 	buf->overflowed = qfalse;
 	buf->bit = 0;					//<- in bits
+	buf->warning = NULL;
 }
 
 
@@ -101,14 +102,11 @@ bit functions
 =============================================================================
 */
 
-int	overflows;
-
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	int	i;
 //	FILE*	fp;
 
-	oldsize += bits;
 
 	// this isn't an exact overflow check, but close enough
 	if ( msg->maxsize - msg->cursize < 4 ) {
@@ -124,7 +122,7 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	if ( bits != 32 ) {
 		if ( bits > 0 ) {
 			if ( value > ( ( 1 << bits ) - 1 ) || value < 0 ) {
-				overflows++;
+				msg->overflows++;
 			}
 		} else {
 			int	r;
@@ -132,7 +130,7 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 			r = 1 << (bits-1);
 
 			if ( value >  r - 1 || value < -r ) {
-				overflows++;
+				msg->overflows++;
 			}
 		}
 	}
@@ -163,16 +161,14 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 		if (bits&7) {
 			int nbits;
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				Huff_putBit((value&1), msg->data, &msg->bit);
-				value = (value>>1);
-			}
+			Huff_putBits(value & ((1<<nbits)-1), nbits, msg->data, &msg->bit);
+			value = (value>>nbits);
 			bits = bits - nbits;
 		}
 		if (bits) {
 			for(i=0;i<bits;i+=8) {
 //				fwrite(bp, 1, 1, fp);
-				Huff_offsetTransmit (&msgHuff.compressor, (value&0xff), msg->data, &msg->bit);
+				Huff_offsetTransmitTable (&msgHuffTransmit, (value&0xff), msg->data, &msg->bit);
 				value = (value>>8);
 			}
 		}
@@ -181,6 +177,40 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	}
 }
 
+/*
+=================
+MSG_WriteBitStream
+
+Appends bits that an earlier bitstream message wrote from its
+start.  The codes don't depend on where they land, so the result
+is the same as repeating the writes that made them.
+=================
+*/
+void MSG_WriteBitStream( msg_t *msg, const byte *data, int bits ) {
+	int		i;
+
+	if ( msg->oob ) {
+		Com_Error( ERR_DROP, "MSG_WriteBitStream: oob message" );
+	}
+	if ( msg->maxsize - msg->cursize < 4 + ( ( bits + 7 ) >> 3 ) ) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	if ( !( msg->bit & 7 ) ) {
+		Com_Memcpy( msg->data + ( msg->bit >> 3 ), data, ( bits + 7 ) >> 3 );
+		msg->bit += bits;
+	} else {
+		for ( i = 0 ; i + 24 <= bits ; i += 24, data += 3 ) {
+			Huff_putBits( data[0] | ( data[1] << 8 ) | ( data[2] << 16 ), 24, msg->data, &msg->bit );
+		}
+		for ( ; i < bits ; i += 8, data++ ) {
+			Huff_putBits( data[0], bits - i < 8 ? bits - i : 8, msg->data, &msg->bit );
+		}
+	}
+	msg->cursize = (msg->bit>>3)+1;
+}
+
 int MSG_ReadBits( msg_t *msg, int bits ) {
 	int			value;
 	int			get;
@@ -227,7 +257,7 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		if (bits) {
 //			fp = fopen("c:\\netchan.bin", "a");
 			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				Huff_offsetReceiveTable (&msgHuffReceive, &get, msg->data, &msg->bit, msg->maxsize);
 //				fwrite(&get, 1, 1, fp);
 				value |= (get<<(i+nbits));
 			}
@@ -309,7 +339,7 @@ void MSG_WriteString( msg_t *sb, const char *s ) {
 
 		l = (int)strlen( s );
 		if ( l >= MAX_STRING_CHARS ) {
-			Com_Printf( "MSG_WriteString: MAX_STRING_CHARS" );
+			sb->warning = "MSG_WriteString: MAX_STRING_CHARS\n";
 			MSG_WriteData (sb, "", 1);
 			return;
 		}
@@ -335,7 +365,7 @@ void MSG_WriteBigString( msg_t *sb, const char *s ) {
 
 		l = (int)strlen( s );
 		if ( l >= BIG_INFO_STRING ) {
-			Com_Printf( "MSG_WriteString: BIG_INFO_STRING" );
+			sb->warning = "MSG_WriteString: BIG_INFO_STRING\n";
 			MSG_WriteData (sb, "", 1);
 			return;
 		}
@@ -701,7 +731,6 @@ void MSG_WriteDeltaUsercmdKey( msg_t *msg, int key, usercmd_t *from, usercmd_t *
 		from->buttons == to->buttons &&
 		from->weapon == to->weapon) {
 			MSG_WriteBits( msg, 0, 1 );				// no change
-			oldsize += 7;
 			return;
 	}
 	key ^= to->serverTime;
@@ -914,8 +943,6 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields;
-
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
@@ -934,7 +961,6 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 			if (fullFloat == 0.0f) {
 					MSG_WriteBits( msg, 0, 1 );
-					oldsize += FLOAT_INT_BITS;
 			} else {
 				MSG_WriteBits( msg, 1, 1 );
 				if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
@@ -1190,8 +1216,6 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields - lc;
-
 	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
 		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
@@ -1257,7 +1281,6 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 
 	if (!statsbits && !persistantbits && !ammobits && !powerupbits) {
 		MSG_WriteBits( msg, 0, 1 );	// no change
-		oldsize += 4;
 		return;
 	}
 	MSG_WriteBits( msg, 1, 1 );	// changed
@@ -1717,6 +1740,10 @@ void MSG_initHuffman() {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+
+	// the trees never change after this
+	Huff_BuildTable(&msgHuff.compressor, &msgHuffTransmit);
+	Huff_BuildTable(&msgHuff.decompressor, &msgHuffReceive);
 }
 
 /*
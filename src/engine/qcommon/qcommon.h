@@ -41,6 +41,9 @@ typedef struct {
 	int		cursize;
 	int		readcount;
 	int		bit;				// for bitwise reads and writes
+	int		overflows;			// values written with fewer bits than they need
+	const char	*warning;		// printed by whoever sends the message, the
+								// writer may be a worker thread
 } msg_t;
 
 void MSG_Init (msg_t *buf, byte *data, int length);
@@ -60,6 +63,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteBitStream( msg_t *msg, const byte *data, int bits );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -287,7 +291,8 @@ typedef struct vm_s vm_t;
 
 typedef enum {
 	VMI_NATIVE,
-	VMI_BYTECODE
+	VMI_BYTECODE,
+	VMI_COMPILED
 } vmInterpret_t;
 
 typedef enum {
@@ -318,10 +323,28 @@ void	VM_Clear(void);
 vm_t	*VM_Restart( vm_t *vm );
 
 intptr_t		QDECL VM_Call( vm_t *vm, int callNum, ... );
+unsigned int	VM_ExecutedInstructions( vm_t *vm );
+
+// fixed arity versions of VM_Call, for the calls made every frame
+intptr_t	VM_Call0( vm_t *vm, int callNum );
+intptr_t	VM_Call1( vm_t *vm, int callNum, int arg0 );
+intptr_t	VM_Call2( vm_t *vm, int callNum, int arg0, int arg1 );
+intptr_t	VM_Call3( vm_t *vm, int callNum, int arg0, int arg1, int arg2 );
+
+// a system call with its own handler skips the module's dispatch
+// function, the handler gets the same arguments
+typedef intptr_t (*vmSystemCall_t)( intptr_t *args );
+
+#define	VM_MAX_FAST_SYSCALLS	256
+
+void		VM_SetSystemCall( vm_t *vm, int callNum, vmSystemCall_t handler );
+vmSystemCall_t	VM_GetSystemCall( vm_t *vm, int callNum );
+intptr_t	VM_SystemCall( vm_t *vm, intptr_t *args );
 
 void	VM_Debug( int level );
 
 void	*VM_ArgPtr( intptr_t intValue );
+void	*VM_ArgArray( intptr_t intValue, int count, int size );
 void	*VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue );
 
 
@@ -573,6 +596,35 @@ int		FS_ReadFile( const char *qpath, void **buffer );
 // the buffer should be considered read-only, because it may be cached
 // for other uses.
 
+int		FS_ReadFileView( const char *qpath, const void **buffer );
+// like FS_ReadFile, but files stored uncompressed in a pk3 come back as
+// a view of the mapped pk3 without a copy.  The view really is read-only
+// and has no trailing 0, so it is only for binary files.
+
+const void *FS_MapFile( const char *qpath, int *length );
+// maps a file from the home path read only, NULL if it can't be mapped.
+// Release it with Sys_UnmapFile.
+
+typedef void (*fsAsyncCallback_t)( const char *qpath, void *buffer, int length, void *data );
+
+qboolean FS_ReadFileAsync( const char *qpath, fsAsyncCallback_t callback, void *data );
+// reads the file on a worker thread, qfalse if it doesn't exist.
+// The callback runs on the main thread from FS_AsyncFrame or FS_FinishAsync,
+// in the order the files were asked for.  It gets the file with a trailing 0,
+// inflated on the worker and freed when it returns, or NULL and -1 if the
+// read failed.
+
+qboolean FS_Prefetch( const char *qpath );
+// faults in the pages of the file in the background so the next FS_ReadFile
+// of it doesn't have to wait for the disk, qfalse if it doesn't exist or
+// isn't in a mapped pk3
+
+void	FS_AsyncFrame( void );
+// runs the callbacks of finished reads
+
+void	FS_FinishAsync( void );
+// waits for all the reads and runs their callbacks
+
 void	FS_ForceFlush( fileHandle_t f );
 // forces flush on files we're writing to.
 
@@ -631,6 +683,8 @@ qboolean FS_idPak( char *pak, char *base );
 qboolean FS_ComparePaks( char *neededpaks, int len, qboolean dlstring );
 
 void FS_Rename( const char *from, const char *to );
+qboolean FS_ReplaceFile( const char *from, const char *to );
+// like FS_Rename, but never copies over to, from is removed if it fails
 
 /*
 ==============================================================
@@ -788,6 +842,8 @@ void Hunk_Clear( void );
 void Hunk_ClearToMark( void );
 void Hunk_SetMark( void );
 qboolean Hunk_CheckMark( void );
+qboolean Hunk_GetPosition( int *low, int *high );
+void Hunk_ClearToPosition( int low, int high );
 void Hunk_ClearTempMemory( void );
 void *Hunk_AllocateTempMemory( int size );
 void Hunk_FreeTempMemory( void *buf );
@@ -796,6 +852,7 @@ void Hunk_Log( void);
 void Hunk_Trash( void );
 
 void Com_TouchMemory( void );
+void Com_MemDump( const char *event );
 
 // commandLine should not include the executable name (argv[0])
 void Com_Init( char *commandLine );
@@ -930,6 +987,7 @@ void	Sys_Init (void);
 void	* QDECL Sys_LoadDll( const char *name, char *fqpath , intptr_t (QDECL **entryPoint)(int, ...),
 				  intptr_t (QDECL *systemcalls)(intptr_t, ...) );
 void	Sys_UnloadDll( void *dllHandle );
+void	*Sys_DllSymbol( void *dllHandle, const char *symbol );
 
 void	Sys_UnloadGame( void );
 void	*Sys_GetGameAPI( void *parms );
@@ -955,6 +1013,7 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+int		Sys_Microseconds (void);
 
 void	Sys_SnapVector( float *v );
 
@@ -982,6 +1041,11 @@ void		Sys_ShowIP(void);
 qboolean	Sys_CheckCD( void );
 
 void	Sys_Mkdir( const char *path );
+qboolean Sys_StatFile( const char *ospath, int *size, int *mtime );
+const void *Sys_MapFile( const char *ospath, int *length );
+void	Sys_UnmapFile( const void *base, int length );
+qboolean Sys_ReplaceFile( const char *from, const char *to );
+int		Sys_ProcessId( void );
 char	*Sys_Cwd( void );
 void	Sys_SetDefaultCDPath(const char *path);
 char	*Sys_DefaultCDPath(void);
@@ -997,8 +1061,28 @@ void	Sys_BeginProfiling( void );
 void	Sys_EndProfiling( void );
 
 qboolean Sys_LowPhysicalMemory();
+void	*Sys_ReserveMemory( int size );
+qboolean Sys_CommitMemory( void *ptr, int size );
+void	Sys_DecommitMemory( void *ptr, int size );
 unsigned int Sys_ProcessorCount();
 
+// worker threads, they run until the process exits
+qboolean Sys_CreateThread( void (*function)( void *data ), void *data );
+void	*Sys_CreateMutex( void );
+void	Sys_LockMutex( void *mutex );
+void	Sys_UnlockMutex( void *mutex );
+void	*Sys_CreateSemaphore( void );
+void	Sys_SignalSemaphore( void *semaphore );
+void	Sys_WaitSemaphore( void *semaphore );
+
+// variables declared QTHREAD get a separate copy in every thread, they can
+// only be statically initialized to constants
+#ifdef _MSC_VER
+#define	QTHREAD		__declspec(thread)
+#else
+#define	QTHREAD		__thread
+#endif
+
 int Sys_MonkeyShouldBeSpanked( void );
 
 /* This is based on the Adaptive Huffman algorithm described in Sayood's Data
@@ -1037,6 +1121,19 @@ typedef struct {
 	huff_t		decompressor;
 } huffman_t;
 
+#define HUFF_FAST_BITS	11			/* the msg_hData tree is 11 deep */
+#define HUFF_MAX_CODE	24			/* longer codes are sent through the tree */
+
+/* A fixed tree flattened for coding a whole symbol at a time, only valid
+   as long as the tree gets no more Huff_addRef calls */
+typedef struct {
+	huff_t			*huff;
+	unsigned int	code[HMAX+1];					/* first bit sent in bit 0 */
+	byte			codeLength[HMAX+1];				/* 0 if not in the tree or too long */
+	short			fastSymbol[1<<HUFF_FAST_BITS];	/* -1 if the code is longer */
+	byte			fastLength[1<<HUFF_FAST_BITS];
+} huffTable_t;
+
 void	Huff_Compress(msg_t *buf, int offset);
 void	Huff_Decompress(msg_t *buf, int offset);
 void	Huff_Init(huffman_t *huff);
@@ -1047,6 +1144,10 @@ void	Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset);
 void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
+void	Huff_BuildTable( huff_t *huff, huffTable_t *table );
+void	Huff_putBits( unsigned int bits, int count, byte *fout, int *offset );
+void	Huff_offsetReceiveTable( const huffTable_t *table, int *ch, byte *fin, int *offset, int maxsize );
+void	Huff_offsetTransmitTable( const huffTable_t *table, int ch, byte *fout, int *offset );
 
 extern huffman_t clientHuffTables;
 
@@ -58,6 +58,30 @@ typedef struct {
 	int		bssLength;			// zero filled memory appended to datalength
 } vmHeader_t;
 
+// a native module translated from a qvm by qvm2c keeps the qvm's
+// sandboxed data segment, system call arguments are still offsets
+// into it, so it exports the segment for the engine to resolve them
+#define	VM_AOT_VERSION			2
+#define	VM_AOT_SEGMENT			"vmSegment"
+#define	VM_AOT_STACK_SIZE		0x20000		// same as an interpreted qvm
+
+// real system call numbers are never negative
+#define	VM_AOT_SYSCALL_ERROR	-1
+
+typedef enum {
+	VM_AOT_ERR_STACK_OVERFLOW,
+	VM_AOT_ERR_BAD_CALL,
+	VM_AOT_ERR_BAD_JUMP,
+	VM_AOT_ERR_BLOCK_COPY
+} vmAotError_t;
+
+typedef struct {
+	int				version;
+	unsigned char	*dataBase;
+	int				dataMask;
+	intptr_t		(QDECL *systemCall)( intptr_t *args );	// set by the engine
+} vmSegment_t;
+
 
 /*
 ========================================================================
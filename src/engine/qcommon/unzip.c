@@ -1950,6 +1950,34 @@ extern int unzOpenCurrentFile (unzFile file)
 }
 
 
+static int unzlocal_InflateFile (void *dest, unsigned destLen, FILE *file, unsigned sourceLen,
+								 void *buffer, unsigned bufferSize);
+
+/*
+  Read all of a deflated entry in one pass, streaming the compressed data
+  through the UNZ_BUFSIZE read buffer.  The output is the caller's buffer,
+  so the decoder needs no window of its own.
+  Leaves the read info untouched and returns 0 if anything goes wrong.
+*/
+static uInt unzlocal_ReadWholeFile (file_in_zip_read_info_s* info, void *buf)
+{
+	uInt compressed = (uInt)info->rest_read_compressed;
+	uInt size = (uInt)info->rest_read_uncompressed;
+
+	if (fseek(info->file, info->pos_in_zipfile + info->byte_before_the_zipfile, SEEK_SET)!=0)
+		return 0;
+
+	if (unzlocal_InflateFile(buf, size, info->file, compressed, info->read_buffer, UNZ_BUFSIZE) != UNZ_OK)
+		return 0;
+
+	info->pos_in_zipfile += compressed;
+	info->rest_read_compressed = 0;
+	info->rest_read_uncompressed = 0;
+	info->stream.total_out += size;
+	return size;
+}
+
+
 /*
   Read bytes from the current file.
   buf contain buffer where data must be copied
@@ -1980,6 +2008,18 @@ extern int unzReadCurrentFile  (unzFile file, void *buf, unsigned len)
 	if (len==0)
 		return 0;
 
+	/* a deflated entry read whole in one call skips the streaming decoder */
+	if ((pfile_in_zip_read_info->compression_method!=0) &&
+		(s->cur_file_info.compressed_size == pfile_in_zip_read_info->rest_read_compressed) &&
+		(pfile_in_zip_read_info->rest_read_uncompressed > 0) &&
+		(len >= pfile_in_zip_read_info->rest_read_uncompressed))
+	{
+		iRead = unzlocal_ReadWholeFile(pfile_in_zip_read_info, buf);
+		if (iRead)
+			return iRead;
+		/* nothing was consumed, let the streaming decoder report the error */
+	}
+
 	pfile_in_zip_read_info->stream.next_out = (Byte*)buf;
 
 	pfile_in_zip_read_info->stream.avail_out = (uInt)len;
@@ -2101,6 +2141,546 @@ extern long unztell (unzFile file)
 }
 
 
+/*
+  Inflate a file that was read from the zip without unzReadCurrentFile,
+  through the old streaming decoder.  Kept for fs_inflatebench.
+  return UNZ_OK if there is no problem
+*/
+extern int unzInflateBufferZlib (void *dest, unsigned destLen, const void *source, unsigned sourceLen)
+{
+	z_stream stream;
+	int err;
+
+	stream.zalloc = (alloc_func)0;
+	stream.zfree = (free_func)0;
+	stream.opaque = (voidp)0;
+	stream.next_in = (Byte*)source;
+	stream.avail_in = (uInt)sourceLen;
+	stream.next_out = (Byte*)dest;
+	stream.avail_out = (uInt)destLen;
+	stream.total_out = 0;
+
+	/* windowBits < 0 for the raw deflate data of a zip entry */
+	err=inflateInit2(&stream, -MAX_WBITS);
+	if (err != Z_OK)
+		return UNZ_INTERNALERROR;
+
+	while (err == Z_OK && stream.avail_out > 0)
+		err=inflate(&stream, Z_SYNC_FLUSH);
+
+	inflateEnd(&stream);
+
+	if (stream.total_out != destLen)
+		return UNZ_BADZIPFILE;
+	return UNZ_OK;
+}
+
+
+/*
+  One pass inflate for entries whose compressed and uncompressed sizes
+  are both known, which is every entry of a zip.  The input is read
+  through a machine word bit buffer that is refilled a word at a time,
+  Huffman codes up to UNZ_FAST_BITS long are decoded with one table
+  lookup, and long matches are copied eight bytes at a time.  It keeps
+  no state outside the stack and allocates nothing, so any thread can
+  call it.
+*/
+
+#define UNZ_FAST_BITS	10
+#define UNZ_FAST_MASK	((1 << UNZ_FAST_BITS) - 1)
+#define UNZ_BITBUF_BITS	((int)sizeof(size_t) * 8)
+
+typedef struct
+{
+	unsigned short	fast[1 << UNZ_FAST_BITS];	/* symbol << 4 | code length, 0 if longer */
+	int				maxcode[17];				/* next first code, left justified to 16 bits */
+	unsigned short	firstcode[16];
+	unsigned short	firstsymbol[16];
+	unsigned char	size[288];
+	unsigned short	value[288];
+} unz_huffman;
+
+typedef struct
+{
+	const unsigned char	*in;
+	unsigned		inPos;				/* bytes moved into bits, can pass inLen */
+	unsigned		inLen;
+	size_t			bits;
+	int				numBits;
+
+	/* input streamed from a file through in, which is inSize long */
+	FILE			*file;
+	unsigned		fileLeft;
+	unsigned		inSize;
+
+	unsigned char	*out;
+	unsigned		outPos;
+	unsigned		outLen;
+
+	unz_huffman		length;
+	unz_huffman		distance;
+} unz_inflate;
+
+static const unsigned short unz_lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char unz_lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short unz_distanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char unz_distanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char unz_codeLengthOrder[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static int unzlocal_ReverseBits (int n, int bits)
+{
+	n = ((n & 0xAAAA) >> 1) | ((n & 0x5555) << 1);
+	n = ((n & 0xCCCC) >> 2) | ((n & 0x3333) << 2);
+	n = ((n & 0xF0F0) >> 4) | ((n & 0x0F0F) << 4);
+	n = ((n & 0xFF00) >> 8) | ((n & 0x00FF) << 8);
+	return n >> (16 - bits);
+}
+
+static int unzlocal_BuildHuffman (unz_huffman *h, const unsigned char *sizes, int num)
+{
+	int count[16], next[16];
+	int i, code, symbol;
+
+	memset(count, 0, sizeof(count));
+	memset(h->fast, 0, sizeof(h->fast));
+	for (i = 0; i < num; i++)
+		count[sizes[i]]++;
+	count[0] = 0;
+
+	code = 0;
+	symbol = 0;
+	for (i = 1; i < 16; i++)
+	{
+		next[i] = code;
+		h->firstcode[i] = (unsigned short)code;
+		h->firstsymbol[i] = (unsigned short)symbol;
+		code += count[i];
+		if (count[i] && code - 1 >= (1 << i))
+			return 0;		/* over subscribed */
+		h->maxcode[i] = code << (16 - i);
+		code <<= 1;
+		symbol += count[i];
+	}
+	h->maxcode[16] = 0x10000;
+
+	for (i = 0; i < num; i++)
+	{
+		int s = sizes[i];
+		int c;
+
+		if (!s)
+			continue;
+		c = next[s] - h->firstcode[s] + h->firstsymbol[s];
+		h->size[c] = (unsigned char)s;
+		h->value[c] = (unsigned short)i;
+		if (s <= UNZ_FAST_BITS)
+		{
+			int j;
+			for (j = unzlocal_ReverseBits(next[s], s); j < (1 << UNZ_FAST_BITS); j += 1 << s)
+				h->fast[j] = (unsigned short)((i << 4) | s);
+		}
+		next[s]++;
+	}
+	return 1;
+}
+
+/*
+  Moves the unread input to the front of the buffer and fills the rest
+  from the file.  The last bytes before inPos are kept, a stored block
+  gives back up to seven of them.
+*/
+static void unzlocal_ReadInput (unz_inflate *z)
+{
+	unsigned char *buf = (unsigned char *)z->in;
+	unsigned keep, len;
+
+	keep = z->inPos < 8 ? z->inPos : 8;
+	if (z->inPos > z->inLen)
+		return;
+	memmove(buf, buf + z->inPos - keep, z->inLen - z->inPos + keep);
+	z->inLen -= z->inPos - keep;
+	z->inPos = keep;
+
+	len = z->inSize - z->inLen;
+	if (len > z->fileLeft)
+		len = z->fileLeft;
+	if (len && fread(buf + z->inLen, len, 1, z->file) != 1)
+	{
+		/* reads as the end of the data, which fails the inflate */
+		z->fileLeft = 0;
+		return;
+	}
+	z->inLen += len;
+	z->fileLeft -= len;
+}
+
+static void unzlocal_Refill (unz_inflate *z)
+{
+#if !idppc
+	if (z->inPos + sizeof(size_t) <= z->inLen)
+	{
+		size_t w;
+
+		/* little endian: the bytes past the ones counted are ORed in
+		   again at the same place by the next refill */
+		memcpy(&w, z->in + z->inPos, sizeof(w));
+		z->bits |= w << z->numBits;
+		z->inPos += (UNZ_BITBUF_BITS - 1 - z->numBits) >> 3;
+		z->numBits |= UNZ_BITBUF_BITS - 8;
+		return;
+	}
+#endif
+	if (z->fileLeft)
+	{
+		unzlocal_ReadInput(z);
+#if !idppc
+		if (z->inPos + sizeof(size_t) <= z->inLen)
+		{
+			unzlocal_Refill(z);
+			return;
+		}
+#endif
+	}
+	while (z->numBits <= UNZ_BITBUF_BITS - 8)
+	{
+		/* past the end reads zeros, the caller checks for overrun */
+		if (z->inPos < z->inLen)
+			z->bits |= (size_t)z->in[z->inPos] << z->numBits;
+		z->inPos++;
+		z->numBits += 8;
+	}
+}
+
+static int unzlocal_GetBits (unz_inflate *z, int n)
+{
+	int v;
+
+	if (z->numBits < n)
+		unzlocal_Refill(z);
+	v = (int)(z->bits & (((size_t)1 << n) - 1));
+	z->bits >>= n;
+	z->numBits -= n;
+	return v;
+}
+
+static int unzlocal_Decode (unz_inflate *z, const unz_huffman *h)
+{
+	int v, s, k;
+
+	if (z->numBits < 16)
+		unzlocal_Refill(z);
+
+	v = h->fast[z->bits & UNZ_FAST_MASK];
+	if (v)
+	{
+		s = v & 15;
+		z->bits >>= s;
+		z->numBits -= s;
+		return v >> 4;
+	}
+
+	/* codes longer than the table, canonical order makes them sortable */
+	k = unzlocal_ReverseBits((int)(z->bits & 0xffff), 16);
+	for (s = UNZ_FAST_BITS + 1; k >= h->maxcode[s]; s++)
+		;
+	if (s >= 16)
+		return -1;
+	v = (k >> (16 - s)) - h->firstcode[s] + h->firstsymbol[s];
+	if (v >= 288 || h->size[v] != s)
+		return -1;
+	z->bits >>= s;
+	z->numBits -= s;
+	return h->value[v];
+}
+
+static int unzlocal_InflateStored (unz_inflate *z)
+{
+	unsigned len, nlen;
+
+	/* drop to the byte boundary and give back the whole bytes */
+	z->numBits &= ~7;
+	z->inPos -= z->numBits >> 3;
+	z->bits = 0;
+	z->numBits = 0;
+
+	if (z->inPos + 4 > z->inLen && z->fileLeft)
+		unzlocal_ReadInput(z);
+	if (z->inPos + 4 > z->inLen)
+		return 0;
+	len = z->in[z->inPos] | (z->in[z->inPos+1] << 8);
+	nlen = z->in[z->inPos+2] | (z->in[z->inPos+3] << 8);
+	z->inPos += 4;
+	if (len != (~nlen & 0xffff))
+		return 0;
+	if (len > z->outLen - z->outPos)
+		return 0;
+
+	while (len)
+	{
+		unsigned n = z->inLen - z->inPos;
+
+		if (!n)
+		{
+			if (!z->fileLeft)
+				return 0;
+			unzlocal_ReadInput(z);
+			continue;
+		}
+		if (n > len)
+			n = len;
+		memcpy(z->out + z->outPos, z->in + z->inPos, n);
+		z->inPos += n;
+		z->outPos += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int unzlocal_InflateCodes (unz_inflate *z)
+{
+	unsigned char *out = z->out;
+	unsigned pos = z->outPos;
+	unsigned len, dist;
+	int sym;
+
+	for (;;)
+	{
+		sym = unzlocal_Decode(z, &z->length);
+		if (sym < 256)
+		{
+			if (sym < 0 || pos >= z->outLen)
+				return 0;
+			out[pos++] = (unsigned char)sym;
+			continue;
+		}
+		if (sym == 256)
+			break;
+
+		sym -= 257;
+		if (sym >= 29)
+			return 0;
+		len = unz_lengthBase[sym];
+		if (unz_lengthExtra[sym])
+			len += unzlocal_GetBits(z, unz_lengthExtra[sym]);
+
+		sym = unzlocal_Decode(z, &z->distance);
+		if (sym < 0 || sym >= 30)
+			return 0;
+		dist = unz_distanceBase[sym];
+		if (unz_distanceExtra[sym])
+			dist += unzlocal_GetBits(z, unz_distanceExtra[sym]);
+
+		if (dist > pos || len > z->outLen - pos)
+			return 0;
+
+		{
+			unsigned char *dst = out + pos;
+			const unsigned char *src = dst - dist;
+
+			if (dist >= 8 && len + 8 <= z->outLen - pos)
+			{
+				/* can overrun by up to seven bytes that later output replaces */
+				unsigned char *end = dst + len;
+				do {
+					memcpy(dst, src, 8);
+					dst += 8;
+					src += 8;
+				} while (dst < end);
+			}
+			else if (dist == 1)
+				memset(dst, *src, len);
+			else
+			{
+				unsigned i;
+				for (i = 0; i < len; i++)
+					dst[i] = src[i];
+			}
+		}
+		pos += len;
+	}
+
+	z->outPos = pos;
+	return 1;
+}
+
+static int unzlocal_InflateFixed (unz_inflate *z)
+{
+	unsigned char sizes[288];
+
+	memset(sizes, 8, 144);
+	memset(sizes + 144, 9, 112);
+	memset(sizes + 256, 7, 24);
+	memset(sizes + 280, 8, 8);
+	if (!unzlocal_BuildHuffman(&z->length, sizes, 288))
+		return 0;
+	memset(sizes, 5, 32);
+	if (!unzlocal_BuildHuffman(&z->distance, sizes, 32))
+		return 0;
+	return unzlocal_InflateCodes(z);
+}
+
+static int unzlocal_InflateDynamic (unz_inflate *z)
+{
+	unz_huffman codes;
+	unsigned char codeSizes[19];
+	unsigned char sizes[286 + 32 + 137];
+	int hlit, hdist, hclen;
+	int i, n, c, fill;
+
+	hlit = unzlocal_GetBits(z, 5) + 257;
+	hdist = unzlocal_GetBits(z, 5) + 1;
+	hclen = unzlocal_GetBits(z, 4) + 4;
+
+	memset(codeSizes, 0, sizeof(codeSizes));
+	for (i = 0; i < hclen; i++)
+		codeSizes[unz_codeLengthOrder[i]] = (unsigned char)unzlocal_GetBits(z, 3);
+	if (!unzlocal_BuildHuffman(&codes, codeSizes, 19))
+		return 0;
+
+	n = 0;
+	while (n < hlit + hdist)
+	{
+		c = unzlocal_Decode(z, &codes);
+		if (c < 0 || c >= 19)
+			return 0;
+		if (c < 16)
+		{
+			sizes[n++] = (unsigned char)c;
+			continue;
+		}
+
+		fill = 0;
+		if (c == 16)
+		{
+			if (n == 0)
+				return 0;
+			c = unzlocal_GetBits(z, 2) + 3;
+			fill = sizes[n-1];
+		}
+		else if (c == 17)
+			c = unzlocal_GetBits(z, 3) + 3;
+		else
+			c = unzlocal_GetBits(z, 7) + 11;
+		if (c > hlit + hdist - n)
+			return 0;
+		memset(sizes + n, fill, c);
+		n += c;
+	}
+
+	if (!unzlocal_BuildHuffman(&z->length, sizes, hlit))
+		return 0;
+	if (!unzlocal_BuildHuffman(&z->distance, sizes + hlit, hdist))
+		return 0;
+	return unzlocal_InflateCodes(z);
+}
+
+static int unzlocal_Inflate (unz_inflate *z)
+{
+	int final, type, ok;
+
+	do {
+		final = unzlocal_GetBits(z, 1);
+		type = unzlocal_GetBits(z, 2);
+		switch (type)
+		{
+		case 0: ok = unzlocal_InflateStored(z); break;
+		case 1: ok = unzlocal_InflateFixed(z); break;
+		case 2: ok = unzlocal_InflateDynamic(z); break;
+		default: ok = 0; break;
+		}
+		/* zeros read past the end of the input are not data */
+		if (!ok || z->inPos - (z->numBits >> 3) > z->inLen)
+			return UNZ_BADZIPFILE;
+	} while (!final && z->outPos < z->outLen);
+
+	if (z->outPos != z->outLen)
+		return UNZ_BADZIPFILE;
+	return UNZ_OK;
+}
+
+/*
+  Inflate a file that was read from the zip without unzReadCurrentFile.
+  source holds the compressed data, dest gets exactly destLen bytes.
+  Safe to call from any thread.
+  return UNZ_OK if there is no problem
+*/
+extern int unzInflateBuffer (void *dest, unsigned destLen, const void *source, unsigned sourceLen)
+{
+	unz_inflate z;
+
+	z.in = (const unsigned char *)source;
+	z.inPos = 0;
+	z.inLen = sourceLen;
+	z.bits = 0;
+	z.numBits = 0;
+	z.file = NULL;
+	z.fileLeft = 0;
+	z.inSize = sourceLen;
+	z.out = (unsigned char *)dest;
+	z.outPos = 0;
+	z.outLen = destLen;
+
+	return unzlocal_Inflate(&z);
+}
+
+/*
+  Inflate sourceLen bytes of compressed data read from the current
+  position of file, through buffer, which is bufferSize long.
+*/
+static int unzlocal_InflateFile (void *dest, unsigned destLen, FILE *file, unsigned sourceLen,
+								 void *buffer, unsigned bufferSize)
+{
+	unz_inflate z;
+
+	z.in = (const unsigned char *)buffer;
+	z.inPos = 0;
+	z.inLen = 0;
+	z.bits = 0;
+	z.numBits = 0;
+	z.file = file;
+	z.fileLeft = sourceLen;
+	z.inSize = bufferSize;
+	z.out = (unsigned char *)dest;
+	z.outPos = 0;
+	z.outLen = destLen;
+
+	return unzlocal_Inflate(&z);
+}
+
+
+/*
+  Give the offset of the data of the current file (opened by unzOpenCurrentFile)
+  from the start of the zip file, and whether it is stored without compression.
+  Only valid before anything was read from it.
+*/
+extern int unzGetCurrentFileDataOffset (unzFile file, unsigned long *offset, int *stored)
+{
+	unz_s* s;
+	file_in_zip_read_info_s* pfile_in_zip_read_info;
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+	if (pfile_in_zip_read_info==NULL)
+		return UNZ_PARAMERROR;
+
+	*offset = pfile_in_zip_read_info->pos_in_zipfile +
+				pfile_in_zip_read_info->byte_before_the_zipfile;
+	*stored = pfile_in_zip_read_info->compression_method==0;
+	return UNZ_OK;
+}
+
+
 /*
   return 1 if the end of file was reached, 0 elsewhere 
 */
@@ -314,6 +314,30 @@ extern long unztell(unzFile file);
   Give the current position in uncompressed data
 */
 
+extern int unzGetCurrentFileDataOffset (unzFile file, unsigned long *offset, int *stored);
+
+/*
+  Give the offset of the data of the current file (opened by unzOpenCurrentFile)
+  from the start of the zip file, and whether it is stored without compression.
+  return UNZ_OK if there is no problem
+*/
+
+extern int unzInflateBuffer (void *dest, unsigned destLen, const void *source, unsigned sourceLen);
+
+/*
+  Inflate a file that was read from the zip without unzReadCurrentFile.
+  source holds the compressed data, dest gets exactly destLen bytes.
+  Allocates nothing, so it is safe to call from any thread.
+  return UNZ_OK if there is no problem
+*/
+
+extern int unzInflateBufferZlib (void *dest, unsigned destLen, const void *source, unsigned sourceLen);
+
+/*
+  Same as unzInflateBuffer through the streaming decoder unzReadCurrentFile
+  used to use.  Allocates through Z_Malloc, main thread only.
+*/
+
 extern int unzeof (unzFile file);
 
 /*
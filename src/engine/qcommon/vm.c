@@ -40,12 +40,19 @@ vm_t	*currentVM = NULL; // bk001212
 vm_t	*lastVM    = NULL; // bk001212
 int		vm_debugLevel;
 
+cvar_t	*vm_threaded;
+cvar_t	*vm_optimize;
+cvar_t	*vm_profile;
+cvar_t	*vm_profileInterval;
+
 #define	MAX_VM		3
 vm_t	vmTable[MAX_VM];
 
 
 void VM_VmInfo_f( void );
 void VM_VmProfile_f( void );
+void VM_AotCheck_f( void );
+void VM_JitCheck_f( void );
 
 void VM_Debug( int level ) {
 	vm_debugLevel = level;
@@ -60,9 +67,15 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "1", CVAR_ARCHIVE );
 	Cvar_Get( "vm_game", "1", CVAR_ARCHIVE );
 	Cvar_Get( "vm_ui", "1", CVAR_ARCHIVE );
+	vm_threaded = Cvar_Get( "vm_threaded", "0", CVAR_ARCHIVE );
+	vm_optimize = Cvar_Get( "vm_optimize", "0", CVAR_ARCHIVE );
+	vm_profile = Cvar_Get( "vm_profile", "0", CVAR_ARCHIVE );
+	vm_profileInterval = Cvar_Get( "vm_profileInterval", "10000", CVAR_ARCHIVE );
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+	Cmd_AddCommand ("vmaotcheck", VM_AotCheck_f );
+	Cmd_AddCommand ("vmjitcheck", VM_JitCheck_f );
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -183,8 +196,8 @@ void VM_LoadSymbols( vm_t *vm ) {
 	int		segment;
 	int		numInstructions;
 
-	// don't load symbols if not developer
-	if ( !com_developer->integer ) {
+	// don't load symbols if not developer, unless they're needed for profiling
+	if ( !com_developer->integer && !vm->profile ) {
 		return;
 	}
 
@@ -249,6 +262,68 @@ void VM_LoadSymbols( vm_t *vm ) {
 	FS_FreeFile( mapfile );
 }
 
+/*
+=================
+VM_BlockCopy
+
+OP_BLOCK_COPY for both the interpreter and compiled code
+=================
+*/
+void VM_BlockCopy( vm_t *vm, unsigned int dest, unsigned int src, size_t n ) {
+	unsigned int dataMask = vm->dataMask;
+
+	if ( ( dest & dataMask ) != dest
+		|| ( src & dataMask ) != src
+		|| ( ( dest + n ) & dataMask ) != dest + n
+		|| ( ( src + n ) & dataMask ) != src + n )
+	{
+		Com_Error( ERR_DROP, "OP_BLOCK_COPY out of range!" );
+	}
+
+	Com_Memcpy( vm->dataBase + dest, vm->dataBase + src, n );
+}
+
+/*
+=================
+VM_AotError
+
+Sandbox violations caught by a module translated with qvm2c
+=================
+*/
+static void VM_AotError( vm_t *vm, int error ) {
+	switch ( error ) {
+	case VM_AOT_ERR_STACK_OVERFLOW:
+		Com_Error( ERR_DROP, "%s: program stack overflow", vm->name );
+	case VM_AOT_ERR_BAD_CALL:
+		Com_Error( ERR_DROP, "%s: call to bad instruction", vm->name );
+	case VM_AOT_ERR_BAD_JUMP:
+		Com_Error( ERR_DROP, "%s: jump to bad instruction", vm->name );
+	case VM_AOT_ERR_BLOCK_COPY:
+		Com_Error( ERR_DROP, "OP_BLOCK_COPY out of range!" );
+	default:
+		Com_Error( ERR_DROP, "%s: unknown translated code error %i", vm->name, error );
+	}
+}
+
+/*
+=================
+VM_DllSystemCall
+
+System calls from dlls.  Translated modules call this directly
+through their vmSegment, other dlls go through VM_DllSyscall.
+=================
+*/
+static intptr_t QDECL VM_DllSystemCall( intptr_t *args ) {
+  if ( args[0] == VM_AOT_SYSCALL_ERROR ) {
+    VM_AotError( currentVM, args[1] );
+  }
+
+  if ( currentVM->profile ) {
+    return VM_ProfileSystemCall( currentVM, args );
+  }
+  return VM_DispatchSystemCall( currentVM, args );
+}
+
 intptr_t QDECL VM_DllSyscall( intptr_t arg, ... ) {
   intptr_t args[MAX_VMSYSCALL_ARGS];
   int i;
@@ -260,8 +335,8 @@ intptr_t QDECL VM_DllSyscall( intptr_t arg, ... ) {
   for (i = 1; i < ARRAY_LEN(args); i++)
     args[i] = va_arg(ap, intptr_t);
   va_end(ap);
-  
-  return currentVM->systemCall( args );
+
+  return VM_DllSystemCall( args );
 }
 
 /*
@@ -283,13 +358,18 @@ vm_t *VM_Restart( vm_t *vm ) {
 	if ( vm->dllHandle ) {
 		char	name[MAX_QPATH];
 	    intptr_t (*systemCall)( intptr_t *parms );
+		vmSystemCall_t	fastSystemCalls[VM_MAX_FAST_SYSCALLS];
 		
 		systemCall = vm->systemCall;	
 		Q_strncpyz( name, vm->name, sizeof( name ) );
+		Com_Memcpy( fastSystemCalls, vm->fastSystemCalls, sizeof( fastSystemCalls ) );
 
 		VM_Free( vm );
 
 		vm = VM_Create( name, systemCall, VMI_NATIVE );
+		if ( vm ) {
+			Com_Memcpy( vm->fastSystemCalls, fastSystemCalls, sizeof( fastSystemCalls ) );
+		}
 		return vm;
 	}
 
@@ -343,51 +423,49 @@ vm_t *VM_Restart( vm_t *vm ) {
 
 /*
 ================
-VM_Create
+VM_AttachSegment
 
-If image ends in .qvm it will be interpreted, otherwise
-it will attempt to load as a system dll
+A dll translated from a qvm still passes data segment offsets
+to the system calls, find the segment so VM_ArgPtr can resolve them
 ================
 */
+static void VM_AttachSegment( vm_t *vm ) {
+	vmSegment_t	*segment;
+
+	segment = (vmSegment_t *)Sys_DllSymbol( vm->dllHandle, VM_AOT_SEGMENT );
+	if ( !segment ) {
+		return;
+	}
+	if ( segment->version != VM_AOT_VERSION || !segment->dataBase || !segment->dataMask ) {
+		Com_Error( ERR_FATAL, "%s was translated by an incompatible qvm2c", vm->fqpath );
+	}
+	vm->dataBase = segment->dataBase;
+	vm->dataMask = segment->dataMask;
+
+	// skip the varargs on the way back in
+	segment->systemCall = VM_DllSystemCall;
+}
 
 #define	STACK_SIZE	0x20000
 
-vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *), 
-				vmInterpret_t interpret ) {
-	vm_t		*vm;
+/*
+================
+VM_LoadModule
+
+Loads a module into an empty vm_t.  A plain bytecode module skips
+vm_optimize and vm_threaded and runs the code as it is in the file.
+================
+*/
+static vm_t *VM_LoadModule( vm_t *vm, const char *module, intptr_t (*systemCalls)(intptr_t *), 
+				vmInterpret_t interpret, qboolean plain ) {
 	vmHeader_t	*header;
 	int			length;
 	int			dataLength;
 	int			i, remaining;
 	char		filename[MAX_QPATH];
 
-	if ( !module || !module[0] || !systemCalls ) {
-		Com_Error( ERR_FATAL, "VM_Create: bad parms" );
-	}
-
 	remaining = Hunk_MemoryRemaining();
 
-	// see if we already have the VM
-	for ( i = 0 ; i < MAX_VM ; i++ ) {
-		if (!Q_stricmp(vmTable[i].name, module)) {
-			vm = &vmTable[i];
-			return vm;
-		}
-	}
-
-	// find a free vm
-	for ( i = 0 ; i < MAX_VM ; i++ ) {
-		if ( !vmTable[i].name[0] ) {
-			break;
-		}
-	}
-
-	if ( i == MAX_VM ) {
-		Com_Error( ERR_FATAL, "VM_Create: no free vm_t" );
-	}
-
-	vm = &vmTable[i];
-
 	Q_strncpyz( vm->name, module, sizeof( vm->name ) );
 	vm->systemCall = systemCalls;
 
@@ -403,6 +481,10 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 		Com_Printf( "Loading dll file %s.\n", vm->name );
 		vm->dllHandle = Sys_LoadDll( module, vm->fqpath , &vm->entryPoint, VM_DllSyscall );
 		if ( vm->dllHandle ) {
+			VM_AttachSegment( vm );
+			if ( vm_profile->integer ) {
+				VM_ProfileInit( vm );
+			}
 			return vm;
 		}
 
@@ -457,6 +539,11 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	vm->instructionPointersLength = header->instructionCount * 4;
 	vm->instructionPointers = (int*) Hunk_Alloc( vm->instructionPointersLength, h_high );
 
+	// rewrite the code before any backend sees it
+	if ( vm_optimize->integer && !plain ) {
+		VM_OptimizeCode( vm, header );
+	}
+
 	// copy or compile the instructions
 	vm->codeLength = header->codeLength;
 
@@ -465,6 +552,11 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	// free the original file
 	FS_FreeFile( header );
 
+	// the compiler needs to know about the profile
+	if ( vm_profile->integer ) {
+		VM_ProfileInit( vm );
+	}
+
 	// load the map file
 	VM_LoadSymbols( vm );
 
@@ -472,11 +564,57 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	vm->programStack = vm->dataMask + 1;
 	vm->stackBottom = vm->programStack - STACK_SIZE;
 
+	// the compiler translates the prepared interpreter image
+	if ( interpret == VMI_COMPILED ) {
+		VM_Compile( vm );
+	} else if ( vm_threaded->integer && !plain ) {
+		VM_PrepareThreaded( vm );
+	}
+
 	Com_Printf("%s loaded in %d bytes on the hunk\n", module, remaining - Hunk_MemoryRemaining());
 
 	return vm;
 }
 
+/*
+================
+VM_Create
+
+If image ends in .qvm it will be interpreted, otherwise
+it will attempt to load as a system dll
+================
+*/
+vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *), 
+				vmInterpret_t interpret ) {
+	vm_t		*vm;
+	int			i;
+
+	if ( !module || !module[0] || !systemCalls ) {
+		Com_Error( ERR_FATAL, "VM_Create: bad parms" );
+	}
+
+	// see if we already have the VM
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if (!Q_stricmp(vmTable[i].name, module)) {
+			vm = &vmTable[i];
+			return vm;
+		}
+	}
+
+	// find a free vm
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( !vmTable[i].name[0] ) {
+			break;
+		}
+	}
+
+	if ( i == MAX_VM ) {
+		Com_Error( ERR_FATAL, "VM_Create: no free vm_t" );
+	}
+
+	return VM_LoadModule( &vmTable[i], module, systemCalls, interpret, qfalse );
+}
+
 /*
 ==============
 VM_Free
@@ -484,6 +622,8 @@ VM_Free
 */
 void VM_Free( vm_t *vm ) {
 
+	VM_FreeCompiled( vm );
+
 	if ( vm->dllHandle ) {
 		Sys_UnloadDll( vm->dllHandle );
 		Com_Memset( vm, 0, sizeof( *vm ) );
@@ -508,6 +648,7 @@ void VM_Free( vm_t *vm ) {
 void VM_Clear(void) {
 	int i;
 	for (i=0;i<MAX_VM; i++) {
+		VM_FreeCompiled( &vmTable[i] );
 		if ( vmTable[i].dllHandle ) {
 			Sys_UnloadDll( vmTable[i].dllHandle );
 		}
@@ -525,7 +666,7 @@ void *VM_ArgPtr( intptr_t intValue ) {
 	if ( currentVM==NULL )
 	  return NULL;
 
-	if ( currentVM->entryPoint ) {
+	if ( currentVM->entryPoint && !currentVM->dataMask ) {
 		return (void *)(currentVM->dataBase + intValue);
 	}
 	else {
@@ -533,6 +674,41 @@ void *VM_ArgPtr( intptr_t intValue ) {
 	}
 }
 
+/*
+=================
+VM_ArgArray
+
+VM_ArgPtr for count elements of size bytes, which all have to be
+inside the data segment of the module
+=================
+*/
+void *VM_ArgArray( intptr_t intValue, int count, int size ) {
+	unsigned int	dataMask;
+
+	if ( !intValue ) {
+		return NULL;
+	}
+	if ( currentVM==NULL )
+	  return NULL;
+
+	if ( count < 0 || size <= 0 || count > 0x7fffffff / size ) {
+		Com_Error( ERR_DROP, "VM_ArgArray: bad array size" );
+	}
+
+	if ( currentVM->entryPoint && !currentVM->dataMask ) {
+		return (void *)(currentVM->dataBase + intValue);
+	}
+
+	dataMask = currentVM->dataMask;
+	if ( ( intValue & dataMask ) != intValue
+		|| (unsigned int)( count * size ) > dataMask + 1 - (unsigned int)intValue )
+	{
+		Com_Error( ERR_DROP, "VM_ArgArray: array out of range" );
+	}
+
+	return (void *)(currentVM->dataBase + intValue);
+}
+
 void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	if ( !intValue ) {
 		return NULL;
@@ -543,7 +719,7 @@ void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	  return NULL;
 
 	//
-	if ( vm->entryPoint ) {
+	if ( vm->entryPoint && !vm->dataMask ) {
 		return (void *)(vm->dataBase + intValue);
 	}
 	else {
@@ -578,13 +754,18 @@ locals from sp
 #define	MAX_STACK	256
 #define	STACK_MASK	(MAX_STACK-1)
 
-intptr_t	QDECL VM_Call( vm_t *vm, int callnum, ... ) {
-	vm_t	*oldVM;
-	intptr_t		r;
-	int i;
-	int args[16];
-	va_list ap;
+#define	MAX_VMMAIN_ARGS	16		// a dll's vmMain gets the command and this many more
+
+/*
+==============
+VM_CallArgs
 
+args[0] is the command, followed by MAX_VMMAIN_ARGS arguments
+==============
+*/
+static intptr_t VM_CallArgs( vm_t *vm, int *args ) {
+	vm_t		*oldVM;
+	intptr_t	r;
 
 	if ( !vm ) {
 		Com_Error( ERR_FATAL, "VM_Call with NULL vm" );
@@ -595,37 +776,22 @@ intptr_t	QDECL VM_Call( vm_t *vm, int callnum, ... ) {
 	lastVM = vm;
 
 	if ( vm_debugLevel ) {
-	  Com_Printf( "VM_Call( %i )\n", callnum );
+	  Com_Printf( "VM_Call( %i )\n", args[0] );
 	}
 
 	// if we have a dll loaded, call it directly
 	if ( vm->entryPoint ) {
 		//rcg010207 -  see dissertation at top of VM_DllSyscall() in this file.
-		va_start(ap, callnum);
-		for (i = 0; i < sizeof (args) / sizeof (args[i]); i++) {
-			args[i] = va_arg(ap, int);
-		}
-		va_end(ap);
-
-		r = vm->entryPoint( callnum,  args[0],  args[1],  args[2], args[3],
-                            args[4],  args[5],  args[6], args[7],
-                            args[8],  args[9], args[10], args[11],
-                            args[12], args[13], args[14], args[15]);
-	}
-	else
-	{
-		struct {
-			int callnum;
-			int args[10];
-		} a;
-		a.callnum = callnum;
-		va_start(ap, callnum);
-		for (i = 0; i < sizeof (a.args) / sizeof (a.args[i]); i++) {
-			a.args[i] = va_arg(ap, int);
-		}
-		va_end(ap);
-
-		r = VM_CallInterpreted( vm, &a.callnum );
+		r = vm->entryPoint( args[0],  args[1],  args[2],  args[3], args[4],
+                            args[5],  args[6],  args[7], args[8],
+                            args[9],  args[10], args[11], args[12],
+                            args[13], args[14], args[15], args[16] );
+	} else if ( vm->compiled ) {
+		r = VM_CallCompiled( vm, args );
+	} else if ( vm->threaded ) {
+		r = VM_CallThreaded( vm, args );
+	} else {
+		r = VM_CallInterpreted( vm, args );
 	}
 
 	if ( oldVM != NULL ) // bk001220 - assert(currentVM!=NULL) for oldVM==NULL
@@ -633,74 +799,203 @@ intptr_t	QDECL VM_Call( vm_t *vm, int callnum, ... ) {
 	return r;
 }
 
-//=================================================================
+intptr_t	QDECL VM_Call( vm_t *vm, int callnum, ... ) {
+	int		args[MAX_VMMAIN_ARGS + 1];
+	int		i;
+	va_list	ap;
+
+	args[0] = callnum;
+	va_start( ap, callnum );
+	for ( i = 1 ; i < ARRAY_LEN( args ) ; i++ ) {
+		args[i] = va_arg( ap, int );
+	}
+	va_end( ap );
+
+	return VM_CallArgs( vm, args );
+}
+
+/*
+==============
+VM_Call0 / VM_Call1 / VM_Call2 / VM_Call3
+
+No va_list to walk, and the unused arguments are zero instead
+of whatever was on the stack
+==============
+*/
+intptr_t VM_Call0( vm_t *vm, int callNum ) {
+	int		args[MAX_VMMAIN_ARGS + 1] = { callNum };
+
+	return VM_CallArgs( vm, args );
+}
+
+intptr_t VM_Call1( vm_t *vm, int callNum, int arg0 ) {
+	int		args[MAX_VMMAIN_ARGS + 1] = { callNum, arg0 };
 
-static int QDECL VM_ProfileSort( const void *a, const void *b ) {
-	vmSymbol_t	*sa, *sb;
+	return VM_CallArgs( vm, args );
+}
+
+intptr_t VM_Call2( vm_t *vm, int callNum, int arg0, int arg1 ) {
+	int		args[MAX_VMMAIN_ARGS + 1] = { callNum, arg0, arg1 };
+
+	return VM_CallArgs( vm, args );
+}
+
+intptr_t VM_Call3( vm_t *vm, int callNum, int arg0, int arg1, int arg2 ) {
+	int		args[MAX_VMMAIN_ARGS + 1] = { callNum, arg0, arg1, arg2 };
 
-	sa = *(vmSymbol_t **)a;
-	sb = *(vmSymbol_t **)b;
+	return VM_CallArgs( vm, args );
+}
 
-	if ( sa->profileCount < sb->profileCount ) {
-		return -1;
+/*
+==============
+VM_SetSystemCall
+
+Gives a system call its own handler, so calls from every kind of
+module skip the dispatch function passed to VM_Create.  Meant for
+the few calls made many times a frame.  A NULL handler goes back
+to the dispatch function.
+==============
+*/
+void VM_SetSystemCall( vm_t *vm, int callNum, vmSystemCall_t handler ) {
+	if ( callNum < 0 || callNum >= VM_MAX_FAST_SYSCALLS ) {
+		Com_Error( ERR_FATAL, "VM_SetSystemCall: bad call number %i", callNum );
 	}
-	if ( sa->profileCount > sb->profileCount ) {
-		return 1;
+	vm->fastSystemCalls[callNum] = handler;
+}
+
+vmSystemCall_t VM_GetSystemCall( vm_t *vm, int callNum ) {
+	if ( callNum < 0 || callNum >= VM_MAX_FAST_SYSCALLS ) {
+		return NULL;
 	}
-	return 0;
+	return vm->fastSystemCalls[callNum];
 }
 
 /*
 ==============
-VM_VmProfile_f
+VM_SystemCall
 
+Makes a system call on behalf of the module, the same way the
+module's own calls are dispatched
 ==============
 */
-void VM_VmProfile_f( void ) {
-	vm_t		*vm;
-	vmSymbol_t	**sorted, *sym;
-	int			i;
-	double		total;
+intptr_t VM_SystemCall( vm_t *vm, intptr_t *args ) {
+	vm_t		*oldVM;
+	intptr_t	r;
 
-	if ( !lastVM ) {
-		return;
-	}
+	oldVM = currentVM;
+	currentVM = vm;
+	r = VM_DispatchSystemCall( vm, args );
+	currentVM = oldVM;
 
-	vm = lastVM;
+	return r;
+}
 
-	if ( !vm->numSymbols ) {
-		return;
-	}
+/*
+==============
+VM_ExecutedInstructions
 
-	sorted = (vmSymbol_t**) Z_Malloc( vm->numSymbols * sizeof( *sorted ) );
-	sorted[0] = vm->symbols;
-	total = sorted[0]->profileCount;
-	for ( i = 1 ; i < vm->numSymbols ; i++ ) {
-		sorted[i] = sorted[i-1]->next;
-		total += sorted[i]->profileCount;
+Running total of bytecode instructions executed by the interpreters,
+compiled and native modules don't count
+==============
+*/
+unsigned int VM_ExecutedInstructions( vm_t *vm ) {
+	if ( !vm ) {
+		return 0;
 	}
+	return vm->executedInstructions;
+}
+
+//=================================================================
 
-	qsort( sorted, vm->numSymbols, sizeof( *sorted ), VM_ProfileSort );
+/*
+==============
+VM_VmProfile_f
 
-	for ( i = 0 ; i < vm->numSymbols ; i++ ) {
-		int		perc;
+vmprofile [module]				print the profiles
+vmprofile reset [module]		start over
+vmprofile dump <file> [module]	write the sampled stacks for flamegraph tools
+==============
+*/
+void VM_VmProfile_f( void ) {
+	vm_t			*vm;
+	const char		*cmd, *module;
+	fileHandle_t	f;
+	int				i, count;
+
+	cmd = Cmd_Argv( 1 );
+	f = 0;
+	if ( !Q_stricmp( cmd, "reset" ) ) {
+		module = Cmd_Argv( 2 );
+	} else if ( !Q_stricmp( cmd, "dump" ) ) {
+		if ( Cmd_Argc() < 3 ) {
+			Com_Printf( "usage: vmprofile dump <file> [module]\n" );
+			return;
+		}
+		module = Cmd_Argv( 3 );
+		f = FS_FOpenFileWrite( Cmd_Argv( 2 ) );
+		if ( !f ) {
+			Com_Printf( "Couldn't write %s\n", Cmd_Argv( 2 ) );
+			return;
+		}
+	} else {
+		module = cmd;
+		cmd = "";
+	}
 
-		sym = sorted[i];
+	count = 0;
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		if ( !vm->name[0] || !vm->profile ) {
+			continue;
+		}
+		if ( module[0] && Q_stricmp( module, vm->name ) ) {
+			continue;
+		}
+		count++;
 
-		perc = 100 * (float) sym->profileCount / total;
-		Com_Printf( "%2i%% %9i %s\n", perc, sym->profileCount, sym->symName );
-		sym->profileCount = 0;
+		if ( !Q_stricmp( cmd, "reset" ) ) {
+			VM_ProfileReset( vm );
+		} else if ( f ) {
+			VM_ProfileDump( vm, f );
+		} else {
+			VM_ProfileReport( vm );
+		}
 	}
 
-	Com_Printf("    %9.0f total\n", total );
+	if ( f ) {
+		FS_FCloseFile( f );
+		Com_Printf( "Wrote %s\n", Cmd_Argv( 2 ) );
+	}
+	if ( !count ) {
+		Com_Printf( "No profiled virtual machines, set vm_profile 1 before they load\n" );
+	}
+}
 
-	Z_Free( sorted );
+/*
+==============
+VM_PrintOptFunctions
+==============
+*/
+static void VM_PrintOptFunctions( vm_t *vm ) {
+	vmOptFunction_t	*f;
+	int				i;
+
+	for ( i = 0 ; i < vm->numOptFunctions ; i++ ) {
+		f = &vm->optFunctions[i];
+		Com_Printf( "    %5i %5i %3i%% ", f->instructions, f->removed, 100 * f->removed / f->instructions );
+		if ( vm->symbols ) {
+			Com_Printf( "%s\n", VM_ValueToSymbol( vm, vm->instructionPointers[ f->start ] ) );
+		} else {
+			Com_Printf( "instruction %i\n", f->start );
+		}
+	}
 }
 
 /*
 ==============
 VM_VmInfo_f
 
+vminfo [module] also lists what the optimizer did to each function
 ==============
 */
 void VM_VmInfo_f( void ) {
@@ -715,14 +1010,309 @@ void VM_VmInfo_f( void ) {
 		}
 		Com_Printf( "%s : ", vm->name );
 		if ( vm->dllHandle ) {
-			Com_Printf( "native\n" );
+			if ( vm->dataMask ) {
+				Com_Printf( "translated\n" );
+				Com_Printf( "    data length : %7i\n", vm->dataMask + 1 );
+			} else {
+				Com_Printf( "native\n" );
+			}
 			continue;
 		}
-        Com_Printf( "interpreted\n" );
+		if ( vm->compiled ) {
+			Com_Printf( "compiled\n" );
+			Com_Printf( "    native code : %7i\n", vm->compiledCodeLength );
+		} else if ( vm->threaded ) {
+			Com_Printf( "threaded\n" );
+			Com_Printf( "    fused pairs : %7i\n", vm->threadedFused );
+		} else {
+			Com_Printf( "interpreted\n" );
+		}
 		Com_Printf( "    code length : %7i\n", vm->codeLength );
 		Com_Printf( "    table length: %7i\n", vm->instructionPointersLength );
 		Com_Printf( "    data length : %7i\n", vm->dataMask + 1 );
+		if ( vm->optimized ) {
+			Com_Printf( "    optimized   : %7i of %i instructions removed\n", vm->optRemoved, vm->optInstructions );
+			Com_Printf( "    folded %i, branches %i, loads/stores %i, dead stores %i\n",
+				vm->optFolded, vm->optThreaded, vm->optLoadsStores, vm->optDeadStores );
+			if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), vm->name ) ) {
+				Com_Printf( "    instr  removed function\n" );
+				VM_PrintOptFunctions( vm );
+			}
+		}
+	}
+}
+
+/*
+==============================================================================
+
+AOT CONFORMANCE CHECK
+
+==============================================================================
+*/
+
+#define	MAX_AOT_CHECK_CALLS		32
+#define	MAX_AOT_CHECK_TRACE		0x10000
+
+typedef struct {
+	int			args[MAX_VMSYSCALL_ARGS];
+} vmTraceRecord_t;
+
+typedef struct {
+	qboolean		recording;
+	vmTraceRecord_t	*trace;
+	int				numRecorded;
+	int				count;
+	int				mismatch;		// 1 + index of the first differing call
+	vmTraceRecord_t	other;
+} vmAotCheck_t;
+
+static vmAotCheck_t	aotCheck;
+
+/*
+==============
+VM_AotCheckSyscall
+
+Records the interpreter's system calls and compares the translated
+module's against them.  Every call returns 0 so both runs see the
+same world.
+==============
+*/
+static intptr_t VM_AotCheckSyscall( intptr_t *args ) {
+	vmTraceRecord_t	*record;
+	int				i;
+
+	if ( aotCheck.recording ) {
+		if ( aotCheck.count < MAX_AOT_CHECK_TRACE ) {
+			record = &aotCheck.trace[ aotCheck.count ];
+			for ( i = 0 ; i < MAX_VMSYSCALL_ARGS ; i++ ) {
+				record->args[i] = args[i];
+			}
+			aotCheck.numRecorded++;
+		}
+		aotCheck.count++;
+		return 0;
+	}
+
+	if ( !aotCheck.mismatch && aotCheck.count < aotCheck.numRecorded ) {
+		record = &aotCheck.trace[ aotCheck.count ];
+		for ( i = 0 ; i < MAX_VMSYSCALL_ARGS ; i++ ) {
+			aotCheck.other.args[i] = args[i];
+		}
+		if ( memcmp( record, &aotCheck.other, sizeof( *record ) ) ) {
+			aotCheck.mismatch = aotCheck.count + 1;
+		}
+	}
+	aotCheck.count++;
+	return 0;
+}
+
+static void VM_PrintTraceRecord( const char *label, const vmTraceRecord_t *record ) {
+	int		i;
+
+	Com_Printf( "%s:", label );
+	for ( i = 0 ; i < MAX_VMSYSCALL_ARGS ; i++ ) {
+		Com_Printf( " %i", record->args[i] );
+	}
+	Com_Printf( "\n" );
+}
+
+/*
+==============
+VM_AotCheckCalls
+
+Returns the number of calls that matched
+==============
+*/
+static int VM_AotCheckCalls( vm_t *interp, vm_t *aot, const char *label, int calls[][MAX_VMMAIN_ARGS + 1], int numCalls ) {
+	int		interpCalls, r[2];
+	int		i, j;
+
+	for ( i = 0 ; i < numCalls ; i++ ) {
+		aotCheck.recording = qtrue;
+		aotCheck.numRecorded = 0;
+		aotCheck.count = 0;
+		r[0] = VM_CallArgs( interp, calls[i] );
+		interpCalls = aotCheck.count;
+
+		aotCheck.recording = qfalse;
+		aotCheck.count = 0;
+		r[1] = VM_CallArgs( aot, calls[i] );
+
+		Com_Printf( "call %i: command %i, %i system calls\n", i, calls[i][0], interpCalls );
+
+		if ( aotCheck.mismatch ) {
+			Com_Printf( S_COLOR_RED "system call %i differs\n", aotCheck.mismatch - 1 );
+			VM_PrintTraceRecord( "interpreted", &aotCheck.trace[ aotCheck.mismatch - 1 ] );
+			VM_PrintTraceRecord( label, &aotCheck.other );
+			break;
+		}
+		if ( aotCheck.count != interpCalls ) {
+			Com_Printf( S_COLOR_RED "made %i system calls, interpreted made %i\n", aotCheck.count, interpCalls );
+			break;
+		}
+		if ( r[0] != r[1] ) {
+			Com_Printf( S_COLOR_RED "returned %i, interpreted returned %i\n", r[1], r[0] );
+			break;
+		}
+		for ( j = 0 ; j <= interp->dataMask ; j++ ) {
+			if ( interp->dataBase[j] != aot->dataBase[j] ) {
+				break;
+			}
+		}
+		if ( j <= interp->dataMask ) {
+			Com_Printf( S_COLOR_RED "data segment differs at 0x%x\n", j );
+			break;
+		}
+	}
+
+	return i;
+}
+
+/*
+==============
+VM_CheckModule
+
+Runs a qvm in the interpreter and in another backend side by side
+with a stub system call handler, comparing the system call traces,
+return values and data segments after every call.  The module must
+not be loaded, for the game that means no map is running:
+
+vmaotcheck qagame "0 0 0 0" "8 100" "8 200" "1 0"
+
+Each quoted argument is a vmMain command followed by its arguments.
+Both modules take vmTable slots while they run, and the hunk memory
+they used is given back when they are freed.
+==============
+*/
+static void VM_CheckModule( const char *command, vmInterpret_t interpret ) {
+	char		module[MAX_QPATH];
+	char		callText[MAX_STRING_CHARS];
+	int			calls[MAX_AOT_CHECK_CALLS][MAX_VMMAIN_ARGS + 1];
+	int			numCalls;
+	char		*text, *token;
+	vm_t		*interp, *aot;
+	int			hunkLow, hunkHigh;
+	int			i, j, numFree;
+
+	if ( Cmd_Argc() < 3 ) {
+		Com_Printf( "Usage: %s <module> \"<command> [args]\" ...\n", command );
+		return;
+	}
+
+	Q_strncpyz( module, Cmd_Argv( 1 ), sizeof( module ) );
+	numFree = 0;
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( !Q_stricmp( vmTable[i].name, module ) ) {
+			Com_Printf( "%s is in use, it can't be checked now\n", module );
+			return;
+		}
+		if ( !vmTable[i].name[0] ) {
+			numFree++;
+		}
+	}
+	if ( numFree < 2 ) {
+		Com_Printf( "%s needs two free vm slots\n", command );
+		return;
+	}
+	if ( !Hunk_GetPosition( &hunkLow, &hunkHigh ) ) {
+		Com_Printf( "%s can't run while temp memory is in use\n", command );
+		return;
+	}
+
+	numCalls = 0;
+	for ( i = 2 ; i < Cmd_Argc() && numCalls < MAX_AOT_CHECK_CALLS ; i++ ) {
+		Q_strncpyz( callText, Cmd_Argv( i ), sizeof( callText ) );
+		text = callText;
+		Com_Memset( calls[numCalls], 0, sizeof( calls[numCalls] ) );
+		for ( j = 0 ; j < 11 ; j++ ) {
+			token = COM_Parse( &text );
+			if ( !token[0] ) {
+				break;
+			}
+			calls[numCalls][j] = atoi( token );
+		}
+		numCalls++;
+	}
+
+	Com_Memset( &aotCheck, 0, sizeof( aotCheck ) );
+
+	// qvm2c translates the code as it is in the file, and only the
+	// plain interpreter saves the return addresses the translation does.
+	// The compiler gets the plain image too, so only the backends differ.
+	// VM_Create would hand back the first module by name, so both are
+	// loaded into free slots directly.
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( !vmTable[i].name[0] ) {
+			break;
+		}
+	}
+	interp = VM_LoadModule( &vmTable[i], module, VM_AotCheckSyscall, VMI_BYTECODE, qtrue );
+	if ( !interp ) {
+		Hunk_ClearToPosition( hunkLow, hunkHigh );
+		return;
+	}
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( !vmTable[i].name[0] ) {
+			break;
+		}
+	}
+	aot = VM_LoadModule( &vmTable[i], module, VM_AotCheckSyscall, interpret, (qboolean)( interpret == VMI_COMPILED ) );
+
+	if ( interpret == VMI_COMPILED ) {
+		if ( !aot || !aot->compiled ) {
+			Com_Printf( "%s wasn't compiled\n", module );
+		} else {
+			aotCheck.trace = (vmTraceRecord_t *)Hunk_AllocateTempMemory( MAX_AOT_CHECK_TRACE * sizeof( vmTraceRecord_t ) );
+			if ( VM_AotCheckCalls( interp, aot, "compiled   ", calls, numCalls ) == numCalls ) {
+				Com_Printf( "%s: %i calls match\n", module, numCalls );
+			}
+			Hunk_FreeTempMemory( aotCheck.trace );
+			aotCheck.trace = NULL;
+		}
+	} else if ( !aot || !aot->dllHandle ) {
+		Com_Printf( "%s has no native module\n", module );
+	} else if ( !aot->dataMask ) {
+		Com_Printf( "%s is not a qvm2c translation\n", aot->fqpath );
+	} else if ( aot->dataMask != interp->dataMask ) {
+		Com_Printf( "%s was translated from a different qvm\n", aot->fqpath );
+	} else {
+		aotCheck.trace = (vmTraceRecord_t *)Hunk_AllocateTempMemory( MAX_AOT_CHECK_TRACE * sizeof( vmTraceRecord_t ) );
+		if ( VM_AotCheckCalls( interp, aot, "translated ", calls, numCalls ) == numCalls ) {
+			Com_Printf( "%s: %i calls match\n", module, numCalls );
+		}
+		Hunk_FreeTempMemory( aotCheck.trace );
+		aotCheck.trace = NULL;
 	}
+
+	if ( aot ) {
+		VM_Free( aot );
+	}
+	VM_Free( interp );
+	Hunk_ClearToPosition( hunkLow, hunkHigh );
+}
+
+/*
+==============
+VM_AotCheck_f
+
+Checks a qvm2c translation against the interpreter
+==============
+*/
+void VM_AotCheck_f( void ) {
+	VM_CheckModule( "vmaotcheck", VMI_NATIVE );
+}
+
+/*
+==============
+VM_JitCheck_f
+
+Checks the load time compiler against the interpreter, with the same
+arguments as vmaotcheck
+==============
+*/
+void VM_JitCheck_f( void ) {
+	VM_CheckModule( "vmjitcheck", VMI_COMPILED );
 }
 
 /*
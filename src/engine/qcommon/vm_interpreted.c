@@ -154,7 +154,7 @@ VM_PrepareInterpreter
 */
 void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 	int		op;
-	int		pc;
+	int		pc, out;
 	byte	*code;
 	int		instruction;
 	int		*codeBase;
@@ -163,24 +163,32 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 //	memcpy( vm->codeBase, (byte *)header + header->codeOffset, vm->codeLength );
 
 	// we don't need to translate the instructions, but we still need
-	// to find each instructions starting point for jumps
+	// to find each instructions starting point for jumps.
+	// instructions removed by the optimizer are left out of the image,
+	// their instruction pointer is the one of the instruction after them,
+	// so calls and branches to them land on the next real instruction
 	pc = 0;
+	out = 0;
 	instruction = 0;
 	code = (byte *)header + header->codeOffset;
 	codeBase = (int *)vm->codeBase;
 
 	while ( instruction < header->instructionCount ) {
-		vm->instructionPointers[ instruction ] = pc;
+		vm->instructionPointers[ instruction ] = out;
 		instruction++;
 
-		op = code[ pc ];
-		codeBase[pc] = op;
-		if ( pc > header->codeLength ) {
+		if ( pc >= header->codeLength ) {
 			Com_Error( ERR_FATAL, "VM_PrepareInterpreter: pc > header->codeLength" );
 		}
-
+		op = code[ pc ];
 		pc++;
 
+		if ( op == OP_IGNORE ) {
+			continue;
+		}
+		codeBase[out] = op;
+		out++;
+
 		// these are the only opcodes that aren't a single byte
 		switch ( op ) {
 		case OP_ENTER:
@@ -204,11 +212,13 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 		case OP_GTF:
 		case OP_GEF:
 		case OP_BLOCK_COPY:
-			codeBase[pc+0] = loadWord(&code[pc]);
+			codeBase[out] = loadWord(&code[pc]);
+			out += 4;
 			pc += 4;
 			break;
 		case OP_ARG:
-			codeBase[pc+0] = code[pc];
+			codeBase[out] = code[pc];
+			out += 1;
 			pc += 1;
 			break;
 		default:
@@ -216,20 +226,23 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 		}
 
 	}
-	pc = 0;
-	instruction = 0;
-	code = (byte *)header + header->codeOffset;
-	codeBase = (int *)vm->codeBase;
 
-	while ( instruction < header->instructionCount ) {
-		op = code[ pc ];
-		instruction++;
+	// the image is shorter than the file by the removed instructions
+	vm->codeLength = out;
+
+	// branches hold instruction numbers, make them point into the image
+	pc = 0;
+	while ( pc < vm->codeLength ) {
+		op = codeBase[ pc ];
 		pc++;
 		switch ( op ) {
 		case OP_ENTER:
 		case OP_CONST:
 		case OP_LOCAL:
 		case OP_LEAVE:
+		case OP_BLOCK_COPY:
+			pc += 4;
+			break;
 		case OP_EQ:
 		case OP_NE:
 		case OP_LTI:
@@ -246,28 +259,10 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 		case OP_LEF:
 		case OP_GTF:
 		case OP_GEF:
-		case OP_BLOCK_COPY:
-			switch(op) {
-				case OP_EQ:
-				case OP_NE:
-				case OP_LTI:
-				case OP_LEI:
-				case OP_GTI:
-				case OP_GEI:
-				case OP_LTU:
-				case OP_LEU:
-				case OP_GTU:
-				case OP_GEU:
-				case OP_EQF:
-				case OP_NEF:
-				case OP_LTF:
-				case OP_LEF:
-				case OP_GTF:
-				case OP_GEF:
+			if ( (unsigned)codeBase[pc] < (unsigned)header->instructionCount ) {
 				codeBase[pc] = vm->instructionPointers[codeBase[pc]];
-				break;
-			default:
-				break;
+			} else {
+				codeBase[pc] = -1;		// the compilers reject it
 			}
 			pc += 4;
 			break;
@@ -310,7 +305,15 @@ locals from sp
 
 #define	DEBUGSTR va("%s%i", VM_Indent(vm), opStack-stack )
 
-int	VM_CallInterpreted( vm_t *vm, int *args ) {
+// VM_Interpret is expanded once with and once without the profiler,
+// so an unprofiled module doesn't pay for the sample check
+#ifdef _MSC_VER
+#define	VM_FORCEINLINE	__forceinline
+#else
+#define	VM_FORCEINLINE	inline __attribute__((always_inline))
+#endif
+
+static VM_FORCEINLINE int VM_Interpret( vm_t *vm, int *args, const qboolean profiled ) {
 	int		stack[MAX_STACK];
 	int		*opStack;
 	int		programCounter;
@@ -320,9 +323,8 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	int		*codeImage;
 	int		v1;
 	int		dataMask;
-#ifdef DEBUG_VM
-	vmSymbol_t	*profileSymbol;
-#endif
+	unsigned int	count;
+	unsigned int	sampleAt;
 
 	// interpret the code
 	vm->currentlyInterpreting = qtrue;
@@ -331,7 +333,6 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	programStack = stackOnEntry = vm->programStack;
 
 #ifdef DEBUG_VM
-	profileSymbol = VM_ValueToFunctionSymbol( vm, 0 );
 	// uncomment this for debugging breakpoints
 	vm->breakFunction = 0;
 #endif
@@ -346,6 +347,10 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	// not corrupt anything
 	opStack = stack;
 	programCounter = 0;
+	count = 0;
+
+	// the sample interval carries over from the last call
+	sampleAt = profiled ? vm->profile->remaining : 0xffffffff;
 
 	programStack -= 48;
 
@@ -377,10 +382,16 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 //		unsigned int	r2;
 
 nextInstruction:
+		if ( profiled && count >= sampleAt ) {
+			sampleAt = count + VM_ProfileSample( vm, programCounter, programStack, qfalse );
+		}
 		r0 = ((int *)opStack)[0];
 		r1 = ((int *)opStack)[-1];
 nextInstruction2:
 		opcode = codeImage[ programCounter++ ];
+		if ( profiled ) {
+			count++;
+		}
 #ifdef DEBUG_VM
 		if ( (unsigned)programCounter > vm->codeLength ) {
 			Com_Error( ERR_DROP, "VM pc out of range" );
@@ -404,7 +415,6 @@ nextInstruction2:
 		if ( vm_debugLevel > 1 ) {
 			Com_Printf( "%s %s\n", DEBUGSTR, opnames[opcode] );
 		}
-		profileSymbol->profileCount++;
 #endif
 
 		switch ( opcode ) {
@@ -412,6 +422,9 @@ nextInstruction2:
 		default:
 			Com_Error( ERR_DROP, "Bad VM instruction" );  // this should be scanned on load!
 #endif
+		case OP_IGNORE:
+			// not in a prepared image, but harmless if it is
+			goto nextInstruction2;
 		case OP_BREAK:
 			vm->breakCount++;
 			goto nextInstruction2;
@@ -465,25 +478,11 @@ nextInstruction2:
 			programCounter += 1;
 			goto nextInstruction;
 
-        case OP_BLOCK_COPY:
-            {
-                int src = r0;
-                int dest = r1;
-                size_t n = r2;
-
-                if ((dest & dataMask) != dest
-                    || (src & dataMask) != src
-                    || ((dest + n) & dataMask) != dest + n
-                    || ((src + n) & dataMask) != src + n)
-                {
-                    Com_Error(ERR_DROP, "OP_BLOCK_COPY out of range!");
-                }
-
-                Com_Memcpy(vm->dataBase + dest, vm->dataBase + src, n);
-                programCounter += 4;
-                opStack -= 2;
-            }
-            goto nextInstruction;
+		case OP_BLOCK_COPY:
+			VM_BlockCopy( vm, r1, r0, r2 );
+			programCounter += 4;
+			opStack -= 2;
+			goto nextInstruction;
 
 		case OP_CALL:
 			// save current program counter
@@ -520,7 +519,11 @@ nextInstruction2:
                     argarr[i] = *imagePtr;
                     imagePtr++;
                 }
-                r = vm->systemCall( argarr );
+                if ( vm->profile ) {
+                    r = VM_ProfileSystemCall( vm, argarr );
+                } else {
+                    r = VM_DispatchSystemCall( vm, argarr );
+                }
             }
 
 #ifdef DEBUG_VM
@@ -553,9 +556,6 @@ nextInstruction2:
 			goto nextInstruction;
 
 		case OP_ENTER:
-#ifdef DEBUG_VM
-			profileSymbol = VM_ValueToFunctionSymbol( vm, programCounter );
-#endif
 			// get size of stack frame
 			v1 = r2;
 
@@ -585,7 +585,6 @@ nextInstruction2:
 			// grab the saved program counter
 			programCounter = *(int *)&image[ programStack ];
 #ifdef DEBUG_VM
-			profileSymbol = VM_ValueToFunctionSymbol( vm, programCounter );
 			if ( vm_debugLevel ) {
 				vm->callLevel--;
 				Com_Printf( "%s<--- %s\n", DEBUGSTR, VM_ValueToSymbol( vm, programCounter ) );
@@ -827,7 +826,7 @@ nextInstruction2:
 			opStack--;
 			goto nextInstruction;
 		case OP_BCOM:
-			opStack[-1] = ~ ((unsigned)r0);
+			*opStack = ~ ((unsigned)r0);
 			goto nextInstruction;
 
 		case OP_LSH:
@@ -880,6 +879,10 @@ nextInstruction2:
 
 done:
 	vm->currentlyInterpreting = qfalse;
+	vm->executedInstructions += count;
+	if ( profiled ) {
+		vm->profile->remaining = count < sampleAt ? sampleAt - count : 1;
+	}
 
 	if ( opStack != &stack[1] ) {
 		Com_Error( ERR_DROP, "Interpreter error: opStack = %i", opStack - stack );
@@ -890,3 +893,10 @@ done:
 	// return the result
 	return *opStack;
 }
+
+int	VM_CallInterpreted( vm_t *vm, int *args ) {
+	if ( vm->profile ) {
+		return VM_Interpret( vm, args, qtrue );
+	}
+	return VM_Interpret( vm, args, qfalse );
+}
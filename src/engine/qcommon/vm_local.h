@@ -117,13 +117,53 @@ typedef enum {
 
 typedef int	vmptr_t;
 
+typedef struct vmThreadedOp_s vmThreadedOp_t;
+
+// functions the load time optimizer changed
+typedef struct {
+	int		start;				// instruction number of the OP_ENTER
+	int		instructions;		// before optimization
+	int		removed;
+} vmOptFunction_t;
+
 typedef struct vmSymbol_s {
 	struct vmSymbol_s	*next;
 	int		symValue;
-	int		profileCount;
 	char	symName[1];		// variable sized
 } vmSymbol_t;
 
+// sampling profiler, see vm_profile.c
+#define	VM_PROFILE_MAX_DEPTH	32
+#define	VM_PROFILE_MAX_STACKS	2048	// must be a power of two
+#define	VM_PROFILE_MAX_SYSCALLS	1024
+
+typedef struct {
+	int		count;
+	int		depth;			// 0 for an unused slot
+	int		frames[VM_PROFILE_MAX_DEPTH];	// function numbers, leaf first
+} vmProfileStack_t;
+
+typedef struct {
+	int		calls;
+	int		maxUsec;
+	double	usec;
+} vmProfileSyscall_t;
+
+typedef struct {
+	int		remaining;		// instructions until the next sample, compiled code decrements this
+	int		startTime;
+
+	int		numFunctions;
+	int		*functions;		// code offset of every OP_ENTER, ascending
+
+	int		samples;
+	int		droppedSamples;	// stack table was full
+	int		numStacks;
+	vmProfileStack_t	*stacks;
+
+	vmProfileSyscall_t	syscalls[VM_PROFILE_MAX_SYSCALLS];
+} vmProfile_t;
+
 #define	VM_OFFSET_PROGRAM_STACK		0
 #define	VM_OFFSET_SYSTEM_CALL		4
 
@@ -134,6 +174,8 @@ struct vm_s {
     intptr_t    (*systemCall)( intptr_t *parms );
 
 	//------------------------------------
+
+	vmSystemCall_t	fastSystemCalls[VM_MAX_FAST_SYSCALLS];	// skip systemCall for these
    
     char		name[MAX_QPATH];
 
@@ -150,6 +192,34 @@ struct vm_s {
 	int			*instructionPointers;
 	int			instructionPointersLength;
 
+	// for compiled modules, translated from the interpreter image
+	qboolean	compiled;
+	byte		*compiledCode;
+	int			compiledCodeLength;
+	intptr_t	*compiledInstructions;	// native address of each instruction
+	void		*compiledUnwind;		// win64 function table, if registered
+
+	// for threaded modules, predecoded from the interpreter image
+	qboolean	threaded;
+	struct vmThreadedOp_s	*threadedCode;
+	int			threadedFused;		// number of superinstructions
+
+	unsigned int	executedInstructions;	// bytecode instructions run by the interpreters,
+											// the plain one only counts while profiling
+
+	vmProfile_t	*profile;			// NULL unless vm_profile was set at load time
+
+	// load time optimizer results
+	qboolean	optimized;
+	int			optInstructions;	// before optimization
+	int			optRemoved;
+	int			optFolded;
+	int			optThreaded;
+	int			optLoadsStores;
+	int			optDeadStores;
+	int			numOptFunctions;
+	vmOptFunction_t	*optFunctions;
+
 	byte		*dataBase;
 	int			dataMask;
 
@@ -170,9 +240,48 @@ struct vm_s {
 extern	vm_t	*currentVM;
 extern	int		vm_debugLevel;
 
+extern	cvar_t	*vm_profileInterval;
+
+/*
+==============
+VM_DispatchSystemCall
+
+Every backend makes its system calls through here
+==============
+*/
+static ID_INLINE intptr_t VM_DispatchSystemCall( vm_t *vm, intptr_t *args ) {
+	if ( (unsigned)args[0] < VM_MAX_FAST_SYSCALLS && vm->fastSystemCalls[ args[0] ] ) {
+		return vm->fastSystemCalls[ args[0] ]( args );
+	}
+	return vm->systemCall( args );
+}
+
+void VM_OptimizeCode( vm_t *vm, vmHeader_t *header );
+
+void VM_ProfileInit( vm_t *vm );
+int VM_ProfileSample( vm_t *vm, int pc, int programStack, qboolean instructionNumbers );
+intptr_t VM_ProfileSystemCall( vm_t *vm, intptr_t *args );
+void VM_ProfileReset( vm_t *vm );
+void VM_ProfileReport( vm_t *vm );
+void VM_ProfileDump( vm_t *vm, fileHandle_t f );
+
 void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header );
+
+// VM_PrepareInterpreter leaves instructions the optimizer removed out of
+// the image, they share their pc with the instruction after them
+#define	VM_InstructionRemoved( vm, i ) \
+	( (i) + 1 < ( (vm)->instructionPointersLength >> 2 ) && (vm)->instructionPointers[(i)+1] == (vm)->instructionPointers[(i)] )
 int	VM_CallInterpreted( vm_t *vm, int *args );
 
+void VM_PrepareThreaded( vm_t *vm );
+int	VM_CallThreaded( vm_t *vm, int *args );
+
+void VM_Compile( vm_t *vm );
+void VM_FreeCompiled( vm_t *vm );
+int	VM_CallCompiled( vm_t *vm, int *args );
+
+void VM_BlockCopy( vm_t *vm, unsigned int dest, unsigned int src, size_t n );
+
 vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value );
 int VM_SymbolToValue( vm_t *vm, const char *symbol );
 const char *VM_ValueToSymbol( vm_t *vm, int value );
@@ -0,0 +1,1290 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_optimize.c -- load time bytecode optimizer
+
+/*
+
+The optimizer rewrites the qvm code in place before any backend sees it,
+so the interpreter, the threaded interpreter and the compiler all run
+the result.
+
+Instruction numbers are used by calls, branches and jump tables in the
+data segment, and there is no telling a jump table from other data, so
+instructions are never moved.  A removed instruction becomes OP_IGNORE,
+which is a single byte and compiles to nothing.  Removed instructions
+are placed in front of the ones that survive, so the pairs the backends
+fuse stay next to each other.
+
+Everything works on straight line code inside a function:
+
+constant folding		CONST CONST op, CONST op, and x+0 style identities
+branch threading		branches to "CONST JUMP" go straight to the final
+						target, jumps to the next instruction disappear and
+						jumps to an OP_LEAVE become the OP_LEAVE
+load / store pairs		"x = x" copies, stores of the value a local already
+						holds, and loads of a local holding a known constant
+dead stores				a store to a local that is overwritten or goes out
+						of scope before it is read
+
+The memory optimizations are only done in functions that never let the
+address of a local escape, so nothing but the function itself can see
+its locals.
+
+*/
+
+#include "vm_local.h"
+
+#define	MAX_OPT_PASSES		4
+#define	MAX_OPT_STACK		256		// same as the interpreter op stack
+#define	MAX_OPT_SLOTS		32
+#define	MAX_OPT_THREAD		16		// longest jump chain followed
+
+typedef struct {
+	int			op;
+	int			value;
+	qboolean	fixedTarget;	// entry point, jump table entry or reached from another function
+	qboolean	target;
+} vmOptInstruction_t;
+
+// an op stack entry of the straight line simulation
+typedef struct {
+	int			instruction;	// producer, -1 if it was pushed before the block
+	qboolean	fromLocal;		// an OP_LOAD4 of a local
+	int			local;			// the local's offset
+} vmOptValue_t;
+
+typedef struct {
+	int			offset;
+	int			size;
+	int			value;			// known constants
+	int			local;			// pending stores: the OP_LOCAL and the store
+	int			store;
+} vmOptSlot_t;
+
+typedef struct {
+	vm_t				*vm;
+	vmOptInstruction_t	*code;
+	int					instructionCount;
+
+	// current function
+	int					start, end;
+	int					frameSize;
+	qboolean			addressTaken;
+
+	vmOptValue_t		stack[MAX_OPT_STACK];
+	int					depth;
+
+	vmOptSlot_t			known[MAX_OPT_SLOTS];
+	int					numKnown;
+	vmOptSlot_t			pending[MAX_OPT_SLOTS];
+	int					numPending;
+} vmOptimizer_t;
+
+typedef union {
+	float	f;
+	int		i;
+} vmOptFloat_t;
+
+/*
+=================
+VM_OperandSize
+=================
+*/
+static int VM_OperandSize( int op ) {
+	switch ( op ) {
+	case OP_ENTER:
+	case OP_CONST:
+	case OP_LOCAL:
+	case OP_LEAVE:
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+	case OP_BLOCK_COPY:
+		return 4;
+	case OP_ARG:
+		return 1;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static qboolean VM_IsCompare( int op ) {
+	return (qboolean)( op >= OP_EQ && op <= OP_GEF );
+}
+
+/*
+=================
+VM_OptStackEffect
+
+How many values an instruction takes off the op stack and puts back
+=================
+*/
+static void VM_OptStackEffect( int op, int *pops, int *pushes ) {
+	*pops = 0;
+	*pushes = 0;
+
+	switch ( op ) {
+	case OP_CONST:
+	case OP_LOCAL:
+	case OP_PUSH:
+		*pushes = 1;
+		break;
+	case OP_POP:
+	case OP_ARG:
+	case OP_JUMP:
+	case OP_LEAVE:
+		*pops = 1;
+		break;
+	case OP_STORE1:
+	case OP_STORE2:
+	case OP_STORE4:
+	case OP_BLOCK_COPY:
+		*pops = 2;
+		break;
+	case OP_CALL:
+	case OP_LOAD1:
+	case OP_LOAD2:
+	case OP_LOAD4:
+	case OP_SEX8:
+	case OP_SEX16:
+	case OP_NEGI:
+	case OP_BCOM:
+	case OP_NEGF:
+	case OP_CVIF:
+	case OP_CVFI:
+		*pops = 1;
+		*pushes = 1;
+		break;
+	case OP_ADD:
+	case OP_SUB:
+	case OP_DIVI:
+	case OP_DIVU:
+	case OP_MODI:
+	case OP_MODU:
+	case OP_MULI:
+	case OP_MULU:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_DIVF:
+	case OP_MULF:
+		*pops = 2;
+		*pushes = 1;
+		break;
+	default:
+		if ( VM_IsCompare( op ) ) {
+			*pops = 2;
+		}
+		break;
+	}
+}
+
+/*
+=================
+VM_OptIsPure
+
+Instructions that can be dropped along with their result
+=================
+*/
+static qboolean VM_OptIsPure( int op ) {
+	switch ( op ) {
+	case OP_IGNORE:
+	case OP_CONST:
+	case OP_LOCAL:
+	case OP_LOAD1:
+	case OP_LOAD2:
+	case OP_LOAD4:
+	case OP_SEX8:
+	case OP_SEX16:
+	case OP_NEGI:
+	case OP_ADD:
+	case OP_SUB:
+	case OP_DIVI:
+	case OP_DIVU:
+	case OP_MODI:
+	case OP_MODU:
+	case OP_MULI:
+	case OP_MULU:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+	case OP_BCOM:
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+	case OP_NEGF:
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_DIVF:
+	case OP_MULF:
+	case OP_CVIF:
+	case OP_CVFI:
+		return qtrue;
+	default:
+		break;
+	}
+	return qfalse;
+}
+
+/*
+==============================================================================
+
+CODE NAVIGATION
+
+==============================================================================
+*/
+
+/*
+=================
+VM_OptPrev
+
+The previous real instruction, if it is the only way to reach i
+=================
+*/
+static int VM_OptPrev( vmOptimizer_t *o, int i ) {
+	if ( o->code[i].target ) {
+		return -1;
+	}
+	for ( i-- ; i >= o->start ; i-- ) {
+		if ( o->code[i].op != OP_IGNORE ) {
+			return i;
+		}
+		if ( o->code[i].target ) {
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/*
+=================
+VM_OptNext
+
+The instruction that really runs when control reaches i
+=================
+*/
+static int VM_OptNext( vmOptimizer_t *o, int i ) {
+	while ( i < o->instructionCount && o->code[i].op == OP_IGNORE ) {
+		i++;
+	}
+	return i;
+}
+
+static void VM_OptRemove( vmOptimizer_t *o, int i ) {
+	o->code[i].op = OP_IGNORE;
+	o->code[i].value = 0;
+}
+
+/*
+=================
+VM_OptMarkTargets
+
+Every instruction that can be reached other than by falling into it
+=================
+*/
+static void VM_OptMarkTargets( vmOptimizer_t *o ) {
+	vmOptInstruction_t	*code = o->code;
+	int					i, prev, value;
+
+	for ( i = o->start ; i < o->end ; i++ ) {
+		code[i].target = code[i].fixedTarget;
+	}
+	for ( i = o->start ; i < o->end ; i++ ) {
+		if ( VM_IsCompare( code[i].op ) ) {
+			value = code[i].value;
+		} else if ( code[i].op == OP_JUMP ) {
+			for ( prev = i - 1 ; prev >= o->start && code[prev].op == OP_IGNORE ; prev-- ) {
+			}
+			if ( prev < o->start || code[prev].op != OP_CONST ) {
+				continue;
+			}
+			value = code[prev].value;
+		} else {
+			continue;
+		}
+		if ( value >= o->start && value < o->end ) {
+			code[value].target = qtrue;
+		}
+	}
+}
+
+/*
+==============================================================================
+
+CONSTANT FOLDING
+
+==============================================================================
+*/
+
+/*
+=================
+VM_OptFoldUnary
+=================
+*/
+static qboolean VM_OptFoldUnary( int op, int a, int *result ) {
+	vmOptFloat_t	f;
+
+	switch ( op ) {
+	case OP_SEX8:	*result = (signed char)a; return qtrue;
+	case OP_SEX16:	*result = (short)a; return qtrue;
+	case OP_NEGI:	*result = (int)( 0u - (unsigned)a ); return qtrue;
+	case OP_BCOM:	*result = ~a; return qtrue;
+	case OP_NEGF:
+		f.i = a;
+		f.f = -f.f;
+		*result = f.i;
+		return qtrue;
+	case OP_CVIF:
+		f.f = (float)a;
+		*result = f.i;
+		return qtrue;
+	case OP_CVFI:
+		// out of range conversions are up to the backend
+		f.i = a;
+		if ( !( f.f > -2147483648.0f && f.f < 2147483648.0f ) ) {
+			return qfalse;
+		}
+		*result = (int)f.f;
+		return qtrue;
+	default:
+		break;
+	}
+	return qfalse;
+}
+
+/*
+=================
+VM_OptFoldBinary
+=================
+*/
+static qboolean VM_OptFoldBinary( int op, int a, int b, int *result ) {
+	vmOptFloat_t	fa, fb;
+
+	fa.i = a;
+	fb.i = b;
+
+	switch ( op ) {
+	case OP_ADD:	*result = (int)( (unsigned)a + (unsigned)b ); return qtrue;
+	case OP_SUB:	*result = (int)( (unsigned)a - (unsigned)b ); return qtrue;
+	case OP_MULI:
+	case OP_MULU:	*result = (int)( (unsigned)a * (unsigned)b ); return qtrue;
+	case OP_BAND:	*result = a & b; return qtrue;
+	case OP_BOR:	*result = a | b; return qtrue;
+	case OP_BXOR:	*result = a ^ b; return qtrue;
+
+	// leave the faults to the backend
+	case OP_DIVI:
+	case OP_MODI:
+		if ( b == 0 || ( a == (int)0x80000000 && b == -1 ) ) {
+			return qfalse;
+		}
+		*result = op == OP_DIVI ? a / b : a % b;
+		return qtrue;
+	case OP_DIVU:
+	case OP_MODU:
+		if ( b == 0 ) {
+			return qfalse;
+		}
+		*result = (int)( op == OP_DIVU ? (unsigned)a / (unsigned)b : (unsigned)a % (unsigned)b );
+		return qtrue;
+
+	// so are shifts out of range
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		if ( b < 0 || b > 31 ) {
+			return qfalse;
+		}
+		if ( op == OP_LSH ) {
+			*result = (int)( (unsigned)a << b );
+		} else if ( op == OP_RSHI ) {
+			*result = a >> b;
+		} else {
+			*result = (int)( (unsigned)a >> b );
+		}
+		return qtrue;
+
+	case OP_ADDF:	fa.f = fa.f + fb.f; *result = fa.i; return qtrue;
+	case OP_SUBF:	fa.f = fa.f - fb.f; *result = fa.i; return qtrue;
+	case OP_MULF:	fa.f = fa.f * fb.f; *result = fa.i; return qtrue;
+	case OP_DIVF:
+		if ( fb.f == 0.0f ) {
+			return qfalse;
+		}
+		fa.f = fa.f / fb.f;
+		*result = fa.i;
+		return qtrue;
+	default:
+		break;
+	}
+	return qfalse;
+}
+
+/*
+=================
+VM_OptFoldCompare
+=================
+*/
+static qboolean VM_OptFoldCompare( int op, int a, int b ) {
+	vmOptFloat_t	fa, fb;
+
+	fa.i = a;
+	fb.i = b;
+
+	switch ( op ) {
+	case OP_EQ:		return (qboolean)( a == b );
+	case OP_NE:		return (qboolean)( a != b );
+	case OP_LTI:	return (qboolean)( a < b );
+	case OP_LEI:	return (qboolean)( a <= b );
+	case OP_GTI:	return (qboolean)( a > b );
+	case OP_GEI:	return (qboolean)( a >= b );
+	case OP_LTU:	return (qboolean)( (unsigned)a < (unsigned)b );
+	case OP_LEU:	return (qboolean)( (unsigned)a <= (unsigned)b );
+	case OP_GTU:	return (qboolean)( (unsigned)a > (unsigned)b );
+	case OP_GEU:	return (qboolean)( (unsigned)a >= (unsigned)b );
+	case OP_EQF:	return (qboolean)( fa.f == fb.f );
+	case OP_NEF:	return (qboolean)( fa.f != fb.f );
+	case OP_LTF:	return (qboolean)( fa.f < fb.f );
+	case OP_LEF:	return (qboolean)( fa.f <= fb.f );
+	case OP_GTF:	return (qboolean)( fa.f > fb.f );
+	case OP_GEF:	return (qboolean)( fa.f >= fb.f );
+	default:
+		break;
+	}
+	return qfalse;
+}
+
+/*
+=================
+VM_OptIsIdentity
+
+x op k == x
+=================
+*/
+static qboolean VM_OptIsIdentity( int op, int k ) {
+	switch ( op ) {
+	case OP_ADD:
+	case OP_SUB:
+	case OP_BOR:
+	case OP_BXOR:
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		return (qboolean)( k == 0 );
+	case OP_MULI:
+	case OP_MULU:
+	case OP_DIVI:
+	case OP_DIVU:
+		return (qboolean)( k == 1 );
+	default:
+		break;
+	}
+	return qfalse;
+}
+
+/*
+=================
+VM_OptFold
+=================
+*/
+static int VM_OptFold( vmOptimizer_t *o ) {
+	vmOptInstruction_t	*code = o->code;
+	int					i, p1, p2, pops, pushes, result;
+	int					count;
+
+	count = 0;
+	for ( i = o->start ; i < o->end ; i++ ) {
+		VM_OptStackEffect( code[i].op, &pops, &pushes );
+		if ( code[i].op == OP_CALL || pops == 0 ) {
+			continue;
+		}
+		p1 = VM_OptPrev( o, i );
+		if ( p1 == -1 || code[p1].op != OP_CONST ) {
+			continue;
+		}
+
+		if ( pops == 1 && pushes == 1 ) {
+			if ( VM_OptFoldUnary( code[i].op, code[p1].value, &result ) ) {
+				VM_OptRemove( o, p1 );
+				code[i].op = OP_CONST;
+				code[i].value = result;
+				count++;
+			}
+			continue;
+		}
+		if ( pops != 2 ) {
+			continue;
+		}
+
+		p2 = VM_OptPrev( o, p1 );
+		if ( p2 != -1 && code[p2].op == OP_CONST ) {
+			if ( VM_IsCompare( code[i].op ) ) {
+				// a branch that always goes the same way
+				if ( VM_OptFoldCompare( code[i].op, code[p2].value, code[p1].value ) ) {
+					VM_OptRemove( o, p2 );
+					code[p1].value = code[i].value;
+					code[i].op = OP_JUMP;
+					code[i].value = 0;
+				} else {
+					VM_OptRemove( o, p2 );
+					VM_OptRemove( o, p1 );
+					VM_OptRemove( o, i );
+				}
+				count++;
+				continue;
+			}
+			if ( pushes == 1 && VM_OptFoldBinary( code[i].op, code[p2].value, code[p1].value, &result ) ) {
+				VM_OptRemove( o, p2 );
+				VM_OptRemove( o, p1 );
+				code[i].op = OP_CONST;
+				code[i].value = result;
+				count++;
+				continue;
+			}
+		}
+
+		if ( pushes == 1 && VM_OptIsIdentity( code[i].op, code[p1].value ) ) {
+			VM_OptRemove( o, p1 );
+			VM_OptRemove( o, i );
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+==============================================================================
+
+BRANCH THREADING
+
+==============================================================================
+*/
+
+/*
+=================
+VM_OptFinalTarget
+
+Follows chains of "CONST JUMP"
+=================
+*/
+static int VM_OptFinalTarget( vmOptimizer_t *o, int target ) {
+	vmOptInstruction_t	*code = o->code;
+	int					i, next, hops;
+
+	for ( hops = 0 ; hops < MAX_OPT_THREAD ; hops++ ) {
+		i = VM_OptNext( o, target );
+		if ( i >= o->end || code[i].op != OP_CONST ) {
+			break;
+		}
+		next = VM_OptNext( o, i + 1 );
+		if ( next >= o->end || code[next].op != OP_JUMP ) {
+			break;
+		}
+		if ( code[i].value < o->start || code[i].value >= o->end || code[i].value == target ) {
+			break;
+		}
+		target = code[i].value;
+	}
+	return target;
+}
+
+/*
+=================
+VM_OptThread
+=================
+*/
+static int VM_OptThread( vmOptimizer_t *o ) {
+	vmOptInstruction_t	*code = o->code;
+	int					i, p1, target, final, land;
+	int					count;
+
+	count = 0;
+	for ( i = o->start ; i < o->end ; i++ ) {
+		if ( VM_IsCompare( code[i].op ) ) {
+			target = code[i].value;
+			if ( target < o->start || target >= o->end ) {
+				continue;
+			}
+			final = VM_OptFinalTarget( o, target );
+			if ( final != target ) {
+				code[i].value = final;
+				count++;
+			}
+			continue;
+		}
+
+		if ( code[i].op != OP_JUMP ) {
+			continue;
+		}
+		p1 = VM_OptPrev( o, i );
+		if ( p1 == -1 || code[p1].op != OP_CONST ) {
+			continue;
+		}
+		target = code[p1].value;
+		if ( target < o->start || target >= o->end ) {
+			continue;
+		}
+
+		final = VM_OptFinalTarget( o, target );
+		land = VM_OptNext( o, final );
+
+		if ( land == VM_OptNext( o, i + 1 ) ) {
+			// jump to the next instruction
+			VM_OptRemove( o, p1 );
+			VM_OptRemove( o, i );
+			count++;
+		} else if ( land < o->end && code[land].op == OP_LEAVE ) {
+			// return from here, the return value is already on the stack
+			VM_OptRemove( o, p1 );
+			code[i].op = OP_LEAVE;
+			code[i].value = code[land].value;
+			count++;
+		} else if ( final != target ) {
+			code[p1].value = final;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+==============================================================================
+
+STRAIGHT LINE SIMULATION
+
+==============================================================================
+*/
+
+static void VM_OptResetStack( vmOptimizer_t *o ) {
+	o->depth = 0;
+}
+
+static vmOptValue_t VM_OptPop( vmOptimizer_t *o ) {
+	static const vmOptValue_t	unknown = { -1, qfalse, 0 };
+
+	if ( o->depth <= 0 ) {
+		return unknown;		// pushed before the block started
+	}
+	return o->stack[ --o->depth ];
+}
+
+static qboolean VM_OptPush( vmOptimizer_t *o, int instruction, qboolean fromLocal, int local ) {
+	if ( o->depth >= MAX_OPT_STACK ) {
+		return qfalse;
+	}
+	o->stack[o->depth].instruction = instruction;
+	o->stack[o->depth].fromLocal = fromLocal;
+	o->stack[o->depth].local = local;
+	o->depth++;
+	return qtrue;
+}
+
+static qboolean VM_OptIsLocal( vmOptimizer_t *o, vmOptValue_t *v ) {
+	return (qboolean)( v->instruction != -1 && o->code[ v->instruction ].op == OP_LOCAL );
+}
+
+/*
+=================
+VM_OptEndsBlock
+=================
+*/
+static qboolean VM_OptEndsBlock( int op ) {
+	return (qboolean)( op == OP_JUMP || op == OP_LEAVE || VM_IsCompare( op ) );
+}
+
+/*
+=================
+VM_OptFindAddressTaken
+
+A local whose address is used for anything but a load or a store can
+be reached through a pointer, which rules out the memory optimizations
+=================
+*/
+static void VM_OptFindAddressTaken( vmOptimizer_t *o ) {
+	vmOptInstruction_t	*code = o->code;
+	vmOptValue_t		a, b;
+	int					i, j, op, pops, pushes;
+
+	o->addressTaken = qfalse;
+	VM_OptResetStack( o );
+
+	for ( i = o->start ; i < o->end ; i++ ) {
+		op = code[i].op;
+		if ( code[i].target ) {
+			for ( j = 0 ; j < o->depth ; j++ ) {
+				if ( VM_OptIsLocal( o, &o->stack[j] ) ) {
+					o->addressTaken = qtrue;
+					return;
+				}
+			}
+			VM_OptResetStack( o );
+		}
+
+		VM_OptStackEffect( op, &pops, &pushes );
+		if ( pops == 1 ) {
+			a = VM_OptPop( o );
+			if ( VM_OptIsLocal( o, &a ) && op != OP_LOAD1 && op != OP_LOAD2 && op != OP_LOAD4 ) {
+				o->addressTaken = qtrue;
+				return;
+			}
+		} else if ( pops == 2 ) {
+			b = VM_OptPop( o );
+			a = VM_OptPop( o );
+			if ( VM_OptIsLocal( o, &b ) ) {
+				o->addressTaken = qtrue;
+				return;
+			}
+			if ( VM_OptIsLocal( o, &a ) && op != OP_STORE1 && op != OP_STORE2 && op != OP_STORE4 ) {
+				o->addressTaken = qtrue;
+				return;
+			}
+		}
+		if ( pushes && !VM_OptPush( o, i, qfalse, 0 ) ) {
+			o->addressTaken = qtrue;
+			return;
+		}
+
+		if ( VM_OptEndsBlock( op ) ) {
+			for ( j = 0 ; j < o->depth ; j++ ) {
+				if ( VM_OptIsLocal( o, &o->stack[j] ) ) {
+					o->addressTaken = qtrue;
+					return;
+				}
+			}
+			VM_OptResetStack( o );
+		}
+	}
+}
+
+/*
+==============================================================================
+
+LOCAL MEMORY
+
+==============================================================================
+*/
+
+static qboolean VM_OptOverlaps( vmOptSlot_t *slot, int offset, int size ) {
+	return (qboolean)( slot->offset < offset + size && offset < slot->offset + slot->size );
+}
+
+static vmOptSlot_t *VM_OptFindSlot( vmOptSlot_t *slots, int numSlots, int offset, int size ) {
+	int		i;
+
+	for ( i = 0 ; i < numSlots ; i++ ) {
+		if ( slots[i].offset == offset && slots[i].size == size ) {
+			return &slots[i];
+		}
+	}
+	return NULL;
+}
+
+static void VM_OptForgetSlots( vmOptSlot_t *slots, int *numSlots, int offset, int size ) {
+	int		i;
+
+	for ( i = 0 ; i < *numSlots ; ) {
+		if ( VM_OptOverlaps( &slots[i], offset, size ) ) {
+			slots[i] = slots[ --*numSlots ];
+		} else {
+			i++;
+		}
+	}
+}
+
+static void VM_OptAddSlot( vmOptSlot_t *slots, int *numSlots, vmOptSlot_t *slot ) {
+	if ( *numSlots == MAX_OPT_SLOTS ) {
+		// forget the oldest
+		memmove( slots, slots + 1, ( MAX_OPT_SLOTS - 1 ) * sizeof( *slots ) );
+		--*numSlots;
+	}
+	slots[ (*numSlots)++ ] = *slot;
+}
+
+/*
+=================
+VM_OptRangeIsPure
+
+The instructions computing the value of a store
+=================
+*/
+static qboolean VM_OptRangeIsPure( vmOptimizer_t *o, int first, int last ) {
+	int		i;
+
+	for ( i = first ; i <= last ; i++ ) {
+		if ( !VM_OptIsPure( o->code[i].op ) ) {
+			return qfalse;
+		}
+	}
+	return qtrue;
+}
+
+/*
+=================
+VM_OptRemoveStore
+
+The value is still computed if that has side effects
+=================
+*/
+static void VM_OptRemoveStore( vmOptimizer_t *o, int local, int store ) {
+	int		i;
+
+	if ( VM_OptRangeIsPure( o, local + 1, store - 1 ) ) {
+		for ( i = local ; i <= store ; i++ ) {
+			VM_OptRemove( o, i );
+		}
+	} else {
+		VM_OptRemove( o, local );
+		o->code[store].op = OP_POP;
+	}
+}
+
+/*
+=================
+VM_OptStore
+=================
+*/
+static void VM_OptStore( vmOptimizer_t *o, int i, vmOptValue_t *address, vmOptValue_t *value, int *loadsStores, int *deadStores ) {
+	vmOptInstruction_t	*code = o->code;
+	vmOptSlot_t			*slot, s;
+	int					offset, size;
+	qboolean			isConst;
+
+	offset = code[ address->instruction ].value;
+	size = code[i].op == OP_STORE4 ? 4 : code[i].op == OP_STORE2 ? 2 : 1;
+	isConst = (qboolean)( value->instruction != -1 && code[ value->instruction ].op == OP_CONST );
+
+	if ( size == 4 && VM_OptRangeIsPure( o, address->instruction + 1, i - 1 ) ) {
+		// "x = x"
+		if ( value->fromLocal && value->local == offset ) {
+			VM_OptRemoveStore( o, address->instruction, i );
+			(*loadsStores)++;
+			return;
+		}
+		// storing what is already there
+		slot = VM_OptFindSlot( o->known, o->numKnown, offset, 4 );
+		if ( isConst && slot && slot->value == code[ value->instruction ].value ) {
+			VM_OptRemoveStore( o, address->instruction, i );
+			(*loadsStores)++;
+			return;
+		}
+	}
+
+	// the previous store to the same place was never read
+	slot = VM_OptFindSlot( o->pending, o->numPending, offset, size );
+	if ( slot ) {
+		VM_OptRemoveStore( o, slot->local, slot->store );
+		(*deadStores)++;
+	}
+
+	VM_OptForgetSlots( o->known, &o->numKnown, offset, size );
+	VM_OptForgetSlots( o->pending, &o->numPending, offset, size );
+
+	s.offset = offset;
+	s.size = size;
+	s.local = address->instruction;
+	s.store = i;
+	s.value = 0;
+	VM_OptAddSlot( o->pending, &o->numPending, &s );
+
+	if ( size == 4 && isConst ) {
+		s.value = code[ value->instruction ].value;
+		VM_OptAddSlot( o->known, &o->numKnown, &s );
+	}
+}
+
+/*
+=================
+VM_OptMemory
+=================
+*/
+static void VM_OptMemory( vmOptimizer_t *o, int *loadsStores, int *deadStores ) {
+	vmOptInstruction_t	*code = o->code;
+	vmOptValue_t		a, b;
+	vmOptSlot_t			*slot;
+	int					i, j, op, pops, pushes, offset, size;
+
+	VM_OptResetStack( o );
+	o->numKnown = 0;
+	o->numPending = 0;
+
+	for ( i = o->start ; i < o->end ; i++ ) {
+		op = code[i].op;
+		if ( code[i].target ) {
+			VM_OptResetStack( o );
+			o->numKnown = 0;
+			o->numPending = 0;
+		}
+
+		VM_OptStackEffect( op, &pops, &pushes );
+
+		switch ( op ) {
+		case OP_LOAD1:
+		case OP_LOAD2:
+		case OP_LOAD4:
+			a = VM_OptPop( o );
+			if ( !VM_OptIsLocal( o, &a ) ) {
+				VM_OptPush( o, i, qfalse, 0 );
+				break;
+			}
+			offset = code[ a.instruction ].value;
+			size = op == OP_LOAD4 ? 4 : op == OP_LOAD2 ? 2 : 1;
+			slot = VM_OptFindSlot( o->known, o->numKnown, offset, 4 );
+			if ( op == OP_LOAD4 && slot && VM_OptPrev( o, i ) == a.instruction ) {
+				// the value is known, the memory isn't read
+				VM_OptRemove( o, a.instruction );
+				code[i].op = OP_CONST;
+				code[i].value = slot->value;
+				(*loadsStores)++;
+				VM_OptPush( o, i, qfalse, 0 );
+				break;
+			}
+			VM_OptForgetSlots( o->pending, &o->numPending, offset, size );
+			VM_OptPush( o, i, (qboolean)( op == OP_LOAD4 ), offset );
+			break;
+
+		case OP_STORE1:
+		case OP_STORE2:
+		case OP_STORE4:
+			b = VM_OptPop( o );
+			a = VM_OptPop( o );
+			if ( VM_OptIsLocal( o, &a ) ) {
+				VM_OptStore( o, i, &a, &b, loadsStores, deadStores );
+			}
+			break;
+
+		case OP_ARG:
+			VM_OptPop( o );
+			VM_OptForgetSlots( o->known, &o->numKnown, code[i].value, 4 );
+			VM_OptForgetSlots( o->pending, &o->numPending, code[i].value, 4 );
+			break;
+
+		case OP_CALL:
+			// the callee sees the argument area, and the return
+			// address and system call number are stored in the frame
+			VM_OptPop( o );
+			VM_OptPush( o, i, qfalse, 0 );
+			o->numKnown = 0;
+			o->numPending = 0;
+			break;
+
+		case OP_LEAVE:
+			// locals go out of scope, the caller owns the area past the frame
+			for ( j = 0 ; j < o->numPending ; j++ ) {
+				slot = &o->pending[j];
+				if ( slot->offset >= 0 && slot->offset + slot->size <= o->frameSize ) {
+					VM_OptRemoveStore( o, slot->local, slot->store );
+					(*deadStores)++;
+				}
+			}
+			break;
+
+		default:
+			for ( j = 0 ; j < pops ; j++ ) {
+				VM_OptPop( o );
+			}
+			if ( pushes ) {
+				VM_OptPush( o, i, qfalse, 0 );
+			}
+			break;
+		}
+
+		if ( VM_OptEndsBlock( op ) ) {
+			VM_OptResetStack( o );
+			o->numKnown = 0;
+			o->numPending = 0;
+		}
+	}
+}
+
+/*
+==============================================================================
+
+DRIVER
+
+==============================================================================
+*/
+
+/*
+=================
+VM_OptDecode
+=================
+*/
+static qboolean VM_OptDecode( vmOptimizer_t *o, vmHeader_t *header ) {
+	byte	*code;
+	int		i, pc, op, size;
+
+	code = (byte *)header + header->codeOffset;
+	pc = 0;
+	for ( i = 0 ; i < o->instructionCount ; i++ ) {
+		if ( pc >= header->codeLength ) {
+			return qfalse;
+		}
+		op = code[pc++];
+		if ( op < 0 || op > OP_CVFI ) {
+			return qfalse;
+		}
+		size = VM_OperandSize( op );
+		if ( pc + size > header->codeLength ) {
+			return qfalse;
+		}
+		o->code[i].op = op;
+		if ( size == 4 ) {
+			o->code[i].value = code[pc] | ( code[pc+1] << 8 ) | ( code[pc+2] << 16 ) | ( code[pc+3] << 24 );
+		} else if ( size == 1 ) {
+			o->code[i].value = code[pc];
+		}
+		pc += size;
+
+		if ( VM_IsCompare( op ) && ( o->code[i].value < 0 || o->code[i].value >= o->instructionCount ) ) {
+			return qfalse;
+		}
+	}
+	return (qboolean)( o->code[0].op == OP_ENTER );
+}
+
+/*
+=================
+VM_OptEncode
+
+Never longer than the original, so it fits in place
+=================
+*/
+static void VM_OptEncode( vmOptimizer_t *o, vmHeader_t *header ) {
+	byte	*code;
+	int		i, pc, size, value;
+
+	code = (byte *)header + header->codeOffset;
+	pc = 0;
+	for ( i = 0 ; i < o->instructionCount ; i++ ) {
+		code[pc++] = o->code[i].op;
+		size = VM_OperandSize( o->code[i].op );
+		value = o->code[i].value;
+		if ( size == 4 ) {
+			code[pc++] = value & 255;
+			code[pc++] = ( value >> 8 ) & 255;
+			code[pc++] = ( value >> 16 ) & 255;
+			code[pc++] = ( value >> 24 ) & 255;
+		} else if ( size == 1 ) {
+			code[pc++] = value;
+		}
+	}
+	header->codeLength = pc;
+}
+
+/*
+=================
+VM_OptMarkFixedTargets
+
+Targets no rewrite can take away
+=================
+*/
+static void VM_OptMarkFixedTargets( vmOptimizer_t *o, vmHeader_t *header ) {
+	vmOptInstruction_t	*code = o->code;
+	byte				*data;
+	int					*function;
+	int					i, prev, value, start, length;
+
+	// jump tables, and anything else that looks like an instruction number
+	data = (byte *)header + header->dataOffset;
+	length = header->dataLength + header->litLength;
+	for ( i = 0 ; i + 4 <= length ; i += 4 ) {
+		value = data[i] | ( data[i+1] << 8 ) | ( data[i+2] << 16 ) | ( data[i+3] << 24 );
+		if ( value >= 0 && value < o->instructionCount ) {
+			code[value].fixedTarget = qtrue;
+		}
+	}
+
+	function = (int *)Hunk_AllocateTempMemory( o->instructionCount * sizeof( int ) );
+	start = 0;
+	for ( i = 0 ; i < o->instructionCount ; i++ ) {
+		if ( code[i].op == OP_ENTER ) {
+			code[i].fixedTarget = qtrue;
+			start = i;
+		}
+		function[i] = start;
+	}
+
+	// branches between functions
+	for ( i = 0 ; i < o->instructionCount ; i++ ) {
+		if ( VM_IsCompare( code[i].op ) ) {
+			value = code[i].value;
+		} else if ( code[i].op == OP_JUMP ) {
+			for ( prev = i - 1 ; prev >= 0 && code[prev].op == OP_IGNORE ; prev-- ) {
+			}
+			if ( prev < 0 || code[prev].op != OP_CONST ) {
+				continue;
+			}
+			value = code[prev].value;
+		} else {
+			continue;
+		}
+		if ( value >= 0 && value < o->instructionCount && function[value] != function[i] ) {
+			code[value].fixedTarget = qtrue;
+		}
+	}
+
+	Hunk_FreeTempMemory( function );
+}
+
+/*
+=================
+VM_CountInstructions
+=================
+*/
+static int VM_CountInstructions( vmOptimizer_t *o ) {
+	int		i, count;
+
+	count = 0;
+	for ( i = o->start ; i < o->end ; i++ ) {
+		if ( o->code[i].op != OP_IGNORE ) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+=================
+VM_OptimizeCode
+
+Rewrites the code of a freshly loaded qvm before it is prepared
+=================
+*/
+void VM_OptimizeCode( vm_t *vm, vmHeader_t *header ) {
+	vmOptimizer_t		*o;
+	vmOptFunction_t		*functions;
+	int					numFunctions;
+	int					pass, before, after, changed;
+	int					folded, threaded, loadsStores, deadStores;
+	int					i;
+
+	o = (vmOptimizer_t *)Hunk_AllocateTempMemory( sizeof( *o ) );
+	Com_Memset( o, 0, sizeof( *o ) );
+	o->vm = vm;
+	o->instructionCount = header->instructionCount;
+	o->code = (vmOptInstruction_t *)Hunk_AllocateTempMemory( o->instructionCount * sizeof( *o->code ) );
+	Com_Memset( o->code, 0, o->instructionCount * sizeof( *o->code ) );
+
+	if ( !VM_OptDecode( o, header ) ) {
+		// the backends will complain about it
+		Hunk_FreeTempMemory( o->code );
+		Hunk_FreeTempMemory( o );
+		return;
+	}
+
+	VM_OptMarkFixedTargets( o, header );
+
+	numFunctions = 0;
+	for ( i = 0 ; i < o->instructionCount ; i++ ) {
+		if ( o->code[i].op == OP_ENTER ) {
+			numFunctions++;
+		}
+	}
+	functions = (vmOptFunction_t *)Hunk_AllocateTempMemory( numFunctions * sizeof( *functions ) );
+
+	folded = threaded = loadsStores = deadStores = 0;
+	vm->numOptFunctions = 0;
+	vm->optInstructions = 0;
+	vm->optRemoved = 0;
+
+	for ( o->start = 0 ; o->start < o->instructionCount ; o->start = o->end ) {
+		for ( o->end = o->start + 1 ; o->end < o->instructionCount && o->code[o->end].op != OP_ENTER ; o->end++ ) {
+		}
+		o->frameSize = o->code[o->start].value;
+
+		before = VM_CountInstructions( o );
+
+		for ( pass = 0 ; pass < MAX_OPT_PASSES ; pass++ ) {
+			changed = 0;
+
+			VM_OptMarkTargets( o );
+			i = VM_OptFold( o );
+			folded += i;
+			changed += i;
+
+			VM_OptMarkTargets( o );
+			i = VM_OptThread( o );
+			threaded += i;
+			changed += i;
+
+			VM_OptMarkTargets( o );
+			VM_OptFindAddressTaken( o );
+			if ( !o->addressTaken ) {
+				i = loadsStores + deadStores;
+				VM_OptMemory( o, &loadsStores, &deadStores );
+				changed += loadsStores + deadStores - i;
+			}
+
+			if ( !changed ) {
+				break;
+			}
+		}
+
+		after = VM_CountInstructions( o );
+		vm->optInstructions += before;
+		vm->optRemoved += before - after;
+		if ( after != before ) {
+			functions[vm->numOptFunctions].start = o->start;
+			functions[vm->numOptFunctions].instructions = before;
+			functions[vm->numOptFunctions].removed = before - after;
+			vm->numOptFunctions++;
+		}
+	}
+
+	VM_OptEncode( o, header );
+
+	vm->optimized = qtrue;
+	vm->optFolded = folded;
+	vm->optThreaded = threaded;
+	vm->optLoadsStores = loadsStores;
+	vm->optDeadStores = deadStores;
+	vm->optFunctions = NULL;
+	if ( vm->numOptFunctions ) {
+		vm->optFunctions = (vmOptFunction_t *)Hunk_Alloc( vm->numOptFunctions * sizeof( *functions ), h_high );
+		Com_Memcpy( vm->optFunctions, functions, vm->numOptFunctions * sizeof( *functions ) );
+	}
+
+	Hunk_FreeTempMemory( functions );
+	Hunk_FreeTempMemory( o->code );
+	Hunk_FreeTempMemory( o );
+}
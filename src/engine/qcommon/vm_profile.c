@@ -0,0 +1,461 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_profile.c -- sampling profiler for qvm modules
+
+/*
+
+When vm_profile is set as a module loads, the module gets a profile
+that stays with it until it is freed.  The cost of an idle profile is
+a compare per instruction in the interpreters, and a counter decrement
+per branch, call and return in compiled code.
+
+Every vm_profileInterval bytecode instructions the backend stops at the
+next safe point and calls VM_ProfileSample with the current program
+counter and program stack.  The sample walks the qvm call stack the
+same way OP_LEAVE unwinds it: the function containing the program
+counter is found from the OP_ENTER offsets, its frame size is the
+OP_ENTER operand, and the return address is at the top of the
+caller's frame.  Each distinct stack is counted once per sample, and
+"vmprofile dump" writes them in the collapsed stack format that
+flamegraph tools read:
+
+qagame;vmMain;G_RunFrame;G_RunMissile 42
+
+Names come from the map file, which is loaded for profiled modules
+even without developer.  Functions with no symbol are named by their
+instruction number.
+
+System calls are timed separately, per trap number, with
+Sys_Microseconds.  That covers native modules as well, which can't be
+sampled.
+
+*/
+
+#include "vm_local.h"
+
+#define	MIN_PROFILE_INTERVAL	100
+
+static int VM_ProfileInterval( void ) {
+	if ( vm_profileInterval->integer < MIN_PROFILE_INTERVAL ) {
+		return MIN_PROFILE_INTERVAL;
+	}
+	return vm_profileInterval->integer;
+}
+
+/*
+=================
+VM_ProfileInit
+
+Needs the image prepared by VM_PrepareInterpreter
+=================
+*/
+void VM_ProfileInit( vm_t *vm ) {
+	vmProfile_t	*prof;
+	int			*code;
+	int			i, instructionCount;
+
+	prof = (vmProfile_t *)Hunk_Alloc( sizeof( *prof ), h_high );
+	vm->profile = prof;
+
+	if ( vm->dllHandle ) {
+		// only the system calls can be profiled
+		VM_ProfileReset( vm );
+		return;
+	}
+
+	prof->stacks = (vmProfileStack_t *)Hunk_Alloc( VM_PROFILE_MAX_STACKS * sizeof( *prof->stacks ), h_high );
+
+	code = (int *)vm->codeBase;
+	instructionCount = vm->instructionPointersLength >> 2;
+	for ( i = 0 ; i < instructionCount ; i++ ) {
+		if ( code[ vm->instructionPointers[i] ] == OP_ENTER && !VM_InstructionRemoved( vm, i ) ) {
+			prof->numFunctions++;
+		}
+	}
+
+	prof->functions = (int *)Hunk_Alloc( prof->numFunctions * sizeof( int ), h_high );
+	prof->numFunctions = 0;
+	for ( i = 0 ; i < instructionCount ; i++ ) {
+		if ( code[ vm->instructionPointers[i] ] == OP_ENTER && !VM_InstructionRemoved( vm, i ) ) {
+			prof->functions[ prof->numFunctions++ ] = vm->instructionPointers[i];
+		}
+	}
+
+	VM_ProfileReset( vm );
+}
+
+/*
+=================
+VM_ProfileReset
+=================
+*/
+void VM_ProfileReset( vm_t *vm ) {
+	vmProfile_t	*prof;
+
+	prof = vm->profile;
+	if ( !prof ) {
+		return;
+	}
+
+	if ( prof->stacks ) {
+		Com_Memset( prof->stacks, 0, VM_PROFILE_MAX_STACKS * sizeof( *prof->stacks ) );
+	}
+	Com_Memset( prof->syscalls, 0, sizeof( prof->syscalls ) );
+	prof->samples = 0;
+	prof->droppedSamples = 0;
+	prof->numStacks = 0;
+	prof->remaining = VM_ProfileInterval();
+	prof->startTime = Sys_Milliseconds();
+}
+
+/*
+=================
+VM_ProfileFunction
+
+Returns the number of the function containing the code offset, or -1
+=================
+*/
+static int VM_ProfileFunction( vmProfile_t *prof, int pc ) {
+	int		low, high, mid;
+
+	low = 0;
+	high = prof->numFunctions - 1;
+	if ( high < 0 || pc < prof->functions[0] ) {
+		return -1;
+	}
+
+	while ( low < high ) {
+		mid = ( low + high + 1 ) >> 1;
+		if ( prof->functions[mid] <= pc ) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	return low;
+}
+
+/*
+=================
+VM_ProfileRecord
+=================
+*/
+static void VM_ProfileRecord( vmProfile_t *prof, const int *frames, int depth ) {
+	vmProfileStack_t	*stack;
+	unsigned int		hash;
+	int					i;
+
+	hash = 2166136261u;
+	for ( i = 0 ; i < depth ; i++ ) {
+		hash = ( hash ^ frames[i] ) * 16777619u;
+	}
+
+	for ( i = 0 ; i < VM_PROFILE_MAX_STACKS ; i++ ) {
+		stack = &prof->stacks[ ( hash + i ) & ( VM_PROFILE_MAX_STACKS - 1 ) ];
+
+		if ( !stack->depth ) {
+			// keep some slots free so the probes stay short
+			if ( prof->numStacks >= VM_PROFILE_MAX_STACKS * 3 / 4 ) {
+				break;
+			}
+			prof->numStacks++;
+			stack->depth = depth;
+			Com_Memcpy( stack->frames, frames, depth * sizeof( frames[0] ) );
+			stack->count = 1;
+			return;
+		}
+
+		if ( stack->depth == depth && !memcmp( stack->frames, frames, depth * sizeof( frames[0] ) ) ) {
+			stack->count++;
+			return;
+		}
+	}
+
+	prof->droppedSamples++;
+}
+
+/*
+=================
+VM_ProfileSample
+
+Called by the backends at a point where the program counter and the
+program stack agree, which is anywhere but inside OP_CALL and OP_LEAVE.
+A program counter at an OP_ENTER hasn't allocated its frame yet.
+The threaded interpreter uses instruction numbers instead of code
+offsets, for both the program counter and the return addresses.
+
+Returns the number of instructions until the next sample.
+=================
+*/
+int VM_ProfileSample( vm_t *vm, int pc, int programStack, qboolean instructionNumbers ) {
+	vmProfile_t	*prof;
+	int			frames[VM_PROFILE_MAX_DEPTH];
+	int			*code;
+	int			instructionCount;
+	int			depth, f;
+
+	prof = vm->profile;
+	code = (int *)vm->codeBase;
+	instructionCount = vm->instructionPointersLength >> 2;
+
+	depth = 0;
+	while ( depth < VM_PROFILE_MAX_DEPTH ) {
+		if ( instructionNumbers ) {
+			if ( (unsigned)pc >= (unsigned)instructionCount ) {
+				break;
+			}
+			pc = vm->instructionPointers[pc];
+		} else if ( (unsigned)pc >= (unsigned)vm->codeLength ) {
+			break;
+		}
+
+		f = VM_ProfileFunction( prof, pc );
+		if ( f < 0 ) {
+			break;
+		}
+		frames[depth++] = f;
+
+		if ( pc != prof->functions[f] ) {
+			programStack += code[ prof->functions[f] + 1 ];
+		}
+		if ( programStack & 3 || (unsigned)programStack > (unsigned)vm->dataMask - 3 ) {
+			break;
+		}
+
+		// -1 marks the frame VM_Call built
+		pc = *(int *)&vm->dataBase[ programStack ];
+		if ( pc == -1 ) {
+			break;
+		}
+	}
+
+	prof->samples++;
+	if ( depth ) {
+		VM_ProfileRecord( prof, frames, depth );
+	} else {
+		prof->droppedSamples++;
+	}
+
+	prof->remaining = VM_ProfileInterval();
+	return prof->remaining;
+}
+
+/*
+=================
+VM_ProfileSystemCall
+
+Used by every backend instead of vm->systemCall while profiling
+=================
+*/
+intptr_t VM_ProfileSystemCall( vm_t *vm, intptr_t *args ) {
+	vmProfileSyscall_t	*s;
+	intptr_t			r;
+	int					start, usec;
+
+	if ( args[0] < 0 || args[0] >= VM_PROFILE_MAX_SYSCALLS ) {
+		return VM_DispatchSystemCall( vm, args );
+	}
+	s = &vm->profile->syscalls[ args[0] ];
+
+	start = Sys_Microseconds();
+	r = VM_DispatchSystemCall( vm, args );
+	usec = Sys_Microseconds() - start;
+
+	s->calls++;
+	s->usec += usec;
+	if ( usec > s->maxUsec ) {
+		s->maxUsec = usec;
+	}
+
+	return r;
+}
+
+//=================================================================
+
+/*
+=================
+VM_ProfileFunctionName
+=================
+*/
+static const char *VM_ProfileFunctionName( vm_t *vm, int f ) {
+	int		pc;
+	int		low, high, mid;
+
+	pc = vm->profile->functions[f];
+
+	if ( vm->symbols && VM_ValueToFunctionSymbol( vm, pc )->symValue <= pc ) {
+		return VM_ValueToSymbol( vm, pc );
+	}
+
+	// no symbol, name it by instruction number
+	low = 0;
+	high = ( vm->instructionPointersLength >> 2 ) - 1;
+	while ( low < high ) {
+		mid = ( low + high ) >> 1;
+		if ( vm->instructionPointers[mid] < pc ) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return va( "vm_%i", low );
+}
+
+typedef struct {
+	int		f;
+	int		self;
+	int		total;
+} vmProfileEntry_t;
+
+static int QDECL VM_ProfileEntrySort( const void *a, const void *b ) {
+	return ( (vmProfileEntry_t *)b )->self - ( (vmProfileEntry_t *)a )->self;
+}
+
+static int QDECL VM_ProfileSyscallSort( const void *a, const void *b ) {
+	double	ta, tb;
+
+	ta = ( *(vmProfileSyscall_t **)a )->usec;
+	tb = ( *(vmProfileSyscall_t **)b )->usec;
+	if ( ta > tb ) {
+		return -1;
+	}
+	if ( ta < tb ) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+=================
+VM_ProfileReport
+
+Flat profile of the sampled functions, then the system calls
+=================
+*/
+#define	MAX_REPORT_LINES	30
+
+void VM_ProfileReport( vm_t *vm ) {
+	vmProfile_t			*prof;
+	vmProfileStack_t	*stack;
+	vmProfileEntry_t	*entries;
+	vmProfileSyscall_t	*sorted[VM_PROFILE_MAX_SYSCALLS];
+	int					i, j, k, count;
+	double				totalUsec;
+
+	prof = vm->profile;
+	if ( !prof ) {
+		return;
+	}
+
+	Com_Printf( "%s: %i samples in %i msec, %i dropped\n", vm->name, prof->samples,
+		Sys_Milliseconds() - prof->startTime, prof->droppedSamples );
+
+	if ( prof->numFunctions && prof->samples ) {
+		entries = (vmProfileEntry_t *)Z_Malloc( prof->numFunctions * sizeof( *entries ) );
+		for ( i = 0 ; i < prof->numFunctions ; i++ ) {
+			entries[i].f = i;
+		}
+
+		for ( i = 0 ; i < VM_PROFILE_MAX_STACKS ; i++ ) {
+			stack = &prof->stacks[i];
+			if ( !stack->depth ) {
+				continue;
+			}
+			entries[ stack->frames[0] ].self += stack->count;
+			for ( j = 0 ; j < stack->depth ; j++ ) {
+				// recursion only counts once toward the total
+				for ( k = 0 ; k < j ; k++ ) {
+					if ( stack->frames[k] == stack->frames[j] ) {
+						break;
+					}
+				}
+				if ( k == j ) {
+					entries[ stack->frames[j] ].total += stack->count;
+				}
+			}
+		}
+
+		qsort( entries, prof->numFunctions, sizeof( *entries ), VM_ProfileEntrySort );
+
+		Com_Printf( "  self  total function\n" );
+		for ( i = 0 ; i < prof->numFunctions && i < MAX_REPORT_LINES ; i++ ) {
+			if ( !entries[i].self ) {
+				break;
+			}
+			Com_Printf( "%5.1f%% %5.1f%% %s\n", 100.0f * entries[i].self / prof->samples,
+				100.0f * entries[i].total / prof->samples, VM_ProfileFunctionName( vm, entries[i].f ) );
+		}
+
+		Z_Free( entries );
+	}
+
+	count = 0;
+	totalUsec = 0;
+	for ( i = 0 ; i < VM_PROFILE_MAX_SYSCALLS ; i++ ) {
+		if ( prof->syscalls[i].calls ) {
+			sorted[count++] = &prof->syscalls[i];
+			totalUsec += prof->syscalls[i].usec;
+		}
+	}
+	if ( !count ) {
+		return;
+	}
+
+	qsort( sorted, count, sizeof( sorted[0] ), VM_ProfileSyscallSort );
+
+	Com_Printf( "trap      calls       msec  usec/call   max usec\n" );
+	for ( i = 0 ; i < count && i < MAX_REPORT_LINES ; i++ ) {
+		Com_Printf( "%4i %10i %10.1f %10.2f %10i\n", (int)( sorted[i] - prof->syscalls ), sorted[i]->calls,
+			sorted[i]->usec / 1000, sorted[i]->usec / sorted[i]->calls, sorted[i]->maxUsec );
+	}
+	Com_Printf( "%.1f msec in %i different system calls\n", totalUsec / 1000, count );
+}
+
+/*
+=================
+VM_ProfileDump
+
+Writes the sampled stacks in collapsed stack format, root first,
+with the module name as the root of every stack
+=================
+*/
+void VM_ProfileDump( vm_t *vm, fileHandle_t f ) {
+	vmProfileStack_t	*stack;
+	int					i, j;
+
+	if ( !vm->profile || !vm->profile->stacks ) {
+		return;
+	}
+
+	for ( i = 0 ; i < VM_PROFILE_MAX_STACKS ; i++ ) {
+		stack = &vm->profile->stacks[i];
+		if ( !stack->depth ) {
+			continue;
+		}
+		FS_Printf( f, "%s", vm->name );
+		for ( j = stack->depth - 1 ; j >= 0 ; j-- ) {
+			FS_Printf( f, ";%s", VM_ProfileFunctionName( vm, stack->frames[j] ) );
+		}
+		FS_Printf( f, " %i\n", stack->count );
+	}
+}
@@ -0,0 +1,720 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_threaded.c -- threaded code interpreter, for hosts that can't run the compiler
+
+#include "vm_local.h"
+
+/*
+
+The image built by VM_PrepareInterpreter is decoded once more into
+one fixed size slot per instruction, so the program counter is an
+instruction number and every operand is already in place.  With gcc
+each slot holds the address of its handler and every handler jumps
+straight to the next one; other compilers fall back to a switch on
+the slot's opcode.
+
+Common pairs are fused into superinstructions.  A fused handler is
+stored in the slot of the first instruction only, the second slot
+keeps its own handler, so branches into the middle of a pair still
+land on valid code.
+
+The top of the op stack is kept in a local so the common push/pop
+sequences never touch memory.
+
+*/
+
+#if defined( __GNUC__ )
+#define	VM_THREADED_GOTO
+#endif
+
+typedef enum {
+	OP_LOCAL_LOAD4 = OP_CVFI + 1,
+	OP_CONST_LOAD4,
+	OP_CONST_STORE4,
+	OP_CONST_ADD,
+	OP_CONST_SUB,
+	OP_CONST_CALL,
+	OP_CONST_SYSCALL,
+	OP_CONST_JUMP,
+
+	OP_CONST_EQ,			// must stay in the same order as OP_EQ - OP_GEU
+	OP_CONST_NE,
+	OP_CONST_LTI,
+	OP_CONST_LEI,
+	OP_CONST_GTI,
+	OP_CONST_GEI,
+	OP_CONST_LTU,
+	OP_CONST_LEU,
+	OP_CONST_GTU,
+	OP_CONST_GEU,
+
+	OP_NUM_THREADED
+} superOpcode_t;
+
+struct vmThreadedOp_s {
+	intptr_t	handler;		// label address or opcode
+	int			value;
+	int			value2;			// branch target of fused compares
+};
+
+typedef union {
+	float	f;
+	int		i;
+} vmFloatInt_t;
+
+#ifdef VM_THREADED_GOTO
+static const void * const *vmThreadedHandlers;
+#endif
+
+static int VM_ExecuteThreaded( vm_t *vm, int programStack );
+
+/*
+=================
+VM_ThreadedTarget
+
+Converts a branch operand, already resolved to a code offset by
+VM_PrepareInterpreter, into an instruction number
+=================
+*/
+static int VM_ThreadedTarget( vm_t *vm, const int *pcToInstruction, int target ) {
+	if ( target < 0 || target >= vm->codeLength || pcToInstruction[target] == -1 ) {
+		Com_Error( ERR_DROP, "VM_PrepareThreaded: %s has bad branch target %i", vm->name, target );
+	}
+	return pcToInstruction[target];
+}
+
+/*
+=================
+VM_PrepareThreaded
+=================
+*/
+void VM_PrepareThreaded( vm_t *vm ) {
+	vmThreadedOp_t	*code;
+	int		*codeBase;
+	int		*pcToInstruction;
+	int		instructionCount;
+	int		fused;
+	int		i, pc, op, next;
+
+	codeBase = (int *)vm->codeBase;
+	instructionCount = vm->instructionPointersLength >> 2;
+
+#ifdef VM_THREADED_GOTO
+	VM_ExecuteThreaded( NULL, 0 );
+#endif
+
+	pcToInstruction = (int *)Hunk_AllocateTempMemory( vm->codeLength * sizeof( int ) );
+	Com_Memset( pcToInstruction, -1, vm->codeLength * sizeof( int ) );
+	for ( i = 0 ; i < instructionCount ; i++ ) {
+		pcToInstruction[ vm->instructionPointers[i] ] = i;
+	}
+
+	// one extra slot catches running off the end of the code
+	code = (vmThreadedOp_t *)Hunk_Alloc( ( instructionCount + 1 ) * sizeof( *code ), h_high );
+
+	for ( i = 0 ; i < instructionCount ; i++ ) {
+		pc = vm->instructionPointers[i];
+		op = codeBase[pc];
+
+		if ( VM_InstructionRemoved( vm, i ) ) {
+			op = OP_IGNORE;
+		}
+
+		code[i].handler = op;
+		switch ( op ) {
+		case OP_ENTER:
+		case OP_LEAVE:
+		case OP_CONST:
+		case OP_LOCAL:
+		case OP_BLOCK_COPY:
+		case OP_ARG:
+			code[i].value = codeBase[pc+1];
+			break;
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+			code[i].value = VM_ThreadedTarget( vm, pcToInstruction, codeBase[pc+1] );
+			break;
+		case OP_UNDEF:
+			// OP_UNDEF is reserved for running off the end of the code
+			code[i].handler = OP_IGNORE;
+			break;
+		default:
+			if ( op < 0 || op > OP_CVFI ) {
+				Com_Error( ERR_DROP, "VM_PrepareThreaded: %s has bad opcode %i at offset %i", vm->name, op, pc );
+			}
+			break;
+		}
+	}
+	code[instructionCount].handler = OP_UNDEF;
+
+	Hunk_FreeTempMemory( pcToInstruction );
+
+	// fuse pairs, the second instruction of a pair is left untouched
+	fused = 0;
+	for ( i = 0 ; i < instructionCount - 1 ; i++ ) {
+		op = code[i].handler;
+		next = code[i+1].handler;
+
+		if ( op == OP_LOCAL ) {
+			if ( next == OP_LOAD4 ) {
+				code[i].handler = OP_LOCAL_LOAD4;
+			}
+		} else if ( op == OP_CONST ) {
+			switch ( next ) {
+			case OP_LOAD4:
+				code[i].handler = OP_CONST_LOAD4;
+				break;
+			case OP_STORE4:
+				code[i].handler = OP_CONST_STORE4;
+				break;
+			case OP_ADD:
+				code[i].handler = OP_CONST_ADD;
+				break;
+			case OP_SUB:
+				code[i].handler = OP_CONST_SUB;
+				break;
+			case OP_CALL:
+				if ( code[i].value < 0 ) {
+					code[i].handler = OP_CONST_SYSCALL;
+				} else if ( code[i].value < instructionCount ) {
+					code[i].handler = OP_CONST_CALL;
+				}
+				break;
+			case OP_JUMP:
+				if ( code[i].value >= 0 && code[i].value < instructionCount ) {
+					code[i].handler = OP_CONST_JUMP;
+				}
+				break;
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+				code[i].handler = OP_CONST_EQ + ( next - OP_EQ );
+				code[i].value2 = code[i+1].value;
+				break;
+			default:
+				break;
+			}
+		}
+
+		if ( code[i].handler != op ) {
+			fused++;
+		}
+	}
+
+#ifdef VM_THREADED_GOTO
+	for ( i = 0 ; i <= instructionCount ; i++ ) {
+		code[i].handler = (intptr_t)vmThreadedHandlers[ code[i].handler ];
+	}
+#endif
+
+	vm->threadedCode = code;
+	vm->threadedFused = fused;
+	vm->threaded = qtrue;
+
+	Com_Printf( "VM file %s threaded, %i of %i instructions fused\n", vm->name, fused * 2, instructionCount );
+}
+
+/*
+=================
+VM_ThreadedSystemCall
+=================
+*/
+static int VM_ThreadedSystemCall( vm_t *vm, byte *image, int programStack, int call ) {
+	intptr_t	args[MAX_VMSYSCALL_ARGS];
+	int			*imagePtr;
+	int			i;
+
+	// save the stack to allow recursive VM entry
+	vm->programStack = programStack - 4;
+	*(int *)&image[ programStack + 4 ] = -1 - call;
+
+	imagePtr = (int *)&image[ programStack + 4 ];
+	for ( i = 0 ; i < MAX_VMSYSCALL_ARGS ; i++ ) {
+		args[i] = imagePtr[i];
+	}
+
+	if ( vm->profile ) {
+		return VM_ProfileSystemCall( vm, args );
+	}
+	return VM_DispatchSystemCall( vm, args );
+}
+
+/*
+=================
+VM_ExecuteThreaded
+
+Runs from instruction 0 until the matching OP_LEAVE.  A NULL vm
+only publishes the handler table for VM_PrepareThreaded.
+=================
+*/
+#define	MAX_STACK	256
+
+#ifdef VM_THREADED_GOTO
+#define	HANDLER(x)		L_##x:
+#define	DISPATCH()		goto *(void *)ip->handler
+#else
+#define	HANDLER(x)		case x:
+#define	DISPATCH()		goto dispatch
+#endif
+
+#define	NEXT(n)			ip += n; count += n; DISPATCH()
+#define	BRANCH(t,n)		ip = code + (t); count += n; if ( count >= sampleAt ) goto sample; DISPATCH()
+#define	PUSH(v)			*opStack++ = tos; tos = (v)
+#define	POP()			tos = *--opStack
+
+static int VM_ExecuteThreaded( vm_t *vm, int programStack ) {
+	int				stack[MAX_STACK];
+	int				*opStack;
+	int				tos;
+	const vmThreadedOp_t	*code;
+	const vmThreadedOp_t	*ip;
+	byte			*image;
+	int				dataMask;
+	int				stackBottom;
+	unsigned int	instructionCount;
+	unsigned int	count;
+	unsigned int	sampleAt;
+	int				v1;
+	vmFloatInt_t	f0, f1;
+
+#ifdef VM_THREADED_GOTO
+	static const void * const handlers[OP_NUM_THREADED] = {
+		&&L_OP_UNDEF, &&L_OP_IGNORE, &&L_OP_BREAK, &&L_OP_ENTER,
+		&&L_OP_LEAVE, &&L_OP_CALL, &&L_OP_PUSH, &&L_OP_POP,
+		&&L_OP_CONST, &&L_OP_LOCAL, &&L_OP_JUMP,
+		&&L_OP_EQ, &&L_OP_NE, &&L_OP_LTI, &&L_OP_LEI,
+		&&L_OP_GTI, &&L_OP_GEI, &&L_OP_LTU, &&L_OP_LEU,
+		&&L_OP_GTU, &&L_OP_GEU, &&L_OP_EQF, &&L_OP_NEF,
+		&&L_OP_LTF, &&L_OP_LEF, &&L_OP_GTF, &&L_OP_GEF,
+		&&L_OP_LOAD1, &&L_OP_LOAD2, &&L_OP_LOAD4, &&L_OP_STORE1,
+		&&L_OP_STORE2, &&L_OP_STORE4, &&L_OP_ARG, &&L_OP_BLOCK_COPY,
+		&&L_OP_SEX8, &&L_OP_SEX16, &&L_OP_NEGI, &&L_OP_ADD,
+		&&L_OP_SUB, &&L_OP_DIVI, &&L_OP_DIVU, &&L_OP_MODI,
+		&&L_OP_MODU, &&L_OP_MULI, &&L_OP_MULU, &&L_OP_BAND,
+		&&L_OP_BOR, &&L_OP_BXOR, &&L_OP_BCOM, &&L_OP_LSH,
+		&&L_OP_RSHI, &&L_OP_RSHU, &&L_OP_NEGF, &&L_OP_ADDF,
+		&&L_OP_SUBF, &&L_OP_DIVF, &&L_OP_MULF, &&L_OP_CVIF,
+		&&L_OP_CVFI,
+
+		&&L_OP_LOCAL_LOAD4, &&L_OP_CONST_LOAD4, &&L_OP_CONST_STORE4, &&L_OP_CONST_ADD,
+		&&L_OP_CONST_SUB, &&L_OP_CONST_CALL, &&L_OP_CONST_SYSCALL, &&L_OP_CONST_JUMP,
+		&&L_OP_CONST_EQ, &&L_OP_CONST_NE, &&L_OP_CONST_LTI, &&L_OP_CONST_LEI,
+		&&L_OP_CONST_GTI, &&L_OP_CONST_GEI, &&L_OP_CONST_LTU, &&L_OP_CONST_LEU,
+		&&L_OP_CONST_GTU, &&L_OP_CONST_GEU
+	};
+
+	if ( !vm ) {
+		vmThreadedHandlers = handlers;
+		return 0;
+	}
+#endif
+
+	image = vm->dataBase;
+	dataMask = vm->dataMask;
+	stackBottom = vm->stackBottom;
+	code = vm->threadedCode;
+	instructionCount = vm->instructionPointersLength >> 2;
+
+	// leave a free spot at start of stack so
+	// that as long as opStack is valid, opStack-1 will
+	// not corrupt anything
+	stack[0] = 0;
+	opStack = stack;
+	tos = 0;
+	count = 0;
+	ip = code;
+
+	// the sample interval carries over from the last call, the
+	// profiler only looks at taken branches, calls and returns
+	sampleAt = vm->profile ? vm->profile->remaining : 0xffffffff;
+
+	DISPATCH();
+
+sample:
+	sampleAt = count + VM_ProfileSample( vm, ip - code, programStack, qtrue );
+	DISPATCH();
+
+#ifndef VM_THREADED_GOTO
+dispatch:
+	switch ( ip->handler ) {
+	default:
+#endif
+
+	HANDLER( OP_UNDEF )
+		Com_Error( ERR_DROP, "%s: ran off the end of the code", vm->name );
+
+	HANDLER( OP_IGNORE )
+		NEXT( 1 );
+	HANDLER( OP_BREAK )
+		vm->breakCount++;
+		NEXT( 1 );
+
+	HANDLER( OP_ENTER )
+		programStack -= ip->value;
+		if ( programStack <= stackBottom ) {
+			Com_Error( ERR_DROP, "%s: program stack overflow", vm->name );
+		}
+		NEXT( 1 );
+
+	HANDLER( OP_LEAVE )
+		programStack += ip->value;
+		v1 = *(int *)&image[ programStack ];
+		count++;
+		if ( (unsigned)v1 >= instructionCount ) {
+			// check for leaving the VM
+			if ( v1 == -1 ) {
+				goto done;
+			}
+			Com_Error( ERR_DROP, "%s: return to bad instruction %i", vm->name, v1 );
+		}
+		ip = code + v1;
+		if ( count >= sampleAt ) {
+			goto sample;
+		}
+		DISPATCH();
+
+	HANDLER( OP_CALL )
+		v1 = tos;
+		POP();
+		*(int *)&image[ programStack ] = ( ip - code ) + 1;
+		if ( v1 < 0 ) {
+			PUSH( VM_ThreadedSystemCall( vm, image, programStack, v1 ) );
+			NEXT( 1 );
+		}
+		if ( (unsigned)v1 >= instructionCount ) {
+			Com_Error( ERR_DROP, "%s: call to bad instruction %i", vm->name, v1 );
+		}
+		BRANCH( v1, 1 );
+
+	HANDLER( OP_CONST_CALL )
+		*(int *)&image[ programStack ] = ( ip - code ) + 2;
+		BRANCH( ip->value, 2 );
+
+	HANDLER( OP_CONST_SYSCALL )
+		*(int *)&image[ programStack ] = ( ip - code ) + 2;
+		PUSH( VM_ThreadedSystemCall( vm, image, programStack, ip->value ) );
+		NEXT( 2 );
+
+	// push and pop are only needed for discarded or bad function return values
+	HANDLER( OP_PUSH )
+		PUSH( 0 );
+		NEXT( 1 );
+	HANDLER( OP_POP )
+		POP();
+		NEXT( 1 );
+
+	HANDLER( OP_CONST )
+		PUSH( ip->value );
+		NEXT( 1 );
+	HANDLER( OP_LOCAL )
+		PUSH( ip->value + programStack );
+		NEXT( 1 );
+
+	HANDLER( OP_LOCAL_LOAD4 )
+		PUSH( *(int *)&image[ ( ip->value + programStack ) & dataMask ] );
+		NEXT( 2 );
+	HANDLER( OP_CONST_LOAD4 )
+		PUSH( *(int *)&image[ ip->value & dataMask ] );
+		NEXT( 2 );
+	HANDLER( OP_CONST_STORE4 )
+		*(int *)&image[ tos & ( dataMask & ~3 ) ] = ip->value;
+		POP();
+		NEXT( 2 );
+	HANDLER( OP_CONST_ADD )
+		tos += ip->value;
+		NEXT( 2 );
+	HANDLER( OP_CONST_SUB )
+		tos -= ip->value;
+		NEXT( 2 );
+
+	HANDLER( OP_JUMP )
+		v1 = tos;
+		POP();
+		if ( (unsigned)v1 >= instructionCount ) {
+			Com_Error( ERR_DROP, "%s: jump to bad instruction %i", vm->name, v1 );
+		}
+		BRANCH( v1, 1 );
+	HANDLER( OP_CONST_JUMP )
+		BRANCH( ip->value, 2 );
+
+	/*
+	===================================================================
+	BRANCHES
+	===================================================================
+	*/
+
+#define	INT_BRANCH(cond)	v1 = opStack[-1]; opStack -= 2; \
+							if ( cond ) { tos = *opStack; BRANCH( ip->value, 1 ); } \
+							tos = *opStack; NEXT( 1 )
+#define	CONST_BRANCH(cond)	v1 = tos; POP(); \
+							if ( cond ) { BRANCH( ip->value2, 2 ); } \
+							NEXT( 2 )
+#define	FLOAT_BRANCH(cond)	f0.i = opStack[-1]; f1.i = tos; opStack -= 2; tos = *opStack; \
+							if ( cond ) { BRANCH( ip->value, 1 ); } \
+							NEXT( 1 )
+
+	HANDLER( OP_EQ )	INT_BRANCH( v1 == tos );
+	HANDLER( OP_NE )	INT_BRANCH( v1 != tos );
+	HANDLER( OP_LTI )	INT_BRANCH( v1 < tos );
+	HANDLER( OP_LEI )	INT_BRANCH( v1 <= tos );
+	HANDLER( OP_GTI )	INT_BRANCH( v1 > tos );
+	HANDLER( OP_GEI )	INT_BRANCH( v1 >= tos );
+	HANDLER( OP_LTU )	INT_BRANCH( (unsigned)v1 < (unsigned)tos );
+	HANDLER( OP_LEU )	INT_BRANCH( (unsigned)v1 <= (unsigned)tos );
+	HANDLER( OP_GTU )	INT_BRANCH( (unsigned)v1 > (unsigned)tos );
+	HANDLER( OP_GEU )	INT_BRANCH( (unsigned)v1 >= (unsigned)tos );
+
+	HANDLER( OP_CONST_EQ )	CONST_BRANCH( v1 == ip->value );
+	HANDLER( OP_CONST_NE )	CONST_BRANCH( v1 != ip->value );
+	HANDLER( OP_CONST_LTI )	CONST_BRANCH( v1 < ip->value );
+	HANDLER( OP_CONST_LEI )	CONST_BRANCH( v1 <= ip->value );
+	HANDLER( OP_CONST_GTI )	CONST_BRANCH( v1 > ip->value );
+	HANDLER( OP_CONST_GEI )	CONST_BRANCH( v1 >= ip->value );
+	HANDLER( OP_CONST_LTU )	CONST_BRANCH( (unsigned)v1 < (unsigned)ip->value );
+	HANDLER( OP_CONST_LEU )	CONST_BRANCH( (unsigned)v1 <= (unsigned)ip->value );
+	HANDLER( OP_CONST_GTU )	CONST_BRANCH( (unsigned)v1 > (unsigned)ip->value );
+	HANDLER( OP_CONST_GEU )	CONST_BRANCH( (unsigned)v1 >= (unsigned)ip->value );
+
+	HANDLER( OP_EQF )	FLOAT_BRANCH( f0.f == f1.f );
+	HANDLER( OP_NEF )	FLOAT_BRANCH( f0.f != f1.f );
+	HANDLER( OP_LTF )	FLOAT_BRANCH( f0.f < f1.f );
+	HANDLER( OP_LEF )	FLOAT_BRANCH( f0.f <= f1.f );
+	HANDLER( OP_GTF )	FLOAT_BRANCH( f0.f > f1.f );
+	HANDLER( OP_GEF )	FLOAT_BRANCH( f0.f >= f1.f );
+
+	//===================================================================
+
+	HANDLER( OP_LOAD4 )
+		tos = *(int *)&image[ tos & dataMask ];
+		NEXT( 1 );
+	HANDLER( OP_LOAD2 )
+		tos = *(unsigned short *)&image[ tos & dataMask ];
+		NEXT( 1 );
+	HANDLER( OP_LOAD1 )
+		tos = image[ tos & dataMask ];
+		NEXT( 1 );
+
+	HANDLER( OP_STORE4 )
+		*(int *)&image[ opStack[-1] & ( dataMask & ~3 ) ] = tos;
+		opStack -= 2;
+		tos = *opStack;
+		NEXT( 1 );
+	HANDLER( OP_STORE2 )
+		*(short *)&image[ opStack[-1] & ( dataMask & ~1 ) ] = tos;
+		opStack -= 2;
+		tos = *opStack;
+		NEXT( 1 );
+	HANDLER( OP_STORE1 )
+		image[ opStack[-1] & dataMask ] = tos;
+		opStack -= 2;
+		tos = *opStack;
+		NEXT( 1 );
+
+	HANDLER( OP_ARG )
+		// single byte offset from programStack
+		*(int *)&image[ ip->value + programStack ] = tos;
+		POP();
+		NEXT( 1 );
+
+	HANDLER( OP_BLOCK_COPY )
+		VM_BlockCopy( vm, opStack[-1], tos, ip->value );
+		opStack -= 2;
+		tos = *opStack;
+		NEXT( 1 );
+
+	HANDLER( OP_SEX8 )
+		tos = (signed char)tos;
+		NEXT( 1 );
+	HANDLER( OP_SEX16 )
+		tos = (short)tos;
+		NEXT( 1 );
+
+	HANDLER( OP_NEGI )
+		tos = -tos;
+		NEXT( 1 );
+	HANDLER( OP_ADD )
+		tos = *--opStack + tos;
+		NEXT( 1 );
+	HANDLER( OP_SUB )
+		tos = *--opStack - tos;
+		NEXT( 1 );
+	HANDLER( OP_DIVI )
+		tos = *--opStack / tos;
+		NEXT( 1 );
+	HANDLER( OP_DIVU )
+		tos = (unsigned)*--opStack / (unsigned)tos;
+		NEXT( 1 );
+	HANDLER( OP_MODI )
+		tos = *--opStack % tos;
+		NEXT( 1 );
+	HANDLER( OP_MODU )
+		tos = (unsigned)*--opStack % (unsigned)tos;
+		NEXT( 1 );
+	HANDLER( OP_MULI )
+		tos = *--opStack * tos;
+		NEXT( 1 );
+	HANDLER( OP_MULU )
+		tos = (unsigned)*--opStack * (unsigned)tos;
+		NEXT( 1 );
+
+	HANDLER( OP_BAND )
+		tos = (unsigned)*--opStack & (unsigned)tos;
+		NEXT( 1 );
+	HANDLER( OP_BOR )
+		tos = (unsigned)*--opStack | (unsigned)tos;
+		NEXT( 1 );
+	HANDLER( OP_BXOR )
+		tos = (unsigned)*--opStack ^ (unsigned)tos;
+		NEXT( 1 );
+	HANDLER( OP_BCOM )
+		tos = ~(unsigned)tos;
+		NEXT( 1 );
+
+	HANDLER( OP_LSH )
+		tos = *--opStack << tos;
+		NEXT( 1 );
+	HANDLER( OP_RSHI )
+		tos = *--opStack >> tos;
+		NEXT( 1 );
+	HANDLER( OP_RSHU )
+		tos = (unsigned)*--opStack >> tos;
+		NEXT( 1 );
+
+	HANDLER( OP_NEGF )
+		f0.i = tos;
+		f0.f = -f0.f;
+		tos = f0.i;
+		NEXT( 1 );
+	HANDLER( OP_ADDF )
+		f0.i = *--opStack;
+		f1.i = tos;
+		f0.f = f0.f + f1.f;
+		tos = f0.i;
+		NEXT( 1 );
+	HANDLER( OP_SUBF )
+		f0.i = *--opStack;
+		f1.i = tos;
+		f0.f = f0.f - f1.f;
+		tos = f0.i;
+		NEXT( 1 );
+	HANDLER( OP_DIVF )
+		f0.i = *--opStack;
+		f1.i = tos;
+		f0.f = f0.f / f1.f;
+		tos = f0.i;
+		NEXT( 1 );
+	HANDLER( OP_MULF )
+		f0.i = *--opStack;
+		f1.i = tos;
+		f0.f = f0.f * f1.f;
+		tos = f0.i;
+		NEXT( 1 );
+
+	HANDLER( OP_CVIF )
+		f0.f = (float)tos;
+		tos = f0.i;
+		NEXT( 1 );
+	HANDLER( OP_CVFI )
+		f0.i = tos;
+		tos = (int)f0.f;
+		NEXT( 1 );
+
+#ifndef VM_THREADED_GOTO
+	}
+#endif
+
+done:
+	vm->executedInstructions += count;
+	if ( vm->profile ) {
+		vm->profile->remaining = count < sampleAt ? sampleAt - count : 1;
+	}
+
+	if ( opStack != &stack[1] ) {
+		Com_Error( ERR_DROP, "Threaded interpreter error: opStack = %i", (int)( opStack - stack ) );
+	}
+
+	return tos;
+}
+
+/*
+==============
+VM_CallThreaded
+
+Same stack frame setup as VM_CallInterpreted
+==============
+*/
+int VM_CallThreaded( vm_t *vm, int *args ) {
+	int		programStack;
+	int		stackOnEntry;
+	byte	*image;
+	int		r;
+
+	vm->currentlyInterpreting = qtrue;
+
+	// we might be called recursively, so this might not be the very top
+	programStack = stackOnEntry = vm->programStack;
+
+	image = vm->dataBase;
+
+	programStack -= 48;
+
+	*(int *)&image[ programStack + 44] = args[9];
+	*(int *)&image[ programStack + 40] = args[8];
+	*(int *)&image[ programStack + 36] = args[7];
+	*(int *)&image[ programStack + 32] = args[6];
+	*(int *)&image[ programStack + 28] = args[5];
+	*(int *)&image[ programStack + 24] = args[4];
+	*(int *)&image[ programStack + 20] = args[3];
+	*(int *)&image[ programStack + 16] = args[2];
+	*(int *)&image[ programStack + 12] = args[1];
+	*(int *)&image[ programStack + 8 ] = args[0];
+	*(int *)&image[ programStack + 4 ] = 0;	// return stack
+	*(int *)&image[ programStack ] = -1;	// will terminate the loop on return
+
+	r = VM_ExecuteThreaded( vm, programStack );
+
+	vm->currentlyInterpreting = qfalse;
+	vm->programStack = stackOnEntry;
+
+	return r;
+}
@@ -0,0 +1,1079 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_x86_64.c -- load time compiler and execution environment for x86-64
+
+#include "vm_local.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/*
+
+The compiler works from the int-per-byte code image built by
+VM_PrepareInterpreter, so branch operands are already resolved to
+code offsets and the interpreter and the compiler always agree on
+what a program means.
+
+Register usage inside generated code (all callee saved on both
+the win64 and the system V abi, so helpers called from generated
+code never disturb them):
+
+rbx		vm->dataBase
+r12		opStack pointer, grows up by 4 bytes like the interpreter's
+r13		native address of every instruction, for OP_CALL and OP_JUMP
+r15d	programStack
+
+rax, rcx, rdx and xmm0/xmm1 are scratch.
+
+Every function's OP_ENTER reserves 40 bytes of native stack so that
+rsp stays 16 byte aligned with 32 bytes of home space whenever a
+C helper is called.  Unwind info for that frame shape is registered
+on win64 so Com_Error can longjmp through generated code.
+
+*/
+
+#define	VM_JIT_FRAME		40		// home space + alignment
+#define	VM_JIT_MAX_STACK	256		// must match the interpreter opStack
+
+typedef enum {
+	JITERR_BAD_CALL,
+	JITERR_BAD_JUMP,
+	JITERR_STACK_OVERFLOW
+} vmJitError_t;
+
+typedef int *(*vmJitEntry_t)( byte *dataBase, int *opStack, int programStack, intptr_t *instructions );
+
+typedef struct {
+	byte	*buf;			// NULL while sizing the image
+	int		pos;
+} vmAssembler_t;
+
+/*
+=================================================================
+
+EMITTERS
+
+=================================================================
+*/
+
+static int Hex( int c ) {
+	if ( c >= 'a' && c <= 'f' ) {
+		return 10 + c - 'a';
+	}
+	if ( c >= 'A' && c <= 'F' ) {
+		return 10 + c - 'A';
+	}
+	if ( c >= '0' && c <= '9' ) {
+		return c - '0';
+	}
+
+	Com_Error( ERR_FATAL, "Hex: bad char '%c'", c );
+	return 0;
+}
+
+static void Emit1( vmAssembler_t *as, int v ) {
+	if ( as->buf ) {
+		as->buf[ as->pos ] = v;
+	}
+	as->pos++;
+}
+
+static void Emit4( vmAssembler_t *as, int v ) {
+	Emit1( as, v & 255 );
+	Emit1( as, ( v >> 8 ) & 255 );
+	Emit1( as, ( v >> 16 ) & 255 );
+	Emit1( as, ( v >> 24 ) & 255 );
+}
+
+static void Emit8( vmAssembler_t *as, intptr_t v ) {
+	Emit4( as, (int)( v & 0xffffffff ) );
+	Emit4( as, (int)( (unsigned long long)v >> 32 ) );
+}
+
+static void EmitString( vmAssembler_t *as, const char *string ) {
+	int		c1, c2;
+
+	while ( 1 ) {
+		c1 = string[0];
+		c2 = string[1];
+
+		Emit1( as, ( Hex( c1 ) << 4 ) | Hex( c2 ) );
+
+		if ( !string[2] ) {
+			break;
+		}
+		string += 3;
+	}
+}
+
+/*
+=================
+EmitJump
+
+Emits the given opcode bytes followed by a rel32 that is filled in
+later by PatchJump, returns the offset of the rel32.
+=================
+*/
+static int EmitJump( vmAssembler_t *as, const char *opcode ) {
+	int		at;
+
+	EmitString( as, opcode );
+	at = as->pos;
+	Emit4( as, 0 );
+	return at;
+}
+
+static void PatchJump( vmAssembler_t *as, int at, int target ) {
+	int		rel;
+
+	if ( !as->buf ) {
+		return;
+	}
+	rel = target - ( at + 4 );
+	as->buf[at+0] = rel & 255;
+	as->buf[at+1] = ( rel >> 8 ) & 255;
+	as->buf[at+2] = ( rel >> 16 ) & 255;
+	as->buf[at+3] = ( rel >> 24 ) & 255;
+}
+
+/*
+=================
+Argument loaders for calls out to C helpers
+=================
+*/
+#ifdef _WIN32
+#define	ARG0_IMM64		"48 B9"				// mov rcx, imm64
+#define	ARG1_R15D		"44 89 FA"			// mov edx, r15d
+#define	ARG1_OPSTACK1	"41 8B 54 24 FC"	// mov edx, [r12-4]
+#define	ARG1_IMM32		"BA"				// mov edx, imm32
+#define	ARG2_EAX		"41 89 C0"			// mov r8d, eax
+#define	ARG2_IMM32		"41 B8"				// mov r8d, imm32
+#define	ARG2_OPSTACK0	"45 8B 04 24"		// mov r8d, [r12]
+#define	ARG3_IMM32		"41 B9"				// mov r9d, imm32
+#define	ENTRY_LOAD_REGS	"48 89 CB 49 89 D4 45 89 C7 4D 89 CD"	// rbx = rcx, r12 = rdx, r15d = r8d, r13 = r9
+#else
+#define	ARG0_IMM64		"48 BF"				// mov rdi, imm64
+#define	ARG1_R15D		"44 89 FE"			// mov esi, r15d
+#define	ARG1_OPSTACK1	"41 8B 74 24 FC"	// mov esi, [r12-4]
+#define	ARG1_IMM32		"BE"				// mov esi, imm32
+#define	ARG2_EAX		"89 C2"				// mov edx, eax
+#define	ARG2_IMM32		"BA"				// mov edx, imm32
+#define	ARG2_OPSTACK0	"41 8B 14 24"		// mov edx, [r12]
+#define	ARG3_IMM32		"B9"				// mov ecx, imm32
+#define	ENTRY_LOAD_REGS	"48 89 FB 49 89 F4 41 89 D7 49 89 CD"	// rbx = rdi, r12 = rsi, r15d = edx, r13 = rcx
+#endif
+
+static void EmitCallHelper( vmAssembler_t *as, void *func ) {
+	EmitString( as, "48 B8" );		// mov rax, func
+	Emit8( as, (intptr_t)func );
+	EmitString( as, "FF D0" );		// call rax
+}
+
+/*
+=================================================================
+
+HELPERS CALLED FROM GENERATED CODE
+
+=================================================================
+*/
+
+/*
+=================
+VM_JitSystemCall
+
+Same stack frame handling as the OP_CALL case of VM_CallInterpreted
+=================
+*/
+static int VM_JitSystemCall( vm_t *vm, int programStack, int syscallNum ) {
+	intptr_t	argarr[MAX_VMSYSCALL_ARGS];
+	int			*imagePtr;
+	int			i;
+
+	// save the stack to allow recursive VM entry
+	vm->programStack = programStack - 4;
+	*(int *)&vm->dataBase[ programStack + 4 ] = syscallNum;
+
+	imagePtr = (int *)&vm->dataBase[ programStack + 4 ];
+	for ( i = 0; i < ARRAY_LEN( argarr ); i++ ) {
+		argarr[i] = imagePtr[i];
+	}
+
+	if ( vm->profile ) {
+		return (int)VM_ProfileSystemCall( vm, argarr );
+	}
+	return (int)VM_DispatchSystemCall( vm, argarr );
+}
+
+static void VM_JitBlockCopy( vm_t *vm, int dest, int src, int n ) {
+	VM_BlockCopy( vm, dest, src, n );
+}
+
+static void VM_JitProfileSample( vm_t *vm, int programStack, int pc ) {
+	VM_ProfileSample( vm, pc, programStack, qfalse );
+}
+
+static void VM_JitError( vm_t *vm, int error, int value ) {
+	switch ( error ) {
+	case JITERR_BAD_CALL:
+		Com_Error( ERR_DROP, "%s: call to bad instruction %i", vm->name, value );
+		break;
+	case JITERR_BAD_JUMP:
+		Com_Error( ERR_DROP, "%s: jump to bad instruction %i", vm->name, value );
+		break;
+	case JITERR_STACK_OVERFLOW:
+		Com_Error( ERR_DROP, "%s: program stack overflow", vm->name );
+		break;
+	default:
+		Com_Error( ERR_DROP, "%s: unknown compiled code error %i", vm->name, error );
+		break;
+	}
+}
+
+/*
+=================================================================
+
+WIN64 UNWIND INFO
+
+=================================================================
+*/
+
+#ifdef _WIN32
+#define	UWOP_PUSH_NONVOL	0
+#define	UWOP_ALLOC_SMALL	2
+
+// UNWIND_INFO for the entry stub: push rbx, rbp, r12-r15, sub rsp 8
+static const byte vmJitEntryUnwind[] = {
+	1, 14, 7, 0,
+	14, UWOP_ALLOC_SMALL | ( 0 << 4 ),
+	10, UWOP_PUSH_NONVOL | ( 15 << 4 ),
+	8, UWOP_PUSH_NONVOL | ( 14 << 4 ),
+	6, UWOP_PUSH_NONVOL | ( 13 << 4 ),
+	4, UWOP_PUSH_NONVOL | ( 12 << 4 ),
+	2, UWOP_PUSH_NONVOL | ( 5 << 4 ),
+	1, UWOP_PUSH_NONVOL | ( 3 << 4 ),
+	0, 0
+};
+
+// UNWIND_INFO for every compiled function: sub rsp, VM_JIT_FRAME
+static const byte vmJitFunctionUnwind[] = {
+	1, 4, 1, 0,
+	4, UWOP_ALLOC_SMALL | ( ( ( VM_JIT_FRAME - 8 ) / 8 ) << 4 ),
+	0, 0
+};
+#endif
+
+/*
+=================================================================
+
+COMPILER
+
+=================================================================
+*/
+
+typedef struct {
+	vmAssembler_t	as;
+
+	vm_t		*vm;
+	int			*code;				// prepared interpreter image
+	int			instructionCount;
+
+	int			*pcToNative;		// native offset of every interpreter pc
+
+	int			entryEnd;
+	int			errBadCall;
+	int			errBadJump;
+	int			errStackOverflow;
+	int			stubsStart;
+	int			codeEnd;
+
+	int			*functionStarts;	// NULL while sizing
+	int			numFunctions;
+
+	int			profileCount;		// instructions since the last profile check
+
+	char		error[MAX_STRING_CHARS];	// first error, raised after the pass
+} vmCompiler_t;
+
+/*
+=================
+VM_EmitEntry
+
+int *entry( byte *dataBase, int *opStack, int programStack, intptr_t *instructions )
+=================
+*/
+static void VM_EmitEntry( vmCompiler_t *c ) {
+	vmAssembler_t	*as = &c->as;
+
+	// the prologue must stay in sync with vmJitEntryUnwind
+	EmitString( as, "53" );				// push rbx
+	EmitString( as, "55" );				// push rbp
+	EmitString( as, "41 54" );			// push r12
+	EmitString( as, "41 55" );			// push r13
+	EmitString( as, "41 56" );			// push r14
+	EmitString( as, "41 57" );			// push r15
+	EmitString( as, "48 83 EC 08" );	// sub rsp, 8
+
+	EmitString( as, ENTRY_LOAD_REGS );
+	EmitString( as, "41 FF 55 00" );	// call [r13] (instruction 0)
+	EmitString( as, "4C 89 E0" );		// mov rax, r12
+
+	EmitString( as, "48 83 C4 08" );	// add rsp, 8
+	EmitString( as, "41 5F" );			// pop r15
+	EmitString( as, "41 5E" );			// pop r14
+	EmitString( as, "41 5D" );			// pop r13
+	EmitString( as, "41 5C" );			// pop r12
+	EmitString( as, "5D" );				// pop rbp
+	EmitString( as, "5B" );				// pop rbx
+	EmitString( as, "C3" );				// ret
+}
+
+/*
+=================
+VM_EmitErrorStubs
+
+Out of line error paths, only ever reached from inside a function
+body so the stack is already aligned for the helper call
+=================
+*/
+static void VM_EmitErrorStub( vmCompiler_t *c, int error ) {
+	vmAssembler_t	*as = &c->as;
+
+	EmitString( as, ARG2_EAX );
+	EmitString( as, ARG1_IMM32 );
+	Emit4( as, error );
+	EmitString( as, ARG0_IMM64 );
+	Emit8( as, (intptr_t)c->vm );
+	EmitCallHelper( as, (void *)VM_JitError );
+	EmitString( as, "CC" );				// int 3, VM_JitError never returns
+}
+
+static void VM_EmitErrorStubs( vmCompiler_t *c ) {
+	vmAssembler_t	*as = &c->as;
+
+	c->stubsStart = as->pos;
+
+	// never executed, stands in for the prologue described by
+	// vmJitFunctionUnwind so the stubs unwind like a function body
+	EmitString( as, "CC CC CC CC" );
+
+	c->errBadCall = as->pos;
+	VM_EmitErrorStub( c, JITERR_BAD_CALL );
+
+	c->errBadJump = as->pos;
+	VM_EmitErrorStub( c, JITERR_BAD_JUMP );
+
+	c->errStackOverflow = as->pos;
+	EmitString( as, "44 89 F8" );		// mov eax, r15d
+	VM_EmitErrorStub( c, JITERR_STACK_OVERFLOW );
+}
+
+/*
+=================
+VM_EmitProfileCheck
+
+Only emitted for profiled modules, in front of every branch, call and
+return.  Takes the instructions since the last check off the count
+VM_ProfileSample left, and samples when it runs out.  The distance is
+measured in straight line code, so it overestimates where code is
+branched into, but never across a function boundary.
+=================
+*/
+static void VM_EmitProfileCheck( vmCompiler_t *c, int pc ) {
+	vmAssembler_t	*as = &c->as;
+	int				skip;
+
+	EmitString( as, "48 B8" );				// mov rax, &vm->profile->remaining
+	Emit8( as, (intptr_t)&c->vm->profile->remaining );
+	EmitString( as, "81 28" );				// sub dword [rax], profileCount
+	Emit4( as, c->profileCount );
+	skip = EmitJump( as, "0F 8F" );			// jg skip
+
+	EmitString( as, ARG2_IMM32 );
+	Emit4( as, pc );
+	EmitString( as, ARG1_R15D );
+	EmitString( as, ARG0_IMM64 );
+	Emit8( as, (intptr_t)c->vm );
+	EmitCallHelper( as, (void *)VM_JitProfileSample );
+	PatchJump( as, skip, as->pos );
+
+	c->profileCount = 0;
+}
+
+/*
+=================
+VM_CompileError
+
+Errors are kept until the pass is done, so VM_Compile can give back
+the buffers before raising them
+=================
+*/
+static void VM_CompileError( vmCompiler_t *c, const char *error ) {
+	if ( !c->error[0] ) {
+		Q_strncpyz( c->error, error, sizeof( c->error ) );
+	}
+}
+
+/*
+=================
+VM_EmitBranch
+
+Pops two values and jumps to the interpreter pc target if the
+condition code holds.
+=================
+*/
+static int VM_BranchTarget( vmCompiler_t *c, int target ) {
+	if ( target < 0 || target >= c->vm->codeLength ) {
+		VM_CompileError( c, va( "VM_Compile: %s has branch out of range", c->vm->name ) );
+		return 0;
+	}
+	if ( c->as.buf && c->pcToNative[target] == -1 ) {
+		VM_CompileError( c, va( "VM_Compile: %s has branch into the middle of an instruction", c->vm->name ) );
+		return 0;
+	}
+	return c->pcToNative[target];
+}
+
+static void VM_EmitIntBranch( vmCompiler_t *c, const char *jcc, int target ) {
+	vmAssembler_t	*as = &c->as;
+
+	EmitString( as, "41 8B 44 24 FC" );	// mov eax, [r12-4]
+	EmitString( as, "41 8B 0C 24" );	// mov ecx, [r12]
+	EmitString( as, "49 83 EC 08" );	// sub r12, 8
+	EmitString( as, "39 C8" );			// cmp eax, ecx
+	PatchJump( as, EmitJump( as, jcc ), VM_BranchTarget( c, target ) );
+}
+
+static void VM_EmitFloatBranch( vmCompiler_t *c, int op, int target ) {
+	vmAssembler_t	*as = &c->as;
+	int				skip, dest;
+
+	dest = VM_BranchTarget( c, target );
+
+	EmitString( as, "F3 41 0F 10 44 24 FC" );	// movss xmm0, [r12-4]
+	EmitString( as, "F3 41 0F 10 0C 24" );		// movss xmm1, [r12]
+	EmitString( as, "49 83 EC 08" );			// sub r12, 8
+
+	// unordered compares must fall through except for OP_NEF,
+	// same as the C comparisons in the interpreter
+	switch ( op ) {
+	case OP_EQF:
+		EmitString( as, "0F 2E C1" );			// ucomiss xmm0, xmm1
+		skip = EmitJump( as, "0F 8A" );			// jp skip
+		PatchJump( as, EmitJump( as, "0F 84" ), dest );	// je
+		PatchJump( as, skip, as->pos );
+		break;
+	case OP_NEF:
+		EmitString( as, "0F 2E C1" );			// ucomiss xmm0, xmm1
+		PatchJump( as, EmitJump( as, "0F 8A" ), dest );	// jp
+		PatchJump( as, EmitJump( as, "0F 85" ), dest );	// jne
+		break;
+	case OP_LTF:
+		EmitString( as, "0F 2E C8" );			// ucomiss xmm1, xmm0
+		PatchJump( as, EmitJump( as, "0F 87" ), dest );	// ja
+		break;
+	case OP_LEF:
+		EmitString( as, "0F 2E C8" );			// ucomiss xmm1, xmm0
+		PatchJump( as, EmitJump( as, "0F 83" ), dest );	// jae
+		break;
+	case OP_GTF:
+		EmitString( as, "0F 2E C1" );			// ucomiss xmm0, xmm1
+		PatchJump( as, EmitJump( as, "0F 87" ), dest );	// ja
+		break;
+	case OP_GEF:
+		EmitString( as, "0F 2E C1" );			// ucomiss xmm0, xmm1
+		PatchJump( as, EmitJump( as, "0F 83" ), dest );	// jae
+		break;
+	}
+}
+
+static void VM_EmitFloatOp( vmCompiler_t *c, const char *op ) {
+	vmAssembler_t	*as = &c->as;
+
+	EmitString( as, "F3 41 0F 10 44 24 FC" );	// movss xmm0, [r12-4]
+	EmitString( as, op );						// op xmm0, [r12]
+	EmitString( as, "49 83 EC 04" );			// sub r12, 4
+	EmitString( as, "F3 41 0F 11 04 24" );		// movss [r12], xmm0
+}
+
+static void VM_EmitDivide( vmCompiler_t *c, qboolean isSigned, qboolean remainder ) {
+	vmAssembler_t	*as = &c->as;
+
+	EmitString( as, "41 8B 44 24 FC" );			// mov eax, [r12-4]
+	if ( isSigned ) {
+		EmitString( as, "99" );					// cdq
+		EmitString( as, "41 F7 3C 24" );		// idiv dword [r12]
+	} else {
+		EmitString( as, "31 D2" );				// xor edx, edx
+		EmitString( as, "41 F7 34 24" );		// div dword [r12]
+	}
+	EmitString( as, "49 83 EC 04" );			// sub r12, 4
+	if ( remainder ) {
+		EmitString( as, "41 89 14 24" );		// mov [r12], edx
+	} else {
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+	}
+}
+
+/*
+=================
+VM_EmitInstruction
+=================
+*/
+static void VM_EmitInstruction( vmCompiler_t *c, int pc ) {
+	vmAssembler_t	*as = &c->as;
+	vm_t			*vm = c->vm;
+	int				op, v;
+	int				at, skip;
+
+	op = c->code[pc];
+	v = c->code[pc+1];		// operand, if the instruction has one
+
+	if ( vm->profile ) {
+		c->profileCount++;
+		if ( op == OP_CALL || op == OP_LEAVE || op == OP_JUMP || ( op >= OP_EQ && op <= OP_GEF ) ) {
+			VM_EmitProfileCheck( c, pc );
+		}
+	}
+
+	switch ( op ) {
+	case OP_UNDEF:
+	case OP_IGNORE:
+	case OP_BREAK:
+		break;
+
+	case OP_ENTER:
+		// the prologue must stay in sync with vmJitFunctionUnwind
+		if ( c->functionStarts ) {
+			c->functionStarts[ c->numFunctions ] = as->pos;
+		}
+		c->numFunctions++;
+		EmitString( as, "48 83 EC 28" );		// sub rsp, VM_JIT_FRAME
+		EmitString( as, "41 81 EF" );			// sub r15d, v
+		Emit4( as, v );
+		EmitString( as, "41 81 FF" );			// cmp r15d, stackBottom
+		Emit4( as, vm->stackBottom );
+		PatchJump( as, EmitJump( as, "0F 8E" ), c->errStackOverflow );	// jle
+		break;
+
+	case OP_LEAVE:
+		EmitString( as, "41 81 C7" );			// add r15d, v
+		Emit4( as, v );
+		EmitString( as, "48 83 C4 28" );		// add rsp, VM_JIT_FRAME
+		EmitString( as, "C3" );					// ret
+		break;
+
+	case OP_CALL:
+		// native calls don't need the return address in the image, but
+		// the data segment has to match the interpreter's, and the
+		// profiler walks the stack through it
+		EmitString( as, "42 C7 04 3B" );		// mov dword [rbx+r15], pc + 1
+		Emit4( as, pc + 1 );
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "85 C0" );				// test eax, eax
+		skip = EmitJump( as, "0F 8C" );			// jl systemcall
+		EmitString( as, "3D" );					// cmp eax, instructionCount
+		Emit4( as, c->instructionCount );
+		PatchJump( as, EmitJump( as, "0F 83" ), c->errBadCall );		// jae
+		EmitString( as, "41 FF 54 C5 00" );		// call [r13+rax*8]
+		at = EmitJump( as, "E9" );				// jmp done
+
+		PatchJump( as, skip, as->pos );
+		EmitString( as, "F7 D0" );				// not eax
+		EmitString( as, ARG2_EAX );
+		EmitString( as, ARG1_R15D );
+		EmitString( as, ARG0_IMM64 );
+		Emit8( as, (intptr_t)vm );
+		EmitCallHelper( as, (void *)VM_JitSystemCall );
+		EmitString( as, "49 83 C4 04" );		// add r12, 4
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		PatchJump( as, at, as->pos );
+		break;
+
+	case OP_PUSH:
+		EmitString( as, "49 83 C4 04" );		// add r12, 4
+		break;
+	case OP_POP:
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		break;
+
+	case OP_CONST:
+		EmitString( as, "49 83 C4 04" );		// add r12, 4
+		EmitString( as, "41 C7 04 24" );		// mov dword [r12], v
+		Emit4( as, v );
+		break;
+
+	case OP_LOCAL:
+		EmitString( as, "41 8D 87" );			// lea eax, [r15+v]
+		Emit4( as, v );
+		EmitString( as, "49 83 C4 04" );		// add r12, 4
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+
+	case OP_JUMP:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "3D" );					// cmp eax, instructionCount
+		Emit4( as, c->instructionCount );
+		PatchJump( as, EmitJump( as, "0F 83" ), c->errBadJump );		// jae
+		EmitString( as, "41 FF 64 C5 00" );		// jmp [r13+rax*8]
+		break;
+
+	case OP_EQ:		VM_EmitIntBranch( c, "0F 84", v ); break;	// je
+	case OP_NE:		VM_EmitIntBranch( c, "0F 85", v ); break;	// jne
+	case OP_LTI:	VM_EmitIntBranch( c, "0F 8C", v ); break;	// jl
+	case OP_LEI:	VM_EmitIntBranch( c, "0F 8E", v ); break;	// jle
+	case OP_GTI:	VM_EmitIntBranch( c, "0F 8F", v ); break;	// jg
+	case OP_GEI:	VM_EmitIntBranch( c, "0F 8D", v ); break;	// jge
+	case OP_LTU:	VM_EmitIntBranch( c, "0F 82", v ); break;	// jb
+	case OP_LEU:	VM_EmitIntBranch( c, "0F 86", v ); break;	// jbe
+	case OP_GTU:	VM_EmitIntBranch( c, "0F 87", v ); break;	// ja
+	case OP_GEU:	VM_EmitIntBranch( c, "0F 83", v ); break;	// jae
+
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+		VM_EmitFloatBranch( c, op, v );
+		break;
+
+	case OP_LOAD4:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "25" );					// and eax, dataMask
+		Emit4( as, vm->dataMask );
+		EmitString( as, "8B 04 03" );			// mov eax, [rbx+rax]
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+	case OP_LOAD2:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "25" );					// and eax, dataMask
+		Emit4( as, vm->dataMask );
+		EmitString( as, "0F B7 04 03" );		// movzx eax, word [rbx+rax]
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+	case OP_LOAD1:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "25" );					// and eax, dataMask
+		Emit4( as, vm->dataMask );
+		EmitString( as, "0F B6 04 03" );		// movzx eax, byte [rbx+rax]
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+
+	case OP_STORE4:
+		EmitString( as, "41 8B 44 24 FC" );		// mov eax, [r12-4]
+		EmitString( as, "25" );					// and eax, dataMask & ~3
+		Emit4( as, vm->dataMask & ~3 );
+		EmitString( as, "41 8B 0C 24" );		// mov ecx, [r12]
+		EmitString( as, "89 0C 03" );			// mov [rbx+rax], ecx
+		EmitString( as, "49 83 EC 08" );		// sub r12, 8
+		break;
+	case OP_STORE2:
+		EmitString( as, "41 8B 44 24 FC" );		// mov eax, [r12-4]
+		EmitString( as, "25" );					// and eax, dataMask & ~1
+		Emit4( as, vm->dataMask & ~1 );
+		EmitString( as, "41 8B 0C 24" );		// mov ecx, [r12]
+		EmitString( as, "66 89 0C 03" );		// mov [rbx+rax], cx
+		EmitString( as, "49 83 EC 08" );		// sub r12, 8
+		break;
+	case OP_STORE1:
+		EmitString( as, "41 8B 44 24 FC" );		// mov eax, [r12-4]
+		EmitString( as, "25" );					// and eax, dataMask
+		Emit4( as, vm->dataMask );
+		EmitString( as, "41 8B 0C 24" );		// mov ecx, [r12]
+		EmitString( as, "88 0C 03" );			// mov [rbx+rax], cl
+		EmitString( as, "49 83 EC 08" );		// sub r12, 8
+		break;
+
+	case OP_ARG:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "41 8D 8F" );			// lea ecx, [r15+v]
+		Emit4( as, v );
+		EmitString( as, "89 04 0B" );			// mov [rbx+rcx], eax
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		break;
+
+	case OP_BLOCK_COPY:
+		EmitString( as, ARG3_IMM32 );
+		Emit4( as, v );
+		EmitString( as, ARG2_OPSTACK0 );
+		EmitString( as, ARG1_OPSTACK1 );
+		EmitString( as, ARG0_IMM64 );
+		Emit8( as, (intptr_t)vm );
+		EmitCallHelper( as, (void *)VM_JitBlockCopy );
+		EmitString( as, "49 83 EC 08" );		// sub r12, 8
+		break;
+
+	case OP_SEX8:
+		EmitString( as, "41 0F BE 04 24" );		// movsx eax, byte [r12]
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+	case OP_SEX16:
+		EmitString( as, "41 0F BF 04 24" );		// movsx eax, word [r12]
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+
+	case OP_NEGI:
+		EmitString( as, "41 F7 1C 24" );		// neg dword [r12]
+		break;
+	case OP_BCOM:
+		EmitString( as, "41 F7 14 24" );		// not dword [r12]
+		break;
+
+	case OP_ADD:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 01 04 24" );		// add [r12], eax
+		break;
+	case OP_SUB:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 29 04 24" );		// sub [r12], eax
+		break;
+	case OP_BAND:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 21 04 24" );		// and [r12], eax
+		break;
+	case OP_BOR:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 09 04 24" );		// or [r12], eax
+		break;
+	case OP_BXOR:
+		EmitString( as, "41 8B 04 24" );		// mov eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 31 04 24" );		// xor [r12], eax
+		break;
+
+	case OP_MULI:
+	case OP_MULU:
+		EmitString( as, "41 8B 44 24 FC" );		// mov eax, [r12-4]
+		EmitString( as, "41 0F AF 04 24" );		// imul eax, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+
+	case OP_DIVI:	VM_EmitDivide( c, qtrue, qfalse ); break;
+	case OP_DIVU:	VM_EmitDivide( c, qfalse, qfalse ); break;
+	case OP_MODI:	VM_EmitDivide( c, qtrue, qtrue ); break;
+	case OP_MODU:	VM_EmitDivide( c, qfalse, qtrue ); break;
+
+	case OP_LSH:
+		EmitString( as, "41 8B 0C 24" );		// mov ecx, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 D3 24 24" );		// shl dword [r12], cl
+		break;
+	case OP_RSHI:
+		EmitString( as, "41 8B 0C 24" );		// mov ecx, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 D3 3C 24" );		// sar dword [r12], cl
+		break;
+	case OP_RSHU:
+		EmitString( as, "41 8B 0C 24" );		// mov ecx, [r12]
+		EmitString( as, "49 83 EC 04" );		// sub r12, 4
+		EmitString( as, "41 D3 2C 24" );		// shr dword [r12], cl
+		break;
+
+	case OP_NEGF:
+		EmitString( as, "41 81 34 24 00 00 00 80" );	// xor dword [r12], 0x80000000
+		break;
+	case OP_ADDF:	VM_EmitFloatOp( c, "F3 41 0F 58 04 24" ); break;	// addss xmm0, [r12]
+	case OP_SUBF:	VM_EmitFloatOp( c, "F3 41 0F 5C 04 24" ); break;	// subss xmm0, [r12]
+	case OP_DIVF:	VM_EmitFloatOp( c, "F3 41 0F 5E 04 24" ); break;	// divss xmm0, [r12]
+	case OP_MULF:	VM_EmitFloatOp( c, "F3 41 0F 59 04 24" ); break;	// mulss xmm0, [r12]
+
+	case OP_CVIF:
+		EmitString( as, "F3 41 0F 2A 04 24" );	// cvtsi2ss xmm0, dword [r12]
+		EmitString( as, "F3 41 0F 11 04 24" );	// movss [r12], xmm0
+		break;
+	case OP_CVFI:
+		EmitString( as, "F3 41 0F 2C 04 24" );	// cvttss2si eax, dword [r12]
+		EmitString( as, "41 89 04 24" );		// mov [r12], eax
+		break;
+
+	default:
+		VM_CompileError( c, va( "VM_Compile: %s has bad opcode %i at offset %i", vm->name, op, pc ) );
+		break;
+	}
+}
+
+/*
+=================
+VM_CompilePass
+
+Emits the whole image.  The first pass runs with a NULL buffer to
+size the image and find every native offset, the second writes it.
+Every instruction emits the same number of bytes in both passes.
+=================
+*/
+static void VM_CompilePass( vmCompiler_t *c ) {
+	vm_t	*vm = c->vm;
+	int		i, pc;
+
+	c->as.pos = 0;
+	c->numFunctions = 0;
+	c->profileCount = 0;
+
+	VM_EmitEntry( c );
+	c->entryEnd = c->as.pos;
+
+	for ( i = 0 ; i < c->instructionCount ; i++ ) {
+		pc = vm->instructionPointers[i];
+		c->pcToNative[pc] = c->as.pos;
+		if ( VM_InstructionRemoved( vm, i ) ) {
+			continue;
+		}
+		VM_EmitInstruction( c, pc );
+	}
+	// a branch to the end of the image lands on the error stubs
+	c->pcToNative[vm->codeLength] = c->as.pos;
+
+	VM_EmitErrorStubs( c );
+	c->codeEnd = c->as.pos;
+}
+
+/*
+=================
+VM_AllocExecutable / VM_ProtectExecutable / VM_FreeExecutable
+=================
+*/
+static byte *VM_AllocExecutable( int size ) {
+	byte	*buf;
+
+#ifdef _WIN32
+	buf = (byte *)VirtualAlloc( NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+#else
+	buf = (byte *)mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( buf == MAP_FAILED ) {
+		buf = NULL;
+	}
+#endif
+	return buf;
+}
+
+static void VM_ProtectExecutable( byte *buf, int size ) {
+#ifdef _WIN32
+	DWORD	oldProtect;
+
+	VirtualProtect( buf, size, PAGE_EXECUTE_READ, &oldProtect );
+	FlushInstructionCache( GetCurrentProcess(), buf, size );
+#else
+	mprotect( buf, size, PROT_READ | PROT_EXEC );
+#endif
+}
+
+static void VM_FreeExecutable( byte *buf, int size ) {
+#ifdef _WIN32
+	VirtualFree( buf, 0, MEM_RELEASE );
+#else
+	munmap( buf, size );
+#endif
+}
+
+/*
+=================
+VM_CompileFailed
+
+Gives back everything VM_Compile allocated before raising the error
+=================
+*/
+static void VM_CompileFailed( vmCompiler_t *c, int size ) {
+	if ( c->as.buf ) {
+		VM_FreeExecutable( c->as.buf, size );
+	}
+	if ( c->functionStarts ) {
+		Hunk_FreeTempMemory( c->functionStarts );
+	}
+	Hunk_FreeTempMemory( c->pcToNative );
+	Com_Error( ERR_DROP, "%s", c->error );
+}
+
+/*
+=================
+VM_Compile
+
+Translates the image prepared by VM_PrepareInterpreter, so that
+must have been called first.  Needs vm->stackBottom.
+=================
+*/
+void VM_Compile( vm_t *vm ) {
+	vmCompiler_t	c;
+	int				i;
+	int				size;
+	int				startTime;
+#ifdef _WIN32
+	int				unwindOfs, functionsOfs;
+	RUNTIME_FUNCTION	*functions;
+#endif
+
+	startTime = Sys_Milliseconds();
+
+	Com_Memset( &c, 0, sizeof( c ) );
+	c.vm = vm;
+	c.code = (int *)vm->codeBase;
+	c.instructionCount = vm->instructionPointersLength >> 2;
+	c.pcToNative = (int *)Hunk_AllocateTempMemory( ( vm->codeLength + 1 ) * sizeof( int ) );
+	Com_Memset( c.pcToNative, -1, ( vm->codeLength + 1 ) * sizeof( int ) );
+
+	// size everything
+	VM_CompilePass( &c );
+	if ( c.error[0] ) {
+		VM_CompileFailed( &c, 0 );
+	}
+
+	size = c.codeEnd;
+#ifdef _WIN32
+	unwindOfs = ( size + 3 ) & ~3;
+	functionsOfs = unwindOfs + sizeof( vmJitEntryUnwind ) + sizeof( vmJitFunctionUnwind );
+	size = functionsOfs + ( c.numFunctions + 2 ) * sizeof( RUNTIME_FUNCTION );
+#endif
+
+	c.as.buf = VM_AllocExecutable( size );
+	if ( !c.as.buf ) {
+		Hunk_FreeTempMemory( c.pcToNative );
+		Com_Error( ERR_FATAL, "VM_Compile: couldn't allocate %i bytes of executable memory", size );
+	}
+	c.functionStarts = (int *)Hunk_AllocateTempMemory( ( c.numFunctions + 1 ) * sizeof( int ) );
+
+	// now write it out, all offsets are known from the sizing pass
+	VM_CompilePass( &c );
+	if ( c.error[0] ) {
+		VM_CompileFailed( &c, size );
+	}
+
+	vm->compiledInstructions = (intptr_t *)Hunk_Alloc( c.instructionCount * sizeof( intptr_t ), h_high );
+	for ( i = 0 ; i < c.instructionCount ; i++ ) {
+		vm->compiledInstructions[i] = (intptr_t)( c.as.buf + c.pcToNative[ vm->instructionPointers[i] ] );
+	}
+
+#ifdef _WIN32
+	// describe the frames so longjmp and the debugger can walk through them
+	Com_Memcpy( c.as.buf + unwindOfs, vmJitEntryUnwind, sizeof( vmJitEntryUnwind ) );
+	Com_Memcpy( c.as.buf + unwindOfs + sizeof( vmJitEntryUnwind ), vmJitFunctionUnwind, sizeof( vmJitFunctionUnwind ) );
+
+	functions = (RUNTIME_FUNCTION *)( c.as.buf + functionsOfs );
+	functions[0].BeginAddress = 0;
+	functions[0].EndAddress = c.entryEnd;
+	functions[0].UnwindData = unwindOfs;
+	c.functionStarts[c.numFunctions] = c.stubsStart;
+	for ( i = 0 ; i < c.numFunctions ; i++ ) {
+		functions[i+1].BeginAddress = c.functionStarts[i];
+		functions[i+1].EndAddress = c.functionStarts[i+1];
+		functions[i+1].UnwindData = unwindOfs + sizeof( vmJitEntryUnwind );
+	}
+	functions[i+1].BeginAddress = c.stubsStart;
+	functions[i+1].EndAddress = c.codeEnd;
+	functions[i+1].UnwindData = unwindOfs + sizeof( vmJitEntryUnwind );
+
+	if ( !RtlAddFunctionTable( functions, c.numFunctions + 2, (DWORD64)c.as.buf ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't register unwind info for %s\n", vm->name );
+	} else {
+		vm->compiledUnwind = functions;
+	}
+#endif
+
+	VM_ProtectExecutable( c.as.buf, size );
+
+	Hunk_FreeTempMemory( c.functionStarts );
+	Hunk_FreeTempMemory( c.pcToNative );
+
+	vm->compiledCode = c.as.buf;
+	vm->compiledCodeLength = size;
+	vm->compiled = qtrue;
+
+	Com_Printf( "VM file %s compiled to %i bytes of code in %i msec\n", vm->name, size, Sys_Milliseconds() - startTime );
+}
+
+/*
+=================
+VM_FreeCompiled
+=================
+*/
+void VM_FreeCompiled( vm_t *vm ) {
+	if ( !vm->compiledCode ) {
+		return;
+	}
+#ifdef _WIN32
+	if ( vm->compiledUnwind ) {
+		RtlDeleteFunctionTable( (RUNTIME_FUNCTION *)vm->compiledUnwind );
+	}
+#endif
+	VM_FreeExecutable( vm->compiledCode, vm->compiledCodeLength );
+	vm->compiledCode = NULL;
+	vm->compiledUnwind = NULL;
+	vm->compiledCodeLength = 0;
+	vm->compiled = qfalse;
+}
+
+/*
+==============
+VM_CallCompiled
+
+Same stack frame setup as VM_CallInterpreted
+==============
+*/
+int VM_CallCompiled( vm_t *vm, int *args ) {
+	int		stack[VM_JIT_MAX_STACK];
+	int		*opStack;
+	int		programStack;
+	int		stackOnEntry;
+	byte	*image;
+
+	// we might be called recursively, so this might not be the very top
+	programStack = stackOnEntry = vm->programStack;
+
+	image = vm->dataBase;
+
+	programStack -= 48;
+
+	*(int *)&image[ programStack + 44] = args[9];
+	*(int *)&image[ programStack + 40] = args[8];
+	*(int *)&image[ programStack + 36] = args[7];
+	*(int *)&image[ programStack + 32] = args[6];
+	*(int *)&image[ programStack + 28] = args[5];
+	*(int *)&image[ programStack + 24] = args[4];
+	*(int *)&image[ programStack + 20] = args[3];
+	*(int *)&image[ programStack + 16] = args[2];
+	*(int *)&image[ programStack + 12] = args[1];
+	*(int *)&image[ programStack + 8 ] = args[0];
+	*(int *)&image[ programStack + 4 ] = 0;	// return stack
+	*(int *)&image[ programStack ] = -1;	// return address, unused by compiled code
+
+	// leave a free spot at start of stack so
+	// that as long as opStack is valid, opStack-1 will
+	// not corrupt anything
+	opStack = ((vmJitEntry_t)vm->compiledCode)( image, stack, programStack, vm->compiledInstructions );
+
+	if ( opStack != &stack[1] ) {
+		Com_Error( ERR_DROP, "Compiled code error: opStack = %i", (int)( opStack - stack ) );
+	}
+
+	vm->programStack = stackOnEntry;
+
+	// return the result
+	return *opStack;
+}
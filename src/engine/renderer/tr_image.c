@@ -938,7 +938,7 @@ static void LoadBMP( const char *name, byte **pic, int *width, int *height )
 	//
 	// load the file
 	//
-	length = ri.FS_ReadFile( ( char * ) name, (void **)&buffer);
+	length = ri.FS_ReadFileView( name, (const void **)&buffer);
 	if (!buffer) {
 		return;
 	}
@@ -1236,7 +1236,7 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 	//
 	// load the file
 	//
-	ri.FS_ReadFile ( ( char * ) name, (void **)&buffer);
+	ri.FS_ReadFileView ( name, (const void **)&buffer);
 	if (!buffer) {
 		return;
 	}
@@ -1462,7 +1462,7 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 
 static void LoadJPG( const char *filename, byte **pic, int *width, int *height ) {
   byte* fbuffer;
-  int len = ri.FS_ReadFile ( ( char * ) filename, (void **)&fbuffer);
+  int len = ri.FS_ReadFileView ( filename, (const void **)&fbuffer);
   if (!fbuffer) {
 	return;
   }
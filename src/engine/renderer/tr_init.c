@@ -1262,5 +1262,7 @@ refexport_t *GetRefAPI ( int apiVersion, refimport_t *rimp ) {
 	re.GetEntityToken = R_GetEntityToken;
 	re.inPVS = R_inPVS;
 
+	re.GetMemoryStats = R_GetMemoryStats;
+
 	return &re;
 }
@@ -756,6 +756,7 @@ int			R_LerpTag( orientation_t *tag, qhandle_t handle, int startFrame, int endFr
 void		R_ModelBounds( qhandle_t handle, vec3_t mins, vec3_t maxs );
 
 void		R_Modellist_f (void);
+void		R_GetMemoryStats( refMemoryStats_t *stats );
 
 //====================================================
 extern	refimport_t		ri;
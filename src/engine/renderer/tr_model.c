@@ -630,6 +630,29 @@ void R_Modellist_f(void) {
 	}
 
 
+/*
+================
+R_GetMemoryStats
+================
+*/
+void R_GetMemoryStats( refMemoryStats_t *stats ) {
+	int		i;
+
+	Com_Memset( stats, 0, sizeof( *stats ) );
+
+	stats->numImages = tr.numImages;
+	for ( i = 0 ; i < tr.numImages ; i++ ) {
+		stats->imageTexels += tr.images[i]->uploadWidth * tr.images[i]->uploadHeight;
+	}
+	stats->usedImageTexels = R_SumOfUsedImages();
+
+	stats->numModels = tr.numModels;
+	for ( i = 1 ; i < tr.numModels ; i++ ) {
+		stats->modelBytes += tr.models[i]->dataSize;
+	}
+}
+
+
 //=============================================================================
 
 
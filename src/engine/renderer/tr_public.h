@@ -26,6 +26,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define	REF_API_VERSION		8
 
+// memory the refresh module is holding, for the memory telemetry
+typedef struct {
+	int		numImages;
+	int		imageTexels;		// all uploaded images
+	int		usedImageTexels;	// images drawn in the last frame
+	int		numModels;
+	int		modelBytes;
+} refMemoryStats_t;
+
 //
 // these are the functions exported by the refresh module
 //
@@ -97,6 +106,8 @@ typedef struct {
 	void	(*RemapShader)(const char *oldShader, const char *newShader, const char *offsetTime);
 	qboolean (*GetEntityToken)( char *buffer, int size );
 	qboolean (*inPVS)( const vec3_t p1, const vec3_t p2 );
+
+	void	(*GetMemoryStats)( refMemoryStats_t *stats );
 } refexport_t;
 
 //
@@ -145,6 +156,7 @@ typedef struct {
 	// NULL can be passed for buf to just determine existance
 	int		(*FS_FileIsInPAK)( const char *name, int *pCheckSum );
 	int		(*FS_ReadFile)( const char *name, void **buf );
+	int		(*FS_ReadFileView)( const char *name, const void **buf );
 	void	(*FS_FreeFile)( void *buf );
 	char **	(*FS_ListFiles)( const char *name, const char *extension, int *numfilesfound );
 	void	(*FS_FreeFileList)( char **filelist );
@@ -33,6 +33,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define	MAX_ENT_CLUSTERS	16
 
+// an entity's place in the list of one of the clusters it touches
+typedef struct clusterLink_s {
+	struct clusterLink_s	*prev, *next;
+	int						entityNum;
+} clusterLink_t;
+
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
@@ -42,7 +48,9 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
+
+	int				numClusterLinks;	// one for each different cluster in clusternums
+	clusterLink_t	clusterLinks[MAX_ENT_CLUSTERS];
 } svEntity_t;
 
 typedef enum {
@@ -60,12 +68,13 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;	
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	struct cmodel_s	*models[MAX_MODELS];
 	char			*configstrings[MAX_CONFIGSTRINGS];
 	svEntity_t		svEntities[MAX_GENTITIES];
+	int				numClusters;
+	clusterLink_t	*clusterEntities;	// [numClusters] list heads, the linked entities in each cluster
 
 	char			*entityParsePoint;	// used during game VM init
 
@@ -243,6 +252,9 @@ extern	cvar_t	*sv_pure;
 extern	cvar_t	*sv_floodProtect;
 extern	cvar_t	*sv_lanForceRate;
 extern	cvar_t	*sv_strictAuth;
+extern	cvar_t	*sv_deltaCache;
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_traceThreads;
 
 //===========================================================
 
@@ -311,6 +323,8 @@ void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_DeltaCache_f( void );
+void SV_SnapshotDiff_f( void );
 
 //
 // sv_game.c
@@ -335,6 +349,7 @@ void		SV_BotFreeClient( int clientNum );
 void		SV_BotInitCvars(void);
 int			SV_BotLibSetup( void );
 int			SV_BotLibShutdown( void );
+void		SV_BotLibMemoryStats( int *allocated, int *blocks );
 int			SV_BotGetSnapshotEntity( int client, int ent );
 int			SV_BotGetConsoleMessage( int client, char *buf, int size );
 
@@ -391,6 +406,13 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 
 // passEntityNum is explicitly excluded from clipping checks (normally ENTITYNUM_NONE)
 
+void SV_TraceBatch( trace_t *results, const traceQuery_t *queries, int count, int threads );
+// the same as an SV_Trace for every query, the world part is done on up to threads threads
+
+void SV_StopTraceRecord( void );
+void SV_TraceRecord_f( void );
+void SV_TraceBench_f( void );
+
 
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
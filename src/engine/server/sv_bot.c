@@ -433,7 +433,7 @@ void SV_BotFrame( int time ) {
 	if (!bot_enable) return;
 	//NOTE: maybe the game is already shutdown
 	if (!gvm) return;
-	VM_Call( gvm, BOTAI_START_FRAME, time );
+	VM_Call1( gvm, BOTAI_START_FRAME, time );
 }
 
 /*
@@ -471,6 +471,20 @@ int SV_BotLibShutdown( void ) {
 	return botlib_export->BotLibShutdown();
 }
 
+/*
+===============
+SV_BotLibMemoryStats
+===============
+*/
+void SV_BotLibMemoryStats( int *allocated, int *blocks ) {
+	if ( !botlib_export ) {
+		*allocated = *blocks = 0;
+		return;
+	}
+
+	botlib_export->MemoryStats( allocated, blocks );
+}
+
 /*
 ==================
 SV_BotInitCvars
@@ -273,7 +273,7 @@ static void SV_MapRestart_f( void ) {
 
 	// run a few frames to allow everything to settle
 	for ( i = 0 ;i < 3 ; i++ ) {
-		VM_Call( gvm, GAME_RUN_FRAME, svs.time );
+		VM_Call1( gvm, GAME_RUN_FRAME, svs.time );
 		svs.time += 100;
 	}
 
@@ -299,7 +299,7 @@ static void SV_MapRestart_f( void ) {
 		SV_AddServerCommand( client, "map_restart\n" );
 
 		// connect the client again, without the firstTime flag
-		denied = (char*) VM_ExplicitArgPtr( gvm, VM_Call( gvm, GAME_CLIENT_CONNECT, i, qfalse, isBot ) );
+		denied = (char*) VM_ExplicitArgPtr( gvm, VM_Call3( gvm, GAME_CLIENT_CONNECT, i, qfalse, isBot ) );
 		if ( denied ) {
 			// this generally shouldn't happen, because the client
 			// was connected before the level change
@@ -314,7 +314,7 @@ static void SV_MapRestart_f( void ) {
 	}	
 
 	// run another frame to allow things to look at all the players
-	VM_Call( gvm, GAME_RUN_FRAME, svs.time );
+	VM_Call1( gvm, GAME_RUN_FRAME, svs.time );
 	svs.time += 100;
 }
 
@@ -700,6 +700,137 @@ static void SV_KillServer_f( void ) {
 	SV_Shutdown( "killserver" );
 }
 
+/*
+=================
+SV_VmBench_f
+
+Runs the game module for a number of frames and reports how fast
+it went, toggle vm_game / vm_threaded and reload the map to compare.
+The plain interpreter only counts instructions with vm_profile on.
+=================
+*/
+static void SV_VmBench_f( void ) {
+	int				i, frames, frameMsec;
+	int				startTime, msec;
+	unsigned int	start;
+	double			instructions;
+
+	// make sure server is running
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() > 1 ) {
+		frames = atoi( Cmd_Argv( 1 ) );
+	} else {
+		frames = 1000;
+	}
+	if ( frames < 1 ) {
+		Com_Printf( "Usage: vmbench [frames]\n" );
+		return;
+	}
+
+	if ( sv_fps->integer < 1 ) {
+		Cvar_Set( "sv_fps", "10" );
+	}
+	frameMsec = 1000 / sv_fps->integer;
+
+	instructions = 0;
+	startTime = Sys_Milliseconds();
+	for ( i = 0 ; i < frames ; i++ ) {
+		svs.time += frameMsec;
+		start = VM_ExecutedInstructions( gvm );
+		VM_Call1( gvm, GAME_RUN_FRAME, svs.time );
+		instructions += VM_ExecutedInstructions( gvm ) - start;
+	}
+	msec = Sys_Milliseconds() - startTime;
+
+	Com_Printf( "vm_game %s, vm_threaded %s: %i frames in %i msec, %.3f msec/frame\n",
+		Cvar_VariableString( "vm_game" ), Cvar_VariableString( "vm_threaded" ),
+		frames, msec, (float)msec / frames );
+	if ( instructions ) {
+		Com_Printf( "%.0f instructions, %.2f million per second\n",
+			instructions, msec ? instructions / ( msec * 1000.0 ) : 0 );
+	}
+}
+
+/*
+=================
+SV_VmCallBench_f
+
+Measures the cost of getting in and out of the game module, and of
+a system call with and without its own handler.  The module is
+called with a command it doesn't know, which vmMain returns -1 for.
+=================
+*/
+#define	VM_BENCH_COMMAND	-1
+
+static void SV_VmCallBench_f( void ) {
+	int				i, count;
+	int				start, usec[4];
+	intptr_t		args[16];
+	vec3_t			point;
+	vmSystemCall_t	handler;
+
+	// make sure server is running
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() > 1 ) {
+		count = atoi( Cmd_Argv( 1 ) );
+	} else {
+		count = 100000;
+	}
+	if ( count < 1 ) {
+		Com_Printf( "Usage: vmcallbench [calls]\n" );
+		return;
+	}
+
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		VM_Call( gvm, VM_BENCH_COMMAND, i );
+	}
+	usec[0] = Sys_Microseconds() - start;
+
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		VM_Call1( gvm, VM_BENCH_COMMAND, i );
+	}
+	usec[1] = Sys_Microseconds() - start;
+
+	// the point is read through VM_ArgPtr, so a qvm reads some of
+	// its own memory instead, which is just as good
+	Com_Memset( args, 0, sizeof( args ) );
+	VectorClear( point );
+	args[0] = G_POINT_CONTENTS;
+	args[1] = (intptr_t)point;
+	args[2] = ENTITYNUM_NONE;
+
+	handler = VM_GetSystemCall( gvm, G_POINT_CONTENTS );
+	VM_SetSystemCall( gvm, G_POINT_CONTENTS, NULL );
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		VM_SystemCall( gvm, args );
+	}
+	usec[2] = Sys_Microseconds() - start;
+	VM_SetSystemCall( gvm, G_POINT_CONTENTS, handler );
+
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		VM_SystemCall( gvm, args );
+	}
+	usec[3] = Sys_Microseconds() - start;
+
+	Com_Printf( "%i calls, nsec per call:\n", count );
+	Com_Printf( "VM_Call                     %8.1f\n", usec[0] * 1000.0 / count );
+	Com_Printf( "VM_Call1                    %8.1f\n", usec[1] * 1000.0 / count );
+	Com_Printf( "G_POINT_CONTENTS by switch  %8.1f\n", usec[2] * 1000.0 / count );
+	Com_Printf( "G_POINT_CONTENTS by handler %8.1f%s\n", usec[3] * 1000.0 / count, handler ? "" : " (no handler)" );
+}
+
 //===========================================================
 
 /*
@@ -733,6 +864,12 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("spdevmap", SV_Map_f);
 #endif
 	Cmd_AddCommand ("killserver", SV_KillServer_f);
+	Cmd_AddCommand ("vmbench", SV_VmBench_f);
+	Cmd_AddCommand ("vmcallbench", SV_VmCallBench_f);
+	Cmd_AddCommand ("deltacache", SV_DeltaCache_f);
+	Cmd_AddCommand ("snapshotdiff", SV_SnapshotDiff_f);
+	Cmd_AddCommand ("tracerecord", SV_TraceRecord_f);
+	Cmd_AddCommand ("tracebench", SV_TraceBench_f);
 	if( com_dedicated->integer ) {
 		Cmd_AddCommand ("say", SV_ConSay_f);
 	}
@@ -298,6 +298,73 @@ static int	FloatAsInt( float f ) {
 	return temp.i;
 }
 
+#define	VMA(x) VM_ArgPtr(args[x])
+#define	VMF(x) (*(float*)&args[x])
+
+/*
+====================
+SV_GameLinkEntity etc
+
+The system calls made many times a frame, SV_SetGameSystemCalls
+gives them their own handlers so they skip the switch below
+====================
+*/
+static intptr_t SV_GameLinkEntity( intptr_t *args ) {
+	SV_LinkEntity( (sharedEntity_t*) VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_GameUnlinkEntity( intptr_t *args ) {
+	SV_UnlinkEntity( (sharedEntity_t*) VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_GameEntitiesInBox( intptr_t *args ) {
+	return SV_AreaEntities( (const vec_t*) VMA(1), (const vec_t*) VMA(2), (int*) VMA(3), args[4] );
+}
+
+static intptr_t SV_GameTrace( intptr_t *args ) {
+	SV_Trace((trace_t*)VMA(1), (const vec_t*)VMA(2), (vec_t*) VMA(3), (vec_t*)VMA(4), (const vec_t*) VMA(5), args[6], args[7], /*int capsule*/ qfalse);
+	return 0;
+}
+
+static intptr_t SV_GameTraceCapsule( intptr_t *args ) {
+	SV_Trace((trace_t*)VMA(1), (const vec_t*)VMA(2), (vec_t*)VMA(3), (vec_t*)VMA(4), (const vec_t*)VMA(5), args[6], args[7], /*int capsule*/ qtrue);
+	return 0;
+}
+
+static intptr_t SV_GameTraceBatch( intptr_t *args ) {
+	trace_t				*results;
+	const traceQuery_t	*queries;
+	int					count;
+
+	count = args[3];
+	if ( count <= 0 ) {
+		return 0;
+	}
+	results = (trace_t*)VM_ArgArray( args[1], count, sizeof( trace_t ) );
+	queries = (const traceQuery_t*)VM_ArgArray( args[2], count, sizeof( traceQuery_t ) );
+	if ( !results || !queries ) {
+		Com_Error( ERR_DROP, "SV_GameTraceBatch: NULL array" );
+	}
+	SV_TraceBatch( results, queries, count, sv_traceThreads->integer );
+	return 0;
+}
+
+static intptr_t SV_GamePointContents( intptr_t *args ) {
+	return SV_PointContents( (const vec_t*) VMA(1), args[2] );
+}
+
+static void SV_SetGameSystemCalls( void ) {
+	VM_SetSystemCall( gvm, G_LINKENTITY, SV_GameLinkEntity );
+	VM_SetSystemCall( gvm, G_UNLINKENTITY, SV_GameUnlinkEntity );
+	VM_SetSystemCall( gvm, G_ENTITIES_IN_BOX, SV_GameEntitiesInBox );
+	VM_SetSystemCall( gvm, G_TRACE, SV_GameTrace );
+	VM_SetSystemCall( gvm, G_TRACECAPSULE, SV_GameTraceCapsule );
+	VM_SetSystemCall( gvm, G_TRACE_BATCH, SV_GameTraceBatch );
+	VM_SetSystemCall( gvm, G_POINT_CONTENTS, SV_GamePointContents );
+}
+
 /*
 ====================
 SV_GameSystemCalls
@@ -305,9 +372,6 @@ SV_GameSystemCalls
 The module is making a system call
 ====================
 */
-#define	VMA(x) VM_ArgPtr(args[x])
-#define	VMF(x) (*(float*)&args[x])
-
 intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	switch( args[0] ) {
 	case G_PRINT:
@@ -367,25 +431,23 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		SV_GameSendServerCommand( args[1], (const char*) VMA(2) );
 		return 0;
 	case G_LINKENTITY:
-		SV_LinkEntity( (sharedEntity_t*) VMA(1) );
-		return 0;
+		return SV_GameLinkEntity( args );
 	case G_UNLINKENTITY:
-		SV_UnlinkEntity( (sharedEntity_t*) VMA(1) );
-		return 0;
+		return SV_GameUnlinkEntity( args );
 	case G_ENTITIES_IN_BOX:
-		return SV_AreaEntities( (const vec_t*) VMA(1), (const vec_t*) VMA(2), (int*) VMA(3), args[4] );
+		return SV_GameEntitiesInBox( args );
 	case G_ENTITY_CONTACT:
 		return SV_EntityContact((vec_t*) VMA(1), (vec_t*) VMA(2), (const sharedEntity_t*) VMA(3), /*int capsule*/ qfalse);
 	case G_ENTITY_CONTACTCAPSULE:
 		return SV_EntityContact( (vec_t*) VMA(1), (vec_t*) VMA(2), (const sharedEntity_t*) VMA(3), /*int capsule*/ qtrue );
 	case G_TRACE:
-		SV_Trace((trace_t*)VMA(1), (const vec_t*)VMA(2), (vec_t*) VMA(3), (vec_t*)VMA(4), (const vec_t*) VMA(5), args[6], args[7], /*int capsule*/ qfalse);
-		return 0;
+		return SV_GameTrace( args );
 	case G_TRACECAPSULE:
-		SV_Trace((trace_t*)VMA(1), (const vec_t*)VMA(2), (vec_t*)VMA(3), (vec_t*)VMA(4), (const vec_t*)VMA(5), args[6], args[7], /*int capsule*/ qtrue);
-		return 0;
+		return SV_GameTraceCapsule( args );
+	case G_TRACE_BATCH:
+		return SV_GameTraceBatch( args );
 	case G_POINT_CONTENTS:
-		return SV_PointContents( (const vec_t*) VMA(1), args[2] );
+		return SV_GamePointContents( args );
 	case G_SET_BRUSH_MODEL:
 		SV_SetBrushModel( (sharedEntity_t*) VMA(1), (const char*) VMA(2) );
 		return 0;
@@ -872,7 +934,7 @@ void SV_ShutdownGameProgs( void ) {
 	if ( !gvm ) {
 		return;
 	}
-	VM_Call( gvm, GAME_SHUTDOWN, qfalse );
+	VM_Call1( gvm, GAME_SHUTDOWN, qfalse );
 	VM_Free( gvm );
 	gvm = NULL;
 }
@@ -900,7 +962,7 @@ static void SV_InitGameVM( qboolean restart ) {
 	
 	// use the current msec count for a random seed
 	// init for this gamestate
-	VM_Call( gvm, GAME_INIT, svs.time, Com_Milliseconds(), restart );
+	VM_Call3( gvm, GAME_INIT, svs.time, Com_Milliseconds(), restart );
 }
 
 
@@ -916,7 +978,7 @@ void SV_RestartGameProgs( void ) {
 	if ( !gvm ) {
 		return;
 	}
-	VM_Call( gvm, GAME_SHUTDOWN, qtrue );
+	VM_Call1( gvm, GAME_SHUTDOWN, qtrue );
 
 	// do a restart instead of a free
 	gvm = VM_Restart( gvm );
@@ -953,6 +1015,7 @@ void SV_InitGameProgs( void ) {
 	if ( !gvm ) {
 		Com_Error( ERR_FATAL, "VM_Create on game failed" );
 	}
+	SV_SetGameSystemCalls();
 
 	SV_InitGameVM( qfalse );
 }
@@ -970,6 +1033,6 @@ qboolean SV_GameCommand( void ) {
 		return qfalse;
 	}
 
-	return (qboolean) VM_Call( gvm, GAME_CONSOLE_COMMAND );
+	return (qboolean) VM_Call0( gvm, GAME_CONSOLE_COMMAND );
 }
 
@@ -439,7 +439,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	// run a few frames to allow everything to settle
 	for ( i = 0 ;i < 3 ; i++ ) {
-		VM_Call( gvm, GAME_RUN_FRAME, svs.time );
+		VM_Call1( gvm, GAME_RUN_FRAME, svs.time );
 		SV_BotFrame( svs.time );
 		svs.time += 100;
 	}
@@ -464,7 +464,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 			}
 
 			// connect the client again
-			denied = (char*) VM_ExplicitArgPtr( gvm, VM_Call( gvm, GAME_CLIENT_CONNECT, i, qfalse, isBot ) );	// firstTime = qfalse
+			denied = (char*) VM_ExplicitArgPtr( gvm, VM_Call3( gvm, GAME_CLIENT_CONNECT, i, qfalse, isBot ) );	// firstTime = qfalse
 			if ( denied ) {
 				// this generally shouldn't happen, because the client
 				// was connected before the level change
@@ -488,14 +488,14 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 					client->deltaMessage = -1;
 					client->nextSnapshotTime = svs.time;	// generate a snapshot immediately
 
-					VM_Call( gvm, GAME_CLIENT_BEGIN, i );
+					VM_Call1( gvm, GAME_CLIENT_BEGIN, i );
 				}
 			}
 		}
 	}	
 
 	// run another frame to allow things to look at all the players
-	VM_Call( gvm, GAME_RUN_FRAME, svs.time );
+	VM_Call1( gvm, GAME_RUN_FRAME, svs.time );
 	SV_BotFrame( svs.time );
 	svs.time += 100;
 
@@ -545,6 +545,9 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	Hunk_SetMark();
 
+	// one record per map so leaks across map changes show up
+	Com_MemDump( "spawn" );
+
 	Com_Printf ("-----------------------------------\n");
 }
 
@@ -611,6 +614,9 @@ void SV_Init (void) {
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
 	sv_strictAuth = Cvar_Get ("sv_strictAuth", "1", CVAR_ARCHIVE );
+	sv_deltaCache = Cvar_Get ("sv_deltaCache", "1", 0 );
+	sv_snapshotThreads = Cvar_Get ("sv_snapshotThreads", "4", CVAR_ARCHIVE );
+	sv_traceThreads = Cvar_Get ("sv_traceThreads", "4", CVAR_ARCHIVE );
 
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars();
@@ -52,6 +52,9 @@ cvar_t	*sv_pure;
 cvar_t	*sv_floodProtect;
 cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
 cvar_t	*sv_strictAuth;
+cvar_t	*sv_deltaCache;			// share encoded entity deltas between clients
+cvar_t	*sv_snapshotThreads;	// workers building and encoding snapshots
+cvar_t	*sv_traceThreads;		// threads for the world part of batched traces
 
 /*
 =============================================================================
@@ -834,7 +837,7 @@ void SV_Frame( int msec ) {
 		svs.time += frameMsec;
 
 		// let everything in the world think and move
-		VM_Call( gvm, GAME_RUN_FRAME, svs.time );
+		VM_Call1( gvm, GAME_RUN_FRAME, svs.time );
 	}
 
 	if ( com_speeds->integer ) {
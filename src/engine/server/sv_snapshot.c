@@ -45,6 +45,194 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+SHARED DELTA CACHE
+
+Most clients see the same entities and delta from the same frame, so
+the same entity deltas get encoded over and over for every client.  The
+bits of each delta are kept for the frame and copied into the other
+messages that need them.
+
+=============================================================================
+*/
+
+#define	DELTA_CACHE_HASH		4096
+#define	DELTA_CACHE_ENTRIES		2048
+#define	DELTA_CACHE_BYTES		(256*1024)
+#define	DELTA_CACHE_MAXDELTA	512			// bigger than any entity delta
+
+typedef struct deltaCacheEntry_s {
+	entityState_t				from;
+	entityState_t				to;
+	qboolean					force;
+	int							bits;		// length of the encoded delta
+	int							offset;		// in data
+	struct deltaCacheEntry_s	*next;
+} deltaCacheEntry_t;
+
+typedef struct {
+	int					numEntries;
+	int					numBytes;
+	deltaCacheEntry_t	*hashTable[DELTA_CACHE_HASH];
+	deltaCacheEntry_t	entries[DELTA_CACHE_ENTRIES];
+	byte				data[DELTA_CACHE_BYTES];
+
+	int					hits;				// for deltacache
+	int					misses;
+	int					frames;
+} deltaCache_t;
+
+static deltaCache_t		deltaCache;
+static void				*deltaCacheLock;	// when snapshots are encoded by the workers
+
+/*
+=============
+SV_ClearDeltaCache
+
+The entity states change every frame, so start over
+=============
+*/
+static void SV_ClearDeltaCache( void ) {
+	if ( !deltaCache.numEntries ) {
+		return;
+	}
+	Com_Memset( deltaCache.hashTable, 0, sizeof( deltaCache.hashTable ) );
+	deltaCache.numEntries = 0;
+	deltaCache.numBytes = 0;
+	deltaCache.frames++;
+}
+
+/*
+=============
+SV_HashDelta
+=============
+*/
+static int SV_HashDelta( const entityState_t *from, const entityState_t *to, qboolean force ) {
+	const int		*f, *t;
+	unsigned int	hash;
+	int				i;
+
+	f = (const int *)from;
+	t = (const int *)to;
+	hash = force;
+	for ( i = 0 ; i < sizeof( *to ) / 4 ; i++ ) {
+		hash = ( hash * 31 + f[i] ) * 31 + t[i];
+	}
+	hash ^= hash >> 16;
+	return hash & ( DELTA_CACHE_HASH - 1 );
+}
+
+/*
+=============
+SV_WriteCachedDelta
+
+Same output as MSG_WriteDeltaEntity, from the cache when another
+client already needed the delta this frame
+=============
+*/
+static void SV_WriteCachedDelta( msg_t *msg, entityState_t *from, entityState_t *to, qboolean force ) {
+	deltaCacheEntry_t	*entry;
+	msg_t				delta;
+	byte				deltaBuf[DELTA_CACHE_MAXDELTA];
+	const byte			*bits;
+	int					numBits;
+	int					hash;
+
+	// removes are a couple of bits, and unchanged entities aren't sent at all
+	if ( !sv_deltaCache->integer || !to || ( !force && !memcmp( from, to, sizeof( *to ) ) ) ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	hash = SV_HashDelta( from, to, force );
+
+	if ( deltaCacheLock ) {
+		Sys_LockMutex( deltaCacheLock );
+	}
+	for ( entry = deltaCache.hashTable[hash] ; entry ; entry = entry->next ) {
+		if ( entry->force == force && !memcmp( &entry->to, to, sizeof( *to ) )
+			&& !memcmp( &entry->from, from, sizeof( *from ) ) ) {
+			break;
+		}
+	}
+	if ( entry ) {
+		deltaCache.hits++;
+	} else {
+		deltaCache.misses++;
+	}
+	if ( deltaCacheLock ) {
+		Sys_UnlockMutex( deltaCacheLock );
+	}
+
+	if ( entry ) {
+		// entries don't change once they are in the table
+		bits = deltaCache.data + entry->offset;
+		numBits = entry->bits;
+	} else {
+		// encode it once on its own, outside the lock
+		MSG_Init( &delta, deltaBuf, sizeof( deltaBuf ) );
+		MSG_Bitstream( &delta );
+		MSG_WriteDeltaEntity( &delta, from, to, force );
+		if ( delta.overflowed ) {
+			MSG_WriteDeltaEntity( msg, from, to, force );
+			return;
+		}
+		bits = deltaBuf;
+		numBits = delta.bit;
+
+		if ( deltaCacheLock ) {
+			Sys_LockMutex( deltaCacheLock );
+		}
+		if ( deltaCache.numEntries < DELTA_CACHE_ENTRIES
+			&& DELTA_CACHE_BYTES - deltaCache.numBytes >= DELTA_CACHE_MAXDELTA ) {
+			entry = &deltaCache.entries[deltaCache.numEntries++];
+			entry->from = *from;
+			entry->to = *to;
+			entry->force = force;
+			entry->bits = delta.bit;
+			entry->offset = deltaCache.numBytes;
+			Com_Memcpy( deltaCache.data + entry->offset, deltaBuf, ( delta.bit + 7 ) >> 3 );
+			deltaCache.numBytes += ( delta.bit + 7 ) >> 3;
+			entry->next = deltaCache.hashTable[hash];
+			deltaCache.hashTable[hash] = entry;
+		}
+		if ( deltaCacheLock ) {
+			Sys_UnlockMutex( deltaCacheLock );
+		}
+	}
+
+	// a message this close to full gets the exact overflow behavior
+	if ( msg->maxsize - msg->cursize < 4 + ( ( numBits + 7 ) >> 3 ) ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+	MSG_WriteBitStream( msg, bits, numBits );
+}
+
+/*
+=============
+SV_DeltaCache_f
+
+Reports how many entity deltas came from the cache since last asked
+=============
+*/
+void SV_DeltaCache_f( void ) {
+	int		total;
+
+	total = deltaCache.hits + deltaCache.misses;
+	Com_Printf( "%i deltas over %i frames, %i encoded, %i from the cache (%.1f%% hit rate)\n",
+		total, deltaCache.frames, deltaCache.misses, deltaCache.hits,
+		total ? 100.0f * deltaCache.hits / total : 0.0f );
+	if ( deltaCache.frames ) {
+		Com_Printf( "%.1f encoded deltas per frame\n", (float)deltaCache.misses / deltaCache.frames );
+	}
+	deltaCache.hits = 0;
+	deltaCache.misses = 0;
+	deltaCache.frames = 0;
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -88,7 +276,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			SV_WriteCachedDelta (msg, oldent, newent, qfalse );
 			oldindex++;
 			newindex++;
 			continue;
@@ -96,14 +284,14 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			SV_WriteCachedDelta (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
 			newindex++;
 			continue;
 		}
 
 		if ( newnum > oldnum ) {
 			// the old entity isn't present in the new message
-			MSG_WriteDeltaEntity (msg, oldent, NULL, qtrue );
+			SV_WriteCachedDelta (msg, oldent, NULL, qtrue );
 			oldindex++;
 			continue;
 		}
@@ -116,41 +304,54 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_DeltaFrame
+
+Picks the previous frame to delta compress the snapshot from, once
+this frame's snapshot entities have all been allocated
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+static clientSnapshot_t *SV_DeltaFrame( client_t *client, int *lastframe ) {
+	clientSnapshot_t	*oldframe;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
-		oldframe = NULL;
-		lastframe = 0;
-	} else if ( client->netchan.outgoingSequence - client->deltaMessage 
+		*lastframe = 0;
+		return NULL;
+	}
+	if ( client->netchan.outgoingSequence - client->deltaMessage 
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
-		oldframe = NULL;
-		lastframe = 0;
-	} else {
-		// we have a valid snapshot to delta from
-		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = 0;
+		return NULL;
+	}
 
-		// the snapshot's entities may still have rolled off the buffer, though
-		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
-			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
-			oldframe = NULL;
-			lastframe = 0;
-		}
+	// we have a valid snapshot to delta from
+	oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
+	*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+
+	// the snapshot's entities may still have rolled off the buffer, though
+	if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
+		Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
+		*lastframe = 0;
+		return NULL;
 	}
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg, clientSnapshot_t *oldframe, int lastframe ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	MSG_WriteByte (msg, svc_snapshot);
 
@@ -229,8 +430,14 @@ Build a client snapshot structure
 typedef struct {
 	int		numSnapshotEntities;
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];	
+	byte	added[MAX_GENTITIES/8];		// used to prevent double adding from portal views
+	qboolean	fullScan;				// check every entity, for snapshotdiff
+	const char	*error;					// for the main thread to drop with
 } snapshotEntityNumbers_t;
 
+// linked entities that aren't found through the cluster lists
+static unsigned int		sv_alwaysCheck[MAX_GENTITIES/32];
+
 /*
 =======================
 SV_QsortEntityNumbers
@@ -259,27 +466,65 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( int entityNum, snapshotEntityNumbers_t *eNums ) {
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( eNums->added[entityNum >> 3] & ( 1 << ( entityNum & 7 ) ) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[entityNum >> 3] |= 1 << ( entityNum & 7 );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
 		return;
 	}
 
-	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = gEnt->s.number;
+	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = entityNum;
 	eNums->numSnapshotEntities++;
 }
 
 /*
 ===============
+SV_SnapshotCandidates
+
+Marks the entities in the clusters set in the pvs, which together with
+sv_alwaysCheck are all the entities that can pass the tests in
 SV_AddEntitiesVisibleFromPoint
 ===============
 */
+static void SV_SnapshotCandidates( const byte *pvs, unsigned int *candidates, qboolean fullScan ) {
+	clusterLink_t	*head, *link;
+	int				i, cluster;
+
+	if ( fullScan ) {
+		Com_Memset( candidates, 0xff, sizeof( sv_alwaysCheck ) );
+		return;
+	}
+
+	Com_Memcpy( candidates, sv_alwaysCheck, sizeof( sv_alwaysCheck ) );
+	for ( i = 0 ; i < ( sv.numClusters + 7 ) >> 3 ; i++ ) {
+		if ( !pvs[i] ) {
+			continue;
+		}
+		for ( cluster = i << 3 ; cluster < ( i << 3 ) + 8 && cluster < sv.numClusters ; cluster++ ) {
+			if ( !( pvs[i] & ( 1 << ( cluster & 7 ) ) ) ) {
+				continue;
+			}
+			head = &sv.clusterEntities[cluster];
+			for ( link = head->next ; link != head ; link = link->next ) {
+				candidates[link->entityNum >> 5] |= 1u << ( link->entityNum & 31 );
+			}
+		}
+	}
+}
+
+/*
+===============
+SV_AddEntitiesVisibleFromPoint
+
+Only reads the world and the game entities, so the snapshots of
+several clients can be built at once
+===============
+*/
 static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
 									snapshotEntityNumbers_t *eNums, qboolean portal ) {
 	int		e, i;
@@ -291,6 +536,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	int		c_fullsend;
 	byte	*clientpvs;
 	byte	*bitvector;
+	unsigned int	candidates[MAX_GENTITIES/32];
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -308,9 +554,20 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 
 	clientpvs = CM_ClusterPVS (clientcluster);
 
+	SV_SnapshotCandidates( clientpvs, candidates, eNums->fullScan );
+
 	c_fullsend = 0;
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		// skip what can't be seen from here, 32 at a time when possible
+		if ( !candidates[e >> 5] ) {
+			e |= 31;
+			continue;
+		}
+		if ( !( candidates[e >> 5] & ( 1u << ( e & 31 ) ) ) ) {
+			continue;
+		}
+
 		ent = SV_GentityNum(e);
 
 		// never send entities that aren't linked in
@@ -318,11 +575,6 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			continue;
 		}
 
-		if (ent->s.number != e) {
-			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
-		}
-
 		// entities can be flagged to explicitly not be sent to the client
 		if ( ent->r.svFlags & SVF_NOCLIENT ) {
 			continue;
@@ -342,8 +594,10 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		}
 		// entities can be flagged to be sent to a given mask of clients
 		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: cientNum > 32\n" );
+			if (frame->ps.clientNum >= 32) {
+				eNums->error = "SVF_CLIENTMASK: cientNum > 32\n";
+				continue;
+			}
 			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
 				continue;
 		}
@@ -351,13 +605,13 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		svEnt = SV_SvEntityForGentity( ent );
 
 		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+		if ( eNums->added[e >> 3] & ( 1 << ( e & 7 ) ) ) {
 			continue;
 		}
 
 		// broadcast entities are always sent
 		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+			SV_AddEntToSnapshot( e, eNums );
 			continue;
 		}
 
@@ -403,7 +657,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		}
 
 		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+		SV_AddEntToSnapshot( e, eNums );
 
 		// if its a portal entity, add everything visible from its camera position
 		if ( ent->r.svFlags & SVF_PORTAL ) {
@@ -420,39 +674,70 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	}
 }
 
+/*
+=============
+SV_ScanEntities
+
+Done once before any snapshots are built, so the visibility checks
+never write to the game entities.  Also finds the entities every
+snapshot has to look at whatever clusters it can see: the game can
+change the flags without relinking, and entities touching too many
+clusters aren't in the cluster lists past the first ones.
+=============
+*/
+static void SV_ScanEntities( void ) {
+	sharedEntity_t	*ent;
+	svEntity_t		*svEnt;
+	int				e;
+
+	Com_Memset( sv_alwaysCheck, 0, sizeof( sv_alwaysCheck ) );
+	if ( !sv.state ) {
+		return;
+	}
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum(e);
+		if ( !ent->r.linked ) {
+			continue;
+		}
+		if ( ent->s.number != e ) {
+			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+		svEnt = &sv.svEntities[e];
+		if ( ( ent->r.svFlags & ( SVF_BROADCAST | SVF_CLIENTMASK ) ) || svEnt->lastCluster ) {
+			sv_alwaysCheck[e >> 5] |= 1u << ( e & 31 );
+		}
+	}
+}
+
 /*
 =============
 SV_BuildClientSnapshot
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstate and areabits.
+copies off the playerstate and areabits.  The entity states are copied
+by SV_CopySnapshotEntities once SV_AllocateSnapshotEntities has given
+them a place.
 
 This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than client->gentity
+
+Returns qfalse if the client has nothing to see yet
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static qboolean SV_BuildClientSnapshot( client_t *client, clientSnapshot_t *frame, snapshotEntityNumbers_t *entityNumbers ) {
 	vec3_t						org;
-	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	int							clientNum;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
-	// this is the frame we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
-
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	entityNumbers->numSnapshotEntities = 0;
+	entityNumbers->error = NULL;
+	Com_Memset( entityNumbers->added, 0, sizeof( entityNumbers->added ) );
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
   // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
@@ -460,7 +745,7 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	
 	clent = client->gentity;
 	if ( !clent || client->state == CS_ZOMBIE ) {
-		return;
+		return qfalse;
 	}
 
 	// grab the current playerState_t
@@ -471,11 +756,10 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		entityNumbers->error = "SV_SvEntityForGentity: bad gEnt";
+		return qfalse;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
-
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	entityNumbers->added[clientNum >> 3] |= 1 << ( clientNum & 7 );
 
 	// find the client's viewpoint
 	VectorCopy( ps->origin, org );
@@ -483,34 +767,60 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesVisibleFromPoint( org, frame, entityNumbers, qfalse );
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
-	// to work correctly.  This also catches the error condition
-	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities, 
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	// to work correctly.
+	qsort( entityNumbers->snapshotEntities, entityNumbers->numSnapshotEntities, 
+		sizeof( entityNumbers->snapshotEntities[0] ), SV_QsortEntityNumbers );
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
 	for ( i = 0 ; i < MAX_MAP_AREA_BYTES/4 ; i++ ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
+	return qtrue;
+}
 
-	// copy the entity states out
-	frame->num_entities = 0;
+/*
+=============
+SV_AllocateSnapshotEntities
+
+Runs on the main thread in client order, so the snapshot entities are
+laid out the same however the snapshots were built
+=============
+*/
+static void SV_AllocateSnapshotEntities( client_t *client, snapshotEntityNumbers_t *entityNumbers ) {
+	clientSnapshot_t	*frame;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
-		}
-		frame->num_entities++;
+	frame->num_entities = entityNumbers->numSnapshotEntities;
+	svs.nextSnapshotEntities += entityNumbers->numSnapshotEntities;
+	// this should never hit, map should always be restarted first in SV_Frame
+	if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
+		Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
+	}
+}
+
+/*
+=============
+SV_CopySnapshotEntities
+
+Copies the entity states out.  Entities allocated this frame are newer
+than any frame SV_DeltaFrame will accept, so this never writes over
+states another client is delta compressing from.
+=============
+*/
+static void SV_CopySnapshotEntities( client_t *client, snapshotEntityNumbers_t *entityNumbers ) {
+	clientSnapshot_t	*frame;
+	int					i;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		svs.snapshotEntities[(frame->first_entity+i) % svs.numSnapshotEntities] =
+			SV_GentityNum(entityNumbers->snapshotEntities[i])->s;
 	}
 }
 
@@ -556,6 +866,10 @@ Called by SV_SendClientSnapshot and SV_SendClientGameState
 void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 	int			rateMsec;
 
+	if ( msg->warning ) {
+		Com_Printf( "%s", msg->warning );
+	}
+
 	// record information about the message
 	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSize = msg->cursize;
 	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSent = svs.time;
@@ -599,51 +913,351 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 }
 
 
+/*
+=============
+SV_SnapshotDiff_f
+
+Finds every client's entities through the cluster lists and by checking
+every entity, and reports any snapshot where they differ
+=============
+*/
+void SV_SnapshotDiff_f( void ) {
+	static snapshotEntityNumbers_t	indexed, full;
+	clientSnapshot_t	frame;
+	client_t			*cl;
+	int					i, compared, different;
+	int					start, indexedUsec, fullUsec;
+
+	// make sure server is running
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	SV_ScanEntities();
+
+	compared = different = 0;
+	indexedUsec = fullUsec = 0;
+	indexed.fullScan = qfalse;
+	full.fullScan = qtrue;
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state < CS_CONNECTED ) {
+			continue;
+		}
+
+		start = Sys_Microseconds();
+		if ( !SV_BuildClientSnapshot( cl, &frame, &indexed ) ) {
+			continue;
+		}
+		indexedUsec += Sys_Microseconds() - start;
+
+		start = Sys_Microseconds();
+		SV_BuildClientSnapshot( cl, &frame, &full );
+		fullUsec += Sys_Microseconds() - start;
+
+		compared++;
+		if ( indexed.numSnapshotEntities != full.numSnapshotEntities
+			|| memcmp( indexed.snapshotEntities, full.snapshotEntities,
+			indexed.numSnapshotEntities * sizeof( indexed.snapshotEntities[0] ) ) ) {
+			Com_Printf( "%s: %i entities through the clusters, %i checking all of them\n",
+				cl->name, indexed.numSnapshotEntities, full.numSnapshotEntities );
+			different++;
+		}
+	}
+
+	Com_Printf( "%i snapshots compared, %i different\n", compared, different );
+	Com_Printf( "%i usec through the clusters, %i usec checking every entity\n", indexedUsec, fullUsec );
+}
+
+
+/*
+=============================================================================
+
+SNAPSHOT JOBS
+
+Building and encoding a snapshot only reads the world, the game
+entities and the client's own state, so the clients are spread over
+worker threads in two passes.  Everything that has to happen in order
+or touches shared state (allocating snapshot entities, the filesystem
+for downloads, printing, and the netchan) stays on the main thread.
+
+=============================================================================
+*/
+
+#define	MAX_SNAPSHOT_THREADS	8
+
+typedef enum {
+	SNAPSHOT_BUILD,			// SV_BuildClientSnapshot
+	SNAPSHOT_ENCODE			// copy the entities and write the message
+} snapshotPass_t;
+
+typedef struct {
+	client_t				*client;
+	qboolean				fragment;		// only sending the rest of the last message
+	qboolean				built;
+	snapshotEntityNumbers_t	entityNumbers;
+	clientSnapshot_t		*oldframe;
+	int						lastframe;
+	msg_t					msg;
+	byte					msgBuf[MAX_MSGLEN];
+} snapshotJob_t;
+
+static snapshotJob_t	*sv_snapshotJobs;
+static int				sv_maxSnapshotJobs;
+static int				sv_numSnapshotJobs;
+
+static int				sv_snapshotWorkers;
+static void				*sv_snapshotLock;
+static void				*sv_snapshotWork;
+static void				*sv_snapshotDone;
+static snapshotPass_t	sv_snapshotPass;
+static int				sv_nextSnapshotJob;
+
 /*
 =======================
-SV_SendClientSnapshot
+SV_IsBot
 
-Also called by SV_FinalMessage
+bots need to have their snapshots build, but
+the query them directly without needing to be sent
+=======================
+*/
+static qboolean SV_IsBot( client_t *client ) {
+	return (qboolean)( client->gentity && client->gentity->r.svFlags & SVF_BOT );
+}
 
+/*
+=======================
+SV_EncodeClientSnapshot
 =======================
 */
-void SV_SendClientSnapshot( client_t *client ) {
-	byte		msg_buf[MAX_MSGLEN];
-	msg_t		msg;
+static void SV_EncodeClientSnapshot( snapshotJob_t *job ) {
+	client_t	*client = job->client;
 
-	// build the snapshot
-	SV_BuildClientSnapshot( client );
+	// a client with nothing to see got no snapshot entities
+	if ( job->built ) {
+		SV_CopySnapshotEntities( client, &job->entityNumbers );
+	}
 
-	// bots need to have their snapshots build, but
-	// the query them directly without needing to be sent
-	if ( client->gentity && client->gentity->r.svFlags & SVF_BOT ) {
+	if ( SV_IsBot( client ) ) {
 		return;
 	}
 
-	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
-	msg.allowoverflow = qtrue;
+	MSG_Init (&job->msg, job->msgBuf, sizeof(job->msgBuf));
+	job->msg.allowoverflow = qtrue;
 
 	// NOTE, MRE: all server->client messages now acknowledge
 	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	MSG_WriteLong( &job->msg, client->lastClientCommand );
 
 	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	SV_UpdateServerCommandsToClient( client, &job->msg );
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	SV_WriteSnapshotToClient( client, &job->msg, job->oldframe, job->lastframe );
+}
+
+/*
+=======================
+SV_FinishClientSnapshot
+
+Adds what has to be done on the main thread and sends the message
+=======================
+*/
+static void SV_FinishClientSnapshot( snapshotJob_t *job ) {
+	client_t	*client = job->client;
+
+	if ( SV_IsBot( client ) ) {
+		return;
+	}
 
 	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient( client, &msg );
+	SV_WriteDownloadToClient( client, &job->msg );
 
 	// check for overflow
-	if ( msg.overflowed ) {
+	if ( job->msg.overflowed ) {
 		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+		MSG_Clear (&job->msg);
+	}
+
+	SV_SendMessageToClient( &job->msg, client );
+}
+
+/*
+=======================
+SV_RunSnapshotJob
+=======================
+*/
+static void SV_RunSnapshotJob( snapshotJob_t *job, snapshotPass_t pass ) {
+	if ( pass == SNAPSHOT_BUILD ) {
+		job->built = SV_BuildClientSnapshot( job->client,
+			&job->client->frames[ job->client->netchan.outgoingSequence & PACKET_MASK ], &job->entityNumbers );
+	} else {
+		SV_EncodeClientSnapshot( job );
+	}
+}
+
+/*
+=======================
+SV_RunSnapshotJobs
+
+Takes jobs until the pass is done, on the workers and the main thread
+=======================
+*/
+static void SV_RunSnapshotJobs( void ) {
+	snapshotJob_t	*job;
+	int				i;
+
+	while ( 1 ) {
+		Sys_LockMutex( sv_snapshotLock );
+		i = sv_nextSnapshotJob++;
+		Sys_UnlockMutex( sv_snapshotLock );
+
+		if ( i >= sv_numSnapshotJobs ) {
+			return;
+		}
+		job = &sv_snapshotJobs[i];
+		if ( job->fragment ) {
+			continue;
+		}
+		SV_RunSnapshotJob( job, sv_snapshotPass );
 	}
+}
 
-	SV_SendMessageToClient( &msg, client );
+/*
+=======================
+SV_SnapshotWorker
+=======================
+*/
+static void SV_SnapshotWorker( void *data ) {
+	while ( 1 ) {
+		Sys_WaitSemaphore( sv_snapshotWork );
+		SV_RunSnapshotJobs();
+		Sys_SignalSemaphore( sv_snapshotDone );
+	}
+}
+
+/*
+=======================
+SV_StartSnapshotWorkers
+
+Threads are started as sv_snapshotThreads asks for them, and are kept
+when it is lowered again
+=======================
+*/
+static int SV_StartSnapshotWorkers( void ) {
+	int		count;
+
+	count = sv_snapshotThreads->integer;
+	if ( count > (int)Sys_ProcessorCount() - 1 ) {
+		count = Sys_ProcessorCount() - 1;
+	}
+	if ( count > MAX_SNAPSHOT_THREADS ) {
+		count = MAX_SNAPSHOT_THREADS;
+	}
+	if ( count <= 0 ) {
+		return 0;
+	}
+
+	if ( !sv_snapshotLock ) {
+		sv_snapshotLock = Sys_CreateMutex();
+		sv_snapshotWork = Sys_CreateSemaphore();
+		sv_snapshotDone = Sys_CreateSemaphore();
+		deltaCacheLock = Sys_CreateMutex();
+	}
+	while ( sv_snapshotWorkers < count ) {
+		if ( !Sys_CreateThread( SV_SnapshotWorker, NULL ) ) {
+			break;
+		}
+		sv_snapshotWorkers++;
+	}
+	return sv_snapshotWorkers < count ? sv_snapshotWorkers : count;
+}
+
+/*
+=======================
+SV_RunSnapshotPass
+=======================
+*/
+static void SV_RunSnapshotPass( snapshotPass_t pass, int workers ) {
+	int		i;
+
+	if ( workers > sv_numSnapshotJobs - 1 ) {
+		workers = sv_numSnapshotJobs - 1;
+	}
+
+	if ( workers <= 0 ) {
+		for ( i = 0 ; i < sv_numSnapshotJobs ; i++ ) {
+			if ( !sv_snapshotJobs[i].fragment ) {
+				SV_RunSnapshotJob( &sv_snapshotJobs[i], pass );
+			}
+		}
+		return;
+	}
+
+	sv_snapshotPass = pass;
+	sv_nextSnapshotJob = 0;
+	for ( i = 0 ; i < workers ; i++ ) {
+		Sys_SignalSemaphore( sv_snapshotWork );
+	}
+	SV_RunSnapshotJobs();
+	for ( i = 0 ; i < workers ; i++ ) {
+		Sys_WaitSemaphore( sv_snapshotDone );
+	}
+}
+
+/*
+=======================
+SV_PrepareSnapshots
+
+Main thread work between building the snapshots and encoding them
+=======================
+*/
+static void SV_PrepareSnapshots( snapshotJob_t *jobs, int numJobs ) {
+	int		i;
+
+	for ( i = 0 ; i < numJobs ; i++ ) {
+		if ( !jobs[i].fragment && jobs[i].entityNumbers.error ) {
+			Com_Error( ERR_DROP, "%s", jobs[i].entityNumbers.error );
+		}
+	}
+
+	for ( i = 0 ; i < numJobs ; i++ ) {
+		if ( !jobs[i].fragment && jobs[i].built ) {
+			SV_AllocateSnapshotEntities( jobs[i].client, &jobs[i].entityNumbers );
+		}
+	}
+
+	// now the oldest snapshot entities that are still valid are known
+	for ( i = 0 ; i < numJobs ; i++ ) {
+		if ( !jobs[i].fragment && !SV_IsBot( jobs[i].client ) ) {
+			jobs[i].oldframe = SV_DeltaFrame( jobs[i].client, &jobs[i].lastframe );
+		}
+	}
+}
+
+
+/*
+=======================
+SV_SendClientSnapshot
+
+Also called by SV_FinalMessage
+
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	snapshotJob_t	job;
+
+	SV_ScanEntities();
+
+	job.client = client;
+	job.fragment = qfalse;
+	job.entityNumbers.fullScan = qfalse;
+	job.built = SV_BuildClientSnapshot( client,
+		&client->frames[ client->netchan.outgoingSequence & PACKET_MASK ], &job.entityNumbers );
+	SV_PrepareSnapshots( &job, 1 );
+	SV_EncodeClientSnapshot( &job );
+	SV_FinishClientSnapshot( &job );
 }
 
 
@@ -653,10 +1267,21 @@ SV_SendClientMessages
 =======================
 */
 void SV_SendClientMessages( void ) {
-	int			i;
-	client_t	*c;
+	int				i;
+	client_t		*c;
+	snapshotJob_t	*job;
+	int				workers;
+
+	if ( sv_maxSnapshotJobs < sv_maxclients->integer ) {
+		if ( sv_snapshotJobs ) {
+			Z_Free( sv_snapshotJobs );
+		}
+		sv_maxSnapshotJobs = sv_maxclients->integer;
+		sv_snapshotJobs = (snapshotJob_t *) Z_Malloc( sv_maxSnapshotJobs * sizeof( *sv_snapshotJobs ) );
+	}
 
-	// send a message to each connected client
+	// find the clients that get a message this frame
+	sv_numSnapshotJobs = 0;
 	for (i=0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++) {
 		if (!c->state) {
 			continue;		// not connected
@@ -666,17 +1291,38 @@ void SV_SendClientMessages( void ) {
 			continue;		// not time yet
 		}
 
+		job = &sv_snapshotJobs[sv_numSnapshotJobs++];
+		job->client = c;
+		job->built = qfalse;
+		job->entityNumbers.fullScan = qfalse;
+		job->entityNumbers.error = NULL;
+
 		// send additional message fragments if the last message
 		// was too large to send at once
-		if ( c->netchan.unsentFragments ) {
+		job->fragment = (qboolean)( c->netchan.unsentFragments != 0 );
+	}
+	if ( !sv_numSnapshotJobs ) {
+		return;
+	}
+
+	SV_ClearDeltaCache();
+	SV_ScanEntities();
+
+	workers = SV_StartSnapshotWorkers();
+	SV_RunSnapshotPass( SNAPSHOT_BUILD, workers );
+	SV_PrepareSnapshots( sv_snapshotJobs, sv_numSnapshotJobs );
+	SV_RunSnapshotPass( SNAPSHOT_ENCODE, workers );
+
+	// the datagrams go out in client order
+	for ( i = 0 ; i < sv_numSnapshotJobs ; i++ ) {
+		job = &sv_snapshotJobs[i];
+		c = job->client;
+		if ( job->fragment ) {
 			c->nextSnapshotTime = svs.time + 
 				SV_RateMsec( c, c->netchan.unsentLength - c->netchan.unsentFragmentStart );
 			SV_Netchan_TransmitNextFragment( c );
 			continue;
 		}
-
-		// generate and send a new message
-		SV_SendClientSnapshot( c );
+		SV_FinishClientSnapshot( job );
 	}
 }
-
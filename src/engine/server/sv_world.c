@@ -147,10 +147,22 @@ SV_ClearWorld
 void SV_ClearWorld( void ) {
 	clipHandle_t	h;
 	vec3_t			mins, maxs;
+	int				i;
 
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
 
+	// recorded traces only make sense on the map they came from
+	SV_StopTraceRecord();
+
+	// empty cluster lists for the snapshots
+	sv.numClusters = CM_NumClusters();
+	sv.clusterEntities = (clusterLink_t *) Hunk_Alloc( ( sv.numClusters + 1 ) * sizeof( clusterLink_t ), h_high );
+	for ( i = 0 ; i < sv.numClusters ; i++ ) {
+		sv.clusterEntities[i].prev = sv.clusterEntities[i].next = &sv.clusterEntities[i];
+		sv.clusterEntities[i].entityNum = -1;
+	}
+
 	// get world map bounds
 	h = CM_InlineModel( 0 );
 	CM_ModelBounds( h, mins, maxs );
@@ -158,6 +170,57 @@ void SV_ClearWorld( void ) {
 }
 
 
+/*
+===============
+SV_LinkEntityClusters
+
+Puts the entity in the list of each cluster it touches, so a snapshot
+only has to look at the entities in the clusters its client can see
+===============
+*/
+static void SV_LinkEntityClusters( svEntity_t *ent ) {
+	clusterLink_t	*link, *head;
+	int				i, j;
+
+	ent->numClusterLinks = 0;
+	for ( i = 0 ; i < ent->numClusters ; i++ ) {
+		// several leafs can be in the same cluster
+		for ( j = 0 ; j < i ; j++ ) {
+			if ( ent->clusternums[j] == ent->clusternums[i] ) {
+				break;
+			}
+		}
+		if ( j != i || ent->clusternums[i] < 0 || ent->clusternums[i] >= sv.numClusters ) {
+			continue;
+		}
+
+		head = &sv.clusterEntities[ent->clusternums[i]];
+		link = &ent->clusterLinks[ent->numClusterLinks++];
+		link->entityNum = ent - sv.svEntities;
+		link->prev = head;
+		link->next = head->next;
+		head->next->prev = link;
+		head->next = link;
+	}
+}
+
+/*
+===============
+SV_UnlinkEntityClusters
+===============
+*/
+static void SV_UnlinkEntityClusters( svEntity_t *ent ) {
+	clusterLink_t	*link;
+	int				i;
+
+	for ( i = 0 ; i < ent->numClusterLinks ; i++ ) {
+		link = &ent->clusterLinks[i];
+		link->prev->next = link->next;
+		link->next->prev = link->prev;
+	}
+	ent->numClusterLinks = 0;
+}
+
 /*
 ===============
 SV_UnlinkEntity
@@ -173,6 +236,8 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linked = qfalse;
 
+	SV_UnlinkEntityClusters( ent );
+
 	ws = ent->worldSector;
 	if ( !ws ) {
 		return;		// not linked in anywhere
@@ -352,6 +417,8 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	ent->nextEntityInWorldSector = node->entities;
 	node->entities = ent;
 
+	SV_LinkEntityClusters( ent );
+
 	gEnt->r.linked = qtrue;
 }
 
@@ -594,35 +661,79 @@ void SV_ClipMoveToEntities( moveclip_t *clip ) {
 }
 
 
+/*
+===============================================================================
+
+TRACE RECORDING
+
+Every trace the server does can be written to a file, so the batched
+traces can be measured against the traces of a real match
+
+===============================================================================
+*/
+
+#define	TRACE_RECORD_IDENT		(('R'<<24)+('C'<<16)+('R'<<8)+'T')
+#define	TRACE_RECORD_VERSION	1
+
+typedef struct {
+	int			ident;
+	int			version;
+} traceRecordHeader_t;
+
+static fileHandle_t	sv_traceRecord;
+
 /*
 ==================
-SV_Trace
+SV_RecordTrace
+==================
+*/
+static void SV_RecordTrace( const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	traceQuery_t	query;
+
+	VectorCopy( start, query.start );
+	VectorCopy( mins, query.mins );
+	VectorCopy( maxs, query.maxs );
+	VectorCopy( end, query.end );
+	query.passEntityNum = passEntityNum;
+	query.contentmask = contentmask;
+	query.capsule = capsule;
+
+	FS_Write( &query, sizeof( query ), sv_traceRecord );
+}
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+/*
+==================
+SV_StopTraceRecord
 ==================
 */
-void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+void SV_StopTraceRecord( void ) {
+	if ( !sv_traceRecord ) {
+		return;
+	}
+	FS_FCloseFile( sv_traceRecord );
+	sv_traceRecord = 0;
+	Com_Printf( "Stopped recording traces.\n" );
+}
+
+/*
+==================
+SV_ClipTraceToEntities
+
+Finishes a trace that has already been clipped to the world
+==================
+*/
+static void SV_ClipTraceToEntities( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
 	moveclip_t	clip;
 	int			i;
 
-	if ( !mins ) {
-		mins = vec3_origin;
-	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
+	results->entityNum = results->fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+	if ( results->fraction == 0 ) {
+		return;		// blocked immediately by the world
 	}
 
 	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
 
-	// clip to world
-	CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
-	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-	if ( clip.trace.fraction == 0 ) {
-		*results = clip.trace;
-		return;		// blocked immediately by the world
-	}
-
+	clip.trace = *results;
 	clip.contentmask = contentmask;
 	clip.start = start;
 //	VectorCopy( clip.trace.endpos, clip.end );
@@ -652,7 +763,66 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	*results = clip.trace;
 }
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	if ( sv_traceRecord ) {
+		SV_RecordTrace( start, mins, maxs, end, passEntityNum, contentmask, capsule );
+	}
+
+	// clip to world
+	CM_BoxTrace( results, start, end, mins, maxs, 0, contentmask, capsule );
+
+	SV_ClipTraceToEntities( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+}
+
+/*
+==================
+SV_TraceBatch
 
+The same as calling SV_Trace for every query.  The world part of the
+traces is spread over up to threads threads, the entities are clipped
+on this one.
+==================
+*/
+void SV_TraceBatch( trace_t *results, const traceQuery_t *queries, int count, int threads ) {
+	const traceQuery_t	*query;
+	int					i;
+
+	if ( threads > Sys_ProcessorCount() ) {
+		threads = Sys_ProcessorCount();
+	}
+
+	if ( sv_traceRecord ) {
+		for ( i = 0 ; i < count ; i++ ) {
+			query = &queries[i];
+			SV_RecordTrace( query->start, query->mins, query->maxs, query->end,
+				query->passEntityNum, query->contentmask, query->capsule );
+		}
+	}
+
+	// clip to world
+	CM_BoxTraceBatch( results, queries, count, threads );
+
+	for ( i = 0 ; i < count ; i++ ) {
+		query = &queries[i];
+		SV_ClipTraceToEntities( &results[i], query->start, query->mins, query->maxs, query->end,
+			query->passEntityNum, query->contentmask, query->capsule );
+	}
+}
 
 /*
 =============
@@ -693,4 +863,172 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 	return contents;
 }
 
+/*
+==================
+SV_TraceRecord_f
+
+tracerecord <file> starts writing every trace to the file,
+tracerecord without a file stops
+==================
+*/
+void SV_TraceRecord_f( void ) {
+	traceRecordHeader_t	header;
+	char				name[MAX_QPATH];
+
+	if ( Cmd_Argc() < 2 ) {
+		if ( !sv_traceRecord ) {
+			Com_Printf( "Usage: tracerecord <file>\n" );
+		}
+		SV_StopTraceRecord();
+		return;
+	}
+
+	// make sure server is running
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	SV_StopTraceRecord();
+
+	Q_strncpyz( name, Cmd_Argv( 1 ), sizeof( name ) );
+	COM_DefaultExtension( name, sizeof( name ), ".trc" );
+
+	sv_traceRecord = FS_FOpenFileWrite( name );
+	if ( !sv_traceRecord ) {
+		Com_Printf( "Couldn't open %s for writing.\n", name );
+		return;
+	}
+
+	header.ident = TRACE_RECORD_IDENT;
+	header.version = TRACE_RECORD_VERSION;
+	FS_Write( &header, sizeof( header ), sv_traceRecord );
+
+	Com_Printf( "Recording traces to %s.\n", name );
+}
+
+/*
+==================
+SV_TraceBench_f
 
+Replays recorded traces one at a time and batched, against the current
+state of the world, and checks that both give the same results
+==================
+*/
+void SV_TraceBench_f( void ) {
+	traceRecordHeader_t	*header;
+	traceQuery_t		*queries, *query;
+	trace_t				*serial, *batched;
+	char				name[MAX_QPATH];
+	int					length, count;
+	int					threads, passes;
+	int					i, pass, start, usec;
+	int					best[3], mismatches[2];
+
+	// make sure server is running
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "Usage: tracebench <file> [threads] [passes]\n" );
+		return;
+	}
+
+	if ( sv_traceRecord ) {
+		Com_Printf( "Stop recording traces first.\n" );
+		return;
+	}
+
+	threads = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : sv_traceThreads->integer;
+	if ( threads > Sys_ProcessorCount() ) {
+		threads = Sys_ProcessorCount();
+	}
+	if ( threads < 1 ) {
+		threads = 1;
+	}
+	passes = Cmd_Argc() > 3 ? atoi( Cmd_Argv( 3 ) ) : 4;
+	if ( passes < 1 ) {
+		passes = 1;
+	}
+
+	Q_strncpyz( name, Cmd_Argv( 1 ), sizeof( name ) );
+	COM_DefaultExtension( name, sizeof( name ), ".trc" );
+
+	length = FS_ReadFile( name, (void **)&header );
+	if ( !header ) {
+		Com_Printf( "Couldn't read %s.\n", name );
+		return;
+	}
+	if ( length < (int)sizeof( *header ) || header->ident != TRACE_RECORD_IDENT
+		|| header->version != TRACE_RECORD_VERSION ) {
+		Com_Printf( "%s is not a trace recording.\n", name );
+		FS_FreeFile( header );
+		return;
+	}
+
+	queries = (traceQuery_t *)( header + 1 );
+	count = ( length - sizeof( *header ) ) / sizeof( *queries );
+	if ( !count ) {
+		Com_Printf( "%s has no traces.\n", name );
+		FS_FreeFile( header );
+		return;
+	}
+
+	serial = (trace_t *) Z_Malloc( count * sizeof( *serial ) );
+	batched = (trace_t *) Z_Malloc( count * sizeof( *batched ) );
+
+	best[0] = best[1] = best[2] = 0x7fffffff;
+	mismatches[0] = mismatches[1] = 0;
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		start = Sys_Microseconds();
+		for ( i = 0, query = queries ; i < count ; i++, query++ ) {
+			SV_Trace( &serial[i], query->start, query->mins, query->maxs, query->end,
+				query->passEntityNum, query->contentmask, query->capsule );
+		}
+		usec = Sys_Microseconds() - start;
+		if ( usec < best[0] ) {
+			best[0] = usec;
+		}
+
+		start = Sys_Microseconds();
+		SV_TraceBatch( batched, queries, count, 1 );
+		usec = Sys_Microseconds() - start;
+		if ( usec < best[1] ) {
+			best[1] = usec;
+		}
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( memcmp( &serial[i], &batched[i], sizeof( trace_t ) ) ) {
+				mismatches[0]++;
+			}
+		}
+
+		start = Sys_Microseconds();
+		SV_TraceBatch( batched, queries, count, threads );
+		usec = Sys_Microseconds() - start;
+		if ( usec < best[2] ) {
+			best[2] = usec;
+		}
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( memcmp( &serial[i], &batched[i], sizeof( trace_t ) ) ) {
+				mismatches[1]++;
+			}
+		}
+	}
+
+	Com_Printf( "%i traces, best of %i passes\n", count, passes );
+	Com_Printf( "one at a time: %8.3f usec per trace\n", (float)best[0] / count );
+	Com_Printf( "batched:       %8.3f usec per trace\n", (float)best[1] / count );
+	Com_Printf( "batched, %i threads: %8.3f usec per trace\n", threads, (float)best[2] / count );
+	if ( mismatches[0] || mismatches[1] ) {
+		Com_Printf( S_COLOR_RED "%i batched and %i threaded results differ from the single traces\n",
+			mismatches[0], mismatches[1] );
+	} else {
+		Com_Printf( "all batched results match the single traces\n" );
+	}
+
+	Z_Free( serial );
+	Z_Free( batched );
+	FS_FreeFile( header );
+}
@@ -427,6 +427,8 @@ typedef struct botlib_export_s
 	int (*BotLibUpdateEntity)(int ent, bot_entitystate_t *state);
 	//just for testing
 	int (*Test)(int parm0, char *parm1, vec3_t parm2, vec3_t parm3);
+	//bytes and number of blocks the library has allocated
+	void (*MemoryStats)(int *allocated, int *blocks);
 } botlib_export_t;
 
 //linking of bot library
@@ -229,6 +229,8 @@ typedef enum {
 	// 1.32
 	G_FS_SEEK,
 
+	G_TRACE_BATCH,	// ( trace_t *results, const traceQuery_t *queries, int count );
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
@@ -154,6 +154,10 @@ void trap_TraceCapsule( trace_t *results, const vec3_t start, const vec3_t mins,
 	syscall( G_TRACECAPSULE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
+void trap_TraceBatch( trace_t *results, const traceQuery_t *queries, int count ) {
+	syscall( G_TRACE_BATCH, results, queries, count );
+}
+
 int trap_PointContents( const vec3_t point, int passEntityNum ) {
 	return syscall( G_POINT_CONTENTS, point, passEntityNum );
 }
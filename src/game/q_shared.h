@@ -123,6 +123,13 @@ typedef int intptr_t;
 #define idppc_altivec 0
 #endif
 
+// SSE2 is always there on x64
+#if (defined _M_X64 || defined __x86_64__ || defined __SSE2__) && !defined(C_ONLY)
+#define idsse	1
+#else
+#define idsse	0
+#endif
+
 // for windows fastcall option
 
 #define	QDECL
@@ -1026,6 +1033,17 @@ typedef struct {
 // trace->entityNum can also be 0 to (MAX_GENTITIES-1)
 // or ENTITYNUM_NONE, ENTITYNUM_WORLD
 
+// one entry of a batched trace, the same arguments trap_Trace takes
+typedef struct {
+	vec3_t		start;
+	vec3_t		mins;
+	vec3_t		maxs;
+	vec3_t		end;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+} traceQuery_t;
+
 
 // markfragments are returned by CM_MarkFragments()
 typedef struct {
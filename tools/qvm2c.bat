@@ -0,0 +1,46 @@
+@echo off
+rem Translates a qvm with qvm2c and builds the native module VM_Create
+rem loads in place of the qvm.  Run it from an x64 Visual Studio command
+rem prompt after the qvm is built, e.g. for the game after game.bat:
+rem
+rem   qvm2c.bat qagame C:\quake3\baseq3
+rem
+rem The module is written to the game directory given, where the engine
+rem looks for dlls.  "vmaotcheck qagame ..." then compares it against the
+rem qvm.  The qvm defaults to binaries\vm\<module>.qvm, a third argument
+rem overrides it.  A .map file next to the qvm names the functions.
+
+setlocal
+
+if "%~2"=="" (
+    echo usage: qvm2c.bat ^<module^> ^<game directory^> [qvm]
+    exit /b 1
+)
+
+set tools_dir=%~dp0
+set qvm2c=%tools_dir%qvm2c.exe
+set intermediate=%tools_dir%..\intermediate\aot\%1
+
+set qvm=%~3
+if "%qvm%"=="" set qvm=%tools_dir%..\binaries\vm\%1.qvm
+
+if not exist "%qvm2c%" (
+    cl.exe /nologo /O2 /Fe"%qvm2c%" /Fo"%tools_dir%\" "%tools_dir%qvm2c.c"
+    if errorlevel 1 exit /b 1
+)
+
+if not exist "%intermediate%" mkdir "%intermediate%"
+
+set map=
+for %%q in ("%qvm%") do if exist "%%~dpnq.map" set map=-m "%%~dpnq.map"
+
+"%qvm2c%" %map% "%qvm%" "%intermediate%\%1.c"
+if errorlevel 1 exit /b 1
+
+cl.exe /nologo /O2 /LD /Fo"%intermediate%\\" /Fe"%intermediate%\%1.dll" "%intermediate%\%1.c"
+if errorlevel 1 exit /b 1
+
+copy /y "%intermediate%\%1.dll" "%~2\%1.dll" >nul
+if errorlevel 1 exit /b 1
+
+echo %1.dll written to %~2
@@ -0,0 +1,907 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Foobar; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// qvm2c.c -- translates a qvm into C source for a native module
+//
+//	qvm2c [-m qagame.map] qagame.qvm qagame.c
+//
+// tools/qvm2c.bat builds this, translates a qvm and compiles the module.
+//
+// The result loads through the normal dll path of VM_Create.  It keeps
+// the qvm's memory model: one power of two data segment that every load
+// and store is masked into, the program stack at the end of it, and
+// system call arguments passed as offsets into the segment.  The segment
+// is exported so the engine can resolve those offsets, and the data and
+// stack contents match the interpreter's exactly, so "vmaotcheck" can
+// compare the two side by side.
+//
+// Only code that keeps a consistent op stack depth across branches can
+// be translated, which is everything lcc produces.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "../src/engine/qcommon/vm_local.h"
+
+typedef struct {
+	int		op;
+	int		value;
+	int		pc;				// code offset, what the interpreter saves on calls
+
+	int		depth;			// op stack depth before the instruction, -1 if unreachable
+	int		function;		// first instruction of the containing function
+	qboolean	label;		// needs a label in the output
+	qboolean	branchTarget;
+	qboolean	tableTarget;	// appears in the data, may be reached by OP_JUMP
+} instruction_t;
+
+static instruction_t	*code;
+static int				numInstructions;
+static int				codeLength;
+
+static unsigned char	*data;			// data + lit, host order
+static int				dataLength;		// initialized data + lit
+static int				segmentLength;	// rounded up to a power of two
+
+static char				**symbols;		// per instruction, from the map file
+
+static int				*worklist;
+static int				worklistCount;
+
+static FILE				*out;
+
+/*
+=================
+Error
+=================
+*/
+static void Error( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	fprintf( stderr, "qvm2c: " );
+	vfprintf( stderr, fmt, argptr );
+	fprintf( stderr, "\n" );
+	va_end( argptr );
+	exit( 1 );
+}
+
+static int ReadLittleLong( const unsigned char *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned)p[3] << 24 );
+}
+
+/*
+=================
+LoadFile
+=================
+*/
+static unsigned char *LoadFile( const char *filename, int *length ) {
+	FILE			*f;
+	unsigned char	*buf;
+
+	f = fopen( filename, "rb" );
+	if ( !f ) {
+		Error( "couldn't open %s", filename );
+	}
+	fseek( f, 0, SEEK_END );
+	*length = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	buf = malloc( *length + 1 );
+	if ( fread( buf, 1, *length, f ) != (size_t)*length ) {
+		Error( "couldn't read %s", filename );
+	}
+	buf[*length] = 0;
+	fclose( f );
+	return buf;
+}
+
+/*
+=================
+LoadQvm
+
+Decodes the code the same way as VM_PrepareInterpreter
+=================
+*/
+static void LoadQvm( const char *filename ) {
+	unsigned char	*buf;
+	unsigned char	*codeBytes;
+	vmHeader_t		header;
+	int				length;
+	int				i, pc, op;
+
+	buf = LoadFile( filename, &length );
+	if ( length < (int)sizeof( header ) ) {
+		Error( "%s is too short", filename );
+	}
+	for ( i = 0 ; i < (int)( sizeof( header ) / 4 ) ; i++ ) {
+		((int *)&header)[i] = ReadLittleLong( buf + i * 4 );
+	}
+
+	if ( header.vmMagic != VM_MAGIC
+		|| header.instructionCount <= 0
+		|| header.bssLength < 0
+		|| header.dataLength < 0
+		|| header.litLength < 0
+		|| header.codeLength <= 0
+		|| header.codeOffset < 0 || header.codeOffset + header.codeLength > length
+		|| header.dataOffset < 0 || header.dataOffset + header.dataLength + header.litLength > length ) {
+		Error( "%s has bad header", filename );
+	}
+
+	// same rounding as VM_Create
+	segmentLength = header.dataLength + header.litLength + header.bssLength;
+	for ( i = 0 ; segmentLength > ( 1 << i ) ; i++ ) {
+	}
+	segmentLength = 1 << i;
+	if ( segmentLength <= VM_AOT_STACK_SIZE ) {
+		Error( "%s has no room for the program stack", filename );
+	}
+
+	dataLength = header.dataLength + header.litLength;
+	data = malloc( dataLength + 4 );
+	memcpy( data, buf + header.dataOffset, dataLength );
+	for ( i = 0 ; i < header.dataLength ; i += 4 ) {
+		int		v = ReadLittleLong( buf + header.dataOffset + i );
+		memcpy( data + i, &v, 4 );
+	}
+
+	numInstructions = header.instructionCount;
+	codeLength = header.codeLength;
+	code = calloc( numInstructions + 1, sizeof( *code ) );
+	codeBytes = buf + header.codeOffset;
+
+	pc = 0;
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( pc >= codeLength ) {
+			Error( "%s: instruction %i is past the end of the code", filename, i );
+		}
+		op = codeBytes[pc];
+		code[i].op = op;
+		code[i].pc = pc;
+		code[i].depth = -1;
+		pc++;
+
+		switch ( op ) {
+		case OP_ENTER:
+		case OP_CONST:
+		case OP_LOCAL:
+		case OP_LEAVE:
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+		case OP_BLOCK_COPY:
+			if ( pc + 4 > codeLength ) {
+				Error( "%s: operand past the end of the code", filename );
+			}
+			code[i].value = ReadLittleLong( codeBytes + pc );
+			pc += 4;
+			break;
+		case OP_ARG:
+			code[i].value = codeBytes[pc];
+			pc += 1;
+			break;
+		default:
+			if ( op > OP_CVFI ) {
+				Error( "%s: bad opcode %i at offset %i", filename, op, code[i].pc );
+			}
+			break;
+		}
+	}
+	// the return address saved by a call in the last instruction
+	code[numInstructions].pc = pc;
+
+	free( buf );
+}
+
+/*
+=================
+LoadMap
+
+Optional, function names only end up in comments
+=================
+*/
+static void LoadMap( const char *filename ) {
+	FILE	*f;
+	int		segment, value;
+	char	name[1024];
+
+	f = fopen( filename, "r" );
+	if ( !f ) {
+		Error( "couldn't open %s", filename );
+	}
+	symbols = calloc( numInstructions, sizeof( *symbols ) );
+	while ( fscanf( f, "%x %x %1023s", &segment, &value, name ) == 3 ) {
+		if ( segment == 0 && value >= 0 && value < numInstructions ) {
+			symbols[value] = strdup( name );
+		}
+	}
+	fclose( f );
+}
+
+/*
+==============================================================================
+
+ANALYSIS
+
+==============================================================================
+*/
+
+static qboolean IsCompare( int op ) {
+	return op >= OP_EQ && op <= OP_GEF;
+}
+
+/*
+=================
+IsDirect
+
+A call or jump whose target is the constant pushed right before it.
+The constant can't be folded in if something can branch between them.
+=================
+*/
+static qboolean IsDirect( int i ) {
+	return i > 0 && code[i-1].op == OP_CONST && code[i-1].function == code[i].function
+		&& !code[i].branchTarget && !code[i].tableTarget;
+}
+
+static void SetDepth( int i, int depth ) {
+	if ( depth < 0 ) {
+		Error( "op stack underflow at instruction %i", i );
+	}
+	if ( code[i].depth == -1 ) {
+		code[i].depth = depth;
+		worklist[worklistCount++] = i;
+	} else if ( code[i].depth != depth ) {
+		Error( "inconsistent op stack depth at instruction %i (%i and %i)", i, code[i].depth, depth );
+	}
+}
+
+/*
+=================
+PropagateDepths
+
+Walks every path through the function, except the targets of computed
+jumps, which are added by AnalyzeFunction
+=================
+*/
+static void PropagateDepths( int start, int end ) {
+	int		i, d, op, target;
+
+	while ( worklistCount ) {
+		i = worklist[--worklistCount];
+		d = code[i].depth;
+		op = code[i].op;
+
+		switch ( op ) {
+		case OP_LEAVE:
+			continue;
+
+		case OP_JUMP:
+			if ( IsDirect( i ) ) {
+				target = code[i-1].value;
+				if ( target < start || target >= end ) {
+					Error( "instruction %i jumps out of its function", i );
+				}
+				SetDepth( target, d - 1 );
+			}
+			continue;
+
+		case OP_CONST: case OP_LOCAL: case OP_PUSH:
+			d++;
+			break;
+
+		case OP_POP: case OP_ARG:
+			d--;
+			break;
+
+		case OP_STORE1: case OP_STORE2: case OP_STORE4: case OP_BLOCK_COPY:
+			d -= 2;
+			break;
+
+		case OP_ADD: case OP_SUB: case OP_DIVI: case OP_DIVU:
+		case OP_MODI: case OP_MODU: case OP_MULI: case OP_MULU:
+		case OP_BAND: case OP_BOR: case OP_BXOR:
+		case OP_LSH: case OP_RSHI: case OP_RSHU:
+		case OP_ADDF: case OP_SUBF: case OP_DIVF: case OP_MULF:
+			d--;
+			break;
+
+		case OP_CALL:
+			// the target is replaced by the return value
+			if ( d < 1 ) {
+				Error( "op stack underflow at instruction %i", i );
+			}
+			break;
+
+		default:
+			if ( IsCompare( op ) ) {
+				target = code[i].value;
+				if ( target < start || target >= end ) {
+					Error( "instruction %i branches out of its function", i );
+				}
+				d -= 2;
+				SetDepth( target, d );
+			}
+			break;
+		}
+
+		if ( d < 0 ) {
+			Error( "op stack underflow at instruction %i", i );
+		}
+		if ( i + 1 < end ) {
+			SetDepth( i + 1, d );
+		}
+	}
+}
+
+/*
+=================
+AnalyzeFunction
+=================
+*/
+static void AnalyzeFunction( int start, int end ) {
+	qboolean	changed;
+	int			i, j;
+
+	worklistCount = 0;
+	SetDepth( start, 0 );
+	do {
+		PropagateDepths( start, end );
+
+		// a computed jump can reach any instruction whose number is in
+		// the data, jump tables are the only source of those
+		changed = qfalse;
+		for ( i = start ; i < end ; i++ ) {
+			if ( code[i].op != OP_JUMP || code[i].depth == -1 || IsDirect( i ) ) {
+				continue;
+			}
+			for ( j = start ; j < end ; j++ ) {
+				if ( code[j].tableTarget && code[j].depth == -1 ) {
+					SetDepth( j, code[i].depth - 1 );
+					changed = qtrue;
+				}
+			}
+		}
+	} while ( changed );
+}
+
+/*
+=================
+Analyze
+=================
+*/
+static void Analyze( void ) {
+	int		i, start, value;
+
+	if ( code[0].op != OP_ENTER ) {
+		Error( "instruction 0 is not a function entry" );
+	}
+
+	// assign instructions to functions
+	start = 0;
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( code[i].op == OP_ENTER ) {
+			start = i;
+		}
+		code[i].function = start;
+	}
+
+	// everything that might be branched to
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( IsCompare( code[i].op ) ) {
+			if ( code[i].value < 0 || code[i].value >= numInstructions ) {
+				Error( "instruction %i branches to %i", i, code[i].value );
+			}
+			code[ code[i].value ].branchTarget = qtrue;
+		}
+		if ( code[i].op == OP_JUMP && i > 0 && code[i-1].op == OP_CONST ) {
+			value = code[i-1].value;
+			if ( value >= 0 && value < numInstructions ) {
+				code[value].branchTarget = qtrue;
+			}
+		}
+	}
+	for ( i = 0 ; i + 4 <= dataLength ; i += 4 ) {
+		value = ReadLittleLong( data + i );
+		if ( value > 0 && value < numInstructions ) {
+			code[value].tableTarget = qtrue;
+		}
+	}
+
+	worklist = malloc( numInstructions * sizeof( *worklist ) );
+	for ( start = 0 ; start < numInstructions ; start = i ) {
+		for ( i = start + 1 ; i < numInstructions && code[i].op != OP_ENTER ; i++ ) {
+		}
+		AnalyzeFunction( start, i );
+	}
+	free( worklist );
+}
+
+/*
+==============================================================================
+
+OUTPUT
+
+==============================================================================
+*/
+
+static void Emit( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vfprintf( out, fmt, argptr );
+	va_end( argptr );
+}
+
+static const char *IntLiteral( int value ) {
+	static char	buf[2][32];
+	static int	index;
+
+	index ^= 1;
+	if ( value == (int)0x80000000 ) {
+		return "(-2147483647 - 1)";
+	}
+	sprintf( buf[index], "%i", value );
+	return buf[index];
+}
+
+static void EmitPrologue( const char *qvmName ) {
+	int		i;
+
+	Emit( "// translated from %s by qvm2c, do not edit\n\n", qvmName );
+	Emit( "#include <stdint.h>\n" );
+	Emit( "#include <string.h>\n\n" );
+
+	Emit( "#ifdef _WIN32\n" );
+	Emit( "#define	QVM_EXPORT	__declspec(dllexport)\n" );
+	Emit( "#define	QVM_DECL	__cdecl\n" );
+	Emit( "#else\n" );
+	Emit( "#define	QVM_EXPORT	__attribute__((visibility(\"default\")))\n" );
+	Emit( "#define	QVM_DECL\n" );
+	Emit( "#endif\n\n" );
+
+	Emit( "#define	DATA_LENGTH		0x%x\n", segmentLength );
+	Emit( "#define	DATA_MASK		( DATA_LENGTH - 1 )\n" );
+	Emit( "#define	STACK_BOTTOM	( DATA_LENGTH - 0x%x )\n\n", VM_AOT_STACK_SIZE );
+
+	Emit( "// must match vmSegment_t in qfiles.h\n" );
+	Emit( "typedef struct {\n" );
+	Emit( "	int				version;\n" );
+	Emit( "	unsigned char	*dataBase;\n" );
+	Emit( "	int				dataMask;\n" );
+	Emit( "	intptr_t		(QVM_DECL *systemCall)( intptr_t *args );\n" );
+	Emit( "} vmSegment_t;\n\n" );
+
+	Emit( "typedef union {\n" );
+	Emit( "	float	f;\n" );
+	Emit( "	int		i;\n" );
+	Emit( "} vmFloatInt_t;\n\n" );
+
+	// one spare word so a 4 byte load at the mask stays in bounds, like the hunk
+	Emit( "static int	vmDataWords[DATA_LENGTH / 4 + 1];\n" );
+	Emit( "#define	vmData	( (unsigned char *)vmDataWords )\n\n" );
+
+	Emit( "QVM_EXPORT vmSegment_t vmSegment = { %i, (unsigned char *)vmDataWords, DATA_MASK, 0 };\n\n", VM_AOT_VERSION );
+
+	Emit( "static intptr_t (QVM_DECL *vmSyscall)( intptr_t arg, ... );\n" );
+	Emit( "static int	vmProgramStack;\n\n" );
+
+	Emit( "#define	LOAD4(a)		( *(int *)&vmData[ (a) & DATA_MASK ] )\n" );
+	Emit( "#define	LOAD2(a)		( *(unsigned short *)&vmData[ (a) & DATA_MASK ] )\n" );
+	Emit( "#define	LOAD1(a)		( vmData[ (a) & DATA_MASK ] )\n" );
+	Emit( "#define	STORE4(a,v)		( *(int *)&vmData[ (a) & ( DATA_MASK & ~3 ) ] = (v) )\n" );
+	Emit( "#define	STORE2(a,v)		( *(short *)&vmData[ (a) & ( DATA_MASK & ~1 ) ] = (short)(v) )\n" );
+	Emit( "#define	STORE1(a,v)		( vmData[ (a) & DATA_MASK ] = (unsigned char)(v) )\n" );
+	Emit( "#define	FRAME(o)		( *(int *)&vmData[ ( ps + (o) ) & DATA_MASK ] )\n\n" );
+
+	Emit( "static float F( int i ) { vmFloatInt_t u; u.i = i; return u.f; }\n" );
+	Emit( "static int I( float f ) { vmFloatInt_t u; u.f = f; return u.i; }\n\n" );
+
+	Emit( "static void vmError( int error ) {\n" );
+	Emit( "	vmSyscall( %i, error );\n", VM_AOT_SYSCALL_ERROR );
+	Emit( "}\n\n" );
+
+	Emit( "static int vmSystemCall( int ps, int call ) {\n" );
+	Emit( "	intptr_t	args[%i];\n", MAX_VMSYSCALL_ARGS );
+	Emit( "	int			i;\n\n" );
+	Emit( "	// save the stack to allow recursive VM entry\n" );
+	Emit( "	vmProgramStack = ps - 4;\n" );
+	Emit( "	FRAME( 4 ) = call;\n" );
+	Emit( "	if ( vmSegment.systemCall ) {\n" );
+	Emit( "		for ( i = 0 ; i < %i ; i++ ) {\n", MAX_VMSYSCALL_ARGS );
+	Emit( "			args[i] = FRAME( 4 + i * 4 );\n" );
+	Emit( "		}\n" );
+	Emit( "		return (int)vmSegment.systemCall( args );\n" );
+	Emit( "	}\n" );
+	Emit( "	return (int)vmSyscall( call" );
+	for ( i = 1 ; i < MAX_VMSYSCALL_ARGS ; i++ ) {
+		Emit( ",\n		(intptr_t)FRAME( %i )", 4 + i * 4 );
+	}
+	Emit( " );\n" );
+	Emit( "}\n\n" );
+
+	Emit( "static void vmBlockCopy( unsigned int dest, unsigned int src, unsigned int n ) {\n" );
+	Emit( "	if ( ( dest & DATA_MASK ) != dest\n" );
+	Emit( "		|| ( src & DATA_MASK ) != src\n" );
+	Emit( "		|| ( ( dest + n ) & DATA_MASK ) != dest + n\n" );
+	Emit( "		|| ( ( src + n ) & DATA_MASK ) != src + n ) {\n" );
+	Emit( "		vmError( %i );\n", VM_AOT_ERR_BLOCK_COPY );
+	Emit( "		return;\n" );
+	Emit( "	}\n" );
+	Emit( "	memcpy( vmData + dest, vmData + src, n );\n" );
+	Emit( "}\n\n" );
+}
+
+static void EmitFunctionName( int start ) {
+	Emit( "static int qvm_%i( int ps )", start );
+}
+
+static void EmitPrototypes( void ) {
+	int		i;
+
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( code[i].op == OP_ENTER ) {
+			EmitFunctionName( i );
+			Emit( ";\n" );
+		}
+	}
+	Emit( "\n" );
+
+	Emit( "static int vmCallIndirect( int ps, int target ) {\n" );
+	Emit( "	if ( target < 0 ) {\n" );
+	Emit( "		return vmSystemCall( ps, -1 - target );\n" );
+	Emit( "	}\n" );
+	Emit( "	switch ( target ) {\n" );
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( code[i].op == OP_ENTER ) {
+			Emit( "	case %i: return qvm_%i( ps );\n", i, i );
+		}
+	}
+	Emit( "	}\n" );
+	Emit( "	vmError( %i );\n", VM_AOT_ERR_BAD_CALL );
+	Emit( "	return 0;\n" );
+	Emit( "}\n\n" );
+}
+
+/*
+=================
+EmitInstruction
+=================
+*/
+#define	T	top
+#define	N	next
+#define	P	push
+
+static void EmitInstruction( int i, int end ) {
+	instruction_t	*in = &code[i];
+	char			top[16], next[16], push[16];
+	int				d = in->depth;
+	int				j, target;
+	const char		*cmp;
+
+	sprintf( top, "s%i", d );
+	sprintf( next, "s%i", d - 1 );
+	sprintf( push, "s%i", d + 1 );
+
+	switch ( in->op ) {
+	case OP_UNDEF:
+	case OP_IGNORE:
+	case OP_BREAK:
+	case OP_POP:
+		break;
+
+	case OP_ENTER:
+		Emit( "	ps -= %i;\n", in->value );
+		Emit( "	if ( ps <= STACK_BOTTOM ) {\n" );
+		Emit( "		vmError( %i );\n", VM_AOT_ERR_STACK_OVERFLOW );
+		Emit( "		return 0;\n" );
+		Emit( "	}\n" );
+		break;
+
+	case OP_LEAVE:
+		Emit( "	return %s;\n", d ? T : "0" );
+		break;
+
+	case OP_CALL:
+		// save the return address like the interpreter does
+		Emit( "	FRAME( 0 ) = %i;\n", code[i+1].pc );
+		target = code[i-1].value;
+		if ( IsDirect( i ) && target < 0 ) {
+			Emit( "	%s = vmSystemCall( ps, %i );\n", T, -1 - target );
+		} else if ( IsDirect( i ) && target < numInstructions && code[target].op == OP_ENTER ) {
+			Emit( "	%s = qvm_%i( ps );\n", T, target );
+		} else {
+			Emit( "	%s = vmCallIndirect( ps, %s );\n", T, T );
+		}
+		break;
+
+	case OP_PUSH:
+		Emit( "	%s = 0;\n", P );
+		break;
+	case OP_CONST:
+		Emit( "	%s = %s;\n", P, IntLiteral( in->value ) );
+		break;
+	case OP_LOCAL:
+		Emit( "	%s = ps + %s;\n", P, IntLiteral( in->value ) );
+		break;
+
+	case OP_JUMP:
+		if ( IsDirect( i ) ) {
+			Emit( "	goto L%i;\n", code[i-1].value );
+			break;
+		}
+		Emit( "	switch ( %s ) {\n", T );
+		for ( j = in->function ; j < end ; j++ ) {
+			if ( code[j].tableTarget && code[j].depth == d - 1 ) {
+				Emit( "	case %i: goto L%i;\n", j, j );
+			}
+		}
+		Emit( "	}\n" );
+		Emit( "	vmError( %i );\n", VM_AOT_ERR_BAD_JUMP );
+		Emit( "	return 0;\n" );
+		break;
+
+	case OP_EQ:		cmp = "%s == %s"; goto intCompare;
+	case OP_NE:		cmp = "%s != %s"; goto intCompare;
+	case OP_LTI:	cmp = "%s < %s"; goto intCompare;
+	case OP_LEI:	cmp = "%s <= %s"; goto intCompare;
+	case OP_GTI:	cmp = "%s > %s"; goto intCompare;
+	case OP_GEI:	cmp = "%s >= %s"; goto intCompare;
+	case OP_LTU:	cmp = "(unsigned)%s < (unsigned)%s"; goto intCompare;
+	case OP_LEU:	cmp = "(unsigned)%s <= (unsigned)%s"; goto intCompare;
+	case OP_GTU:	cmp = "(unsigned)%s > (unsigned)%s"; goto intCompare;
+	case OP_GEU:	cmp = "(unsigned)%s >= (unsigned)%s"; goto intCompare;
+	case OP_EQF:	cmp = "F( %s ) == F( %s )"; goto intCompare;
+	case OP_NEF:	cmp = "F( %s ) != F( %s )"; goto intCompare;
+	case OP_LTF:	cmp = "F( %s ) < F( %s )"; goto intCompare;
+	case OP_LEF:	cmp = "F( %s ) <= F( %s )"; goto intCompare;
+	case OP_GTF:	cmp = "F( %s ) > F( %s )"; goto intCompare;
+	case OP_GEF:	cmp = "F( %s ) >= F( %s )"; goto intCompare;
+intCompare:
+		Emit( "	if ( " );
+		Emit( cmp, N, T );
+		Emit( " ) goto L%i;\n", in->value );
+		break;
+
+	case OP_LOAD1:	Emit( "	%s = LOAD1( %s );\n", T, T ); break;
+	case OP_LOAD2:	Emit( "	%s = LOAD2( %s );\n", T, T ); break;
+	case OP_LOAD4:	Emit( "	%s = LOAD4( %s );\n", T, T ); break;
+	case OP_STORE1:	Emit( "	STORE1( %s, %s );\n", N, T ); break;
+	case OP_STORE2:	Emit( "	STORE2( %s, %s );\n", N, T ); break;
+	case OP_STORE4:	Emit( "	STORE4( %s, %s );\n", N, T ); break;
+	case OP_ARG:	Emit( "	FRAME( %i ) = %s;\n", in->value, T ); break;
+
+	case OP_BLOCK_COPY:
+		Emit( "	vmBlockCopy( %s, %s, %i );\n", N, T, in->value );
+		break;
+
+	case OP_SEX8:	Emit( "	%s = (signed char)%s;\n", T, T ); break;
+	case OP_SEX16:	Emit( "	%s = (short)%s;\n", T, T ); break;
+
+	// signed overflow wraps in the interpreter, so do the math unsigned
+	case OP_NEGI:	Emit( "	%s = (int)( 0u - (unsigned)%s );\n", T, T ); break;
+	case OP_ADD:	Emit( "	%s = (int)( (unsigned)%s + (unsigned)%s );\n", N, N, T ); break;
+	case OP_SUB:	Emit( "	%s = (int)( (unsigned)%s - (unsigned)%s );\n", N, N, T ); break;
+	case OP_MULI:
+	case OP_MULU:	Emit( "	%s = (int)( (unsigned)%s * (unsigned)%s );\n", N, N, T ); break;
+	case OP_DIVI:	Emit( "	%s = %s / %s;\n", N, N, T ); break;
+	case OP_DIVU:	Emit( "	%s = (int)( (unsigned)%s / (unsigned)%s );\n", N, N, T ); break;
+	case OP_MODI:	Emit( "	%s = %s %% %s;\n", N, N, T ); break;
+	case OP_MODU:	Emit( "	%s = (int)( (unsigned)%s %% (unsigned)%s );\n", N, N, T ); break;
+
+	case OP_BAND:	Emit( "	%s = %s & %s;\n", N, N, T ); break;
+	case OP_BOR:	Emit( "	%s = %s | %s;\n", N, N, T ); break;
+	case OP_BXOR:	Emit( "	%s = %s ^ %s;\n", N, N, T ); break;
+	case OP_BCOM:	Emit( "	%s = ~%s;\n", T, T ); break;
+
+	// x86 masks the shift count, which is what the interpreter gets
+	case OP_LSH:	Emit( "	%s = (int)( (unsigned)%s << ( %s & 31 ) );\n", N, N, T ); break;
+	case OP_RSHI:	Emit( "	%s = %s >> ( %s & 31 );\n", N, N, T ); break;
+	case OP_RSHU:	Emit( "	%s = (int)( (unsigned)%s >> ( %s & 31 ) );\n", N, N, T ); break;
+
+	case OP_NEGF:	Emit( "	%s = I( -F( %s ) );\n", T, T ); break;
+	case OP_ADDF:	Emit( "	%s = I( F( %s ) + F( %s ) );\n", N, N, T ); break;
+	case OP_SUBF:	Emit( "	%s = I( F( %s ) - F( %s ) );\n", N, N, T ); break;
+	case OP_DIVF:	Emit( "	%s = I( F( %s ) / F( %s ) );\n", N, N, T ); break;
+	case OP_MULF:	Emit( "	%s = I( F( %s ) * F( %s ) );\n", N, N, T ); break;
+
+	case OP_CVIF:	Emit( "	%s = I( (float)%s );\n", T, T ); break;
+	case OP_CVFI:	Emit( "	%s = (int)F( %s );\n", T, T ); break;
+	}
+}
+
+#undef T
+#undef N
+#undef P
+
+/*
+=================
+EmitFunction
+=================
+*/
+static void EmitFunction( int start, int end ) {
+	int		i, j, maxDepth;
+
+	// anything a branch or a jump table can reach needs a label
+	for ( i = start ; i < end ; i++ ) {
+		if ( code[i].depth == -1 ) {
+			continue;
+		}
+		if ( IsCompare( code[i].op ) ) {
+			code[ code[i].value ].label = qtrue;
+		} else if ( code[i].op == OP_JUMP ) {
+			if ( IsDirect( i ) ) {
+				code[ code[i-1].value ].label = qtrue;
+			} else {
+				for ( j = start ; j < end ; j++ ) {
+					if ( code[j].tableTarget && code[j].depth == code[i].depth - 1 ) {
+						code[j].label = qtrue;
+					}
+				}
+			}
+		}
+	}
+
+	maxDepth = 0;
+	for ( i = start ; i < end ; i++ ) {
+		if ( code[i].depth + 1 > maxDepth ) {
+			maxDepth = code[i].depth + 1;
+		}
+	}
+
+	if ( symbols && symbols[start] ) {
+		Emit( "// %s\n", symbols[start] );
+	}
+	EmitFunctionName( start );
+	Emit( " {\n" );
+	for ( i = 1 ; i <= maxDepth ; i++ ) {
+		Emit( "%s s%i", i == 1 ? "	int	" : ",", i );
+	}
+	if ( maxDepth ) {
+		Emit( ";\n\n" );
+	}
+
+	for ( i = start ; i < end ; i++ ) {
+		if ( code[i].depth == -1 ) {
+			continue;		// unreachable
+		}
+		if ( code[i].label ) {
+			Emit( "L%i: ;\n", i );
+		}
+		EmitInstruction( i, end );
+	}
+
+	// a function can't fall off its end in the interpreter either, it
+	// would run into the next one, which the translation doesn't allow
+	if ( code[end-1].op != OP_LEAVE && code[end-1].op != OP_JUMP ) {
+		Emit( "	vmError( %i );\n", VM_AOT_ERR_BAD_JUMP );
+	}
+	Emit( "	return 0;\n" );
+	Emit( "}\n\n" );
+}
+
+static void EmitEpilogue( void ) {
+	int		i;
+
+	Emit( "QVM_EXPORT void dllEntry( intptr_t (QVM_DECL *syscallptr)( intptr_t arg, ... ) ) {\n" );
+	Emit( "	vmSyscall = syscallptr;\n" );
+	Emit( "	memset( vmDataWords, 0, sizeof( vmDataWords ) );\n" );
+	Emit( "	memcpy( vmData, vmInitialData, %i );\n", dataLength );
+	Emit( "	// the stack is implicitly at the end of the image\n" );
+	Emit( "	vmProgramStack = DATA_LENGTH;\n" );
+	Emit( "}\n\n" );
+
+	Emit( "QVM_EXPORT intptr_t vmMain( int command" );
+	for ( i = 0 ; i < 12 ; i++ ) {
+		Emit( ", int arg%i", i );
+	}
+	Emit( " ) {\n" );
+	Emit( "	int		ps, stackOnEntry, r;\n\n" );
+	Emit( "	// same stack frame setup as VM_CallInterpreted\n" );
+	Emit( "	ps = stackOnEntry = vmProgramStack;\n" );
+	Emit( "	ps -= 48;\n" );
+	Emit( "	FRAME( 8 ) = command;\n" );
+	for ( i = 0 ; i < 9 ; i++ ) {
+		Emit( "	FRAME( %i ) = arg%i;\n", 12 + i * 4, i );
+	}
+	Emit( "	FRAME( 4 ) = 0;\n" );
+	Emit( "	FRAME( 0 ) = -1;\n\n" );
+	Emit( "	r = qvm_0( ps );\n\n" );
+	Emit( "	vmProgramStack = stackOnEntry;\n" );
+	Emit( "	return r;\n" );
+	Emit( "}\n" );
+}
+
+static void EmitData( void ) {
+	int		i;
+
+	Emit( "static const unsigned char vmInitialData[%i] = {", dataLength ? dataLength : 1 );
+	for ( i = 0 ; i < dataLength ; i++ ) {
+		if ( !( i & 15 ) ) {
+			Emit( "\n	" );
+		}
+		Emit( "%i,", data[i] );
+	}
+	if ( !dataLength ) {
+		Emit( "0" );
+	}
+	Emit( "\n};\n\n" );
+}
+
+/*
+=================
+main
+=================
+*/
+int main( int argc, char **argv ) {
+	const char	*mapName;
+	int			i, start;
+
+	mapName = NULL;
+	i = 1;
+	if ( i + 1 < argc && !strcmp( argv[i], "-m" ) ) {
+		mapName = argv[i+1];
+		i += 2;
+	}
+	if ( argc - i != 2 ) {
+		printf( "Usage: qvm2c [-m <mapfile>] <input.qvm> <output.c>\n" );
+		return 1;
+	}
+
+	LoadQvm( argv[i] );
+	if ( mapName ) {
+		LoadMap( mapName );
+	}
+	Analyze();
+
+	out = fopen( argv[i+1], "w" );
+	if ( !out ) {
+		Error( "couldn't write %s", argv[i+1] );
+	}
+
+	EmitPrologue( argv[i] );
+	EmitData();
+	EmitPrototypes();
+	for ( start = 0 ; start < numInstructions ; start = i ) {
+		for ( i = start + 1 ; i < numInstructions && code[i].op != OP_ENTER ; i++ ) {
+		}
+		EmitFunction( start, i );
+	}
+	EmitEpilogue();
+
+	fclose( out );
+	return 0;
+}